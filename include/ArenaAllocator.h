@@ -0,0 +1,80 @@
+// Fixed-size arena for a JsonDocument that lives as long as the firmware
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <ArduinoJson.h>
+
+// Bump allocator over a static buffer. The document only allocates while
+// its fields are added for the first time; afterwards values are replaced
+// in place, so the arena stops growing. When the arena is full,
+// allocate() returns nullptr and ArduinoJson marks the document as
+// overflowed instead of touching the heap.
+//
+// deallocate() only rolls back the most recent block. Freeing any other
+// block leaks its space for the lifetime of the arena; there is no reset,
+// the document is never cleared. Do not use this for a document whose
+// strings or members are replaced over and over, e.g. a changing string
+// value copied in on every update.
+template <size_t SIZE>
+class ArenaAllocator : public ArduinoJson::Allocator {
+ public:
+  void* allocate(size_t size) override {
+    const size_t aligned = align(size);
+    if (aligned > SIZE - used) {
+      failures++;
+      return nullptr;
+    }
+    void* block = buffer + used;
+    last = used;
+    used += aligned;
+    allocations++;
+    return block;
+  }
+
+  void deallocate(void* pointer) override {
+    if (pointer == buffer + last && last < used) {
+      used = last;
+      last = SIZE;
+    }
+  }
+
+  void* reallocate(void* pointer, size_t size) override {
+    if (pointer == nullptr) {
+      return allocate(size);
+    }
+    // Letzter Block kann an Ort und Stelle wachsen oder schrumpfen
+    if (pointer == buffer + last) {
+      const size_t aligned = align(size);
+      if (aligned > SIZE - last) {
+        failures++;
+        return nullptr;
+      }
+      used = last + aligned;
+      return pointer;
+    }
+    const size_t available = used - ((uint8_t*)pointer - buffer);
+    void* moved = allocate(size);
+    if (moved != nullptr) {
+      memcpy(moved, pointer, available < size ? available : size);
+    }
+    return moved;
+  }
+
+  // Belegt, Kapazität, Anzahl Allokationen und abgewiesene Anfragen
+  size_t usedBytes() const { return used; }
+  size_t capacity() const { return SIZE; }
+  uint32_t allocationCount() const { return allocations; }
+  uint32_t failureCount() const { return failures; }
+
+ private:
+  static size_t align(size_t size) {
+    return (size + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+  }
+
+  alignas(max_align_t) uint8_t buffer[SIZE];
+  size_t used = 0;
+  size_t last = SIZE;
+  uint32_t allocations = 0;
+  uint32_t failures = 0;
+};
@@ -0,0 +1,207 @@
+// Hot-path benchmark, runs on the host (env:bench) and on the device
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <Hal.h>
+#include <WaterLevel.h>
+#include <Publisher.h>
+#include <LedCompositor.h>
+#include <History.h>
+#include <HttpApi.h>
+
+// Platform hooks for time and heap accounting
+struct BenchHooks {
+  uint64_t (*nanos)();
+  uint32_t (*allocations)();  // running number of allocations
+  void (*resetPeakHeap)();
+  uint32_t (*peakHeap)();     // heap growth in bytes since resetPeakHeap()
+};
+
+struct BenchResult {
+  const char* stage;
+  uint32_t iterations;
+  uint32_t nsPerIteration;
+  float allocationsPerIteration;
+  uint32_t peakHeapBytes;
+};
+
+typedef void (*BenchReport)(const BenchResult& result);
+
+// Keeps the compiler from optimizing the measured work away
+inline volatile uint32_t benchSink;
+
+const uint16_t BENCH_LED_PIXELS = 16;  // Wie der LED Ring
+const uint32_t BENCH_HISTORY_START = 1700000000 - 1700000000 % HISTORY_DAY;
+const uint32_t BENCH_HISTORY_SAMPLE_INTERVAL = 10;  // s zwischen zwei Messwerten
+
+// Discards payloads, so only serialization is measured
+class NullMqttTransport : public MqttTransport {
+ public:
+  bool connected() override { return true; }
+
+  bool publish(const char* topic, const char* payload, bool retained) override {
+    bytes += strlen(topic) + strlen(payload);
+    return true;
+  }
+
+  bool beginPublish(const char* topic, size_t length, bool retained) override {
+    bytes += strlen(topic);
+    return true;
+  }
+
+  size_t write(const uint8_t* data, size_t size) override {
+    bytes += size;
+    return size;
+  }
+
+  bool endPublish() override { return true; }
+
+  uint32_t bytes = 0;
+};
+
+class BenchRunner {
+ public:
+  BenchRunner(const BenchHooks& hooks, BenchReport report) : hooks(hooks), report(report) {}
+
+  template <typename Body>
+  void run(const char* stage, uint32_t iterations, Body body) {
+    body(0);  // warm-up, first-use allocations are not steady state
+
+    hooks.resetPeakHeap();
+    const uint32_t allocationsBefore = hooks.allocations();
+    const uint64_t start = hooks.nanos();
+    for (uint32_t i = 0; i < iterations; i++) {
+      body(i);
+    }
+    const uint64_t elapsed = hooks.nanos() - start;
+
+    BenchResult result;
+    result.stage = stage;
+    result.iterations = iterations;
+    result.nsPerIteration = (uint32_t)(elapsed / iterations);
+    result.allocationsPerIteration = (float)(hooks.allocations() - allocationsBefore) / iterations;
+    result.peakHeapBytes = hooks.peakHeap();
+    if (hooks.allocations() != allocationsBefore) {
+      allocatingStages++;
+    }
+    report(result);
+  }
+
+  // Stufen, die nach dem Aufwärmen noch Speicher angefordert haben
+  uint32_t allocatingStageCount() const { return allocatingStages; }
+
+ private:
+  const BenchHooks& hooks;
+  BenchReport report;
+  uint32_t allocatingStages = 0;
+};
+
+inline int formatBenchResult(const BenchResult& result, char* buffer, size_t size) {
+  return snprintf(buffer, size,
+                  "{\"stage\":\"%s\",\"iterations\":%lu,\"ns\":%lu,\"allocs\":%.2f,\"peak_heap\":%lu}",
+                  result.stage, (unsigned long)result.iterations,
+                  (unsigned long)result.nsPerIteration, result.allocationsPerIteration,
+                  (unsigned long)result.peakHeapBytes);
+}
+
+// Sägezahn über den Messbereich, damit Filter und Erkennung arbeiten müssen
+inline uint16_t benchDistance(uint32_t i) {
+  return WATER_FULL_DEFAULT + (i * 7) % (WATER_EMPTY_DEFAULT - WATER_FULL_DEFAULT);
+}
+
+// One stage per step of a loop() pass
+inline void runHotPathBenchmarks(BenchRunner& runner, uint32_t iterations, RangeSensor& sensor,
+                                 StatePublisher& publisher, LedStrip& strip) {
+  const Calibration calibration = {WATER_FULL_DEFAULT, WATER_EMPTY_DEFAULT};
+
+  runner.run("sensor_read", iterations, [&](uint32_t) {
+    uint16_t distance = 0;
+    if (sensor.dataReady() && sensor.readMillimeters(distance)) {
+      benchSink = distance;
+    }
+  });
+
+  DistanceFilter filter;
+  runner.run("filter", iterations, [&](uint32_t i) {
+    benchSink = filter.update(benchDistance(i));
+  });
+
+  runner.run("level", iterations, [&](uint32_t i) {
+    benchSink = (uint32_t)waterLevelFromDistance(benchDistance(i), calibration);
+  });
+
+  RefillDetector<REFILL_WINDOW_SAMPLES> detector(REFILL_THRESHOLD, REFILL_TIME_WINDOW,
+                                                 REFILL_SETTLE_TIME, REFILL_DEBOUNCE_SAMPLES);
+  runner.run("refill", iterations, [&](uint32_t i) {
+    benchSink = detector.update(i * 100, waterLevelFromDistance(benchDistance(i), calibration));
+  });
+
+  ConsumptionAnalytics consumption;
+  runner.run("consumption", iterations, [&](uint32_t i) {
+    benchSink = consumption.update(i * 100, waterLevelFromDistance(benchDistance(i), calibration), false);
+  });
+
+  LevelProcessor processor(calibration);
+  runner.run("process", iterations, [&](uint32_t i) {
+    benchSink = processor.process({i * 100, benchDistance(i)}).refill;
+  });
+
+  runner.run("publish", iterations, [&](uint32_t i) {
+    publisher.requestFullFrame();
+    const uint16_t distance = benchDistance(i);
+    publisher.updateWaterLevel(waterLevelFromDistance(distance, calibration), distance);
+    benchSink = publisher.flush(i * 100);
+  });
+
+  // Ohne Änderung des Bilds entfällt show()
+  LedCompositor<BENCH_LED_PIXELS> compositor(strip);
+  runner.run("led", iterations, [&](uint32_t i) {
+    compositor.setLevel(waterLevelFromDistance(benchDistance(i), calibration));
+    benchSink = compositor.render(i * 100);
+  });
+
+  // Ganzer Durchlauf wie im Betrieb: messen, verarbeiten, senden, anzeigen
+  runner.run("steady_state", iterations, [&](uint32_t i) {
+    uint16_t distance = 0;
+    if (!sensor.dataReady() || !sensor.readMillimeters(distance)) {
+      return;
+    }
+    const LevelEvent event = processor.process({i * 100, distance});
+    publisher.updateWaterLevel(event.waterLevel, event.distance);
+    benchSink = publisher.flush(i * 100);
+    compositor.setLevel(event.waterLevel);
+    benchSink = compositor.render(i * 100);
+  });
+}
+
+// Eine Iteration = ein Messwert, alle 6 Werte schließt sich eine Minute.
+// Abgefragt wird der letzte Tag in Minutenwerten (bis zu 1440 Punkte).
+inline void runHistoryBenchmarks(BenchRunner& runner, uint32_t iterations, History& history) {
+  const Calibration calibration = {WATER_FULL_DEFAULT, WATER_EMPTY_DEFAULT};
+  runner.run("history_record", iterations, [&](uint32_t i) {
+    const uint16_t distance = benchDistance(i / 6);
+    history.record(BENCH_HISTORY_START + i * BENCH_HISTORY_SAMPLE_INTERVAL,
+                   waterLevelFromDistance(distance, calibration), distance);
+  });
+
+  const uint32_t end = BENCH_HISTORY_START + iterations * BENCH_HISTORY_SAMPLE_INTERVAL;
+  const uint32_t queries = iterations / 1000 > 0 ? iterations / 1000 : 1;
+  runner.run("history_query_day", queries, [&](uint32_t) {
+    LengthCounter counter;
+    history.query(counter, {end - HISTORY_DAY, end, HISTORY_RAW});
+    benchSink = counter.length();
+  });
+}
+
+// Speicherbedarf nach runHistoryBenchmarks() in Bytes pro aufgezeichnetem Tag
+inline int formatHistoryStorage(const History& history, uint32_t iterations, char* buffer, size_t size) {
+  const float days = (float)iterations * BENCH_HISTORY_SAMPLE_INTERVAL / HISTORY_DAY;
+  auto perDay = [&](HistoryResolution tier) {
+    return days > 0 ? (history.writeCount(tier) * HISTORY_CHUNK_SIZE + history.openBytes(tier)) / days : 0;
+  };
+  return snprintf(buffer, size,
+                  "{\"stage\":\"history_storage\",\"days\":%.1f,\"raw_per_day\":%.0f,"
+                  "\"hourly_per_day\":%.0f,\"daily_per_day\":%.0f}",
+                  days, perDay(HISTORY_RAW), perDay(HISTORY_HOURLY), perDay(HISTORY_DAILY));
+}
@@ -0,0 +1,31 @@
+// Milestones from power-on to the first published value
+#pragma once
+#include <stdint.h>
+
+enum BootMark : uint8_t { BOOT_WIFI_UP, BOOT_MQTT_UP, BOOT_FIRST_PUBLISH, BOOT_MARK_COUNT };
+
+// Each mark is taken once, in ms since boot. Later reconnects do not move
+// it, the timeline describes the start only.
+class BootTimeline {
+ public:
+  // Returns true the first time the mark is set
+  bool mark(BootMark mark, uint32_t now) {
+    if (times[mark] != 0) {
+      return false;
+    }
+    times[mark] = now == 0 ? 1 : now;
+    return true;
+  }
+
+  bool reached(BootMark mark) const { return times[mark] != 0; }
+  uint32_t at(BootMark mark) const { return times[mark]; }
+  bool complete() const { return reached(BOOT_FIRST_PUBLISH); }
+
+  // Wie wurde das WLAN verbunden (Direktverbindung aus dem Cache oder Scan)
+  void setFastConnect(bool fast) { fastConnect = fast; }
+  bool usedFastConnect() const { return fastConnect; }
+
+ private:
+  uint32_t times[BOOT_MARK_COUNT] = {};
+  bool fastConnect = false;
+};
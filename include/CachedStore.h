@@ -0,0 +1,210 @@
+// Write-behind cache in front of a KeyValueStore (NVS on the device)
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <Hal.h>
+
+// Schreiben erst nach einer Ruhephase, damit mehrere Änderungen in einem Commit landen
+const uint32_t STORE_FLUSH_QUIET_TIME = 10000;  // Ruhephase nach der letzten Änderung in ms
+const uint32_t STORE_FLUSH_MAX_DELAY = 60000;   // Spätestens nach so vielen ms schreiben
+#define STORE_DEVICE_KEYS 3                     // wifi_ssid, wifi_password, wifi_cache, dazu die Schlüssel je Tank
+#define STORE_STRING_MAX 65                     // WLAN Passwort: 64 Zeichen + Terminator
+
+// Reads are served from RAM after the first access. Writes only update the
+// cache and mark the key dirty; flush() writes all dirty keys in one batch
+// once no change happened for STORE_FLUSH_QUIET_TIME. Writing a value that
+// is already stored is skipped. Keys are kept by pointer and must outlive
+// the cache (string literals or the names of a Tank). SLOTS should cover
+// every key in use; when all slots are taken, accesses go straight to the
+// backing store.
+template <uint8_t SLOTS>
+class CachedStore : public KeyValueStore {
+ public:
+  CachedStore(KeyValueStore& backing, Clock& clock) : backing(backing), clock(clock) {}
+
+  uint32_t getUInt(const char* key, uint32_t defaultValue) override {
+    Slot* slot = lookup(key, SLOT_UINT);
+    if (slot == nullptr) {
+      return backing.getUInt(key, defaultValue);
+    }
+    if (!slot->loaded) {
+      slot->number = backing.getUInt(key, defaultValue);
+      slot->loaded = true;
+    }
+    return slot->number;
+  }
+
+  void putUInt(const char* key, uint32_t value) override {
+    putNumber(key, SLOT_UINT, value);
+  }
+
+  uint16_t getUShort(const char* key, uint16_t defaultValue) override {
+    Slot* slot = lookup(key, SLOT_USHORT);
+    if (slot == nullptr) {
+      return backing.getUShort(key, defaultValue);
+    }
+    if (!slot->loaded) {
+      slot->number = backing.getUShort(key, defaultValue);
+      slot->loaded = true;
+    }
+    return (uint16_t)slot->number;
+  }
+
+  void putUShort(const char* key, uint16_t value) override {
+    putNumber(key, SLOT_USHORT, value);
+  }
+
+  size_t getString(const char* key, char* value, size_t size) override {
+    Slot* slot = lookup(key, SLOT_STRING);
+    if (slot == nullptr) {
+      return backing.getString(key, value, size);
+    }
+    if (!slot->loaded) {
+      backing.getString(key, slot->text, sizeof(slot->text));
+      slot->loaded = true;
+    }
+    strncpy(value, slot->text, size - 1);
+    value[size - 1] = '\0';
+    return strlen(value);
+  }
+
+  void putString(const char* key, const char* value) override {
+    Slot* slot = lookup(key, SLOT_STRING);
+    if (slot == nullptr || strlen(value) >= sizeof(slot->text)) {
+      backing.putString(key, value);
+      writes++;
+      return;
+    }
+    if (!slot->loaded) {
+      backing.getString(key, slot->text, sizeof(slot->text));
+      slot->loaded = true;
+    }
+    if (strcmp(slot->text, value) == 0) {
+      skipped++;
+      return;
+    }
+    strcpy(slot->text, value);
+    markDirty(*slot);
+  }
+
+  // Periodically called, writes once the quiet time has passed.
+  // Returns true if something was written.
+  bool flush() {
+    if (!dirty) {
+      return false;
+    }
+    const uint32_t now = clock.millis();
+    if (now - lastChange < STORE_FLUSH_QUIET_TIME && now - firstChange < STORE_FLUSH_MAX_DELAY) {
+      return false;
+    }
+    return flushNow();
+  }
+
+  // Writes all dirty keys immediately, e.g. before OTA or restart
+  bool flushNow() {
+    if (!dirty) {
+      return false;
+    }
+    backing.beginBatch();
+    for (Slot& slot : slots) {
+      if (slot.key == nullptr || !slot.dirty) {
+        continue;
+      }
+      switch (slot.type) {
+        case SLOT_UINT:
+          backing.putUInt(slot.key, slot.number);
+          break;
+        case SLOT_USHORT:
+          backing.putUShort(slot.key, (uint16_t)slot.number);
+          break;
+        case SLOT_STRING:
+          backing.putString(slot.key, slot.text);
+          break;
+      }
+      slot.dirty = false;
+      writes++;
+    }
+    backing.commitBatch();
+    dirty = false;
+    flushes++;
+    return true;
+  }
+
+  bool pending() const { return dirty; }
+
+  // Verschleiß: tatsächliche Schreibzugriffe, Commits und übersprungene Werte
+  uint32_t writeCount() const { return writes; }
+  uint32_t flushCount() const { return flushes; }
+  uint32_t skippedCount() const { return skipped; }
+
+ private:
+  enum SlotType : uint8_t { SLOT_UINT, SLOT_USHORT, SLOT_STRING };
+
+  struct Slot {
+    const char* key = nullptr;
+    SlotType type = SLOT_UINT;
+    bool loaded = false;
+    bool dirty = false;
+    uint32_t number = 0;
+    char text[STORE_STRING_MAX] = "";
+  };
+
+  Slot* lookup(const char* key, SlotType type) {
+    for (Slot& slot : slots) {
+      if (slot.key != nullptr && (slot.key == key || strcmp(slot.key, key) == 0)) {
+        return slot.type == type ? &slot : nullptr;
+      }
+    }
+    for (Slot& slot : slots) {
+      if (slot.key == nullptr) {
+        slot.key = key;
+        slot.type = type;
+        return &slot;
+      }
+    }
+    return nullptr;
+  }
+
+  void putNumber(const char* key, SlotType type, uint32_t value) {
+    Slot* slot = lookup(key, type);
+    if (slot == nullptr) {
+      if (type == SLOT_UINT) {
+        backing.putUInt(key, value);
+      } else {
+        backing.putUShort(key, (uint16_t)value);
+      }
+      writes++;
+      return;
+    }
+    if (!slot->loaded) {
+      slot->number = type == SLOT_UINT ? backing.getUInt(key, ~value)
+                                       : backing.getUShort(key, (uint16_t)~value);
+      slot->loaded = true;
+    }
+    if (slot->number == value) {
+      skipped++;
+      return;
+    }
+    slot->number = value;
+    markDirty(*slot);
+  }
+
+  void markDirty(Slot& slot) {
+    slot.dirty = true;
+    lastChange = clock.millis();
+    if (!dirty) {
+      firstChange = lastChange;
+    }
+    dirty = true;
+  }
+
+  KeyValueStore& backing;
+  Clock& clock;
+  Slot slots[SLOTS];
+  bool dirty = false;
+  uint32_t firstChange = 0;
+  uint32_t lastChange = 0;
+  uint32_t writes = 0;
+  uint32_t flushes = 0;
+  uint32_t skipped = 0;
+};
@@ -0,0 +1,52 @@
+// Allocation-free MQTT command dispatch over a compile-time topic table
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string_view>
+
+// Handlers get the payload exactly as received, without copy or terminator,
+// and the instance (e.g. the tank) the topic belongs to
+typedef void (*CommandHandler)(uint8_t instance, const uint8_t* payload, size_t length);
+
+struct CommandRoute {
+  std::string_view topic;
+  CommandHandler handler;
+};
+
+// The table is searched binary, so it has to be sorted by topic
+template <size_t N>
+constexpr bool commandRoutesSorted(const CommandRoute (&routes)[N]) {
+  for (size_t i = 1; i < N; i++) {
+    if (!(routes[i - 1].topic < routes[i].topic)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Returns false if no route matches the topic
+template <size_t N>
+bool dispatchCommand(const CommandRoute (&routes)[N], std::string_view topic, uint8_t instance,
+                     const uint8_t* payload, size_t length) {
+  size_t low = 0;
+  size_t high = N;
+  while (low < high) {
+    const size_t middle = (low + high) / 2;
+    const int order = topic.compare(routes[middle].topic);
+    if (order == 0) {
+      routes[middle].handler(instance, payload, length);
+      return true;
+    }
+    if (order < 0) {
+      high = middle;
+    } else {
+      low = middle + 1;
+    }
+  }
+  return false;
+}
+
+inline bool payloadEquals(const uint8_t* payload, size_t length, std::string_view expected) {
+  return length == expected.size() && memcmp(payload, expected.data(), length) == 0;
+}
@@ -0,0 +1,295 @@
+// Consumption analytics: drop detection (shots, rinses), rolling usage and time-to-empty
+#pragma once
+#include <math.h>
+#include <stdint.h>
+#include <RefillDetector.h>
+
+// Verbrauch Einstellungen
+const float TANK_CAPACITY_ML = 2500;            // Wasser zwischen leer (max_mm) und voll (min_mm)
+const float DROP_THRESHOLD = 1.0;               // Mindestabfall in % innerhalb DROP_TIME_WINDOW
+const uint32_t DROP_TIME_WINDOW = 60000;
+const uint32_t DROP_SAMPLE_INTERVAL = 1000;     // höchstens ein Wert pro Sekunde ins Fenster
+const uint32_t DROP_SETTLE_TIME = 15000;        // so lange kein neues Minimum = Entnahme beendet
+const float DROP_HYSTERESIS = 0.3;              // neues Minimum erst so viel % unter dem alten (Rauschen)
+const uint8_t DROP_DEBOUNCE_SAMPLES = 2;
+const float SHOT_MAX_ML = 120;                  // größere Entnahmen zählen als Spülung/Heißwasser
+const uint32_t USAGE_BUCKET_TIME = 3600000;     // Verbrauch der letzten 24 h in Stundenfächern
+const uint8_t USAGE_BUCKETS = 24;
+const uint32_t TREND_SAMPLE_INTERVAL = 60000;   // ein Punkt pro Minute für die Regression
+const float TREND_TIME_CONSTANT_H = 12;         // Gewicht eines Punkts fällt in 12 h auf 1/e
+const float TREND_MIN_SPAN_H = 1;               // vorher keine Prognose
+const float TREND_MIN_SLOPE = 0.05;             // flacher (%/h) gilt als kein Verbrauch
+#define DROP_WINDOW_SAMPLES 64                  // DROP_TIME_WINDOW / DROP_SAMPLE_INTERVAL + Reserve
+
+enum DropType : uint8_t { DROP_NONE, DROP_SHOT, DROP_RINSE };
+
+struct DropEvent {
+  DropType type;
+  float volumeMl;
+  uint32_t durationMs;
+};
+
+// Detects "level fell by >= threshold within windowMs" against the window
+// maximum (monotonic deque as in RefillDetector) and follows the drop until
+// no new minimum shows up for settleMs. The volume is start minus settled
+// level, so noise during the drop does not add up.
+//
+// IDLE     -> DROPPING fall above threshold for debounceSamples samples
+// DROPPING -> IDLE     no new minimum for settleMs, reports the drop
+template <uint8_t CAPACITY>
+class DropDetector {
+ public:
+  enum State : uint8_t { STATE_IDLE, STATE_DROPPING };
+
+  DropDetector(float threshold, uint32_t windowMs, uint32_t settleMs, float hysteresis, uint8_t debounceSamples)
+      : threshold(threshold), windowMs(windowMs), settleMs(settleMs), hysteresis(hysteresis),
+        debounceSamples(debounceSamples) {}
+
+  // Returns the fall in % once the drop has settled, otherwise 0
+  float update(uint32_t now, float level) {
+    if (state == STATE_DROPPING) {
+      if (level < minLevel - hysteresis) {
+        minLevel = level;
+        minTime = now;
+      }
+      if (now - minTime < settleMs) {
+        return 0;
+      }
+      const float fall = startLevel - level;
+      duration = now - startTime;
+      reset();
+      push(now, level);
+      return fall >= threshold ? fall : 0;
+    }
+
+    while (!maxWindow.empty() && now - maxWindow.front().time > windowMs) {
+      maxWindow.popFront();
+    }
+    push(now, level);
+
+    if (maxWindow.front().level - level < threshold) {
+      debounce = 0;
+      return 0;
+    }
+    if (++debounce >= debounceSamples) {
+      state = STATE_DROPPING;
+      startLevel = maxWindow.front().level;
+      startTime = maxWindow.front().time;
+      minLevel = level;
+      minTime = now;
+    }
+    return 0;
+  }
+
+  // Nach einer Auffüllung oder Kalibrierung neu beginnen
+  void reset() {
+    state = STATE_IDLE;
+    debounce = 0;
+    maxWindow.clear();
+  }
+
+  State currentState() const { return state; }
+  uint32_t lastDuration() const { return duration; }
+
+ private:
+  void push(uint32_t now, float level) {
+    while (!maxWindow.empty() && maxWindow.back().level <= level) {
+      maxWindow.popBack();
+    }
+    if (maxWindow.full()) {
+      maxWindow.popFront();
+    }
+    maxWindow.pushBack({now, level});
+  }
+
+  const float threshold;
+  const uint32_t windowMs;
+  const uint32_t settleMs;
+  const float hysteresis;
+  const uint8_t debounceSamples;
+
+  LevelDeque<CAPACITY> maxWindow;
+  State state = STATE_IDLE;
+  uint8_t debounce = 0;
+  float startLevel = 0;
+  uint32_t startTime = 0;
+  float minLevel = 0;
+  uint32_t minTime = 0;
+  uint32_t duration = 0;
+};
+
+// Exponentially weighted least squares of level over time. Times are kept
+// relative to the newest point, so the sums are shifted and decayed once
+// per point and stay small enough for float. O(1) per point.
+class LevelTrend {
+ public:
+  explicit LevelTrend(float timeConstantH) : timeConstantH(timeConstantH) {}
+
+  void add(uint32_t now, float level) {
+    if (count > 0) {
+      const float dt = (now - lastTime) / 3600000.0f;
+      const float decay = expf(-dt / timeConstantH);
+      sumXX = (sumXX - 2 * dt * sumX + dt * dt * sum) * decay;
+      sumXY = (sumXY - dt * sumY) * decay;
+      sumX = (sumX - dt * sum) * decay;
+      sumY *= decay;
+      sum *= decay;
+      spanH += dt;
+    }
+    sum += 1;
+    sumY += level;
+    lastTime = now;
+    count++;
+  }
+
+  void reset() {
+    sum = sumX = sumY = sumXX = sumXY = 0;
+    spanH = 0;
+    count = 0;
+  }
+
+  // Steigung in %/h, false solange zu wenig Punkte
+  bool slope(float& perHour) const {
+    const float denominator = sum * sumXX - sumX * sumX;
+    if (count < 3 || spanH < TREND_MIN_SPAN_H || denominator <= 0) {
+      return false;
+    }
+    perHour = (sum * sumXY - sumX * sumY) / denominator;
+    return true;
+  }
+
+  // Regressionswert zum Zeitpunkt des letzten Punkts
+  float level(float perHour) const { return sum > 0 ? (sumY - perHour * sumX) / sum : 0; }
+
+ private:
+  const float timeConstantH;
+  float sum = 0;
+  float sumX = 0;
+  float sumY = 0;
+  float sumXX = 0;
+  float sumXY = 0;
+  float spanH = 0;
+  uint32_t lastTime = 0;
+  uint32_t count = 0;
+};
+
+struct ConsumptionStats {
+  uint32_t shots;
+  uint32_t rinses;
+  float lastDropMl;
+  float usage24hMl;     // Summe der Entnahmen der letzten 24 h
+  float usageRateMlH;   // aus der Regression, < 0 = unbekannt
+  float hoursToEmpty;   // < 0 = keine Prognose
+};
+
+// Fed with every level event in the network task. Everything is fixed
+// size, so it runs per sample without the heap.
+class ConsumptionAnalytics {
+ public:
+  ConsumptionAnalytics()
+      : drops(DROP_THRESHOLD, DROP_TIME_WINDOW, DROP_SETTLE_TIME, DROP_HYSTERESIS, DROP_DEBOUNCE_SAMPLES),
+        trend(TREND_TIME_CONSTANT_H) {}
+
+  // Gespeicherte Zähler nach einem Neustart
+  void setCounts(uint32_t shots, uint32_t rinses) {
+    stats.shots = shots;
+    stats.rinses = rinses;
+  }
+
+  // Returns true if the statistics changed: a drop ended or the trend got
+  // a new point
+  bool update(uint32_t now, float waterLevel, bool refill) {
+    lastDrop = {DROP_NONE, 0, 0};
+    if (waterLevel < 0) {
+      return false;
+    }
+    advanceBuckets(now);
+
+    if (refill) {
+      drops.reset();
+      trend.reset();
+      lastTrendTime = now;
+      trend.add(now, waterLevel);
+      updatePrediction();
+      return true;
+    }
+
+    bool changed = false;
+    if (started && now - lastDropSample < DROP_SAMPLE_INTERVAL) {
+      return false;
+    }
+    lastDropSample = now;
+    const float fall = drops.update(now, waterLevel);
+    if (fall > 0) {
+      const float volume = fall * TANK_CAPACITY_ML / 100;
+      lastDrop = {volume <= SHOT_MAX_ML ? DROP_SHOT : DROP_RINSE, volume, drops.lastDuration()};
+      (lastDrop.type == DROP_SHOT ? stats.shots : stats.rinses)++;
+      stats.lastDropMl = volume;
+      usage[bucket] += volume;
+      stats.usage24hMl += volume;
+      changed = true;
+    }
+
+    if (!started || now - lastTrendTime >= TREND_SAMPLE_INTERVAL) {
+      lastTrendTime = now;
+      trend.add(now, waterLevel);
+      updatePrediction();
+      changed = true;
+    }
+    started = true;
+    return changed;
+  }
+
+  // Nach einer Kalibrierung passen alte Pegel nicht mehr zu neuen
+  void reset() {
+    drops.reset();
+    trend.reset();
+    updatePrediction();
+  }
+
+  const ConsumptionStats& statistics() const { return stats; }
+  const DropEvent& drop() const { return lastDrop; }
+
+ private:
+  // Fächer nach verstrichener Zeit weiterschalten, unabhängig vom Überlauf von millis()
+  void advanceBuckets(uint32_t now) {
+    if (!bucketsStarted) {
+      bucketsStarted = true;
+      bucketTime = now;
+      return;
+    }
+    while (now - bucketTime >= USAGE_BUCKET_TIME) {
+      bucketTime += USAGE_BUCKET_TIME;
+      bucket = (bucket + 1) % USAGE_BUCKETS;
+      stats.usage24hMl -= usage[bucket];
+      usage[bucket] = 0;
+    }
+    if (stats.usage24hMl < 0) {
+      stats.usage24hMl = 0;  // Rundungsreste
+    }
+  }
+
+  void updatePrediction() {
+    float perHour;
+    if (!trend.slope(perHour)) {
+      stats.usageRateMlH = -1;
+      stats.hoursToEmpty = -1;
+      return;
+    }
+    stats.usageRateMlH = perHour < 0 ? -perHour * TANK_CAPACITY_ML / 100 : 0;
+    const float level = trend.level(perHour);
+    stats.hoursToEmpty = perHour <= -TREND_MIN_SLOPE && level > 0 ? level / -perHour : -1;
+  }
+
+  DropDetector<DROP_WINDOW_SAMPLES> drops;
+  LevelTrend trend;
+  ConsumptionStats stats = {0, 0, 0, 0, -1, -1};
+  DropEvent lastDrop = {DROP_NONE, 0, 0};
+  float usage[USAGE_BUCKETS] = {};
+  uint8_t bucket = 0;
+  uint32_t bucketTime = 0;
+  bool bucketsStarted = false;
+  bool started = false;
+  uint32_t lastDropSample = 0;
+  uint32_t lastTrendTime = 0;
+};
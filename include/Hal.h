@@ -0,0 +1,80 @@
+// Hardware abstraction layer
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Implemented by HalArduino.h on the device and by HalFakes.h on the host,
+// so processing, refill detection, calibration and publishing can run and
+// be measured off-device.
+
+class Clock {
+ public:
+  virtual ~Clock() {}
+  virtual uint32_t millis() = 0;
+};
+
+class RangeSensor {
+ public:
+  virtual ~RangeSensor() {}
+  // A new measurement can be read without waiting
+  virtual bool dataReady() = 0;
+  // Returns false on timeout
+  virtual bool readMillimeters(uint16_t& distance) = 0;
+  // Optional: time between continuous measurements
+  virtual void setMeasurementPeriod(uint32_t periodMs) {}
+  // Optional: reset bus and sensor after repeated errors, true on success
+  virtual bool recover() { return false; }
+};
+
+class KeyValueStore {
+ public:
+  virtual ~KeyValueStore() {}
+  virtual uint32_t getUInt(const char* key, uint32_t defaultValue) = 0;
+  virtual void putUInt(const char* key, uint32_t value) = 0;
+  virtual uint16_t getUShort(const char* key, uint16_t defaultValue) = 0;
+  virtual void putUShort(const char* key, uint16_t value) = 0;
+  // Copies at most size - 1 characters, returns the string length
+  virtual size_t getString(const char* key, char* value, size_t size) = 0;
+  virtual void putString(const char* key, const char* value) = 0;
+
+  // Optional: puts between these calls are committed together
+  virtual void beginBatch() {}
+  virtual void commitBatch() {}
+};
+
+// 0x00RRGGBB, same layout as Adafruit_NeoPixel::Color()
+inline uint32_t ledColor(uint8_t red, uint8_t green, uint8_t blue) {
+  return ((uint32_t)red << 16) | ((uint32_t)green << 8) | blue;
+}
+
+class LedStrip {
+ public:
+  virtual ~LedStrip() {}
+  virtual uint16_t numPixels() = 0;
+  virtual void setPixelColor(uint16_t index, uint32_t color) = 0;
+  virtual void show() = 0;
+};
+
+// Raw NOR flash area: erasing sets a sector to 0xFF, writes can only clear bits
+class FlashRegion {
+ public:
+  virtual ~FlashRegion() {}
+  virtual size_t size() = 0;
+  virtual size_t sectorSize() = 0;
+  virtual bool read(size_t offset, void* data, size_t length) = 0;
+  virtual bool write(size_t offset, const void* data, size_t length) = 0;
+  virtual bool eraseSector(size_t offset) = 0;
+};
+
+class MqttTransport {
+ public:
+  virtual ~MqttTransport() {}
+  virtual bool connected() = 0;
+  virtual bool publish(const char* topic, const char* payload, bool retained) = 0;
+
+  // Streaming publish: the payload of exactly length bytes is passed in
+  // parts through write() and goes straight to the socket
+  virtual bool beginPublish(const char* topic, size_t length, bool retained) = 0;
+  virtual size_t write(const uint8_t* data, size_t size) = 0;
+  virtual bool endPublish() = 0;
+};
@@ -0,0 +1,293 @@
+// Hardware abstraction layer, device implementation
+#pragma once
+#include <Arduino.h>
+#include <Adafruit_NeoPixel.h>
+#include <Preferences.h>
+#include <PubSubClient.h>
+#include <VL53L0X.h>
+#include <Wire.h>
+#include <esp_partition.h>
+#include <nvs.h>
+#include <Hal.h>
+#include <Latency.h>
+
+class ArduinoClock : public Clock {
+ public:
+  uint32_t millis() override { return ::millis(); }
+};
+
+// Frees a slave that holds SDA low in the middle of a transfer: up to nine
+// SCL pulses until SDA is released, then a STOP condition
+inline bool recoverI2cBus(TwoWire& wire, int sdaPin, int sclPin) {
+  wire.end();
+  pinMode(sdaPin, INPUT_PULLUP);
+  pinMode(sclPin, OUTPUT_OPEN_DRAIN);
+  digitalWrite(sclPin, HIGH);
+  for (int i = 0; i < 9 && digitalRead(sdaPin) == LOW; i++) {
+    digitalWrite(sclPin, LOW);
+    delayMicroseconds(5);
+    digitalWrite(sclPin, HIGH);
+    delayMicroseconds(5);
+  }
+  pinMode(sdaPin, OUTPUT_OPEN_DRAIN);
+  digitalWrite(sdaPin, LOW);
+  delayMicroseconds(5);
+  digitalWrite(sdaPin, HIGH);
+  delayMicroseconds(5);
+  const bool released = digitalRead(sdaPin) == HIGH;
+  wire.begin(sdaPin, sclPin);
+  return released;
+}
+
+const uint8_t VL53L0X_DEFAULT_ADDRESS = 0x29;  // nach dem Einschalten
+const uint32_t VL53L0X_BOOT_TIME = 2;          // ms nach XSHUT bis der Sensor antwortet
+const uint16_t VL53L0X_IO_TIMEOUT = 500;
+
+// Reads only after data ready, so no call waits for a measurement.
+// Several sensors share the bus through XSHUT: all are held in reset,
+// then begin() wakes one at a time and moves it to its own address
+// before the next one comes up at the power-up address.
+class VL53L0XSensor : public RangeSensor {
+ public:
+  VL53L0XSensor(VL53L0X& sensor, int16_t offsetMm, TwoWire& wire, int sdaPin, int sclPin,
+                int xshutPin = -1, uint8_t address = VL53L0X_DEFAULT_ADDRESS)
+      : sensor(sensor), offsetMm(offsetMm), wire(wire), sdaPin(sdaPin), sclPin(sclPin),
+        xshutPin(xshutPin), address(address) {}
+
+  // Vor dem ersten begin() für alle Sensoren aufrufen
+  void holdInReset() {
+    if (xshutPin >= 0) {
+      pinMode(xshutPin, OUTPUT);
+      digitalWrite(xshutPin, LOW);
+    }
+  }
+
+  // XSHUT loslassen (Pull-up auf dem Board), initialisieren, Adresse setzen
+  bool begin() {
+    sensor.setBus(&wire);
+    if (xshutPin >= 0) {
+      pinMode(xshutPin, INPUT);
+      delay(VL53L0X_BOOT_TIME);
+    }
+    sensor.setTimeout(VL53L0X_IO_TIMEOUT);
+    if (!sensor.init()) {
+      return false;
+    }
+    if (address != VL53L0X_DEFAULT_ADDRESS) {
+      sensor.setAddress(address);
+    }
+    return true;
+  }
+
+  bool dataReady() override {
+    return (sensor.readReg(VL53L0X::RESULT_INTERRUPT_STATUS) & 0x07) != 0;
+  }
+
+  // Result register + interrupt clear, the same two accesses as
+  // readRangeContinuousMillimeters() without its busy wait
+  bool readMillimeters(uint16_t& distance) override {
+    const uint16_t range = sensor.readReg16Bit(VL53L0X::RESULT_RANGE_STATUS + 10);
+    if (sensor.last_status != 0) {
+      return false;
+    }
+    sensor.writeReg(VL53L0X::SYSTEM_INTERRUPT_CLEAR, 0x01);
+    distance = range + offsetMm;
+    return sensor.last_status == 0;
+  }
+
+  void setMeasurementPeriod(uint32_t periodMs) override {
+    period = periodMs;
+    sensor.stopContinuous();
+    sensor.startContinuous(periodMs);
+  }
+
+  bool recover() override {
+    const bool released = recoverI2cBus(wire, sdaPin, sclPin);
+    if (!sensor.init()) {
+      return false;
+    }
+    sensor.startContinuous(period);
+    return released;
+  }
+
+ private:
+  VL53L0X& sensor;
+  const int16_t offsetMm;
+  TwoWire& wire;
+  const int sdaPin;
+  const int sclPin;
+  const int xshutPin;
+  const uint8_t address;
+  uint32_t period = 1000;
+};
+
+// Opens the namespace per access, like the sketch did before. Inside a
+// batch the puts go to one NVS handle and are committed together, the
+// value types match what Preferences writes.
+class PreferencesStore : public KeyValueStore {
+ public:
+  PreferencesStore(Preferences& preferences, const char* name)
+      : preferences(preferences), name(name) {}
+
+  uint32_t getUInt(const char* key, uint32_t defaultValue) override {
+    LATENCY_SCOPE(PROBE_NVS);
+    preferences.begin(name, true);
+    uint32_t value = preferences.getUInt(key, defaultValue);
+    preferences.end();
+    return value;
+  }
+
+  void putUInt(const char* key, uint32_t value) override {
+    LATENCY_SCOPE(PROBE_NVS);
+    if (batch != 0) {
+      nvs_set_u32(batch, key, value);
+      return;
+    }
+    preferences.begin(name, false);
+    preferences.putUInt(key, value);
+    preferences.end();
+  }
+
+  uint16_t getUShort(const char* key, uint16_t defaultValue) override {
+    LATENCY_SCOPE(PROBE_NVS);
+    preferences.begin(name, true);
+    uint16_t value = preferences.getUShort(key, defaultValue);
+    preferences.end();
+    return value;
+  }
+
+  void putUShort(const char* key, uint16_t value) override {
+    LATENCY_SCOPE(PROBE_NVS);
+    if (batch != 0) {
+      nvs_set_u16(batch, key, value);
+      return;
+    }
+    preferences.begin(name, false);
+    preferences.putUShort(key, value);
+    preferences.end();
+  }
+
+  size_t getString(const char* key, char* value, size_t size) override {
+    LATENCY_SCOPE(PROBE_NVS);
+    value[0] = '\0';
+    preferences.begin(name, true);
+    if (preferences.isKey(key)) {
+      preferences.getString(key, value, size);
+    }
+    preferences.end();
+    return strlen(value);
+  }
+
+  void putString(const char* key, const char* value) override {
+    LATENCY_SCOPE(PROBE_NVS);
+    if (batch != 0) {
+      nvs_set_str(batch, key, value);
+      return;
+    }
+    preferences.begin(name, false);
+    preferences.putString(key, value);
+    preferences.end();
+  }
+
+  void beginBatch() override {
+    if (nvs_open(name, NVS_READWRITE, &batch) != ESP_OK) {
+      batch = 0;
+    }
+  }
+
+  void commitBatch() override {
+    LATENCY_SCOPE(PROBE_NVS);
+    if (batch != 0) {
+      nvs_commit(batch);
+      nvs_close(batch);
+      batch = 0;
+    }
+  }
+
+ private:
+  Preferences& preferences;
+  const char* name;
+  nvs_handle_t batch = 0;
+};
+
+// Data partition from the partition table, e.g. the "journal" partition.
+// begin() returns false if the partition table has no such partition.
+class EspPartitionRegion : public FlashRegion {
+ public:
+  explicit EspPartitionRegion(const char* label) : label(label) {}
+
+  bool begin() {
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+    return partition != nullptr;
+  }
+
+  size_t size() override { return partition != nullptr ? partition->size : 0; }
+  size_t sectorSize() override { return SPI_FLASH_SEC_SIZE; }
+
+  bool read(size_t offset, void* data, size_t length) override {
+    return esp_partition_read(partition, offset, data, length) == ESP_OK;
+  }
+
+  bool write(size_t offset, const void* data, size_t length) override {
+    return esp_partition_write(partition, offset, data, length) == ESP_OK;
+  }
+
+  bool eraseSector(size_t offset) override {
+    return esp_partition_erase_range(partition, offset, SPI_FLASH_SEC_SIZE) == ESP_OK;
+  }
+
+ private:
+  const char* label;
+  const esp_partition_t* partition = nullptr;
+};
+
+class NeoPixelStrip : public LedStrip {
+ public:
+  explicit NeoPixelStrip(Adafruit_NeoPixel& strip) : strip(strip) {}
+
+  uint16_t numPixels() override { return strip.numPixels(); }
+  void setPixelColor(uint16_t index, uint32_t color) override { strip.setPixelColor(index, color); }
+  void show() override {
+    LATENCY_SCOPE(PROBE_LED_SHOW);
+    strip.show();
+  }
+
+ private:
+  Adafruit_NeoPixel& strip;
+};
+
+// While disabled the client belongs to another task (e.g. a blocking
+// connect) and connected() reports false without touching it
+class PubSubTransport : public MqttTransport {
+ public:
+  explicit PubSubTransport(PubSubClient& client) : client(client) {}
+
+  bool connected() override { return enabled && client.connected(); }
+
+  void setEnabled(bool value) { enabled = value; }
+
+  bool publish(const char* topic, const char* payload, bool retained) override {
+    LATENCY_SCOPE(PROBE_MQTT_PUBLISH);
+    return client.publish(topic, payload, retained);
+  }
+
+  bool beginPublish(const char* topic, size_t length, bool retained) override {
+    publishSpan.start();
+    return client.beginPublish(topic, length, retained);
+  }
+
+  size_t write(const uint8_t* data, size_t size) override {
+    return client.write(data, size);
+  }
+
+  bool endPublish() override {
+    const bool sent = client.endPublish() == 1;
+    publishSpan.stop(PROBE_MQTT_PUBLISH);
+    return sent;
+  }
+
+ private:
+  PubSubClient& client;
+  volatile bool enabled = false;
+  LatencySpan publishSpan;  // beginPublish() bis endPublish()
+};
@@ -0,0 +1,181 @@
+// Hardware abstraction layer, in-memory fakes for host builds
+#pragma once
+#include <stdio.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <Hal.h>
+
+class FakeClock : public Clock {
+ public:
+  uint32_t millis() override { return now; }
+  void advance(uint32_t ms) { now += ms; }
+
+  uint32_t now = 0;
+};
+
+// Replays a recorded trace, one value per dataReady()/readMillimeters() pair
+class FakeRangeSensor : public RangeSensor {
+ public:
+  FakeRangeSensor(const uint16_t* trace, size_t length) : trace(trace), length(length) {}
+
+  bool dataReady() override { return position < length; }
+
+  bool readMillimeters(uint16_t& distance) override {
+    if (position >= length) {
+      return false;
+    }
+    distance = trace[position++];
+    return true;
+  }
+
+  bool finished() const { return position >= length; }
+
+ private:
+  const uint16_t* trace;
+  size_t length;
+  size_t position = 0;
+};
+
+class MemoryStore : public KeyValueStore {
+ public:
+  uint32_t getUInt(const char* key, uint32_t defaultValue) override {
+    auto it = values.find(key);
+    return it == values.end() ? defaultValue : (uint32_t)strtoul(it->second.c_str(), nullptr, 10);
+  }
+
+  void putUInt(const char* key, uint32_t value) override {
+    values[key] = std::to_string(value);
+    writes++;
+  }
+
+  uint16_t getUShort(const char* key, uint16_t defaultValue) override {
+    return (uint16_t)getUInt(key, defaultValue);
+  }
+
+  void putUShort(const char* key, uint16_t value) override {
+    putUInt(key, value);
+  }
+
+  size_t getString(const char* key, char* value, size_t size) override {
+    auto it = values.find(key);
+    snprintf(value, size, "%s", it == values.end() ? "" : it->second.c_str());
+    return strlen(value);
+  }
+
+  void putString(const char* key, const char* value) override {
+    values[key] = value;
+    writes++;
+  }
+
+  std::map<std::string, std::string> values;
+  uint32_t writes = 0;
+};
+
+// Behaves like NOR flash: erase sets 0xFF, write ANDs the bits
+class MemoryFlash : public FlashRegion {
+ public:
+  MemoryFlash(size_t size, size_t sectorSize) : bytes(size, 0xFF), sector(sectorSize) {}
+
+  size_t size() override { return bytes.size(); }
+  size_t sectorSize() override { return sector; }
+
+  bool read(size_t offset, void* data, size_t length) override {
+    if (offset + length > bytes.size()) {
+      return false;
+    }
+    memcpy(data, bytes.data() + offset, length);
+    return true;
+  }
+
+  bool write(size_t offset, const void* data, size_t length) override {
+    if (offset + length > bytes.size()) {
+      return false;
+    }
+    for (size_t i = 0; i < length; i++) {
+      bytes[offset + i] &= ((const uint8_t*)data)[i];
+    }
+    writes++;
+    return true;
+  }
+
+  bool eraseSector(size_t offset) override {
+    if (offset % sector != 0 || offset + sector > bytes.size()) {
+      return false;
+    }
+    memset(bytes.data() + offset, 0xFF, sector);
+    erases++;
+    return true;
+  }
+
+  std::vector<uint8_t> bytes;
+  uint32_t writes = 0;
+  uint32_t erases = 0;
+
+ private:
+  size_t sector;
+};
+
+class FakeLedStrip : public LedStrip {
+ public:
+  explicit FakeLedStrip(uint16_t count) : pixels(count, 0) {}
+
+  uint16_t numPixels() override { return (uint16_t)pixels.size(); }
+  void setPixelColor(uint16_t index, uint32_t color) override { pixels[index] = color; }
+  void show() override { shows++; }
+
+  std::vector<uint32_t> pixels;
+  uint32_t shows = 0;
+};
+
+class FakeMqttTransport : public MqttTransport {
+ public:
+  struct Message {
+    std::string topic;
+    std::string payload;
+    bool retained;
+  };
+
+  bool connected() override { return isConnected; }
+
+  bool publish(const char* topic, const char* payload, bool retained) override {
+    if (!isConnected) {
+      return false;
+    }
+    messages.push_back({topic, payload, retained});
+    return true;
+  }
+
+  bool beginPublish(const char* topic, size_t length, bool retained) override {
+    if (!isConnected || failBeginPublish) {
+      return false;
+    }
+    pending = {topic, std::string(), retained};
+    pending.payload.reserve(length);
+    pendingLength = length;
+    return true;
+  }
+
+  size_t write(const uint8_t* data, size_t size) override {
+    pending.payload.append((const char*)data, size);
+    return size;
+  }
+
+  // Like PubSubClient, a length mismatch leaves an invalid packet
+  bool endPublish() override {
+    if (pending.payload.size() != pendingLength) {
+      return false;
+    }
+    messages.push_back(pending);
+    return true;
+  }
+
+  bool isConnected = true;
+  bool failBeginPublish = false;  // connected, but streamed publishes fail (e.g. socket buffer full)
+  std::vector<Message> messages;
+
+ private:
+  Message pending;
+  size_t pendingLength = 0;
+};
@@ -0,0 +1,593 @@
+// On-device level history: compressed minutes in flash plus hourly and daily rollups
+#pragma once
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string_view>
+#include <Hal.h>
+
+// Verlauf Einstellungen
+const uint32_t HISTORY_MINUTE = 60;
+const uint32_t HISTORY_HOUR = 3600;
+const uint32_t HISTORY_DAY = 86400;                          // Tagesgrenze in UTC
+const size_t HISTORY_CHUNK_SIZE = 128;                       // wird immer ganz geschrieben
+const uint32_t HISTORY_MIN_SECTORS = 6;                      // kleinere Partitionen werden nicht genutzt
+const uint32_t HISTORY_QUERY_MAX_POINTS = 1500;              // pro Antwort, der Rest über "next"
+const uint32_t HISTORY_AUTO_RAW_SPAN = 2 * HISTORY_DAY;      // res=auto: bis 2 Tage Minutenwerte
+const uint32_t HISTORY_AUTO_HOURLY_SPAN = 60 * HISTORY_DAY;  // bis 60 Tage Stunden, darüber Tage
+
+constexpr char mqtt_topic_history[] = "rocket/wasserstand/verlauf";                 // Antworten
+constexpr char mqtt_topic_history_query[] = "rocket/wasserstand/verlauf/abfrage";  // Abfragen als JSON
+constexpr char mqtt_suffix_history_query[] = "verlauf/abfrage";                       // unter dem ersten Tank
+
+enum HistoryResolution : uint8_t { HISTORY_RAW, HISTORY_HOURLY, HISTORY_DAILY, HISTORY_AUTO };
+inline const char* const historyResolutionNames[] = {"raw", "hour", "day", "auto"};
+
+inline bool parseHistoryResolution(std::string_view text, HistoryResolution& resolution) {
+  for (uint8_t i = 0; i <= HISTORY_AUTO; i++) {
+    if (text == historyResolutionNames[i]) {
+      resolution = (HistoryResolution)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+struct HistoryQuery {
+  uint32_t from;  // Epoch s, inklusive
+  uint32_t to;
+  HistoryResolution resolution;
+};
+
+struct HistoryChunkHeader {
+  uint32_t sequence;  // UINT32_MAX = leerer Slot
+  uint32_t start;     // Epoch s des ersten Werts
+  uint16_t count;
+  uint8_t tier;
+  uint8_t checksum;
+};
+static_assert(sizeof(HistoryChunkHeader) == 12, "HistoryChunkHeader must stay 12 bytes");
+
+const size_t HISTORY_PAYLOAD_SIZE = HISTORY_CHUNK_SIZE - sizeof(HistoryChunkHeader);
+
+struct HistoryChunk {
+  HistoryChunkHeader header;
+  uint8_t payload[HISTORY_PAYLOAD_SIZE];
+};
+static_assert(sizeof(HistoryChunk) == HISTORY_CHUNK_SIZE, "HistoryChunk must fill its slot");
+
+inline uint8_t historyChecksum(const HistoryChunk& chunk) {
+  const uint8_t* bytes = (const uint8_t*)&chunk;
+  uint8_t sum = 0x5A;
+  for (size_t i = 0; i < sizeof(chunk); i++) {
+    if (i != offsetof(HistoryChunkHeader, checksum)) {
+      sum = (uint8_t)((sum << 1) | (sum >> 7)) ^ bytes[i];
+    }
+  }
+  return sum;
+}
+
+// Signed values as zigzag with a prefix code:
+//   0 -> '0', |v| < 32 -> '10' + 6 bits, |v| < 2048 -> '110' + 12 bits,
+//   otherwise '111' + 32 bits
+inline uint32_t historyZigzag(int32_t value) {
+  return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+inline int32_t historyUnzigzag(uint32_t value) {
+  return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+inline uint8_t historyValueBits(int32_t value) {
+  const uint32_t zigzag = historyZigzag(value);
+  return zigzag == 0 ? 1 : zigzag < 64 ? 8 : zigzag < 4096 ? 15 : 35;
+}
+
+// Gorilla-style columns: field 0 is the time, stored as delta-of-delta in
+// units of step; every other field is stored as the delta to the previous
+// value. The first value of a chunk is stored in full, so every chunk
+// decodes on its own. A steady level with a few mm of noise costs about
+// 10 bits per minute.
+template <uint8_t FIELDS>
+class HistoryEncoder {
+ public:
+  void start(uint8_t tier, uint32_t step) {
+    memset(&current, 0, sizeof(current));
+    current.header.sequence = UINT32_MAX;
+    current.header.tier = tier;
+    this->step = step;
+    bits = 0;
+  }
+
+  // false if the value no longer fits, the chunk is complete then
+  bool add(const uint32_t (&values)[FIELDS]) {
+    if (current.header.count == 0) {
+      if (!fits(16 * (FIELDS - 1))) {
+        return false;
+      }
+      current.header.start = values[0];
+      for (uint8_t i = 1; i < FIELDS; i++) {
+        writeBits(values[i], 16);
+      }
+      previousDelta = 1;
+    } else {
+      const uint32_t delta = (values[0] - previous[0]) / step;
+      const int32_t deltaOfDelta = (int32_t)(delta - previousDelta);
+      uint32_t needed = historyValueBits(deltaOfDelta);
+      for (uint8_t i = 1; i < FIELDS; i++) {
+        needed += historyValueBits((int32_t)(values[i] - previous[i]));
+      }
+      if (!fits(needed)) {
+        return false;
+      }
+      writeValue(deltaOfDelta);
+      for (uint8_t i = 1; i < FIELDS; i++) {
+        writeValue((int32_t)(values[i] - previous[i]));
+      }
+      previousDelta = delta;
+    }
+    memcpy(previous, values, sizeof(previous));
+    current.header.count++;
+    return true;
+  }
+
+  bool empty() const { return current.header.count == 0; }
+  size_t usedBytes() const { return sizeof(HistoryChunkHeader) + (bits + 7) / 8; }
+  HistoryChunk& chunk() { return current; }
+  const HistoryChunk& chunk() const { return current; }
+
+ private:
+  bool fits(uint32_t count) const { return bits + count <= HISTORY_PAYLOAD_SIZE * 8; }
+
+  void writeBits(uint32_t value, uint8_t count) {
+    for (uint8_t i = count; i-- > 0;) {
+      if ((value >> i) & 1) {
+        current.payload[bits / 8] |= 0x80 >> (bits % 8);
+      }
+      bits++;
+    }
+  }
+
+  void writeValue(int32_t value) {
+    const uint32_t zigzag = historyZigzag(value);
+    if (zigzag == 0) {
+      writeBits(0, 1);
+    } else if (zigzag < 64) {
+      writeBits(0b10, 2);
+      writeBits(zigzag, 6);
+    } else if (zigzag < 4096) {
+      writeBits(0b110, 3);
+      writeBits(zigzag, 12);
+    } else {
+      writeBits(0b111, 3);
+      writeBits(zigzag, 32);
+    }
+  }
+
+  HistoryChunk current;
+  uint32_t step = 1;
+  uint32_t bits = 0;
+  uint32_t previous[FIELDS] = {};
+  uint32_t previousDelta = 1;
+};
+
+template <uint8_t FIELDS>
+class HistoryDecoder {
+ public:
+  HistoryDecoder(const HistoryChunk& chunk, uint32_t step) : chunk(chunk), step(step) {}
+
+  // Next value in chunk order, false at the end
+  bool next(uint32_t (&values)[FIELDS]) {
+    if (index >= chunk.header.count) {
+      return false;
+    }
+    if (index == 0) {
+      values[0] = chunk.header.start;
+      for (uint8_t i = 1; i < FIELDS; i++) {
+        values[i] = readBits(16);
+      }
+    } else {
+      previousDelta += readValue();
+      values[0] = previous[0] + previousDelta * step;
+      for (uint8_t i = 1; i < FIELDS; i++) {
+        values[i] = previous[i] + readValue();
+      }
+    }
+    if (overrun) {
+      return false;
+    }
+    memcpy(previous, values, sizeof(previous));
+    index++;
+    return true;
+  }
+
+ private:
+  uint32_t readBits(uint8_t count) {
+    uint32_t value = 0;
+    for (uint8_t i = 0; i < count; i++) {
+      if (bits >= HISTORY_PAYLOAD_SIZE * 8) {
+        overrun = true;
+        return 0;
+      }
+      value = (value << 1) | ((chunk.payload[bits / 8] >> (7 - bits % 8)) & 1);
+      bits++;
+    }
+    return value;
+  }
+
+  int32_t readValue() {
+    if (readBits(1) == 0) {
+      return 0;
+    }
+    if (readBits(1) == 0) {
+      return historyUnzigzag(readBits(6));
+    }
+    if (readBits(1) == 0) {
+      return historyUnzigzag(readBits(12));
+    }
+    return historyUnzigzag(readBits(32));
+  }
+
+  const HistoryChunk& chunk;
+  const uint32_t step;
+  uint32_t bits = 0;
+  uint16_t index = 0;
+  uint32_t previous[FIELDS] = {};
+  uint32_t previousDelta = 1;
+  bool overrun = false;
+};
+
+// Ring of chunk slots in a sector-aligned part of a flash region. Chunks
+// are written once and whole, so a torn write only costs its own slot.
+// When the ring wraps, the oldest sector is erased.
+class HistoryLog {
+ public:
+  void begin(FlashRegion& region, size_t offset, size_t size) {
+    flash = &region;
+    base = offset;
+    slotCount = size / HISTORY_CHUNK_SIZE;
+    slotsPerSector = region.sectorSize() / HISTORY_CHUNK_SIZE;
+    writeIndex = 0;
+    stored = 0;
+    uint32_t maxSequence = 0;
+    bool any = false;
+
+    for (uint32_t i = 0; i < slotCount; i++) {
+      HistoryChunkHeader header;
+      if (!readHeader(i, header)) {
+        continue;
+      }
+      stored++;
+      if (!any || header.sequence > maxSequence) {
+        maxSequence = header.sequence;
+        writeIndex = (i + 1) % slotCount;
+      }
+      any = true;
+    }
+    nextSequence = any ? maxSequence + 1 : 0;
+
+    // Nach Stromausfall mitten im Schreiben: angefangene Slots überspringen
+    while (writeIndex % slotsPerSector != 0 && !slotErased(writeIndex)) {
+      writeIndex = (writeIndex + 1) % slotCount;
+    }
+  }
+
+  bool append(HistoryChunk& chunk) {
+    if (slotCount == 0) {
+      return false;
+    }
+    if (writeIndex % slotsPerSector == 0) {
+      stored -= countSector(writeIndex);
+      if (!flash->eraseSector(base + writeIndex * HISTORY_CHUNK_SIZE)) {
+        return false;
+      }
+    }
+    chunk.header.sequence = nextSequence;
+    chunk.header.checksum = historyChecksum(chunk);
+    if (!flash->write(base + writeIndex * HISTORY_CHUNK_SIZE, &chunk, sizeof(chunk))) {
+      return false;
+    }
+    nextSequence++;
+    stored++;
+    writes++;
+    writeIndex = (writeIndex + 1) % slotCount;
+    return true;
+  }
+
+  // Visits the chunks that may hold values from from on, oldest first.
+  // Only headers are read for chunks that end before from. visit() returns
+  // false to stop; forEach() then returns false as well.
+  template <typename Visit>
+  bool forEach(uint32_t from, Visit visit) {
+    int32_t pending = -1;
+    uint32_t index = writeIndex;
+    for (uint32_t scanned = 0; scanned < slotCount; scanned++, index = (index + 1) % slotCount) {
+      HistoryChunkHeader header;
+      if (!readHeader(index, header)) {
+        continue;
+      }
+      if (pending >= 0 && header.start > from && !visitSlot(pending, visit)) {
+        return false;
+      }
+      pending = index;
+    }
+    return pending < 0 || visitSlot(pending, visit);
+  }
+
+  uint32_t chunkCount() const { return stored; }
+  uint32_t capacity() const { return slotCount; }
+  uint32_t writeCount() const { return writes; }
+
+ private:
+  template <typename Visit>
+  bool visitSlot(uint32_t index, Visit& visit) {
+    HistoryChunk chunk;
+    if (!flash->read(base + index * HISTORY_CHUNK_SIZE, &chunk, sizeof(chunk)) ||
+        chunk.header.checksum != historyChecksum(chunk)) {
+      return true;
+    }
+    return visit(chunk);
+  }
+
+  bool readHeader(uint32_t index, HistoryChunkHeader& header) {
+    return flash->read(base + index * HISTORY_CHUNK_SIZE, &header, sizeof(header)) &&
+           header.sequence != UINT32_MAX;
+  }
+
+  bool slotErased(uint32_t index) {
+    uint32_t sequence = 0;
+    flash->read(base + index * HISTORY_CHUNK_SIZE, &sequence, sizeof(sequence));
+    return sequence == UINT32_MAX;
+  }
+
+  uint32_t countSector(uint32_t firstIndex) {
+    uint32_t count = 0;
+    for (uint32_t i = firstIndex; i < firstIndex + slotsPerSector; i++) {
+      HistoryChunkHeader header;
+      count += readHeader(i, header) ? 1 : 0;
+    }
+    return count;
+  }
+
+  FlashRegion* flash = nullptr;
+  size_t base = 0;
+  uint32_t slotCount = 0;
+  uint32_t slotsPerSector = 1;
+  uint32_t writeIndex = 0;
+  uint32_t nextSequence = 0;
+  uint32_t stored = 0;
+  uint32_t writes = 0;
+};
+
+// Level history in three tiers, each in its own ring: minute averages
+// (level and distance), hourly and daily min/max/avg of the level. Levels
+// are stored in 0.1 %. Every tier fills a chunk in RAM and writes it when
+// it is full. The minute chunk is also written whenever an hour closes and
+// the hour chunk whenever a day closes, so a power cut loses at most the
+// last hour of minutes and the last day of hours; the cost is a partly
+// used 128 byte slot per hour and per day. Hours and days are closed by
+// the first value after them; the open chunks are part of every query.
+// After a restart the hour and day that were open start over.
+class History {
+ public:
+  explicit History(FlashRegion& flash) : flash(flash) {}
+
+  // Splits the region: 2 sectors for days, 1/8 for hours, the rest for minutes
+  bool begin() {
+    const size_t sectorSize = flash.sectorSize();
+    const uint32_t sectors = sectorSize > 0 ? flash.size() / sectorSize : 0;
+    if (sectors < HISTORY_MIN_SECTORS || sectorSize % HISTORY_CHUNK_SIZE != 0) {
+      return false;
+    }
+    const uint32_t dailySectors = 2;
+    const uint32_t hourlySectors = sectors / 8 > 2 ? sectors / 8 : 2;
+    const uint32_t rawSectors = sectors - dailySectors - hourlySectors;
+    logs[HISTORY_RAW].begin(flash, 0, rawSectors * sectorSize);
+    logs[HISTORY_HOURLY].begin(flash, rawSectors * sectorSize, hourlySectors * sectorSize);
+    logs[HISTORY_DAILY].begin(flash, (rawSectors + hourlySectors) * sectorSize, dailySectors * sectorSize);
+
+    raw.start(HISTORY_RAW, HISTORY_MINUTE);
+    hourly.start(HISTORY_HOURLY, HISTORY_HOUR);
+    daily.start(HISTORY_DAILY, HISTORY_DAY);
+    ready = true;
+    return true;
+  }
+
+  bool active() const { return ready; }
+
+  // Called for every level event; values older than the open minute are dropped
+  void record(uint32_t epoch, float waterLevel, uint16_t distance) {
+    if (!ready || waterLevel < 0) {
+      return;
+    }
+    const uint32_t minute = epoch - epoch % HISTORY_MINUTE;
+    if (minuteSamples > 0 && minute != currentMinute) {
+      if (minute < currentMinute) {
+        return;
+      }
+      closeMinute();
+    }
+    currentMinute = minute;
+    minuteLevelSum += (uint32_t)lroundf(waterLevel * 10);
+    minuteDistanceSum += distance;
+    minuteSamples++;
+  }
+
+  // Closes the open minute and writes the open chunks, e.g. before a restart
+  void flush() {
+    if (minuteSamples > 0) {
+      closeMinute();
+    }
+    seal(HISTORY_RAW, raw);
+    seal(HISTORY_HOURLY, hourly);
+    seal(HISTORY_DAILY, daily);
+  }
+
+  // Streams {"res":..,"columns":[..],"points":[[..],..],"next":..} to out,
+  // see ChunkedWriter. "next" is set when HISTORY_QUERY_MAX_POINTS cut the
+  // answer short and is the from of the follow-up query.
+  template <typename Writer>
+  void query(Writer& out, HistoryQuery query) {
+    query.resolution = resolve(query);
+    out.printf("{\"res\":\"%s\",\"from\":%lu,\"to\":%lu,", historyResolutionNames[query.resolution],
+               (unsigned long)query.from, (unsigned long)query.to);
+    out.print(query.resolution == HISTORY_RAW ? "\"columns\":[\"ts\",\"fuellstand\",\"distanz\"],\"points\":["
+                                              : "\"columns\":[\"ts\",\"min\",\"max\",\"mittel\",\"minuten\"],\"points\":[");
+    QueryState state = {query, 0, 0};
+    if (query.resolution == HISTORY_RAW) {
+      queryTier(out, state, logs[HISTORY_RAW], raw, HISTORY_MINUTE);
+    } else if (query.resolution == HISTORY_HOURLY) {
+      queryTier(out, state, logs[HISTORY_HOURLY], hourly, HISTORY_HOUR);
+    } else {
+      queryTier(out, state, logs[HISTORY_DAILY], daily, HISTORY_DAY);
+    }
+    if (state.next != 0) {
+      out.printf("],\"next\":%lu}", (unsigned long)state.next);
+    } else {
+      out.print("]}");
+    }
+  }
+
+  static HistoryResolution resolve(const HistoryQuery& query) {
+    if (query.resolution != HISTORY_AUTO) {
+      return query.resolution;
+    }
+    const uint32_t span = query.to - query.from;
+    return span <= HISTORY_AUTO_RAW_SPAN ? HISTORY_RAW : span <= HISTORY_AUTO_HOURLY_SPAN ? HISTORY_HOURLY : HISTORY_DAILY;
+  }
+
+  // Chunks im Flash, geschriebene Chunks seit dem Start und Bytes im offenen Chunk
+  uint32_t chunkCount(HistoryResolution tier) const { return logs[tier].chunkCount(); }
+  uint32_t capacity(HistoryResolution tier) const { return logs[tier].capacity(); }
+  uint32_t writeCount(HistoryResolution tier) const { return logs[tier].writeCount(); }
+  size_t openBytes(HistoryResolution tier) const {
+    return tier == HISTORY_RAW ? raw.usedBytes() : tier == HISTORY_HOURLY ? hourly.usedBytes() : daily.usedBytes();
+  }
+
+ private:
+  struct QueryState {
+    HistoryQuery query;
+    uint32_t points;
+    uint32_t next;
+  };
+
+  // Aggregate over the minutes of an hour or the hours of a day
+  struct Rollup {
+    uint32_t start;
+    uint16_t min;
+    uint16_t max;
+    uint32_t sum;      // Summe Füllstand x Minuten
+    uint32_t minutes;
+  };
+
+  void closeMinute() {
+    const uint32_t level = (minuteLevelSum + minuteSamples / 2) / minuteSamples;
+    const uint32_t distance = (minuteDistanceSum + minuteSamples / 2) / minuteSamples;
+    minuteLevelSum = 0;
+    minuteDistanceSum = 0;
+    minuteSamples = 0;
+    add(HISTORY_RAW, raw, {currentMinute, level, distance});
+    addToRollup(hour, HISTORY_HOUR, currentMinute, level, level, level, 1);
+  }
+
+  void addToRollup(Rollup& rollup, uint32_t period, uint32_t time, uint16_t min, uint16_t max,
+                   uint32_t average, uint32_t minutes) {
+    const uint32_t start = time - time % period;
+    if (rollup.minutes > 0 && start != rollup.start) {
+      closeRollup(rollup, period);
+    }
+    if (rollup.minutes == 0) {
+      rollup = {start, min, max, 0, 0};
+    }
+    rollup.min = min < rollup.min ? min : rollup.min;
+    rollup.max = max > rollup.max ? max : rollup.max;
+    rollup.sum += average * minutes;
+    rollup.minutes += minutes;
+  }
+
+  void closeRollup(Rollup& rollup, uint32_t period) {
+    const uint32_t average = (rollup.sum + rollup.minutes / 2) / rollup.minutes;
+    const uint32_t values[5] = {rollup.start, rollup.min, rollup.max, average, rollup.minutes};
+    rollup.minutes = 0;
+    if (period == HISTORY_HOUR) {
+      add(HISTORY_HOURLY, hourly, values);
+      seal(HISTORY_RAW, raw);  // Minuten höchstens eine Stunde nur im RAM
+      addToRollup(day, HISTORY_DAY, values[0], values[1], values[2], average, values[4]);
+    } else {
+      add(HISTORY_DAILY, daily, values);
+      seal(HISTORY_HOURLY, hourly);
+    }
+  }
+
+  template <uint8_t FIELDS>
+  void add(HistoryResolution tier, HistoryEncoder<FIELDS>& encoder, const uint32_t (&values)[FIELDS]) {
+    if (!encoder.add(values)) {
+      seal(tier, encoder);
+      encoder.add(values);
+    }
+  }
+
+  template <uint8_t FIELDS>
+  void seal(HistoryResolution tier, HistoryEncoder<FIELDS>& encoder) {
+    if (!encoder.empty()) {
+      logs[tier].append(encoder.chunk());
+    }
+    encoder.start(tier, tier == HISTORY_RAW ? HISTORY_MINUTE : tier == HISTORY_HOURLY ? HISTORY_HOUR : HISTORY_DAY);
+  }
+
+  template <typename Writer, uint8_t FIELDS>
+  void queryTier(Writer& out, QueryState& state, HistoryLog& log, const HistoryEncoder<FIELDS>& open,
+                 uint32_t step) {
+    auto visit = [&](const HistoryChunk& chunk) { return emitChunk<Writer, FIELDS>(out, state, chunk, step); };
+    if (log.forEach(state.query.from, visit) && !open.empty()) {
+      visit(open.chunk());
+    }
+  }
+
+  // Returns false once the range or the point limit is done
+  template <typename Writer, uint8_t FIELDS>
+  static bool emitChunk(Writer& out, QueryState& state, const HistoryChunk& chunk, uint32_t step) {
+    HistoryDecoder<FIELDS> decoder(chunk, step);
+    uint32_t values[FIELDS];
+    while (decoder.next(values)) {
+      if (values[0] < state.query.from) {
+        continue;
+      }
+      if (values[0] > state.query.to) {
+        return false;
+      }
+      if (state.points == HISTORY_QUERY_MAX_POINTS) {
+        state.next = values[0];
+        return false;
+      }
+      out.printf("%s[%lu", state.points > 0 ? "," : "", (unsigned long)values[0]);
+      for (uint8_t i = 1; i < FIELDS; i++) {
+        // Rohwerte: Füllstand, Distanz; Rollups: min, max, mittel, Minuten
+        const bool level = FIELDS == 3 ? i == 1 : i < 4;
+        if (level) {
+          out.printf(",%lu.%lu", (unsigned long)(values[i] / 10), (unsigned long)(values[i] % 10));
+        } else {
+          out.printf(",%lu", (unsigned long)values[i]);
+        }
+      }
+      out.print("]");
+      state.points++;
+    }
+    return true;
+  }
+
+  FlashRegion& flash;
+  bool ready = false;
+  HistoryLog logs[3];
+  HistoryEncoder<3> raw;     // Zeit, Füllstand, Distanz
+  HistoryEncoder<5> hourly;  // Zeit, min, max, mittel, Minuten
+  HistoryEncoder<5> daily;
+
+  uint32_t currentMinute = 0;
+  uint32_t minuteLevelSum = 0;
+  uint32_t minuteDistanceSum = 0;
+  uint32_t minuteSamples = 0;
+  Rollup hour = {};
+  Rollup day = {};
+};
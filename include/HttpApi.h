@@ -0,0 +1,373 @@
+// Local HTTP API: /api/state as JSON and /metrics in Prometheus text format
+#pragma once
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string_view>
+#include <WaterLevel.h>
+#include <History.h>
+#include <Tank.h>
+
+const size_t HTTP_CHUNK_SIZE = 256;  // Puffer pro gesendetem Stück
+const size_t HTTP_LINE_SIZE = 128;   // längste Ausgabe eines printf()
+
+struct TankApiState {
+  const char* name;
+  float waterLevel;        // negativ = noch kein Messwert
+  uint16_t distance;
+  uint32_t refills;
+  Calibration calibration;
+};
+
+// Snapshot of the values a response is built from, taken in the network task
+struct ApiState {
+  TankApiState tanks[TANK_MAX_COUNT];
+  uint8_t tankCount;
+  const char* firmware;
+  uint32_t uptimeMs;
+  bool mqttConnected;
+  uint32_t sensorTimeouts;
+  uint32_t sensorReadErrors;
+  uint32_t freeHeap;
+};
+
+// Collects output in a fixed buffer and hands it to send(data, length) in
+// chunks of HTTP_CHUNK_SIZE. The sender is a callable, so the same code
+// writes to the WebServer on the device and to a string on the host.
+template <typename Send>
+class ChunkedWriter {
+ public:
+  explicit ChunkedWriter(Send send) : send(send) {}
+  ~ChunkedWriter() { flush(); }
+
+  void write(const char* data, size_t length) {
+    while (length > 0) {
+      const size_t room = sizeof(buffer) - used;
+      const size_t part = length < room ? length : room;
+      memcpy(buffer + used, data, part);
+      used += part;
+      data += part;
+      length -= part;
+      if (used == sizeof(buffer)) {
+        flush();
+      }
+    }
+  }
+
+  void print(std::string_view text) { write(text.data(), text.size()); }
+
+  // Formatted output, a single call must fit into one line buffer
+  void printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+    char line[HTTP_LINE_SIZE];
+    va_list args;
+    va_start(args, format);
+    const int length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (length > 0) {
+      write(line, (size_t)length < sizeof(line) ? length : sizeof(line) - 1);
+    }
+  }
+
+  void flush() {
+    if (used > 0) {
+      send(buffer, used);
+      used = 0;
+    }
+  }
+
+ private:
+  Send send;
+  char buffer[HTTP_CHUNK_SIZE];
+  size_t used = 0;
+};
+
+// Same interface as ChunkedWriter, only counts, e.g. for the length of a
+// streamed MQTT publish
+class LengthCounter {
+ public:
+  void write(const char* data, size_t length) { total += length; }
+  void print(std::string_view text) { total += text.size(); }
+
+  void printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+    va_list args;
+    va_start(args, format);
+    const int length = vsnprintf(nullptr, 0, format, args);
+    va_end(args);
+    if (length > 0) {
+      total += (size_t)length < HTTP_LINE_SIZE ? length : HTTP_LINE_SIZE - 1;
+    }
+  }
+
+  size_t length() const { return total; }
+
+ private:
+  size_t total = 0;
+};
+
+// Quoted JSON string, escapes quotes, backslashes and control characters
+// (e.g. an SSID, which may contain anything)
+template <typename Writer>
+void writeJsonString(Writer& out, std::string_view text) {
+  out.print("\"");
+  size_t start = 0;
+  for (size_t i = 0; i < text.size(); i++) {
+    const unsigned char c = text[i];
+    if (c != '"' && c != '\\' && c >= 0x20) {
+      continue;
+    }
+    out.print(text.substr(start, i - start));
+    if (c == '"' || c == '\\') {
+      const char escaped[2] = {'\\', (char)c};
+      out.write(escaped, sizeof(escaped));
+    } else {
+      out.printf("\\u%04x", c);
+    }
+    start = i + 1;
+  }
+  out.print(text.substr(start));
+  out.print("\"");
+}
+
+// Same keys as the MQTT state frame of a tank
+template <typename Writer>
+void writeTankJson(Writer& out, const TankApiState& tank) {
+  if (tank.waterLevel >= 0) {
+    out.printf("\"fuellstand\":%.1f,\"distanz\":%u,", tank.waterLevel, tank.distance);
+  }
+  out.printf("\"auffuellungen\":%lu,\"min_mm\":%u,\"max_mm\":%u",
+             (unsigned long)tank.refills, tank.calibration.minMm, tank.calibration.maxMm);
+}
+
+// The first tank at the top level as before, all tanks in "tanks"
+template <typename Writer>
+void writeStateJson(Writer& out, const ApiState& state) {
+  out.print("{");
+  writeTankJson(out, state.tanks[0]);
+  out.print(",\"tanks\":[");
+  for (uint8_t i = 0; i < state.tankCount; i++) {
+    out.printf("%s{\"name\":\"%s\",", i > 0 ? "," : "", state.tanks[i].name);
+    writeTankJson(out, state.tanks[i]);
+    out.print("}");
+  }
+  out.print("],");
+  out.printf("\"firmware\":\"%s\",\"uptime_s\":%lu,\"mqtt\":%s}",
+             state.firmware, (unsigned long)(state.uptimeMs / 1000), state.mqttConnected ? "true" : "false");
+}
+
+template <typename Writer>
+void writeMetric(Writer& out, const char* name, const char* type, const char* help) {
+  out.printf("# HELP %s %s\n", name, help);
+  out.printf("# TYPE %s %s\n", name, type);
+}
+
+// Per-tank series carry the label tank="<name>"
+template <typename Writer>
+void writeMetrics(Writer& out, const ApiState& state) {
+  writeMetric(out, "rocket_water_level_percent", "gauge", "Water level in percent");
+  for (uint8_t i = 0; i < state.tankCount; i++) {
+    if (state.tanks[i].waterLevel >= 0) {
+      out.printf("rocket_water_level_percent{tank=\"%s\"} %.1f\n", state.tanks[i].name, state.tanks[i].waterLevel);
+    }
+  }
+  writeMetric(out, "rocket_distance_mm", "gauge", "Filtered sensor distance");
+  for (uint8_t i = 0; i < state.tankCount; i++) {
+    if (state.tanks[i].waterLevel >= 0) {
+      out.printf("rocket_distance_mm{tank=\"%s\"} %u\n", state.tanks[i].name, state.tanks[i].distance);
+    }
+  }
+  writeMetric(out, "rocket_refills_total", "counter", "Detected refills");
+  for (uint8_t i = 0; i < state.tankCount; i++) {
+    out.printf("rocket_refills_total{tank=\"%s\"} %lu\n", state.tanks[i].name, (unsigned long)state.tanks[i].refills);
+  }
+  writeMetric(out, "rocket_calibration_mm", "gauge", "Distance at full and empty");
+  for (uint8_t i = 0; i < state.tankCount; i++) {
+    out.printf("rocket_calibration_mm{tank=\"%s\",point=\"full\"} %u\n", state.tanks[i].name,
+               state.tanks[i].calibration.minMm);
+    out.printf("rocket_calibration_mm{tank=\"%s\",point=\"empty\"} %u\n", state.tanks[i].name,
+               state.tanks[i].calibration.maxMm);
+  }
+  writeMetric(out, "rocket_sensor_errors_total", "counter", "Sensor timeouts and read errors");
+  out.printf("rocket_sensor_errors_total{type=\"timeout\"} %lu\n", (unsigned long)state.sensorTimeouts);
+  out.printf("rocket_sensor_errors_total{type=\"read\"} %lu\n", (unsigned long)state.sensorReadErrors);
+  writeMetric(out, "rocket_mqtt_connected", "gauge", "1 while the broker session is online");
+  out.printf("rocket_mqtt_connected %u\n", state.mqttConnected ? 1 : 0);
+  writeMetric(out, "rocket_heap_free_bytes", "gauge", "Free heap");
+  out.printf("rocket_heap_free_bytes %lu\n", (unsigned long)state.freeHeap);
+  writeMetric(out, "rocket_uptime_seconds", "counter", "Seconds since boot");
+  out.printf("rocket_uptime_seconds %lu\n", (unsigned long)(state.uptimeMs / 1000));
+  writeMetric(out, "rocket_info", "gauge", "Firmware version");
+  out.printf("rocket_info{firmware=\"%s\"} 1\n", state.firmware);
+}
+
+inline size_t skipJsonSpace(std::string_view body, size_t position) {
+  while (position < body.size() && (body[position] == ' ' || body[position] == '\t' ||
+                                    body[position] == '\r' || body[position] == '\n')) {
+    position++;
+  }
+  return position;
+}
+
+// Position after the closing quote of the string starting at position,
+// npos if it is not terminated
+inline size_t skipJsonString(std::string_view body, size_t position) {
+  for (position++; position < body.size(); position++) {
+    if (body[position] == '\\') {
+      position++;
+    } else if (body[position] == '"') {
+      return position + 1;
+    }
+  }
+  return std::string_view::npos;
+}
+
+// Position after the value starting at position: a string, a nested
+// object or array, or a bare token such as a number. npos if malformed.
+inline size_t skipJsonValue(std::string_view body, size_t position) {
+  if (position >= body.size()) {
+    return std::string_view::npos;
+  }
+  if (body[position] == '"') {
+    return skipJsonString(body, position);
+  }
+  if (body[position] == '{' || body[position] == '[') {
+    uint16_t depth = 0;
+    while (position < body.size()) {
+      const char c = body[position];
+      if (c == '"') {
+        position = skipJsonString(body, position);
+        if (position == std::string_view::npos) {
+          return position;
+        }
+        continue;
+      }
+      if (c == '{' || c == '[') {
+        depth++;
+      } else if ((c == '}' || c == ']') && --depth == 0) {
+        return position + 1;
+      }
+      position++;
+    }
+    return std::string_view::npos;
+  }
+  const size_t end = body.find_first_of(",}] \t\r\n", position);
+  return end == position ? std::string_view::npos : end == std::string_view::npos ? body.size() : end;
+}
+
+// Value of a top-level member of a JSON object: the token of a number or
+// the text of a string without quotes (escapes are not decoded). Only key
+// positions are compared, so the same text inside a string value or a
+// nested object does not match. Empty if the key is missing or the body
+// is not a well-formed object up to the key.
+inline std::string_view findJsonValue(std::string_view body, std::string_view key) {
+  size_t position = skipJsonSpace(body, 0);
+  if (position >= body.size() || body[position] != '{') {
+    return {};
+  }
+  position = skipJsonSpace(body, position + 1);
+  while (position < body.size() && body[position] == '"') {
+    const size_t keyEnd = skipJsonString(body, position);
+    if (keyEnd == std::string_view::npos) {
+      return {};
+    }
+    const std::string_view name = body.substr(position + 1, keyEnd - position - 2);
+    position = skipJsonSpace(body, keyEnd);
+    if (position >= body.size() || body[position] != ':') {
+      return {};
+    }
+    const size_t start = skipJsonSpace(body, position + 1);
+    const size_t end = skipJsonValue(body, start);
+    if (end == std::string_view::npos) {
+      return {};
+    }
+    if (name == key) {
+      return body[start] == '"' ? body.substr(start + 1, end - start - 2) : body.substr(start, end - start);
+    }
+    position = skipJsonSpace(body, end);
+    if (position >= body.size() || body[position] != ',') {
+      return {};
+    }
+    position = skipJsonSpace(body, position + 1);
+  }
+  return {};
+}
+
+inline bool findJsonNumber(std::string_view body, std::string_view key, uint16_t& value) {
+  const std::string_view text = findJsonValue(body, key);
+  return !text.empty() && parseCalibrationValue(text.data(), text.size(), value);
+}
+
+// Decimal digits only, false on anything else or overflow
+inline bool parseUnsigned(std::string_view text, uint32_t& value) {
+  if (text.empty() || text.size() > 10) {
+    return false;
+  }
+  uint64_t result = 0;
+  for (char c : text) {
+    if (c < '0' || c > '9') {
+      return false;
+    }
+    result = result * 10 + (c - '0');
+  }
+  if (result > UINT32_MAX) {
+    return false;
+  }
+  value = (uint32_t)result;
+  return true;
+}
+
+// from, to and res from the query string or a JSON body. Missing values
+// default to the last day up to now and res=auto.
+template <typename Lookup>
+bool parseHistoryQuery(Lookup lookup, uint32_t now, HistoryQuery& query) {
+  query = {now > HISTORY_DAY ? now - HISTORY_DAY : 0, now, HISTORY_AUTO};
+  const std::string_view from = lookup("from");
+  const std::string_view to = lookup("to");
+  const std::string_view resolution = lookup("res");
+  if ((!from.empty() && !parseUnsigned(from, query.from)) || (!to.empty() && !parseUnsigned(to, query.to)) ||
+      (!resolution.empty() && !parseHistoryResolution(resolution, query.resolution))) {
+    return false;
+  }
+  if (from.empty() && !to.empty()) {
+    query.from = query.to > HISTORY_DAY ? query.to - HISTORY_DAY : 0;
+  }
+  return query.from <= query.to;
+}
+
+// {"min_mm":..,"max_mm":..}, a missing key keeps the current value.
+// Returns false if nothing valid was sent.
+inline bool parseCalibrationJson(std::string_view body, Calibration& calibration) {
+  Calibration update = calibration;
+  const bool hasMin = findJsonNumber(body, "min_mm", update.minMm);
+  const bool hasMax = findJsonNumber(body, "max_mm", update.maxMm);
+  if ((!hasMin && !hasMax) || !update.isValid()) {
+    return false;
+  }
+  calibration = update;
+  return true;
+}
+
+// If-None-Match against our strong ETag: "*", a single tag or a list,
+// weak tags (W/"..") compare equal as well
+inline bool etagMatches(std::string_view ifNoneMatch, std::string_view etag) {
+  size_t position = 0;
+  while (position < ifNoneMatch.size()) {
+    size_t end = ifNoneMatch.find(',', position);
+    if (end == std::string_view::npos) {
+      end = ifNoneMatch.size();
+    }
+    std::string_view tag = ifNoneMatch.substr(position, end - position);
+    const size_t first = tag.find_first_not_of(" \t");
+    const size_t last = tag.find_last_not_of(" \t");
+    tag = first == std::string_view::npos ? std::string_view() : tag.substr(first, last - first + 1);
+    if (tag.substr(0, 2) == "W/") {
+      tag.remove_prefix(2);
+    }
+    if (tag == "*" || tag == etag) {
+      return true;
+    }
+    position = end + 1;
+  }
+  return false;
+}
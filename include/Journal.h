@@ -0,0 +1,399 @@
+// Store-and-forward journal for level events while the broker is unreachable
+#pragma once
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <Hal.h>
+#include <WaterLevel.h>
+
+// Journal Einstellungen
+const float JOURNAL_LEVEL_DEADBAND = 2.0;    // Mindeständerung für einen Eintrag in %
+const uint32_t JOURNAL_HEARTBEAT = 300000;   // Ohne Änderung spätestens alle 5 Minuten ein Eintrag
+const uint32_t JOURNAL_REPLAY_INTERVAL = 100; // Mindestabstand zwischen zwei Replay-Batches in ms
+#define JOURNAL_RAM_ENTRIES 128
+#define JOURNAL_BATCH_ENTRIES 8
+
+constexpr char mqtt_topic_journal[] = "rocket/wasserstand/journal";  // Nachgelieferte Werte
+
+enum JournalFlags : uint8_t {
+  JOURNAL_REFILL = 1,
+  JOURNAL_EPOCH = 2,    // timestamp is seconds since 1970, otherwise ms since boot
+  JOURNAL_UNKNOWN = 4,  // ms since a previous boot, the wall clock time is lost
+};
+
+struct JournalEntry {
+  uint32_t timestamp;
+  uint16_t distance;
+  uint16_t waterLevel;  // 0.1 %
+  uint8_t flags;
+};
+
+// Wall clock from SNTP. Until the first sync, entries carry ms since boot
+// and are converted once the offset is known.
+class TimeBase {
+ public:
+  void sync(uint32_t epochSeconds, uint32_t nowMs) {
+    offsetMs = (int64_t)epochSeconds * 1000 - nowMs;
+    valid = true;
+  }
+
+  bool synced() const { return valid; }
+
+  uint32_t toEpoch(uint32_t monotonicMs) const {
+    return (uint32_t)((offsetMs + monotonicMs) / 1000);
+  }
+
+ private:
+  int64_t offsetMs = 0;
+  bool valid = false;
+};
+
+// Append-only log on a raw flash region. Records carry a sequence number
+// and are marked consumed after replay by clearing a byte, so no sector
+// is erased before the writer wraps around onto it. When the region is
+// full the oldest sector is dropped.
+class FlashJournal {
+ public:
+  explicit FlashJournal(FlashRegion& flash) : flash(flash) {}
+
+  // Finds read and write position after boot
+  void begin() {
+    recordCount = flash.size() / sizeof(Record);
+    recordsPerSector = flash.sectorSize() / sizeof(Record);
+    pending = 0;
+    uint32_t maxSequence = 0;
+    uint32_t minPending = UINT32_MAX;
+    bool any = false;
+    writeIndex = 0;
+    readIndex = 0;
+
+    for (uint32_t i = 0; i < recordCount; i++) {
+      Record record;
+      if (!readRecord(i, record)) {
+        continue;
+      }
+      if (!any || record.sequence > maxSequence) {
+        maxSequence = record.sequence;
+        writeIndex = (i + 1) % recordCount;
+      }
+      any = true;
+      if (record.consumed == RECORD_PENDING) {
+        pending++;
+        if (record.sequence < minPending) {
+          minPending = record.sequence;
+          readIndex = i;
+        }
+      }
+    }
+
+    nextSequence = any ? maxSequence + 1 : 0;
+    firstSequence = nextSequence;
+    if (pending == 0) {
+      readIndex = writeIndex;
+    }
+
+    // Nach Stromausfall mitten im Schreiben: angefangene Slots überspringen
+    while (writeIndex % recordsPerSector != 0 && !slotErased(writeIndex)) {
+      writeIndex = (writeIndex + 1) % recordCount;
+    }
+  }
+
+  bool append(const JournalEntry& entry) {
+    if (recordCount == 0) {
+      return false;
+    }
+    if (writeIndex % recordsPerSector == 0) {
+      dropSector(writeIndex);
+      if (!flash.eraseSector(writeIndex * sizeof(Record))) {
+        return false;
+      }
+    }
+
+    Record record;
+    record.sequence = nextSequence;
+    record.timestamp = entry.timestamp;
+    record.distance = entry.distance;
+    record.waterLevel = entry.waterLevel;
+    record.flags = entry.flags;
+    record.checksum = checksum(record);
+    record.consumed = RECORD_PENDING;
+    record.reserved = 0xFF;
+    if (!flash.write(writeIndex * sizeof(Record), &record, sizeof(record))) {
+      return false;
+    }
+
+    if (pending == 0) {
+      readIndex = writeIndex;
+    }
+    nextSequence++;
+    pending++;
+    writeIndex = (writeIndex + 1) % recordCount;
+    return true;
+  }
+
+  // Reads up to max of the oldest entries without removing them
+  size_t peek(JournalEntry* entries, size_t max) {
+    size_t found = 0;
+    uint32_t index = readIndex;
+    for (uint32_t scanned = 0; found < max && found < pending && scanned < recordCount; scanned++) {
+      Record record;
+      if (readRecord(index, record) && record.consumed == RECORD_PENDING) {
+        entries[found].timestamp = record.timestamp;
+        entries[found].distance = record.distance;
+        entries[found].waterLevel = record.waterLevel;
+        entries[found].flags = record.flags;
+        if (!(record.flags & JOURNAL_EPOCH) && record.sequence < firstSequence) {
+          entries[found].flags |= JOURNAL_UNKNOWN;
+        }
+        found++;
+      }
+      index = (index + 1) % recordCount;
+    }
+    // Unlesbare Einträge nicht endlos suchen
+    if (found < max && found < pending) {
+      pending = found;
+    }
+    return found;
+  }
+
+  // Marks the count oldest entries as replayed
+  void consume(size_t count) {
+    const uint8_t done = RECORD_CONSUMED;
+    while (count > 0 && pending > 0) {
+      Record record;
+      if (readRecord(readIndex, record) && record.consumed == RECORD_PENDING) {
+        flash.write(readIndex * sizeof(Record) + offsetof(Record, consumed), &done, 1);
+        pending--;
+        count--;
+      }
+      readIndex = (readIndex + 1) % recordCount;
+    }
+  }
+
+  uint32_t size() const { return pending; }
+  uint32_t capacity() const { return recordCount; }
+  uint32_t droppedCount() const { return dropped; }
+
+ private:
+  static const uint8_t RECORD_PENDING = 0xFF;
+  static const uint8_t RECORD_CONSUMED = 0x00;
+
+  struct Record {
+    uint32_t sequence;
+    uint32_t timestamp;
+    uint16_t distance;
+    uint16_t waterLevel;
+    uint8_t flags;
+    uint8_t checksum;
+    uint8_t consumed;
+    uint8_t reserved;
+  };
+  static_assert(sizeof(Record) == 16, "Record must stay 16 bytes to fill sectors evenly");
+
+  static uint8_t checksum(const Record& record) {
+    const uint8_t* bytes = (const uint8_t*)&record;
+    uint8_t sum = 0x5A;
+    for (size_t i = 0; i < offsetof(Record, checksum); i++) {
+      sum = (uint8_t)((sum << 1) | (sum >> 7)) ^ bytes[i];
+    }
+    return sum;
+  }
+
+  bool readRecord(uint32_t index, Record& record) {
+    return flash.read(index * sizeof(Record), &record, sizeof(record)) &&
+           record.sequence != UINT32_MAX && record.checksum == checksum(record);
+  }
+
+  bool slotErased(uint32_t index) {
+    uint32_t sequence = 0;
+    flash.read(index * sizeof(Record), &sequence, sizeof(sequence));
+    return sequence == UINT32_MAX;
+  }
+
+  // Sector is about to be erased, forget entries that were not replayed
+  void dropSector(uint32_t firstIndex) {
+    bool readInSector = false;
+    for (uint32_t i = firstIndex; i < firstIndex + recordsPerSector; i++) {
+      Record record;
+      if (readRecord(i, record) && record.consumed == RECORD_PENDING) {
+        pending--;
+        dropped++;
+      }
+      readInSector |= (i == readIndex);
+    }
+    if (readInSector) {
+      readIndex = (firstIndex + recordsPerSector) % recordCount;
+    }
+  }
+
+  FlashRegion& flash;
+  uint32_t recordCount = 0;
+  uint32_t recordsPerSector = 1;
+  uint32_t writeIndex = 0;
+  uint32_t readIndex = 0;
+  uint32_t nextSequence = 0;
+  uint32_t firstSequence = 0;  // first sequence written in this boot
+  uint32_t pending = 0;
+  uint32_t dropped = 0;
+};
+
+// Records level events while offline and replays them in small batches
+// once the transport is back. Entries live in a RAM ring; when it is full
+// the oldest are moved to the flash journal if one is attached, otherwise
+// they are overwritten. Replay sends the flash entries first, so the order
+// is preserved.
+class OfflineJournal {
+ public:
+  explicit OfflineJournal(const TimeBase& timeBase, FlashJournal* spill = nullptr)
+      : timeBase(timeBase), spill(spill) {}
+
+  void setSpill(FlashJournal* flashJournal) {
+    spill = flashJournal;
+  }
+
+  // now ist der Messzeitpunkt (event.timestamp), nicht die Zeit der
+  // Aufnahme. Liefert true wenn der Wert aufgenommen wurde
+  bool record(uint32_t now, const LevelEvent& event) {
+    const bool changed = lastLevel < 0 || fabsf(event.waterLevel - lastLevel) >= JOURNAL_LEVEL_DEADBAND;
+    if (!event.refill && !changed && now - lastRecordTime < JOURNAL_HEARTBEAT) {
+      return false;
+    }
+
+    JournalEntry entry;
+    entry.timestamp = now;
+    entry.distance = event.distance;
+    entry.waterLevel = (uint16_t)lroundf(event.waterLevel * 10);
+    entry.flags = event.refill ? JOURNAL_REFILL : 0;
+    if (timeBase.synced()) {
+      entry.timestamp = timeBase.toEpoch(now);
+      entry.flags |= JOURNAL_EPOCH;
+    }
+
+    if (count == JOURNAL_RAM_ENTRIES) {
+      spillOldest();
+    }
+    ring[(start + count) % JOURNAL_RAM_ENTRIES] = entry;
+    count++;
+
+    lastLevel = event.waterLevel;
+    lastRecordTime = now;
+    return true;
+  }
+
+  // Publishes at most one batch per JOURNAL_REPLAY_INTERVAL, so the
+  // reconnect burst does not block the loop. A failed publish keeps the
+  // entries for the next call. Returns the number of replayed entries.
+  size_t replay(MqttTransport& transport, uint32_t now) {
+    if (empty() || !transport.connected() || now - lastReplayTime < JOURNAL_REPLAY_INTERVAL) {
+      return 0;
+    }
+    lastReplayTime = now;
+
+    JournalEntry batch[JOURNAL_BATCH_ENTRIES];
+    const bool fromSpill = spill != nullptr && spill->size() > 0;
+    size_t entries = fromSpill ? spill->peek(batch, JOURNAL_BATCH_ENTRIES) : peekRam(batch, JOURNAL_BATCH_ENTRIES);
+    if (entries == 0) {
+      return 0;
+    }
+
+    char payload[JOURNAL_BATCH_ENTRIES * JOURNAL_ENTRY_MAX_LENGTH + 3];
+    const size_t length = formatBatch(batch, entries, now, payload, sizeof(payload));
+    if (!transport.beginPublish(mqtt_topic_journal, length, false)) {
+      return 0;
+    }
+    transport.write((const uint8_t*)payload, length);
+    if (!transport.endPublish()) {
+      return 0;
+    }
+
+    if (fromSpill) {
+      spill->consume(entries);
+    } else {
+      start = (start + entries) % JOURNAL_RAM_ENTRIES;
+      count -= entries;
+    }
+    replayed += entries;
+    return entries;
+  }
+
+  // Format: [{"ts":..,"fuellstand":..,"distanz":..,"auffuellung":1},...],
+  // "alter" (s) statt "ts" solange die Uhrzeit unbekannt ist
+  size_t formatBatch(const JournalEntry* batch, size_t entries, uint32_t now, char* payload, size_t size) const {
+    size_t length = snprintf(payload, size, "[");
+    for (size_t i = 0; i < entries && length < size; i++) {
+      const JournalEntry& entry = batch[i];
+      char time[24] = "";
+      if (entry.flags & JOURNAL_EPOCH) {
+        snprintf(time, sizeof(time), "\"ts\":%lu,", (unsigned long)entry.timestamp);
+      } else if (!(entry.flags & JOURNAL_UNKNOWN) && timeBase.synced()) {
+        snprintf(time, sizeof(time), "\"ts\":%lu,", (unsigned long)timeBase.toEpoch(entry.timestamp));
+      } else if (!(entry.flags & JOURNAL_UNKNOWN)) {
+        snprintf(time, sizeof(time), "\"alter\":%lu,", (unsigned long)((now - entry.timestamp) / 1000));
+      }
+      length += snprintf(payload + length, size - length, "%s{%s\"fuellstand\":%u.%u,\"distanz\":%u%s}",
+                         i > 0 ? "," : "", time, entry.waterLevel / 10, entry.waterLevel % 10,
+                         entry.distance, (entry.flags & JOURNAL_REFILL) ? ",\"auffuellung\":1" : "");
+    }
+    if (length < size) {
+      length += snprintf(payload + length, size - length, "]");
+    }
+    return length < size ? length : size - 1;
+  }
+
+  bool empty() const {
+    return count == 0 && (spill == nullptr || spill->size() == 0);
+  }
+
+  uint32_t size() const {
+    return count + (spill != nullptr ? spill->size() : 0);
+  }
+
+  uint32_t droppedCount() const {
+    return dropped + (spill != nullptr ? spill->droppedCount() : 0);
+  }
+
+  uint32_t replayedCount() const {
+    return replayed;
+  }
+
+ private:
+  static const size_t JOURNAL_ENTRY_MAX_LENGTH = 72;
+
+  size_t peekRam(JournalEntry* batch, size_t max) const {
+    size_t entries = 0;
+    for (; entries < max && entries < count; entries++) {
+      batch[entries] = ring[(start + entries) % JOURNAL_RAM_ENTRIES];
+    }
+    return entries;
+  }
+
+  // Ältere Hälfte des Rings in den Flash verschieben, ohne Flash den ältesten verwerfen
+  void spillOldest() {
+    const uint32_t moving = spill != nullptr ? JOURNAL_RAM_ENTRIES / 2 : 1;
+    for (uint32_t i = 0; i < moving; i++) {
+      JournalEntry& entry = ring[start];
+      if (!(entry.flags & JOURNAL_EPOCH) && timeBase.synced()) {
+        entry.timestamp = timeBase.toEpoch(entry.timestamp);
+        entry.flags |= JOURNAL_EPOCH;
+      }
+      if (spill == nullptr || !spill->append(entry)) {
+        dropped++;
+      }
+      start = (start + 1) % JOURNAL_RAM_ENTRIES;
+      count--;
+    }
+  }
+
+  const TimeBase& timeBase;
+  FlashJournal* spill;
+  JournalEntry ring[JOURNAL_RAM_ENTRIES];
+  uint32_t start = 0;
+  uint32_t count = 0;
+  float lastLevel = -1;
+  uint32_t lastRecordTime = 0;
+  uint32_t lastReplayTime = 0;
+  uint32_t dropped = 0;
+  uint32_t replayed = 0;
+};
@@ -0,0 +1,183 @@
+// Scoped latency timers feeding log-scale histograms, compiled out with LATENCY_TRACKING 0
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifndef LATENCY_TRACKING
+#define LATENCY_TRACKING 1  // Mit -DLATENCY_TRACKING=0 entfallen Messung, Topic und HA Sensoren
+#endif
+
+constexpr char mqtt_topic_latency[] = "rocket/wasserstand/latenz";  // Laufzeiten im Hot Path
+const uint32_t LATENCY_REPORT_INTERVAL = 60000;  // Auswertung alle 60 s
+const size_t LATENCY_REPORT_SIZE = 512;          // Puffer für den Bericht
+
+// Messpunkte, jeder wird nur von einem Task geschrieben
+enum LatencyProbe : uint8_t {
+  PROBE_SENSOR_READ,   // Sensor-Task
+  PROBE_LEVEL,         // Verarbeitung: Filter und Umrechnung
+  PROBE_REFILL,        // Verarbeitung: Auffüllerkennung
+  PROBE_MQTT_PUBLISH,  // Netzwerk-Task
+  PROBE_LED_SHOW,      // LED-Task
+  PROBE_NVS,           // Netzwerk-Task
+  PROBE_COUNT
+};
+
+#if LATENCY_TRACKING
+#include <atomic>
+
+// Four buckets per power of two (at most 25 % wide), values below 4 us get
+// a bucket each. Everything from 2^22 us (about 4 s) on lands in the last
+// bucket.
+const uint8_t LATENCY_SUB_BUCKETS = 4;
+const uint8_t LATENCY_MAX_EXPONENT = 22;
+const uint8_t LATENCY_BUCKETS = LATENCY_SUB_BUCKETS + (LATENCY_MAX_EXPONENT - 2) * LATENCY_SUB_BUCKETS;
+
+struct LatencyWindow {
+  uint32_t count;
+  uint32_t p50;  // Obergrenze des Buckets in us
+  uint32_t p99;
+  uint32_t max;  // exakt in us
+};
+
+// One task records, another one takes windows. Counts only grow; take()
+// compares them with the copy from the previous call, so nothing is reset
+// under the writer's feet.
+class LatencyHistogram {
+ public:
+  void record(uint32_t micros) {
+    std::atomic<uint32_t>& bucket = counts[bucketOf(micros)];
+    bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    if (micros > windowMax.load(std::memory_order_relaxed)) {
+      windowMax.store(micros, std::memory_order_relaxed);
+    }
+  }
+
+  // Statistics since the previous call
+  LatencyWindow take() {
+    uint32_t window[LATENCY_BUCKETS];
+    uint32_t total = 0;
+    for (uint8_t i = 0; i < LATENCY_BUCKETS; i++) {
+      const uint32_t now = counts[i].load(std::memory_order_relaxed);
+      window[i] = now - taken[i];
+      taken[i] = now;
+      total += window[i];
+    }
+    return {total, percentile(window, total, 50), percentile(window, total, 99),
+            windowMax.exchange(0, std::memory_order_relaxed)};
+  }
+
+  static uint8_t bucketOf(uint32_t micros) {
+    if (micros < LATENCY_SUB_BUCKETS) {
+      return (uint8_t)micros;
+    }
+    const uint8_t exponent = 31 - __builtin_clz(micros);
+    if (exponent >= LATENCY_MAX_EXPONENT) {
+      return LATENCY_BUCKETS - 1;
+    }
+    const uint8_t sub = (micros >> (exponent - 2)) & (LATENCY_SUB_BUCKETS - 1);
+    return LATENCY_SUB_BUCKETS + (exponent - 2) * LATENCY_SUB_BUCKETS + sub;
+  }
+
+  static uint32_t upperBound(uint8_t bucket) {
+    if (bucket < LATENCY_SUB_BUCKETS) {
+      return bucket;
+    }
+    const uint8_t exponent = (bucket - LATENCY_SUB_BUCKETS) / LATENCY_SUB_BUCKETS + 2;
+    const uint32_t sub = (bucket - LATENCY_SUB_BUCKETS) % LATENCY_SUB_BUCKETS;
+    return ((LATENCY_SUB_BUCKETS + sub + 1) << (exponent - 2)) - 1;
+  }
+
+ private:
+  static uint32_t percentile(const uint32_t* window, uint32_t total, uint32_t percent) {
+    if (total == 0) {
+      return 0;
+    }
+    const uint32_t rank = (uint32_t)(((uint64_t)total * percent + 99) / 100);
+    uint32_t seen = 0;
+    for (uint8_t i = 0; i < LATENCY_BUCKETS; i++) {
+      seen += window[i];
+      if (seen >= rank) {
+        return upperBound(i);
+      }
+    }
+    return upperBound(LATENCY_BUCKETS - 1);
+  }
+
+  std::atomic<uint32_t> counts[LATENCY_BUCKETS] = {};
+  std::atomic<uint32_t> windowMax{0};
+  uint32_t taken[LATENCY_BUCKETS] = {};
+};
+
+inline LatencyHistogram latencyHistograms[PROBE_COUNT];
+inline const char* const latencyProbeNames[PROBE_COUNT] = {"sensor", "pegel", "auffuellung", "mqtt", "led", "nvs"};
+
+// Microsecond clock of the platform, nothing is recorded while unset
+inline uint32_t (*latencyMicros)() = nullptr;
+
+class LatencyScope {
+ public:
+  explicit LatencyScope(LatencyProbe probe) : probe(probe), start(latencyMicros ? latencyMicros() : 0) {}
+  ~LatencyScope() {
+    if (latencyMicros) {
+      latencyHistograms[probe].record(latencyMicros() - start);
+    }
+  }
+
+ private:
+  const LatencyProbe probe;
+  const uint32_t start;
+};
+
+// For spans that do not fit one scope, e.g. beginPublish() .. endPublish()
+class LatencySpan {
+ public:
+  void start() { begin = latencyMicros ? latencyMicros() : 0; }
+  void stop(LatencyProbe probe) {
+    if (latencyMicros) {
+      latencyHistograms[probe].record(latencyMicros() - begin);
+    }
+  }
+
+ private:
+  uint32_t begin = 0;
+};
+
+#define LATENCY_CONCAT_(a, b) a##b
+#define LATENCY_CONCAT(a, b) LATENCY_CONCAT_(a, b)
+#define LATENCY_SCOPE(probe) LatencyScope LATENCY_CONCAT(latencyScope, __LINE__)(probe)
+
+// {"sensor":{"n":..,"p50":..,"p99":..,"max":..},...}, returns the length or 0
+// if the buffer is too small. Takes a window from every histogram.
+inline size_t formatLatencyReport(char* out, size_t size) {
+  size_t length = 0;
+  for (uint8_t probe = 0; probe < PROBE_COUNT; probe++) {
+    const LatencyWindow window = latencyHistograms[probe].take();
+    const int written = snprintf(out + length, size - length, "%s\"%s\":{\"n\":%lu,\"p50\":%lu,\"p99\":%lu,\"max\":%lu}",
+                                 probe == 0 ? "{" : ",", latencyProbeNames[probe],
+                                 (unsigned long)window.count, (unsigned long)window.p50,
+                                 (unsigned long)window.p99, (unsigned long)window.max);
+    if (written < 0 || (size_t)written >= size - length) {
+      return 0;
+    }
+    length += written;
+  }
+  if (length + 2 > size) {
+    return 0;
+  }
+  out[length++] = '}';
+  out[length] = '\0';
+  return length;
+}
+
+#else
+
+class LatencySpan {
+ public:
+  void start() {}
+  void stop(LatencyProbe) {}
+};
+
+#define LATENCY_SCOPE(probe) ((void)0)
+
+#endif
@@ -0,0 +1,230 @@
+// LED ring rendering: level display with timed animation layers on top
+#pragma once
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <Hal.h>
+#include <WaterLevel.h>
+
+// LED Einstellungen
+const float LED_GAMMA = 2.6;                 // Wie Adafruit_NeoPixel::gamma8()
+const uint32_t LED_FRAME_INTERVAL = 20;      // Bildrate während Animationen (50 Hz)
+const uint32_t LED_FLASH_INTERVAL = 100;     // Blinken nach Auffüllung
+const uint8_t LED_FLASH_COUNT = 3;
+const uint32_t LED_PULSE_PERIOD = 2000;      // Access Point Modus
+const uint32_t LED_LEVEL_STEPS = 201;        // Füllstand in 0,5% Schritten
+
+// Commands from other tasks, applied by the task that owns the ring
+struct LedCommand {
+  enum Type : uint8_t {
+    LED_FILL,        // Ganzer Ring in einer Farbe für value ms, 0 = bis LED_CLEAR
+    LED_PROGRESS,    // Fortschritt value von total, z.B. OTA
+    LED_PULSE,       // Pulsieren bis LED_STOP_PULSE
+    LED_STOP_PULSE,
+    LED_CLEAR,       // Füllung und Fortschritt beenden
+    LED_REDRAW       // Ring wurde von außen verändert, nächstes Bild senden
+  };
+  Type type;
+  uint32_t color;
+  uint32_t value;
+  uint32_t total;
+};
+
+// Keeps the last frame that was sent and only calls show() when the new
+// frame differs, so a steady level costs no strip update. Colors are mixed
+// uncorrected and go through a gamma table on output; the level colors come
+// from a table built once in the constructor.
+//
+// Layers from top to bottom: fill, progress, flash, pulse, level. A layer
+// only covers the pixels it draws, e.g. the pulse uses every second pixel,
+// so the level stays visible in between. Nothing here waits; render() is
+// called per tick and nextFrameIn() says when the next animation frame is
+// due.
+template <uint16_t PIXELS>
+class LedCompositor {
+ public:
+  explicit LedCompositor(LedStrip& strip) : strip(strip) {
+    for (uint16_t i = 0; i < 256; i++) {
+      gamma[i] = (uint8_t)(powf(i / 255.0f, LED_GAMMA) * 255.0f + 0.5f);
+    }
+    for (uint16_t step = 0; step < LED_LEVEL_STEPS; step++) {
+      levelColors[step] = waterLevelColor(step * 100.0f / (LED_LEVEL_STEPS - 1));
+    }
+  }
+
+  // Basis: Füllstand in %, negativ = aus
+  void setLevel(float waterLevel) {
+    if (waterLevel < 0) {
+      level = LEVEL_OFF;
+      return;
+    }
+    const int32_t step = (int32_t)(waterLevel * (LED_LEVEL_STEPS - 1) / 100 + 0.5f);
+    level = step < 0 ? 0 : step >= (int32_t)LED_LEVEL_STEPS ? LED_LEVEL_STEPS - 1 : step;
+  }
+
+  // Blinken über allem außer Füllung und Fortschritt, z.B. nach Auffüllung
+  void flash(uint32_t color, uint8_t count, uint32_t interval, uint32_t now) {
+    flashColor = color;
+    flashStart = now;
+    flashInterval = interval;
+    flashEnd = now + 2 * count * interval;
+    flashActive = count > 0 && interval > 0;
+  }
+
+  void apply(const LedCommand& command, uint32_t now) {
+    switch (command.type) {
+      case LedCommand::LED_FILL:
+        fillColor = command.color;
+        fillEnd = now + command.value;
+        fillTimed = command.value > 0;
+        fillActive = true;
+        break;
+      case LedCommand::LED_PROGRESS:
+        progressColor = command.color;
+        progressPixels = command.total > 0 ? (uint16_t)((uint64_t)command.value * PIXELS / command.total) : 0;
+        progressActive = true;
+        fillActive = false;
+        break;
+      case LedCommand::LED_PULSE:
+        pulseColor = command.color;
+        pulseStart = now;
+        pulseActive = true;
+        break;
+      case LedCommand::LED_STOP_PULSE:
+        pulseActive = false;
+        break;
+      case LedCommand::LED_CLEAR:
+        fillActive = false;
+        progressActive = false;
+        break;
+      case LedCommand::LED_REDRAW:
+        shownValid = false;
+        break;
+    }
+  }
+
+  // Builds the frame for now and sends it if it changed.
+  // Returns true if show() was called.
+  bool render(uint32_t now) {
+    expire(now);
+
+    uint32_t frame[PIXELS];
+    for (uint16_t i = 0; i < PIXELS; i++) {
+      frame[i] = correct(pixelColor(i, now));
+    }
+
+    if (shownValid && memcmp(frame, shown, sizeof(frame)) == 0) {
+      skipped++;
+      return false;
+    }
+    for (uint16_t i = 0; i < PIXELS; i++) {
+      strip.setPixelColor(i, frame[i]);
+    }
+    strip.show();
+    memcpy(shown, frame, sizeof(frame));
+    shownValid = true;
+    shows++;
+    return true;
+  }
+
+  // Wartezeit bis zum nächsten Animationsbild, 0 = Bild ändert sich nur durch neue Werte
+  uint32_t nextFrameIn(uint32_t now) const {
+    if (pulseActive) {
+      return LED_FRAME_INTERVAL;
+    }
+    uint32_t wait = 0;
+    if (flashActive) {
+      const uint32_t intoPhase = (now - flashStart) % flashInterval;
+      wait = flashInterval - intoPhase;
+    }
+    if (fillActive && fillTimed) {
+      const int32_t remaining = (int32_t)(fillEnd - now);
+      const uint32_t fillWait = remaining > 0 ? remaining : 1;
+      wait = wait == 0 || fillWait < wait ? fillWait : wait;
+    }
+    return wait;
+  }
+
+  bool animating() const { return flashActive || pulseActive || (fillActive && fillTimed); }
+
+  uint32_t showCount() const { return shows; }
+  uint32_t skipCount() const { return skipped; }
+
+ private:
+  static constexpr uint16_t LEVEL_OFF = 0xFFFF;
+
+  void expire(uint32_t now) {
+    if (flashActive && (int32_t)(now - flashEnd) >= 0) {
+      flashActive = false;
+    }
+    if (fillActive && fillTimed && (int32_t)(now - fillEnd) >= 0) {
+      fillActive = false;
+    }
+  }
+
+  uint32_t pixelColor(uint16_t i, uint32_t now) const {
+    if (fillActive) {
+      return fillColor;
+    }
+    if (progressActive) {
+      return i < progressPixels ? progressColor : 0;
+    }
+    if (flashActive) {
+      // Gerade Phasen an, ungerade aus
+      return ((now - flashStart) / flashInterval) % 2 == 0 ? flashColor : 0;
+    }
+    if (pulseActive && i % 2 == 0) {
+      return scale(pulseColor, triangle(now - pulseStart, LED_PULSE_PERIOD));
+    }
+    return level == LEVEL_OFF ? 0 : levelColors[level];
+  }
+
+  // 0..255..0 über eine Periode
+  static uint8_t triangle(uint32_t elapsed, uint32_t period) {
+    const uint32_t phase = elapsed % period;
+    const uint32_t half = period / 2;
+    const uint32_t rising = phase < half ? phase : period - phase;
+    return (uint8_t)(rising * 255 / half);
+  }
+
+  static uint32_t scale(uint32_t color, uint8_t factor) {
+    const uint32_t red = ((color >> 16) & 0xFF) * factor / 255;
+    const uint32_t green = ((color >> 8) & 0xFF) * factor / 255;
+    const uint32_t blue = (color & 0xFF) * factor / 255;
+    return ledColor(red, green, blue);
+  }
+
+  uint32_t correct(uint32_t color) const {
+    return ledColor(gamma[(color >> 16) & 0xFF], gamma[(color >> 8) & 0xFF], gamma[color & 0xFF]);
+  }
+
+  LedStrip& strip;
+  uint8_t gamma[256];
+  uint32_t levelColors[LED_LEVEL_STEPS];
+  uint32_t shown[PIXELS] = {};
+  bool shownValid = false;
+
+  uint16_t level = LEVEL_OFF;
+
+  bool fillActive = false;
+  bool fillTimed = false;
+  uint32_t fillColor = 0;
+  uint32_t fillEnd = 0;
+
+  bool progressActive = false;
+  uint32_t progressColor = 0;
+  uint16_t progressPixels = 0;
+
+  bool flashActive = false;
+  uint32_t flashColor = 0;
+  uint32_t flashStart = 0;
+  uint32_t flashInterval = 1;
+  uint32_t flashEnd = 0;
+
+  bool pulseActive = false;
+  uint32_t pulseColor = 0;
+  uint32_t pulseStart = 0;
+
+  uint32_t shows = 0;
+  uint32_t skipped = 0;
+};
@@ -1,210 +1,217 @@
 // Homeassistant sensor config
-#include <string>
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string_view>
+#include <Latency.h>
 
 // Base topic
-const char* mqtt_topic_ha_base = "hass";
+constexpr char mqtt_topic_ha_base[] = "hass";
+constexpr char ha_node_id[] = "kaffeemaschine";
 
-// Concatenated topics
-std::string mqtt_topic_ha_auffuellungen = std::string(mqtt_topic_ha_base) + "/sensor/kaffeemaschine/auffuellungen/config";
-std::string mqtt_topic_ha_distanz = std::string(mqtt_topic_ha_base) + "/sensor/kaffeemaschine/distanz/config";
-std::string mqtt_topic_ha_fuellstand = std::string(mqtt_topic_ha_base) + "/sensor/kaffeemaschine/fuellstand/config";
-std::string mqtt_topic_ha_command = std::string(mqtt_topic_ha_base) + "/button/kaffeemaschine/resetauffuellungen/config";
-std::string mqtt_topic_ha_firmware = std::string(mqtt_topic_ha_base) + "/sensor/kaffeemaschine/firmware/config";
-std::string mqtt_topic_ha_min_mm = std::string(mqtt_topic_ha_base) + "/number/kaffeemaschine/min_mm/config";
-std::string mqtt_topic_ha_max_mm = std::string(mqtt_topic_ha_base) + "/number/kaffeemaschine/max_mm/config";
+// Blocks shared by all entities, stored once
+constexpr std::string_view ha_availability =
+    R"("availability":[{"topic":"rocket/wasserstand/status"}],"availability_mode":"all",)";
+constexpr std::string_view ha_device_origin =
+    R"("device":{"identifiers":["kaffeemaschine"],"manufacturer":"Rocket","model":"Appartemento","name":"Kaffeemaschine"},)"
+    R"("origin":{"name":"ESP32-C6","sw":"1.0.0","url":"https://wiki.seeedstudio.com/xiao_pin_multiplexing_esp33c6"},)"
+    R"("enabled_by_default":true,)";
 
-const char* mqtt_ha_config_auffuellungen = R"rawliteral({
-  "device": {
-    "identifiers": [
-      "kaffeemaschine"
-    ],
-    "manufacturer": "Rocket",
-    "model": "Appartemento",
-    "name": "Kaffeemaschine"
-  },
-  "enabled_by_default": true,
-  "object_id": "kaffeemaschine_auffuellungen",
-  "origin": {
-    "name": "ESP32-C6",
-    "sw": "1.0.0",
-    "url": "https://wiki.seeedstudio.com/xiao_pin_multiplexing_esp33c6"
-  },
-  "name": "Auffüllungen",
-  "icon": "mdi:counter",
-  "state_class": "measurement",
-  "state_topic": "rocket/wasserstand",
-  "unique_id": "kaffeemaschine_auffuellungen",
-  "unit_of_measurement": "",
-  "value_template": "{{ value_json.auffuellungen }}"
-})rawliteral";
+enum HaEntityFlags : uint8_t {
+  HA_NONE = 0,
+  HA_AVAILABILITY = 1,  // only available while the device is online
+};
 
-const char* mqtt_ha_config_distanz = R"rawliteral({
-  "device": {
-    "identifiers": [
-      "kaffeemaschine"
-    ],
-    "manufacturer": "Rocket",
-    "model": "Appartemento",
-    "name": "Kaffeemaschine"
-  },
-  "enabled_by_default": true,
-  "object_id": "kaffeemaschine_distanz",
-  "origin": {
-    "name": "ESP32-C6",
-    "sw": "1.0.0",
-    "url": "https://wiki.seeedstudio.com/xiao_pin_multiplexing_esp33c6"
-  },
-  "name": "Distanz",
-  "device-class": "distance",
-  "icon": "mdi:ruler",
-  "state_class": "measurement",
-  "state_topic": "rocket/wasserstand",
-  "unique_id": "kaffeemaschine_distanz",
-  "unit_of_measurement": "mm",
-  "value_template": "{{ value_json.distanz }}"
-})rawliteral";
+// One row per entity. The discovery topic is
+// <base>/<component>/<node>/<objectId>/config, object_id and unique_id are
+// <node>_<objectId>. fields holds the entity specific JSON members.
+struct HaEntity {
+  std::string_view component;
+  std::string_view objectId;
+  std::string_view name;
+  std::string_view category;
+  uint8_t flags;
+  std::string_view fields;
+};
 
-const char* mqtt_ha_config_fuellstand = R"rawliteral({
-  "device": {
-    "identifiers": [
-      "kaffeemaschine"
-    ],
-    "manufacturer": "Rocket",
-    "model": "Appartemento",
-    "name": "Kaffeemaschine"
-  },
-  "enabled_by_default": true,
-  "object_id": "kaffeemaschine_fuellstand",
-  "origin": {
-    "name": "ESP32-C6",
-    "sw": "1.0.0",
-    "url": "https://wiki.seeedstudio.com/xiao_pin_multiplexing_esp33c6"
-  },
-  "name": "Füllstand",
-  "device_class": "humidity",
-  "state_class": "measurement",
-  "state_topic": "rocket/wasserstand",
-  "unique_id": "kaffeemaschine_fuellstand",
-  "unit_of_measurement": "%",
-  "value_template": "{{ value_json.fuellstand }}"
-})rawliteral";
+// Entities of every tank, "~" is the tank topic rocket/<name>
+constexpr HaEntity ha_tank_entities[] = {
+  {"sensor", "auffuellungen", "Auffüllungen", "", HA_NONE,
+   R"("icon":"mdi:counter","state_class":"measurement","state_topic":"~",)"
+   R"("unit_of_measurement":"","value_template":"{{ value_json.auffuellungen }}")"},
+  {"sensor", "distanz", "Distanz", "", HA_NONE,
+   R"("device_class":"distance","icon":"mdi:ruler","state_class":"measurement",)"
+   R"("state_topic":"~","unit_of_measurement":"mm","value_template":"{{ value_json.distanz }}")"},
+  {"sensor", "fuellstand", "Füllstand", "", HA_NONE,
+   R"("device_class":"humidity","state_class":"measurement","state_topic":"~",)"
+   R"("unit_of_measurement":"%","value_template":"{{ value_json.fuellstand }}")"},
+  {"sensor", "bezuege", "Bezüge", "", HA_NONE,
+   R"("icon":"mdi:coffee","state_class":"total_increasing","state_topic":"~",)"
+   R"("value_template":"{{ value_json.bezuege }}")"},
+  {"sensor", "spuelungen", "Spülungen und Heißwasser", "", HA_NONE,
+   R"("icon":"mdi:water-pump","state_class":"total_increasing","state_topic":"~",)"
+   R"("value_template":"{{ value_json.spuelungen }}")"},
+  {"sensor", "letzte_entnahme", "Letzte Entnahme", "", HA_NONE,
+   R"("device_class":"volume","state_topic":"~","unit_of_measurement":"mL",)"
+   R"("value_template":"{{ value_json.letzte_entnahme_ml }}")"},
+  {"sensor", "verbrauch_24h", "Verbrauch 24 h", "", HA_NONE,
+   R"("device_class":"volume","state_class":"measurement","state_topic":"~",)"
+   R"("unit_of_measurement":"mL","value_template":"{{ value_json.verbrauch_24h_ml }}")"},
+  {"sensor", "verbrauch_rate", "Verbrauch pro Stunde", "", HA_NONE,
+   R"("icon":"mdi:water-minus","state_class":"measurement","state_topic":"~",)"
+   R"("unit_of_measurement":"mL/h","value_template":"{{ value_json.verbrauch_ml_h }}")"},
+  {"sensor", "leer_in", "Leer in", "", HA_NONE,
+   R"("device_class":"duration","state_topic":"~","unit_of_measurement":"h",)"
+   R"("value_template":"{{ value_json.leer_in_h }}")"},
+  {"button", "resetauffuellungen", "Auffüllungen zurücksetzen", "config", HA_AVAILABILITY,
+   R"("command_topic":"~/command","payload_press":"reset_refill_counter")"},
+  {"number", "min_mm", "Kalibrierung voll", "config", HA_AVAILABILITY,
+   R"("command_topic":"~/set/min_mm","state_topic":"~",)"
+   R"("value_template":"{{ value_json.min_mm }}","unit_of_measurement":"mm","mode":"box","min":0,"max":2000,"step":1)"},
+  {"number", "max_mm", "Kalibrierung leer", "config", HA_AVAILABILITY,
+   R"("command_topic":"~/set/max_mm","state_topic":"~",)"
+   R"("value_template":"{{ value_json.max_mm }}","unit_of_measurement":"mm","mode":"box","min":0,"max":2000,"step":1)"},
+};
 
-const char* mqtt_ha_config_command = R"rawliteral({
-  "availability": [
-    {
-      "topic": "rocket/wasserstand/status"
-    }
-  ],
-  "availability_mode": "all",
-  "device": {
-    "identifiers": [
-      "kaffeemaschine"
-    ],
-    "manufacturer": "Rocket",
-    "model": "Appartemento",
-    "name": "Kaffeemaschine"
-  },
-  "enabled_by_default": true,
-  "entity_category": "config",
-  "object_id": "kaffeemaschine_resetauffuellungen",
-  "origin": {
-    "name": "ESP32-C6",
-    "sw": "1.0.0",
-    "url": "https://wiki.seeedstudio.com/xiao_pin_multiplexing_esp33c6"
-  },
-  "name": "Auffüllungen zurücksetzen",
-  "command_topic": "rocket/wasserstand/command",
-  "unique_id": "kaffeemaschine_resetauffuellungen",
-  "payload_press": "reset_refill_counter"
-})rawliteral";
+// Entities of the controller, published with the first tank
+constexpr HaEntity ha_device_entities[] = {
+  {"sensor", "firmware", "Firmware", "diagnostic", HA_NONE,
+   R"("state_topic":"rocket/wasserstand","value_template":"{{ value_json.firmware }}")"},
+  {"sensor", "nvs_schreibzugriffe", "NVS Schreibzugriffe", "diagnostic", HA_NONE,
+   R"("icon":"mdi:content-save","state_class":"total_increasing","state_topic":"rocket/wasserstand",)"
+   R"("value_template":"{{ value_json.nvs_schreibzugriffe }}")"},
+  {"sensor", "sensor_timeouts", "Sensor Timeouts", "diagnostic", HA_NONE,
+   R"("icon":"mdi:timer-alert","state_class":"total_increasing","state_topic":"rocket/wasserstand",)"
+   R"("value_template":"{{ value_json.sensor_timeouts }}")"},
+  {"sensor", "i2c_recoveries", "I2C Recoveries", "diagnostic", HA_NONE,
+   R"("icon":"mdi:restart-alert","state_class":"total_increasing","state_topic":"rocket/wasserstand",)"
+   R"("value_template":"{{ value_json.i2c_recoveries }}")"},
+  {"sensor", "mqtt_fehlversuche", "MQTT Fehlversuche", "diagnostic", HA_NONE,
+   R"("icon":"mdi:lan-disconnect","state_class":"total_increasing","state_topic":"rocket/wasserstand",)"
+   R"("value_template":"{{ value_json.mqtt_fehlversuche }}")"},
+  {"sensor", "mqtt_ausfall", "Letzter MQTT Ausfall", "diagnostic", HA_NONE,
+   R"("device_class":"duration","state_topic":"rocket/wasserstand","unit_of_measurement":"s",)"
+   R"("value_template":"{{ value_json.mqtt_ausfall_s }}")"},
+  {"sensor", "boot_wlan", "Boot bis WLAN", "diagnostic", HA_NONE,
+   R"("device_class":"duration","state_topic":"rocket/wasserstand","unit_of_measurement":"ms",)"
+   R"("value_template":"{{ value_json.boot_wlan_ms }}")"},
+  {"sensor", "boot_mqtt", "Boot bis MQTT", "diagnostic", HA_NONE,
+   R"("device_class":"duration","state_topic":"rocket/wasserstand","unit_of_measurement":"ms",)"
+   R"("value_template":"{{ value_json.boot_mqtt_ms }}")"},
+  {"sensor", "boot_erster_wert", "Boot bis erster Wert", "diagnostic", HA_NONE,
+   R"("device_class":"duration","state_topic":"rocket/wasserstand","unit_of_measurement":"ms",)"
+   R"("value_template":"{{ value_json.boot_erster_wert_ms }}")"},
+  {"sensor", "heap_frei", "Heap frei", "diagnostic", HA_NONE,
+   R"("device_class":"data_size","state_class":"measurement","state_topic":"rocket/wasserstand",)"
+   R"("unit_of_measurement":"B","value_template":"{{ value_json.heap_frei }}")"},
+  {"sensor", "heap_min_frei", "Heap Minimum", "diagnostic", HA_NONE,
+   R"("device_class":"data_size","state_class":"measurement","state_topic":"rocket/wasserstand",)"
+   R"("unit_of_measurement":"B","value_template":"{{ value_json.heap_min_frei }}")"},
+  {"sensor", "heap_groesster_block", "Heap größter Block", "diagnostic", HA_NONE,
+   R"("device_class":"data_size","state_class":"measurement","state_topic":"rocket/wasserstand",)"
+   R"("unit_of_measurement":"B","value_template":"{{ value_json.heap_groesster_block }}")"},
+#if LATENCY_TRACKING
+  {"sensor", "latenz_sensor_p99", "Latenz Sensor lesen p99", "diagnostic", HA_NONE,
+   R"("icon":"mdi:timer-outline","state_class":"measurement","state_topic":"rocket/wasserstand/latenz",)"
+   R"("unit_of_measurement":"µs","value_template":"{{ value_json.sensor.p99 }}")"},
+  {"sensor", "latenz_pegel_p99", "Latenz Füllstand berechnen p99", "diagnostic", HA_NONE,
+   R"("icon":"mdi:timer-outline","state_class":"measurement","state_topic":"rocket/wasserstand/latenz",)"
+   R"("unit_of_measurement":"µs","value_template":"{{ value_json.pegel.p99 }}")"},
+  {"sensor", "latenz_auffuellung_p99", "Latenz Auffüllerkennung p99", "diagnostic", HA_NONE,
+   R"("icon":"mdi:timer-outline","state_class":"measurement","state_topic":"rocket/wasserstand/latenz",)"
+   R"("unit_of_measurement":"µs","value_template":"{{ value_json.auffuellung.p99 }}")"},
+  {"sensor", "latenz_mqtt_p99", "Latenz MQTT senden p99", "diagnostic", HA_NONE,
+   R"("icon":"mdi:timer-outline","state_class":"measurement","state_topic":"rocket/wasserstand/latenz",)"
+   R"("unit_of_measurement":"µs","value_template":"{{ value_json.mqtt.p99 }}")"},
+  {"sensor", "latenz_led_p99", "Latenz LED Ring senden p99", "diagnostic", HA_NONE,
+   R"("icon":"mdi:timer-outline","state_class":"measurement","state_topic":"rocket/wasserstand/latenz",)"
+   R"("unit_of_measurement":"µs","value_template":"{{ value_json.led.p99 }}")"},
+  {"sensor", "latenz_nvs_p99", "Latenz NVS Zugriff p99", "diagnostic", HA_NONE,
+   R"("icon":"mdi:timer-outline","state_class":"measurement","state_topic":"rocket/wasserstand/latenz",)"
+   R"("unit_of_measurement":"µs","value_template":"{{ value_json.nvs.p99 }}")"},
+#endif
+};
 
-const char* mqtt_ha_config_firmware = R"rawliteral({
-  "device": {
-    "identifiers": [
-      "kaffeemaschine"
-    ],
-    "manufacturer": "Rocket",
-    "model": "Appartemento",
-    "name": "Kaffeemaschine"
-  },
-  "enabled_by_default": true,
-  "entity_category": "diagnostic",
-  "object_id": "kaffeemaschine_firmware",
-  "origin": {
-    "name": "ESP32-C6",
-    "sw": "1.0.0",
-    "url": "https://wiki.seeedstudio.com/xiao_pin_multiplexing_esp33c6"
-  },
-  "name": "Firmware",
-  "state_topic": "rocket/wasserstand",
-  "unique_id": "kaffeemaschine_firmware",
-  "value_template": "{{ value_json.firmware }}"
-})rawliteral";
+// Names an entity table is published under. The first tank and the
+// controller use no prefix, so their entities keep the ids of the
+// single-tank firmware. topic is the "~" base of tank entities.
+struct HaInstance {
+  std::string_view objectPrefix;  // vor objectId, z.B. "tropfschale_"
+  std::string_view label;         // vor dem Namen, z.B. "Tropfschale"
+  std::string_view topic;
+};
 
-const char* mqtt_ha_config_min_mm = R"rawliteral({
-  "availability": [
-    {
-      "topic": "rocket/wasserstand/status"
-    }
-  ],
-  "availability_mode": "all",
-  "device": {
-    "identifiers": [
-      "kaffeemaschine"
-    ],
-    "manufacturer": "Rocket",
-    "model": "Appartemento",
-    "name": "Kaffeemaschine"
-  },
-  "enabled_by_default": true,
-  "entity_category": "config",
-  "object_id": "kaffeemaschine_min_mm",
-  "origin": {
-    "name": "ESP32-C6",
-    "sw": "1.0.0",
-    "url": "https://wiki.seeedstudio.com/xiao_pin_multiplexing_esp33c6"
-  },
-  "name": "Kalibrierung voll",
-  "command_topic": "rocket/wasserstand/set/min_mm",
-  "state_topic": "rocket/wasserstand/min_mm",
-  "unique_id": "kaffeemaschine_min_mm",
-  "unit_of_measurement": "mm",
-  "mode": "box",
-  "min": 0,
-  "max": 2000,
-  "step": 1
-})rawliteral";
+const size_t HA_PREFIX_MAX_LENGTH = 16;  // längster objectPrefix
 
-const char* mqtt_ha_config_max_mm = R"rawliteral({
-  "availability": [
-    {
-      "topic": "rocket/wasserstand/status"
-    }
-  ],
-  "availability_mode": "all",
-  "device": {
-    "identifiers": [
-      "kaffeemaschine"
-    ],
-    "manufacturer": "Rocket",
-    "model": "Appartemento",
-    "name": "Kaffeemaschine"
-  },
-  "enabled_by_default": true,
-  "entity_category": "config",
-  "object_id": "kaffeemaschine_max_mm",
-  "origin": {
-    "name": "ESP32-C6",
-    "sw": "1.0.0",
-    "url": "https://wiki.seeedstudio.com/xiao_pin_multiplexing_esp33c6"
-  },
-  "name": "Kalibrierung leer",
-  "command_topic": "rocket/wasserstand/set/max_mm",
-  "state_topic": "rocket/wasserstand/max_mm",
-  "unique_id": "kaffeemaschine_max_mm",
-  "unit_of_measurement": "mm",
-  "mode": "box",
-  "min": 0,
-  "max": 2000,
-  "step": 1
-})rawliteral";
+// Writes the discovery document in parts, write(std::string_view) is called
+// once per part. Also used to compute the length.
+template <typename Writer>
+constexpr void writeHaDiscovery(const HaEntity& entity, const HaInstance& instance, Writer&& write) {
+  write("{");
+  if (!instance.topic.empty()) {
+    write(R"("~":")");
+    write(instance.topic);
+    write(R"(",)");
+  }
+  if (entity.flags & HA_AVAILABILITY) {
+    write(ha_availability);
+  }
+  write(ha_device_origin);
+  if (!entity.category.empty()) {
+    write(R"("entity_category":")");
+    write(entity.category);
+    write(R"(",)");
+  }
+  write(R"("object_id":")");
+  write(ha_node_id);
+  write("_");
+  write(instance.objectPrefix);
+  write(entity.objectId);
+  write(R"(","unique_id":")");
+  write(ha_node_id);
+  write("_");
+  write(instance.objectPrefix);
+  write(entity.objectId);
+  write(R"(","name":")");
+  if (!instance.label.empty()) {
+    write(instance.label);
+    write(" ");
+  }
+  write(entity.name);
+  write(R"(",)");
+  write(entity.fields);
+  write("}");
+}
+
+constexpr size_t haDiscoveryLength(const HaEntity& entity, const HaInstance& instance) {
+  size_t length = 0;
+  writeHaDiscovery(entity, instance, [&length](std::string_view part) { length += part.size(); });
+  return length;
+}
+
+constexpr size_t haTopicLength(const HaEntity& entity) {
+  return std::string_view(mqtt_topic_ha_base).size() + 1 + entity.component.size() + 1 +
+         std::string_view(ha_node_id).size() + 1 + entity.objectId.size() + sizeof("/config") - 1;
+}
+
+template <size_t N>
+constexpr size_t haMaxTopicLength(const HaEntity (&entities)[N]) {
+  size_t length = 0;
+  for (const HaEntity& entity : entities) {
+    length = haTopicLength(entity) > length ? haTopicLength(entity) : length;
+  }
+  return length;
+}
+
+constexpr size_t HA_TOPIC_MAX_LENGTH =
+    (haMaxTopicLength(ha_tank_entities) > haMaxTopicLength(ha_device_entities) ? haMaxTopicLength(ha_tank_entities)
+                                                                                : haMaxTopicLength(ha_device_entities)) +
+    HA_PREFIX_MAX_LENGTH;
+
+inline size_t haDiscoveryTopic(const HaEntity& entity, const HaInstance& instance, char* topic, size_t size) {
+  return snprintf(topic, size, "%s/%.*s/%s/%.*s%.*s/config", mqtt_topic_ha_base,
+                  (int)entity.component.size(), entity.component.data(), ha_node_id,
+                  (int)instance.objectPrefix.size(), instance.objectPrefix.data(),
+                  (int)entity.objectId.size(), entity.objectId.data());
+}
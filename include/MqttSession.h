@@ -0,0 +1,154 @@
+// MQTT connection state with exponential backoff, shared by the firmware and the host build
+#pragma once
+#include <stdint.h>
+#include <Hal.h>
+
+// Reconnect Einstellungen
+const uint32_t MQTT_BACKOFF_MIN = 1000;   // Erster Reconnect-Versuch nach 0,5 - 1 s
+const uint32_t MQTT_BACKOFF_MAX = 60000;  // Abstand wächst bis maximal 30 - 60 s
+
+typedef uint32_t (*RandomSource)();
+
+// Doubles the delay per failed attempt up to maxMs. Half of the delay is
+// random ("equal jitter"), so several devices do not hit a restarted
+// broker at the same moment.
+class ReconnectBackoff {
+ public:
+  ReconnectBackoff(uint32_t minMs, uint32_t maxMs, RandomSource random)
+      : minMs(minMs), maxMs(maxMs), random(random) {}
+
+  uint32_t next() {
+    uint32_t delay = minMs;
+    for (uint8_t i = 0; i < failures && delay < maxMs; i++) {
+      delay *= 2;
+    }
+    if (delay > maxMs) {
+      delay = maxMs;
+    }
+    if (failures < 32) {
+      failures++;
+    }
+    return delay / 2 + random() % (delay / 2 + 1);
+  }
+
+  void reset() { failures = 0; }
+
+ private:
+  const uint32_t minMs;
+  const uint32_t maxMs;
+  RandomSource random;
+  uint8_t failures = 0;
+};
+
+struct MqttSessionStats {
+  uint32_t attempts;
+  uint32_t failures;
+  uint32_t disconnects;
+  uint32_t lastAttemptMs;  // Dauer des letzten Verbindungsversuchs
+  uint32_t maxAttemptMs;
+  uint32_t lastOutageMs;   // Dauer der letzten Unterbrechung bis wieder online
+};
+
+// Tracks the connection, the caller performs the actual work:
+//
+// WAITING    -> CONNECTING attemptDue() once the backoff delay has passed
+// CONNECTING -> SETUP      connectFinished(true)
+// CONNECTING -> WAITING    connectFinished(false), next delay from the backoff
+// SETUP      -> ONLINE     after setupSteps calls of nextStep(), one per tick
+// SETUP/ONLINE -> WAITING  lost()
+class MqttSession {
+ public:
+  enum State : uint8_t { SESSION_WAITING, SESSION_CONNECTING, SESSION_SETUP, SESSION_ONLINE };
+
+  MqttSession(Clock& clock, RandomSource random, uint8_t setupSteps)
+      : clock(clock), backoff(MQTT_BACKOFF_MIN, MQTT_BACKOFF_MAX, random), setupSteps(setupSteps) {}
+
+  // True when a connection attempt should start now
+  bool attemptDue() {
+    if (current != SESSION_WAITING) {
+      return false;
+    }
+    const uint32_t now = clock.millis();
+    if ((int32_t)(now - nextAttempt) < 0) {
+      return false;
+    }
+    current = SESSION_CONNECTING;
+    attemptStart = now;
+    stats.attempts++;
+    return true;
+  }
+
+  void connectFinished(bool connected) {
+    if (current != SESSION_CONNECTING) {
+      return;
+    }
+    const uint32_t now = clock.millis();
+    stats.lastAttemptMs = now - attemptStart;
+    if (stats.lastAttemptMs > stats.maxAttemptMs) {
+      stats.maxAttemptMs = stats.lastAttemptMs;
+    }
+    if (connected) {
+      current = SESSION_SETUP;
+      step = 0;
+      return;
+    }
+    stats.failures++;
+    current = SESSION_WAITING;
+    nextAttempt = now + backoff.next();
+  }
+
+  uint8_t setupStep() const { return step; }
+
+  // Returns true when the last step is done and the session is online
+  bool nextStep() {
+    if (current != SESSION_SETUP) {
+      return current == SESSION_ONLINE;
+    }
+    if (++step < setupSteps) {
+      return false;
+    }
+    current = SESSION_ONLINE;
+    backoff.reset();
+    if (offline) {
+      stats.lastOutageMs = clock.millis() - offlineSince;
+      offline = false;
+    }
+    return true;
+  }
+
+  void lost() {
+    if (current != SESSION_SETUP && current != SESSION_ONLINE) {
+      return;
+    }
+    const uint32_t now = clock.millis();
+    stats.disconnects++;
+    if (!offline) {
+      offline = true;
+      offlineSince = now;
+    }
+    current = SESSION_WAITING;
+    nextAttempt = now + backoff.next();
+  }
+
+  State state() const { return current; }
+  bool online() const { return current == SESSION_ONLINE; }
+  const MqttSessionStats& statistics() const { return stats; }
+
+  // Verbleibende Wartezeit bis zum nächsten Versuch
+  uint32_t retryIn() const {
+    const int32_t remaining = (int32_t)(nextAttempt - clock.millis());
+    return current == SESSION_WAITING && remaining > 0 ? remaining : 0;
+  }
+
+ private:
+  Clock& clock;
+  ReconnectBackoff backoff;
+  const uint8_t setupSteps;
+  State current = SESSION_WAITING;
+  uint8_t step = 0;
+  uint32_t nextAttempt = 0;
+  uint32_t attemptStart = 0;
+  uint32_t offlineSince = 0;
+  bool offline = true;  // bis zur ersten Verbindung
+  MqttSessionStats stats = {};
+};
@@ -0,0 +1,82 @@
+// Generiert von scripts/build_portal.py aus web/, nicht von Hand ändern
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// index.html: 2689 Bytes, komprimiert 1137 Bytes
+const uint8_t PORTAL_INDEX_GZ[] = {
+  0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x9d, 0x56, 0xdb, 0x72, 0xdb, 0x36,
+  0x10, 0x7d, 0xcf, 0x57, 0x6c, 0x99, 0xe9, 0x48, 0x9e, 0x5a, 0x37, 0x5b, 0xae, 0x6d, 0xdd, 0x3a,
+  0xae, 0x9d, 0xb6, 0x9e, 0xba, 0x89, 0x27, 0x72, 0x9b, 0x69, 0x3b, 0x79, 0x00, 0x89, 0xa5, 0x88,
+  0x9a, 0x04, 0x58, 0x00, 0x94, 0xac, 0x64, 0xfc, 0x37, 0xfd, 0x93, 0xfe, 0x58, 0x17, 0x20, 0x25,
+  0x52, 0x76, 0xdc, 0x3a, 0xd5, 0x8b, 0x70, 0xd9, 0x3d, 0x7b, 0xf6, 0x0a, 0x4e, 0xbe, 0xb8, 0x78,
+  0x73, 0x7e, 0xf3, 0xeb, 0xf5, 0x2b, 0xf8, 0xe1, 0xe6, 0xa7, 0xab, 0xd9, 0x8b, 0x49, 0x62, 0xb3,
+  0xd4, 0xfd, 0x21, 0xe3, 0xb3, 0x17, 0x40, 0xbf, 0x49, 0x86, 0x96, 0x81, 0x64, 0x19, 0x4e, 0x83,
+  0xa5, 0xc0, 0x55, 0xae, 0xb4, 0x0d, 0x20, 0x52, 0xd2, 0xa2, 0xb4, 0xd3, 0x60, 0x25, 0xb8, 0x4d,
+  0xa6, 0x1c, 0x97, 0x22, 0xc2, 0x8e, 0xdf, 0xec, 0x83, 0x90, 0xc2, 0x0a, 0x96, 0x76, 0x4c, 0xc4,
+  0x52, 0x9c, 0x0e, 0x82, 0x0a, 0xc8, 0x0a, 0x9b, 0xe2, 0xec, 0xad, 0x8a, 0x6e, 0xd1, 0xc2, 0xbb,
+  0xab, 0xb3, 0xd7, 0xf0, 0xa3, 0x92, 0xb1, 0x58, 0x14, 0x9a, 0x59, 0xa1, 0xe4, 0xa4, 0x57, 0x0a,
+  0x94, 0xc2, 0xc6, 0xae, 0x37, 0x6b, 0xf7, 0x0b, 0x15, 0x5f, 0xc3, 0x47, 0x88, 0xc9, 0x6c, 0x27,
+  0x66, 0x99, 0x48, 0xd7, 0x23, 0x38, 0xd3, 0x64, 0x64, 0x1f, 0x0c, 0x93, 0xa6, 0x63, 0x50, 0x8b,
+  0x78, 0x0c, 0x19, 0xbb, 0x2b, 0x49, 0x8c, 0xe0, 0xa8, 0xdf, 0xcf, 0xef, 0xdc, 0x89, 0x5e, 0x08,
+  0x39, 0x82, 0x3e, 0xb0, 0xc2, 0xaa, 0x31, 0xe4, 0x8c, 0x73, 0x21, 0x17, 0x23, 0x38, 0xf0, 0xd7,
+  0xf7, 0x5b, 0x0b, 0xc9, 0x80, 0xf0, 0x23, 0x95, 0x2a, 0x3d, 0x82, 0x97, 0x87, 0x87, 0x87, 0x63,
+  0xb0, 0x78, 0x67, 0x3b, 0x2c, 0x15, 0x0b, 0x52, 0x8f, 0xc8, 0x59, 0xd4, 0x4d, 0xf9, 0x6e, 0xac,
+  0x74, 0xd6, 0x59, 0x68, 0x55, 0xe4, 0xa4, 0x58, 0x9a, 0xe9, 0x84, 0xca, 0x5a, 0x95, 0x8d, 0x60,
+  0x70, 0xb4, 0x0b, 0x9e, 0xb2, 0x10, 0x53, 0x12, 0xe3, 0xc2, 0xe4, 0x29, 0x23, 0xee, 0x61, 0x4a,
+  0x61, 0x18, 0x3f, 0x54, 0xf3, 0x5a, 0xde, 0xc7, 0x15, 0x8a, 0x45, 0x62, 0x49, 0x4e, 0xa5, 0xbc,
+  0x09, 0x24, 0x64, 0x5e, 0xd8, 0xdf, 0xed, 0x3a, 0xa7, 0x6c, 0x38, 0x7e, 0xc1, 0xfb, 0xfd, 0x9d,
+  0xb3, 0x9c, 0x19, 0xb3, 0x52, 0x9a, 0x07, 0xef, 0xc9, 0x5a, 0x15, 0x89, 0x41, 0xbf, 0xff, 0x65,
+  0xc3, 0xf1, 0x13, 0x67, 0x24, 0x54, 0x77, 0x1d, 0x23, 0x3e, 0xf8, 0x83, 0x90, 0xe4, 0x51, 0x13,
+  0x09, 0x7f, 0xee, 0xd6, 0xa4, 0x93, 0xdf, 0x81, 0x51, 0xa9, 0xe0, 0xf0, 0x92, 0x73, 0xbe, 0x39,
+  0xef, 0x68, 0xc6, 0x45, 0x61, 0x46, 0x30, 0xdc, 0x75, 0x2f, 0x2c, 0x88, 0xbf, 0x24, 0x8b, 0x21,
+  0x8b, 0x6e, 0x5d, 0x48, 0x24, 0xef, 0x6c, 0x42, 0x39, 0x3c, 0x3f, 0xfb, 0xee, 0xa8, 0x3f, 0xde,
+  0x84, 0x76, 0x95, 0x08, 0x8b, 0x0d, 0x36, 0x03, 0x4a, 0x43, 0x15, 0xae, 0x8d, 0x6d, 0xa9, 0x24,
+  0x7e, 0xda, 0x62, 0x54, 0x68, 0xe3, 0x40, 0x72, 0x25, 0xca, 0x74, 0xec, 0x78, 0xf8, 0x90, 0xcf,
+  0x28, 0x51, 0x4b, 0xd4, 0x4f, 0xb0, 0x3a, 0x62, 0xfd, 0xe1, 0xe9, 0x4e, 0x3e, 0x8d, 0x65, 0xb6,
+  0x30, 0x24, 0xbe, 0xc3, 0xad, 0xae, 0x20, 0xcf, 0xb4, 0xff, 0x5f, 0xa1, 0xe8, 0x9a, 0x22, 0x8a,
+  0xd0, 0x98, 0x4f, 0x9b, 0xe5, 0x71, 0xdc, 0xe7, 0x27, 0xe3, 0xba, 0xce, 0xa2, 0xe3, 0xaf, 0x0f,
+  0x77, 0x12, 0xdc, 0x45, 0xad, 0xd5, 0x13, 0xa4, 0xe3, 0x03, 0x8e, 0x1c, 0x6b, 0x6d, 0x76, 0x3a,
+  0x1c, 0x0e, 0x0f, 0x76, 0xb4, 0x85, 0x8c, 0xd5, 0x13, 0xa6, 0x4f, 0x91, 0xc7, 0xc7, 0x0d, 0xd3,
+  0x83, 0xe3, 0xfe, 0x49, 0xbc, 0x51, 0x9e, 0xf4, 0xaa, 0x86, 0x9b, 0xf4, 0xca, 0xd6, 0x9f, 0xb8,
+  0x8e, 0xab, 0x7a, 0x31, 0x19, 0xfc, 0x5b, 0xd7, 0xd2, 0x6d, 0x29, 0xc6, 0xc5, 0x12, 0xa2, 0x94,
+  0x0a, 0x70, 0x1a, 0x54, 0xb1, 0x74, 0x6c, 0x82, 0xba, 0x89, 0x7f, 0x41, 0x1d, 0x0a, 0xc9, 0x51,
+  0xc2, 0x5c, 0x20, 0x18, 0x11, 0x25, 0x90, 0x09, 0x0b, 0x1c, 0xb3, 0x12, 0x38, 0x28, 0xad, 0x74,
+  0xce, 0xbd, 0x81, 0x00, 0x8a, 0x8c, 0x1a, 0x06, 0x0d, 0xc2, 0x1c, 0xa9, 0x68, 0xe0, 0x43, 0x01,
+  0x14, 0x1c, 0x24, 0x35, 0x94, 0xdd, 0x49, 0xa8, 0x6b, 0xe0, 0xb3, 0x5b, 0x5b, 0x60, 0x9a, 0x22,
+  0x5c, 0x5e, 0x8f, 0x68, 0x74, 0xe4, 0x4c, 0x82, 0xe0, 0xd3, 0x40, 0xe4, 0xc1, 0xac, 0x43, 0x9e,
+  0xd1, 0x7e, 0xb6, 0x23, 0xef, 0xac, 0x35, 0x05, 0x57, 0x29, 0x93, 0xb5, 0x68, 0x15, 0x10, 0x72,
+  0xa7, 0x5a, 0xba, 0x4e, 0x07, 0x16, 0x39, 0x77, 0xa7, 0x41, 0xcf, 0xb0, 0x25, 0x06, 0x40, 0x53,
+  0x31, 0x51, 0xa4, 0x7a, 0xfd, 0x66, 0x7e, 0xd3, 0x70, 0xb1, 0x19, 0x84, 0x7a, 0x40, 0x34, 0x04,
+  0xbc, 0x50, 0x39, 0x0e, 0xe8, 0x9e, 0x22, 0x65, 0x04, 0x0f, 0x66, 0xde, 0xfd, 0xf9, 0xfc, 0xf2,
+  0x62, 0x34, 0xe9, 0xf9, 0xcb, 0x07, 0x0a, 0xbe, 0xc5, 0xa1, 0xd1, 0xf6, 0x9e, 0xb6, 0xd7, 0xad,
+  0x46, 0x73, 0xb9, 0xd6, 0xf8, 0x67, 0x21, 0x34, 0xf2, 0x06, 0xa1, 0xda, 0x8f, 0xff, 0xc5, 0x6f,
+  0x3b, 0x50, 0x4a, 0x8e, 0xd7, 0xe5, 0xd6, 0x3e, 0x83, 0xe7, 0x56, 0xd3, 0x73, 0xad, 0x77, 0x25,
+  0xdf, 0x1a, 0xf7, 0x49, 0xaa, 0xd5, 0x54, 0x29, 0xd1, 0x4c, 0x11, 0x52, 0xad, 0x04, 0xb3, 0x79,
+  0xee, 0x0b, 0x40, 0x4b, 0xa0, 0xe2, 0x06, 0x89, 0x05, 0x50, 0xad, 0x69, 0x7a, 0x8b, 0x26, 0xbd,
+  0x52, 0x7e, 0x93, 0x3e, 0xe7, 0x5d, 0xa3, 0x30, 0x1d, 0x87, 0x8c, 0xfa, 0x92, 0x2d, 0x28, 0x79,
+  0x3b, 0x55, 0x1a, 0x80, 0x2f, 0xfd, 0x69, 0xb0, 0x1d, 0xce, 0x7e, 0x00, 0x05, 0xb3, 0x66, 0x09,
+  0x98, 0x48, 0x8b, 0xdc, 0xd6, 0xe4, 0x7a, 0x3d, 0xf8, 0x8d, 0x46, 0x34, 0x95, 0xa6, 0xc7, 0xc8,
+  0x30, 0xe5, 0x85, 0x5c, 0xc0, 0x0a, 0xa5, 0x84, 0xa5, 0xd2, 0x09, 0x73, 0x65, 0xbe, 0x95, 0xa6,
+  0xd7, 0xd2, 0x58, 0x28, 0x74, 0x7a, 0xcd, 0x34, 0xcb, 0x0c, 0x4c, 0x89, 0xf8, 0x0a, 0x7e, 0x7e,
+  0x7b, 0x35, 0x47, 0xa6, 0xa3, 0xa4, 0x3c, 0x6d, 0xaf, 0xa8, 0x37, 0xd4, 0xaa, 0x4b, 0x2f, 0x83,
+  0xef, 0xac, 0xae, 0xf1, 0x97, 0x7b, 0xe3, 0x07, 0x30, 0x95, 0x17, 0x04, 0xb2, 0x05, 0xec, 0x2e,
+  0xd0, 0xb6, 0x5b, 0xd5, 0x45, 0xeb, 0x91, 0x46, 0xd5, 0x8d, 0x8f, 0x14, 0xca, 0xf3, 0xa6, 0xbc,
+  0x88, 0xa1, 0x5d, 0xc1, 0xec, 0xc1, 0xc7, 0x9d, 0xdc, 0x72, 0x15, 0x15, 0x19, 0xbd, 0x82, 0x4e,
+  0xf5, 0x55, 0x8a, 0x6e, 0xf9, 0xed, 0xfa, 0x92, 0x37, 0xcc, 0x76, 0x7d, 0x1c, 0xbb, 0x55, 0x18,
+  0xc9, 0x5c, 0xcb, 0xbf, 0x72, 0xad, 0xf1, 0xe7, 0xe2, 0xb8, 0x0a, 0x3f, 0x2f, 0x3f, 0x30, 0x08,
+  0xa5, 0x3a, 0xff, 0x6c, 0x14, 0x9f, 0xe4, 0xd7, 0x54, 0x6c, 0x8e, 0x49, 0x15, 0x82, 0x16, 0x7c,
+  0x55, 0x45, 0xa3, 0x86, 0xbb, 0x7f, 0xd1, 0xcc, 0xea, 0xc5, 0x9a, 0xea, 0x53, 0x18, 0x2a, 0x31,
+  0x78, 0x87, 0x54, 0x57, 0x70, 0xab, 0x32, 0x42, 0xa7, 0xa4, 0x66, 0xf0, 0x3d, 0xea, 0xbf, 0xff,
+  0xb2, 0xfb, 0x6e, 0x28, 0x55, 0x23, 0xc9, 0x60, 0x1a, 0x52, 0x80, 0xc3, 0x14, 0x45, 0x68, 0x41,
+  0x64, 0x70, 0xce, 0x48, 0x73, 0x8b, 0x17, 0xa3, 0x8d, 0x92, 0x76, 0xab, 0xc7, 0x72, 0xd1, 0x73,
+  0xdf, 0x4d, 0x2c, 0x75, 0xde, 0xd1, 0xf8, 0x6a, 0x6b, 0x98, 0xce, 0x40, 0x77, 0xff, 0x30, 0x4a,
+  0xb6, 0xf7, 0xaa, 0xb3, 0x52, 0xc2, 0x5d, 0x3c, 0x33, 0xf2, 0x22, 0x7f, 0x14, 0xac, 0x12, 0xa3,
+  0x2b, 0xf2, 0x67, 0x86, 0xcb, 0x4d, 0xbe, 0xa7, 0x40, 0xdc, 0x1d, 0x7c, 0x03, 0x2d, 0x7a, 0x44,
+  0xc3, 0xc2, 0x8f, 0x6d, 0x37, 0xad, 0x5d, 0x08, 0x2b, 0x01, 0x37, 0x73, 0x60, 0x04, 0x2d, 0x49,
+  0x1d, 0x69, 0x61, 0x2b, 0xd6, 0x48, 0xf8, 0x7d, 0x55, 0x5b, 0x34, 0x59, 0xab, 0x06, 0xa2, 0x36,
+  0xf5, 0x0f, 0x0b, 0xbd, 0x1b, 0xfe, 0x4b, 0xf3, 0x1f, 0xbb, 0x64, 0xd5, 0x02, 0x81, 0x0a, 0x00,
+  0x00,
+};
+const size_t PORTAL_INDEX_GZ_SIZE = sizeof(PORTAL_INDEX_GZ);
+const char PORTAL_INDEX_ETAG[] = "\"49206de344a0aaf4\"";
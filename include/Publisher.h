@@ -0,0 +1,352 @@
+// MQTT state publishing, shared by the firmware and the host build
+#pragma once
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <ArduinoJson.h>
+#include <Hal.h>
+#include <WaterLevel.h>
+#include <MqttSession.h>
+#include <BootTimeline.h>
+#include <Consumption.h>
+
+constexpr char mqtt_topic_root[] = "rocket";               // Tanks unter rocket/<name>
+constexpr char mqtt_topic_watersum[] = "rocket/wasserstand";  // Topic des ersten Tanks
+constexpr char mqtt_topic_status[] = "rocket/wasserstand/status";
+constexpr char mqtt_topic_benchmark[] = "rocket/wasserstand/benchmark";  // Ergebnisse run_benchmark
+const size_t MQTT_TOPIC_SIZE = 64;
+
+// Unterhalb des Topics eines Tanks
+constexpr char mqtt_suffix_water[] = "fuellstand";
+constexpr char mqtt_suffix_distance[] = "distanz";
+constexpr char mqtt_suffix_refills[] = "auffuellungen";
+constexpr char mqtt_suffix_command[] = "command";    // Eingehende Befehle
+constexpr char mqtt_suffix_firmware[] = "firmware";  // aktuelle Firmware Version, nur erster Tank
+constexpr char mqtt_suffix_min_mm[] = "min_mm";
+constexpr char mqtt_suffix_max_mm[] = "max_mm";
+constexpr char mqtt_suffix_set_min_mm[] = "set/min_mm";
+constexpr char mqtt_suffix_set_max_mm[] = "set/max_mm";
+constexpr char mqtt_suffix_set_all[] = "set/#";  // ein Abo für alle set/ Topics
+
+// Sammelt kleine Schreibzugriffe (ArduinoJson schreibt teils zeichenweise)
+// in Blöcke, damit nicht jedes Byte einzeln an den Socket geht
+class MqttStreamWriter {
+ public:
+  explicit MqttStreamWriter(MqttTransport& transport) : transport(transport) {}
+  ~MqttStreamWriter() { flush(); }
+
+  size_t write(uint8_t c) {
+    if (used == sizeof(chunk)) {
+      flush();
+    }
+    chunk[used++] = c;
+    return 1;
+  }
+
+  size_t write(const uint8_t* data, size_t size) {
+    if (size == 0) {
+      return 0;  // leere Teile, z.B. string_view ohne Daten
+    }
+    if (used + size > sizeof(chunk)) {
+      flush();
+      if (size > sizeof(chunk)) {
+        return transport.write(data, size);
+      }
+    }
+    memcpy(chunk + used, data, size);
+    used += size;
+    return size;
+  }
+
+  void flush() {
+    if (used > 0) {
+      transport.write(chunk, used);
+      used = 0;
+    }
+  }
+
+ private:
+  MqttTransport& transport;
+  uint8_t chunk[64];
+  size_t used = 0;
+};
+
+// Telemetrie wird gesammelt und als ein Frame pro Tick gesendet
+const uint32_t TELEMETRY_MIN_INTERVAL = 1000;   // Frühestens nach so vielen ms erneut senden
+const uint32_t TELEMETRY_MAX_INTERVAL = 60000;  // Spätestens nach so vielen ms erneut senden (Heartbeat)
+#define TELEMETRY_FIELD_TOPICS true             // Einzelwerte zusätzlich auf eigenen Topics
+
+struct TelemetryConfig {
+  const char* topic = mqtt_topic_watersum;  // Sammel-Topic, Einzelwerte darunter
+  uint32_t minIntervalMs = TELEMETRY_MIN_INTERVAL;
+  uint32_t maxIntervalMs = TELEMETRY_MAX_INTERVAL;
+  bool fieldTopics = TELEMETRY_FIELD_TOPICS;
+};
+
+// Felder werden mit update*() als geändert markiert und erst mit flush()
+// gemeinsam im Sammel-Topic veröffentlicht
+class StatePublisher {
+ public:
+  enum Field : uint16_t {
+    FIELD_WATER_LEVEL = 1 << 0,
+    FIELD_DISTANCE = 1 << 1,
+    FIELD_REFILLS = 1 << 2,
+    FIELD_CALIBRATION = 1 << 3,
+    FIELD_FIRMWARE = 1 << 4,
+    FIELD_STORE_WRITES = 1 << 5,
+    FIELD_SENSOR_ERRORS = 1 << 6,
+    FIELD_CONNECTION = 1 << 7,
+    FIELD_BOOT = 1 << 8,
+    FIELD_HEAP = 1 << 9,
+    FIELD_CONSUMPTION = 1 << 10,
+    FIELD_ALL = 0xFFFF,
+  };
+
+  explicit StatePublisher(MqttTransport& transport, const TelemetryConfig& config = TelemetryConfig())
+      : transport(transport), config(config) {}
+
+  // Eigener Allocator für das JSON Dokument, z.B. zum Zählen im Benchmark
+  StatePublisher(MqttTransport& transport, ArduinoJson::Allocator* allocator,
+                 const TelemetryConfig& config = TelemetryConfig())
+      : transport(transport), config(config), jsonDoc(allocator) {}
+
+  // Nur als geändert markieren wenn die Änderung größer als der Schwellwert ist,
+  // liefert true wenn markiert wurde. Der Heartbeat sendet immer den letzten Wert.
+  bool updateWaterLevel(float waterLevel, uint16_t distance) {
+    jsonDoc["fuellstand"] = waterLevel;
+    jsonDoc["distanz"] = distance;
+    currentWaterLevel = waterLevel;
+    currentDistance = distance;
+    known |= FIELD_WATER_LEVEL | FIELD_DISTANCE;
+
+    if (fabsf(waterLevel - lastPublishedWaterLevel) < WATER_LEVEL_THRESHOLD &&
+        lastPublishedWaterLevel >= 0) {
+      return false;
+    }
+    markDirty(FIELD_WATER_LEVEL | FIELD_DISTANCE);
+    return true;
+  }
+
+  void updateRefillCount(uint32_t refillCount) {
+    jsonDoc["auffuellungen"] = refillCount;
+    currentRefills = refillCount;
+    known |= FIELD_REFILLS;
+    markDirty(FIELD_REFILLS);
+  }
+
+  void updateCalibration(const Calibration& calibration) {
+    jsonDoc["min_mm"] = calibration.minMm;
+    jsonDoc["max_mm"] = calibration.maxMm;
+    currentCalibration = calibration;
+    known |= FIELD_CALIBRATION;
+    markDirty(FIELD_CALIBRATION);
+  }
+
+  void updateFirmware(const char* firmware) {
+    // Der String wird ins Dokument kopiert, daher nur bei Änderung
+    if (!(known & FIELD_FIRMWARE) || firmware != currentFirmware) {
+      jsonDoc["firmware"] = firmware;
+    }
+    currentFirmware = firmware;
+    known |= FIELD_FIRMWARE;
+    markDirty(FIELD_FIRMWARE);
+  }
+
+  // Flash-Verschleiß: Schreibzugriffe auf den NVS seit dem Start
+  void updateStoreWrites(uint32_t writes) {
+    jsonDoc["nvs_schreibzugriffe"] = writes;
+    known |= FIELD_STORE_WRITES;
+    markDirty(FIELD_STORE_WRITES);
+  }
+
+  // Sensor Diagnose: Timeouts, I2C Lesefehler und Bus-Recoveries seit dem Start
+  void updateSensorErrors(uint32_t timeouts, uint32_t readErrors, uint32_t recoveries) {
+    jsonDoc["sensor_timeouts"] = timeouts;
+    jsonDoc["sensor_lesefehler"] = readErrors;
+    jsonDoc["i2c_recoveries"] = recoveries;
+    known |= FIELD_SENSOR_ERRORS;
+    markDirty(FIELD_SENSOR_ERRORS);
+  }
+
+  // Verbindungsstatistik: Versuche, Fehlversuche, Dauer und letzte Unterbrechung
+  void updateConnectionStats(const MqttSessionStats& stats) {
+    jsonDoc["mqtt_versuche"] = stats.attempts;
+    jsonDoc["mqtt_fehlversuche"] = stats.failures;
+    jsonDoc["mqtt_trennungen"] = stats.disconnects;
+    jsonDoc["mqtt_verbindungsdauer_ms"] = stats.lastAttemptMs;
+    jsonDoc["mqtt_verbindungsdauer_max_ms"] = stats.maxAttemptMs;
+    jsonDoc["mqtt_ausfall_s"] = stats.lastOutageMs / 1000;
+    known |= FIELD_CONNECTION;
+    markDirty(FIELD_CONNECTION);
+  }
+
+  // Zeitpunkte ab Boot in ms, 0 = noch nicht erreicht
+  void updateBootTimeline(const BootTimeline& timeline) {
+    jsonDoc["boot_wlan_ms"] = timeline.at(BOOT_WIFI_UP);
+    jsonDoc["boot_mqtt_ms"] = timeline.at(BOOT_MQTT_UP);
+    jsonDoc["boot_erster_wert_ms"] = timeline.at(BOOT_FIRST_PUBLISH);
+    jsonDoc["wlan_direktverbindung"] = timeline.usedFastConnect();
+    known |= FIELD_BOOT;
+    markDirty(FIELD_BOOT);
+  }
+
+  // Heap in Bytes: frei, Minimum seit Start, größter zusammenhängender Block
+  void updateHeap(uint32_t freeBytes, uint32_t minFreeBytes, uint32_t largestBlock) {
+    jsonDoc["heap_frei"] = freeBytes;
+    jsonDoc["heap_min_frei"] = minFreeBytes;
+    jsonDoc["heap_groesster_block"] = largestBlock;
+    known |= FIELD_HEAP;
+    markDirty(FIELD_HEAP);
+  }
+
+  // Verbrauch: Bezüge, Spülungen, letzte Entnahme und 24 h in ml, Rate und
+  // Prognose aus der Regression, null solange unbekannt
+  void updateConsumption(const ConsumptionStats& stats) {
+    jsonDoc["bezuege"] = stats.shots;
+    jsonDoc["spuelungen"] = stats.rinses;
+    jsonDoc["letzte_entnahme_ml"] = lroundf(stats.lastDropMl);
+    jsonDoc["verbrauch_24h_ml"] = lroundf(stats.usage24hMl);
+    if (stats.usageRateMlH >= 0) {
+      jsonDoc["verbrauch_ml_h"] = roundf(stats.usageRateMlH * 10) / 10;
+    } else {
+      jsonDoc["verbrauch_ml_h"] = nullptr;
+    }
+    if (stats.hoursToEmpty >= 0) {
+      jsonDoc["leer_in_h"] = roundf(stats.hoursToEmpty * 10) / 10;
+    } else {
+      jsonDoc["leer_in_h"] = nullptr;
+    }
+    known |= FIELD_CONSUMPTION;
+    markDirty(FIELD_CONSUMPTION);
+  }
+
+  // Alles beim nächsten flush() senden, ohne Mindestabstand (z.B. nach Connect)
+  void requestFullFrame() {
+    markDirty(FIELD_ALL);
+    immediate = true;
+  }
+
+  // Einmal pro Tick aufrufen. Sendet geänderte Felder frühestens nach
+  // minIntervalMs, ohne Änderung spätestens nach maxIntervalMs den ganzen
+  // Frame. Liefert true wenn ein Frame gesendet wurde.
+  bool flush(uint32_t now) {
+    if (!transport.connected()) {
+      return false;
+    }
+
+    const uint32_t elapsed = now - lastFrameTime;
+    const bool heartbeat = framesSent > 0 && elapsed >= config.maxIntervalMs;
+    if (!heartbeat && (dirty == 0 || (!immediate && framesSent > 0 && elapsed < config.minIntervalMs))) {
+      return false;
+    }
+
+    // Einzelwerte die schon gesendet wurden nicht wiederholen, wenn nur
+    // das Sammel-Topic fehlgeschlagen ist und im nächsten Tick neu versucht wird
+    if (config.fieldTopics) {
+      topicsSent |= publishFieldTopics((heartbeat ? known : (uint16_t)(dirty & known)) & ~topicsSent);
+    }
+    if (!publishJSONDoc()) {
+      return false;
+    }
+
+    if ((heartbeat || (dirty & FIELD_WATER_LEVEL)) && (known & FIELD_WATER_LEVEL)) {
+      lastPublishedWaterLevel = currentWaterLevel;
+    }
+    dirty = 0;
+    topicsSent = 0;
+    immediate = false;
+    lastFrameTime = now;
+    framesSent++;
+    return true;
+  }
+
+  // Nächster Messwert wird unabhängig vom Schwellwert markiert
+  void forceWaterLevelUpdate() {
+    lastPublishedWaterLevel = -1;
+  }
+
+  float lastWaterLevel() const {
+    return lastPublishedWaterLevel;
+  }
+
+  uint16_t dirtyFields() const {
+    return dirty;
+  }
+
+  uint32_t frameCount() const {
+    return framesSent;
+  }
+
+ private:
+  void markDirty(uint16_t fields) {
+    dirty |= fields;
+    topicsSent &= ~fields;
+  }
+
+  // Liefert die Felder deren Topics gesendet wurden
+  uint16_t publishFieldTopics(uint16_t fields) {
+    char valueStr[12];
+    uint16_t sent = 0;
+    if (fields & FIELD_WATER_LEVEL) {
+      snprintf(valueStr, sizeof(valueStr), "%.1f", currentWaterLevel);
+      sent |= publishField(mqtt_suffix_water, valueStr) ? FIELD_WATER_LEVEL : 0;
+    }
+    if (fields & FIELD_DISTANCE) {
+      snprintf(valueStr, sizeof(valueStr), "%u", currentDistance);
+      sent |= publishField(mqtt_suffix_distance, valueStr) ? FIELD_DISTANCE : 0;
+    }
+    if (fields & FIELD_REFILLS) {
+      snprintf(valueStr, sizeof(valueStr), "%lu", (unsigned long)currentRefills);
+      sent |= publishField(mqtt_suffix_refills, valueStr) ? FIELD_REFILLS : 0;
+    }
+    if (fields & FIELD_CALIBRATION) {
+      snprintf(valueStr, sizeof(valueStr), "%u", currentCalibration.minMm);
+      const bool minSent = publishField(mqtt_suffix_min_mm, valueStr);
+      snprintf(valueStr, sizeof(valueStr), "%u", currentCalibration.maxMm);
+      sent |= publishField(mqtt_suffix_max_mm, valueStr) && minSent ? FIELD_CALIBRATION : 0;
+    }
+    if (fields & FIELD_FIRMWARE) {
+      sent |= publishField(mqtt_suffix_firmware, currentFirmware) ? FIELD_FIRMWARE : 0;
+    }
+    // Felder ohne eigenes Topic
+    return sent | (fields & ~(FIELD_WATER_LEVEL | FIELD_DISTANCE | FIELD_REFILLS | FIELD_CALIBRATION | FIELD_FIRMWARE));
+  }
+
+  // Einzelwert unter <topic>/<suffix>
+  bool publishField(const char* suffix, const char* value) {
+    char topic[MQTT_TOPIC_SIZE];
+    snprintf(topic, sizeof(topic), "%s/%s", config.topic, suffix);
+    return transport.publish(topic, value, true);
+  }
+
+  // JSON Objekt für strukturierte Daten, direkt in den Socket serialisiert
+  bool publishJSONDoc() {
+    if (!transport.beginPublish(config.topic, measureJson(jsonDoc), true)) {
+      return false;
+    }
+    {
+      MqttStreamWriter writer(transport);
+      serializeJson(jsonDoc, writer);
+    }
+    return transport.endPublish();
+  }
+
+  MqttTransport& transport;
+  const TelemetryConfig config;
+  // JSON Buffer für MQTT Nachrichten
+  JsonDocument jsonDoc;
+
+  float currentWaterLevel = 0;
+  uint16_t currentDistance = 0;
+  uint32_t currentRefills = 0;
+  Calibration currentCalibration = {0, 0};
+  const char* currentFirmware = nullptr;
+
+  uint16_t dirty = 0;
+  uint16_t known = 0;       // Felder die schon einen Wert haben
+  uint16_t topicsSent = 0;  // Einzelwerte dieses Frames die schon gesendet sind
+  bool immediate = false;
+  uint32_t lastFrameTime = 0;
+  uint32_t framesSent = 0;
+  float lastPublishedWaterLevel = -1;
+};
@@ -0,0 +1,145 @@
+// Sliding-window refill detection with O(1) monotonic min/max
+#pragma once
+#include <stdint.h>
+
+// Fixed-capacity deque of timestamped levels
+template <uint8_t CAPACITY>
+class LevelDeque {
+ public:
+  struct Point {
+    uint32_t time;
+    float level;
+  };
+
+  void pushBack(const Point& point) {
+    items[(start + count) % CAPACITY] = point;
+    count++;
+  }
+
+  void popBack() { count--; }
+
+  void popFront() {
+    start = (start + 1) % CAPACITY;
+    count--;
+  }
+
+  const Point& front() const { return items[start]; }
+  const Point& back() const { return items[(start + count - 1) % CAPACITY]; }
+  bool empty() const { return count == 0; }
+  bool full() const { return count == CAPACITY; }
+  void clear() { start = 0; count = 0; }
+
+ private:
+  Point items[CAPACITY];
+  uint8_t start = 0;
+  uint8_t count = 0;
+};
+
+// Detects "level rose by >= threshold within windowMs". The window minimum
+// and maximum are kept in monotonic deques, so every sample costs amortized
+// O(1) independent of the window length. CAPACITY bounds the number of
+// samples considered per window.
+//
+// IDLE    -> RISING  rise above threshold for debounceSamples samples (refill)
+// RISING  -> SETTLED no new maximum for settleMs
+// SETTLED -> IDLE    the rise has left the window
+template <uint8_t CAPACITY>
+class RefillDetector {
+ public:
+  enum State : uint8_t { STATE_IDLE, STATE_RISING, STATE_SETTLED };
+
+  RefillDetector(float threshold, uint32_t windowMs, uint32_t settleMs, uint8_t debounceSamples)
+      : threshold(threshold), windowMs(windowMs), settleMs(settleMs),
+        debounceSamples(debounceSamples) {}
+
+  // Returns true exactly once per detected refill
+  bool update(uint32_t now, float level) {
+    expire(now);
+
+    while (!minWindow.empty() && minWindow.back().level >= level) {
+      minWindow.popBack();
+    }
+    if (minWindow.full()) {
+      minWindow.popFront();
+    }
+    minWindow.pushBack({now, level});
+
+    while (!maxWindow.empty() && maxWindow.back().level <= level) {
+      maxWindow.popBack();
+    }
+    if (maxWindow.full()) {
+      maxWindow.popFront();
+    }
+    maxWindow.pushBack({now, level});
+
+    const float rise = level - minWindow.front().level;
+
+    switch (state) {
+      case STATE_IDLE:
+        if (rise < threshold) {
+          debounce = 0;
+          return false;
+        }
+        if (++debounce < debounceSamples) {
+          return false;
+        }
+        debounce = 0;
+        state = STATE_RISING;
+        peak = level;
+        peakTime = now;
+        return true;
+
+      case STATE_RISING:
+        if (level > peak) {
+          peak = level;
+          peakTime = now;
+        } else if (now - peakTime >= settleMs) {
+          state = STATE_SETTLED;
+        }
+        return false;
+
+      case STATE_SETTLED:
+        if (rise < threshold) {
+          state = STATE_IDLE;
+        }
+        return false;
+    }
+    return false;
+  }
+
+  State currentState() const { return state; }
+
+  // Current rise within the window, 0 if no samples
+  float windowRise() const {
+    return minWindow.empty() ? 0 : maxWindow.front().level - minWindow.front().level;
+  }
+
+  void reset() {
+    minWindow.clear();
+    maxWindow.clear();
+    state = STATE_IDLE;
+    debounce = 0;
+  }
+
+ private:
+  void expire(uint32_t now) {
+    while (!minWindow.empty() && now - minWindow.front().time > windowMs) {
+      minWindow.popFront();
+    }
+    while (!maxWindow.empty() && now - maxWindow.front().time > windowMs) {
+      maxWindow.popFront();
+    }
+  }
+
+  const float threshold;
+  const uint32_t windowMs;
+  const uint32_t settleMs;
+  const uint8_t debounceSamples;
+
+  LevelDeque<CAPACITY> minWindow;
+  LevelDeque<CAPACITY> maxWindow;
+  State state = STATE_IDLE;
+  uint8_t debounce = 0;
+  float peak = 0;
+  uint32_t peakTime = 0;
+};
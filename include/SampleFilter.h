@@ -0,0 +1,186 @@
+// Fixed-point filter stages for ToF distance samples (mm)
+#pragma once
+#include <stdint.h>
+
+// Fixed-capacity ring buffer, index 0 is the oldest element
+template <typename T, uint8_t CAPACITY>
+class RingBuffer {
+ public:
+  void push(const T& value) {
+    items[(start + count) % CAPACITY] = value;
+    if (count < CAPACITY) {
+      count++;
+    } else {
+      start = (start + 1) % CAPACITY;
+    }
+  }
+
+  const T& operator[](uint8_t index) const {
+    return items[(start + index) % CAPACITY];
+  }
+
+  const T& newest() const {
+    return (*this)[count - 1];
+  }
+
+  uint8_t size() const { return count; }
+  bool full() const { return count == CAPACITY; }
+  void clear() { start = 0; count = 0; }
+
+ private:
+  T items[CAPACITY];
+  uint8_t start = 0;
+  uint8_t count = 0;
+};
+
+// Sliding median over the last WINDOW samples, removes single spikes
+template <uint8_t WINDOW>
+class MedianFilter {
+  static_assert(WINDOW % 2 == 1, "WINDOW must be odd");
+
+ public:
+  uint16_t update(uint16_t value) {
+    // Drop the sample leaving the window from the sorted copy
+    if (window.full()) {
+      const uint16_t leaving = window[0];
+      uint8_t i = 0;
+      while (sorted[i] != leaving) {
+        i++;
+      }
+      for (; i + 1 < window.size(); i++) {
+        sorted[i] = sorted[i + 1];
+      }
+    }
+    const uint8_t used = window.full() ? window.size() - 1 : window.size();
+    window.push(value);
+
+    // Insertion into the sorted copy
+    uint8_t i = used;
+    while (i > 0 && sorted[i - 1] > value) {
+      sorted[i] = sorted[i - 1];
+      i--;
+    }
+    sorted[i] = value;
+
+    return sorted[window.size() / 2];
+  }
+
+  void reset() { window.clear(); }
+
+ private:
+  RingBuffer<uint16_t, WINDOW> window;
+  uint16_t sorted[WINDOW];
+};
+
+// Holds the last accepted value when a sample jumps by more than
+// MAX_JUMP_MM. After MAX_REJECTS rejected samples in a row the new value
+// is taken as a real level change.
+template <uint16_t MAX_JUMP_MM, uint8_t MAX_REJECTS>
+class OutlierRejector {
+ public:
+  uint16_t update(uint16_t value) {
+    const uint16_t jump = value > accepted ? value - accepted : accepted - value;
+    if (valid && jump > MAX_JUMP_MM && rejected < MAX_REJECTS) {
+      rejected++;
+      rejectedTotal++;
+      return accepted;
+    }
+    valid = true;
+    rejected = 0;
+    accepted = value;
+    return accepted;
+  }
+
+  uint32_t rejectedCount() const { return rejectedTotal; }
+  void reset() { valid = false; rejected = 0; }
+
+ private:
+  uint16_t accepted = 0;
+  uint8_t rejected = 0;
+  bool valid = false;
+  uint32_t rejectedTotal = 0;
+};
+
+// Exponential smoothing, ALPHA_Q8 = alpha * 256
+template <uint16_t ALPHA_Q8>
+class ExponentialFilter {
+  static_assert(ALPHA_Q8 > 0 && ALPHA_Q8 <= 256, "ALPHA_Q8 must be in 1..256");
+
+ public:
+  uint16_t update(uint16_t value) {
+    const int32_t sample = (int32_t)value << 8;
+    if (!valid) {
+      state = sample;
+      valid = true;
+    } else {
+      // (sample - state) needs 25 bits, times ALPHA_Q8 up to 33
+      state += (int32_t)(((int64_t)(sample - state) * ALPHA_Q8) >> 8);
+    }
+    return (uint16_t)((state + 128) >> 8);
+  }
+
+  void reset() { valid = false; }
+
+ private:
+  int32_t state = 0;  // Q8
+  bool valid = false;
+};
+
+// 1-D Kalman filter for a constant level. PROCESS_NOISE and
+// MEASUREMENT_NOISE are variances in mm^2, state and covariance are Q8.
+template <uint16_t PROCESS_NOISE, uint16_t MEASUREMENT_NOISE>
+class KalmanFilter {
+ public:
+  uint16_t update(uint16_t value) {
+    const int32_t measurement = (int32_t)value << 8;
+    if (!valid) {
+      estimate = measurement;
+      covariance = (int32_t)MEASUREMENT_NOISE << 8;
+      valid = true;
+      return value;
+    }
+
+    covariance += (int32_t)PROCESS_NOISE << 8;
+    // Gain in Q16
+    const int32_t gain = (int32_t)(((int64_t)covariance << 16) /
+                                   (covariance + ((int32_t)MEASUREMENT_NOISE << 8)));
+    estimate += (int32_t)(((int64_t)(measurement - estimate) * gain) >> 16);
+    covariance = (int32_t)(((int64_t)covariance * ((1 << 16) - gain)) >> 16);
+
+    return (uint16_t)((estimate + 128) >> 8);
+  }
+
+  void reset() { valid = false; }
+
+ private:
+  int32_t estimate = 0;    // Q8 mm
+  int32_t covariance = 0;  // Q8 mm^2
+  bool valid = false;
+};
+
+// Runs the stages in order, the output of one is the input of the next
+template <typename... Stages>
+class FilterChain;
+
+template <>
+class FilterChain<> {
+ public:
+  uint16_t update(uint16_t value) { return value; }
+  void reset() {}
+};
+
+template <typename First, typename... Rest>
+class FilterChain<First, Rest...> {
+ public:
+  uint16_t update(uint16_t value) {
+    return rest.update(first.update(value));
+  }
+
+  void reset() {
+    first.reset();
+    rest.reset();
+  }
+
+  First first;
+  FilterChain<Rest...> rest;
+};
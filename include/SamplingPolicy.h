@@ -0,0 +1,113 @@
+// Adaptive sample rate driven by how fast the level changes
+#pragma once
+#include <math.h>
+#include <stdint.h>
+
+// Abtastraten und Schwellwerte
+const uint32_t SAMPLING_FAST_INTERVAL = 200;     // Füllstand ändert sich / Auffüllung läuft
+const uint32_t SAMPLING_NORMAL_INTERVAL = 1000;
+const uint32_t SAMPLING_SLOW_INTERVAL = 5000;    // Füllstand stabil
+const float SAMPLING_FAST_RATE = 10.0;           // Ab dieser Änderung in %/min schnell messen
+const float SAMPLING_STABLE_RATE = 1.0;          // Unter dieser Änderung in %/min gilt der Stand als stabil
+const uint32_t SAMPLING_FAST_HOLD = 30000;       // So lange ruhig bis schnell -> normal
+const uint32_t SAMPLING_STABLE_HOLD = 300000;    // So lange stabil bis normal -> langsam
+const uint32_t SAMPLING_FAST_TIME_CONSTANT = 10000;    // Glättung für schnell, reagiert in Sekunden
+const uint32_t SAMPLING_STABLE_TIME_CONSTANT = 60000;  // Glättung für stabil, einzelne mm-Sprünge zählen kaum
+
+// MQTT Keepalive passend zum Modus in Sekunden
+const uint16_t SAMPLING_FAST_KEEPALIVE = 15;
+const uint16_t SAMPLING_NORMAL_KEEPALIVE = 30;
+const uint16_t SAMPLING_SLOW_KEEPALIVE = 120;
+
+enum SamplingMode : uint8_t { SAMPLING_FAST, SAMPLING_NORMAL, SAMPLING_SLOW };
+
+// The change rate is the slope d level / dt in %/min, smoothed
+// exponentially so the result does not depend on the current sample
+// interval. The slope keeps its sign while smoothing, so sensor noise
+// cancels out instead of adding up. A short time constant wakes FAST
+// quickly, a long one decides whether the level is stable, where a single
+// 1 mm step would otherwise look like a change. Stepping down needs the
+// rate to stay low for the hold time, so the mode does not flap.
+//
+// FAST   -> NORMAL fast rate < FAST_RATE for FAST_HOLD
+// NORMAL -> SLOW   stable rate < STABLE_RATE for STABLE_HOLD
+// SLOW   -> NORMAL stable rate >= STABLE_RATE
+// any    -> FAST   fast rate >= FAST_RATE or refill in progress
+class SamplingPolicy {
+ public:
+  // Returns true when the mode changed
+  bool update(uint32_t now, float level, bool refillActive) {
+    if (!started) {
+      started = true;
+      lastTime = now;
+      lastLevel = level;
+      quietSince = now;
+      return false;
+    }
+
+    const uint32_t elapsed = now - lastTime;
+    if (elapsed == 0) {
+      return false;
+    }
+    const float instant = (level - lastLevel) * 60000.0f / elapsed;
+    smooth(fastSlope, instant, elapsed, SAMPLING_FAST_TIME_CONSTANT);
+    smooth(stableSlope, instant, elapsed, SAMPLING_STABLE_TIME_CONSTANT);
+    lastTime = now;
+    lastLevel = level;
+
+    const SamplingMode previous = current;
+    if (refillActive || rate() >= SAMPLING_FAST_RATE) {
+      current = SAMPLING_FAST;
+      quietSince = now;
+    } else if (current == SAMPLING_FAST) {
+      if (now - quietSince >= SAMPLING_FAST_HOLD) {
+        current = SAMPLING_NORMAL;
+        quietSince = now;
+      }
+    } else if (stableRate() >= SAMPLING_STABLE_RATE) {
+      current = SAMPLING_NORMAL;
+      quietSince = now;
+    } else if (current == SAMPLING_NORMAL && now - quietSince >= SAMPLING_STABLE_HOLD) {
+      current = SAMPLING_SLOW;
+    }
+    return current != previous;
+  }
+
+  SamplingMode mode() const { return current; }
+  // Betrag der Änderungsrate in %/min
+  float rate() const { return fabsf(fastSlope); }
+  float stableRate() const { return fabsf(stableSlope); }
+
+  uint32_t intervalMs() const { return samplingInterval(current); }
+  uint16_t keepAliveSeconds() const { return samplingKeepAlive(current); }
+
+  static uint32_t samplingInterval(SamplingMode mode) {
+    return mode == SAMPLING_FAST ? SAMPLING_FAST_INTERVAL
+         : mode == SAMPLING_SLOW ? SAMPLING_SLOW_INTERVAL
+         : SAMPLING_NORMAL_INTERVAL;
+  }
+
+  static uint16_t samplingKeepAlive(SamplingMode mode) {
+    return mode == SAMPLING_FAST ? SAMPLING_FAST_KEEPALIVE
+         : mode == SAMPLING_SLOW ? SAMPLING_SLOW_KEEPALIVE
+         : SAMPLING_NORMAL_KEEPALIVE;
+  }
+
+  static const char* modeName(SamplingMode mode) {
+    return mode == SAMPLING_FAST ? "schnell" : mode == SAMPLING_SLOW ? "langsam" : "normal";
+  }
+
+ private:
+  static void smooth(float& slope, float instant, uint32_t elapsed, uint32_t timeConstant) {
+    const float weight = elapsed >= timeConstant ? 1.0f : (float)elapsed / timeConstant;
+    slope += (instant - slope) * weight;
+  }
+
+  SamplingMode current = SAMPLING_NORMAL;
+  bool started = false;
+  uint32_t lastTime = 0;
+  uint32_t quietSince = 0;
+  float lastLevel = 0;
+  float fastSlope = 0;
+  float stableSlope = 0;
+};
@@ -0,0 +1,123 @@
+// Cooperative, deadline-driven task scheduler
+#pragma once
+#include <stdint.h>
+
+// Clock source in milliseconds. On the device this is millis(), on the host
+// any function returning a simulated time can be passed in.
+typedef unsigned long (*SchedulerClock)();
+typedef void (*TaskCallback)();
+typedef uint8_t TaskId;
+
+const TaskId TASK_INVALID = 0xFF;
+
+template <uint8_t MAX_TASKS>
+class Scheduler {
+ public:
+  explicit Scheduler(SchedulerClock clock) : clock(clock) {}
+
+  // Periodic task, first run after firstDelayMs
+  TaskId every(uint32_t intervalMs, TaskCallback callback, uint32_t firstDelayMs = 0) {
+    return add(callback, intervalMs, firstDelayMs, true);
+  }
+
+  // One-shot task, runs once after delayMs and frees its slot afterwards
+  TaskId once(uint32_t delayMs, TaskCallback callback) {
+    return add(callback, 0, delayMs, false);
+  }
+
+  void cancel(TaskId id) {
+    if (id < MAX_TASKS) {
+      tasks[id].callback = nullptr;
+    }
+  }
+
+  // Next run of a task relative to now (also re-arms one-shot tasks)
+  void runIn(TaskId id, uint32_t delayMs) {
+    if (id < MAX_TASKS && tasks[id].callback) {
+      tasks[id].nextRun = clock() + delayMs;
+    }
+  }
+
+  void setInterval(TaskId id, uint32_t intervalMs) {
+    if (id < MAX_TASKS && tasks[id].callback) {
+      tasks[id].interval = intervalMs;
+    }
+  }
+
+  bool isActive(TaskId id) const {
+    return id < MAX_TASKS && tasks[id].callback != nullptr;
+  }
+
+  // Runs every due task once and returns the time in ms until the next
+  // deadline (capped at maxIdleMs), so the caller can sleep that long.
+  uint32_t run(uint32_t maxIdleMs = 100) {
+    for (uint8_t i = 0; i < MAX_TASKS; i++) {
+      Task& task = tasks[i];
+      if (!task.callback || !isDue(task, clock())) {
+        continue;
+      }
+
+      TaskCallback callback = task.callback;
+      if (task.periodic) {
+        // Keep a fixed rate, but do not catch up after an overrun
+        task.nextRun += task.interval;
+        if (isDue(task, clock())) {
+          task.nextRun = clock() + task.interval;
+        }
+      } else {
+        task.callback = nullptr;
+      }
+      callback();
+    }
+
+    return idleTime(maxIdleMs);
+  }
+
+  uint32_t idleTime(uint32_t maxIdleMs) const {
+    const unsigned long now = clock();
+    uint32_t idle = maxIdleMs;
+    for (uint8_t i = 0; i < MAX_TASKS; i++) {
+      const Task& task = tasks[i];
+      if (!task.callback) {
+        continue;
+      }
+      if (isDue(task, now)) {
+        return 0;
+      }
+      const uint32_t remaining = task.nextRun - now;
+      if (remaining < idle) {
+        idle = remaining;
+      }
+    }
+    return idle;
+  }
+
+ private:
+  struct Task {
+    TaskCallback callback = nullptr;
+    uint32_t interval = 0;
+    uint32_t nextRun = 0;
+    bool periodic = false;
+  };
+
+  // Wrap-safe, millis() overflows after ~49 days
+  static bool isDue(const Task& task, unsigned long now) {
+    return (int32_t)((uint32_t)now - task.nextRun) >= 0;
+  }
+
+  TaskId add(TaskCallback callback, uint32_t interval, uint32_t delayMs, bool periodic) {
+    for (uint8_t i = 0; i < MAX_TASKS; i++) {
+      if (!tasks[i].callback) {
+        tasks[i].callback = callback;
+        tasks[i].interval = interval;
+        tasks[i].nextRun = clock() + delayMs;
+        tasks[i].periodic = periodic;
+        return i;
+      }
+    }
+    return TASK_INVALID;
+  }
+
+  SchedulerClock clock;
+  Task tasks[MAX_TASKS];
+};
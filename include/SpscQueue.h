@@ -0,0 +1,61 @@
+// Lock-free single-producer/single-consumer ring buffer
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+// Bounded and allocation-free. Exactly one task may call push() and exactly
+// one other task may call pop(); no locks are needed in between. Works the
+// same with FreeRTOS tasks on the device and std::thread on the host.
+template <typename T, uint32_t CAPACITY>
+class SpscQueue {
+  static_assert(CAPACITY > 0 && (CAPACITY & (CAPACITY - 1)) == 0,
+                "CAPACITY must be a power of two");
+
+ public:
+  // Producer side. Returns false and counts a drop if the queue is full.
+  bool push(const T& item) {
+    const uint32_t t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) >= CAPACITY) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    buffer[t & (CAPACITY - 1)] = item;
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Returns false if the queue is empty.
+  bool pop(T& item) {
+    const uint32_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire)) {
+      return false;
+    }
+    item = buffer[h & (CAPACITY - 1)];
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  uint32_t size() const {
+    return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+  }
+
+  bool empty() const {
+    return size() == 0;
+  }
+
+  uint32_t droppedCount() const {
+    return dropped.load(std::memory_order_relaxed);
+  }
+
+  static constexpr uint32_t capacity() {
+    return CAPACITY;
+  }
+
+ private:
+  T buffer[CAPACITY];
+  // Free-running indices, only the low bits address the buffer
+  std::atomic<uint32_t> head{0};  // written by the consumer
+  std::atomic<uint32_t> tail{0};  // written by the producer
+  std::atomic<uint32_t> dropped{0};
+};
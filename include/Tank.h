@@ -0,0 +1,301 @@
+// Per-tank state: names, calibration, counters, consumption and publishing
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <array>
+#include <string_view>
+#include <utility>
+#include <Hal.h>
+#include <WaterLevel.h>
+#include <Publisher.h>
+#include <Consumption.h>
+#include <MQTT_ha.h>
+
+// Mehrere Tanks
+const uint8_t TANK_MAX_COUNT = 4;
+const size_t TANK_NAME_MAX_LENGTH = 15;  // Teil des Topics und der Home Assistant IDs
+const size_t TANK_KEY_SIZE = 16;         // NVS Schlüssel haben höchstens 15 Zeichen
+const uint8_t I2C_ADDRESS_MAX = 0x77;
+constexpr char TANK_LEGACY_NAME[] = "wasserstand";  // Topics, Schlüssel und Entitäten der Firmware mit einem Tank
+
+// One row per tank. The tank named "wasserstand" keeps the topics, NVS keys
+// and entities of the single-tank firmware. Everything else is derived from
+// the name, so rows may be reordered or removed; renaming a tank starts it
+// with fresh counters and calibration.
+// Sensors without XSHUT stay at the power-up address, which only works
+// for a single tank.
+struct TankConfig {
+  const char* name;   // Topic rocket/<name>
+  const char* label;  // vor den Namen in Home Assistant, leer beim Tank "wasserstand"
+  int8_t xshutPin;    // -1 = kein XSHUT
+  uint8_t address;    // I2C Adresse des Sensors
+  int8_t intPin;      // GPIO1 (Data Ready), -1 = abfragen statt Interrupt
+  int16_t offsetMm;
+};
+
+// NVS keys of further tanks start with a hash of the name, the name itself
+// would not fit into 15 characters. FNV-1a, 24 bit as 6 hex digits.
+constexpr uint32_t tankKeyHash(std::string_view name) {
+  uint32_t hash = 2166136261u;
+  for (char c : name) {
+    hash = (hash ^ (uint8_t)c) * 16777619u;
+  }
+  return (hash ^ (hash >> 24)) & 0xFFFFFF;
+}
+
+// True if a used pin (>= 0) is one of the pins of other
+constexpr bool tankPinUsedBy(int8_t pin, const TankConfig& other) {
+  return pin >= 0 && (pin == other.xshutPin || pin == other.intPin);
+}
+
+// Checked with static_assert on the table in main.cpp. Every XSHUT and
+// interrupt pin belongs to exactly one sensor.
+template <size_t N>
+constexpr bool tankConfigsValid(const TankConfig (&configs)[N]) {
+  if (N == 0 || N > TANK_MAX_COUNT) {
+    return false;
+  }
+  for (size_t i = 0; i < N; i++) {
+    const std::string_view name(configs[i].name);
+    if (name.empty() || name.size() > TANK_NAME_MAX_LENGTH || name.find_first_of("/+#") != std::string_view::npos ||
+        configs[i].address > I2C_ADDRESS_MAX || (N > 1 && configs[i].xshutPin < 0) ||
+        (configs[i].xshutPin >= 0 && configs[i].xshutPin == configs[i].intPin)) {
+      return false;
+    }
+    for (size_t j = 0; j < i; j++) {
+      if (name == configs[j].name || configs[i].address == configs[j].address ||
+          tankKeyHash(name) == tankKeyHash(configs[j].name) || tankPinUsedBy(configs[i].xshutPin, configs[j]) ||
+          tankPinUsedBy(configs[i].intPin, configs[j])) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+enum TankKey : uint8_t { TANK_KEY_REFILLS, TANK_KEY_MIN_MM, TANK_KEY_MAX_MM, TANK_KEY_SHOTS, TANK_KEY_RINSES,
+                         TANK_KEY_COUNT };
+
+// Topics, NVS keys and the Home Assistant prefix of one tank, built once
+// from its name. TANK_LEGACY_NAME uses the plain keys and no prefix,
+// other tanks prefix the keys with "<hash>_" and the entities with "<name>_".
+class TankNames {
+ public:
+  explicit TankNames(const char* name) {
+    snprintf(base, sizeof(base), "%s/%s", mqtt_topic_root, name);
+    snprintf(command, sizeof(command), "%s/%s", base, mqtt_suffix_command);
+    snprintf(setAll, sizeof(setAll), "%s/%s", base, mqtt_suffix_set_all);
+    const bool legacy = strcmp(name, TANK_LEGACY_NAME) == 0;
+    if (!legacy) {
+      snprintf(prefix, sizeof(prefix), "%s_", name);
+    }
+    static const char* const plainKeys[TANK_KEY_COUNT] = {prefValueRefills, prefValueMinMm, prefValueMaxMm,
+                                                          prefValueShots, prefValueRinses};
+    for (uint8_t i = 0; i < TANK_KEY_COUNT; i++) {
+      if (legacy) {
+        snprintf(keys[i], TANK_KEY_SIZE, "%s", plainKeys[i]);
+      } else {
+        snprintf(keys[i], TANK_KEY_SIZE, "%06lx_%s", (unsigned long)tankKeyHash(name), plainKeys[i]);
+      }
+    }
+  }
+
+  const char* topic() const { return base; }
+  const char* commandTopic() const { return command; }
+  const char* setTopic() const { return setAll; }
+  const char* key(TankKey key) const { return keys[key]; }
+  std::string_view objectPrefix() const { return prefix; }
+
+  // Part after "rocket/<name>/", false if the topic belongs to another tank
+  bool matches(std::string_view topic, std::string_view& suffix) const {
+    const std::string_view own(base);
+    if (topic.size() <= own.size() || topic.substr(0, own.size()) != own || topic[own.size()] != '/') {
+      return false;
+    }
+    suffix = topic.substr(own.size() + 1);
+    return true;
+  }
+
+ private:
+  char base[sizeof(mqtt_topic_root) + TANK_NAME_MAX_LENGTH + 1];
+  char command[MQTT_TOPIC_SIZE];
+  char setAll[MQTT_TOPIC_SIZE];
+  char prefix[HA_PREFIX_MAX_LENGTH + 1] = "";
+  char keys[TANK_KEY_COUNT][TANK_KEY_SIZE];
+};
+
+// Everything the network task keeps per tank. Device-wide values
+// (firmware, heap, connection, ...) are added to the publisher of the
+// first tank by the caller. Not copyable, the publisher points into names.
+class Tank {
+ public:
+  Tank(uint8_t index, const TankConfig& config, MqttTransport& transport)
+      : tankIndex(index), tankConfig(config), tankNames(config.name),
+        statePublisher(transport, telemetryConfig()) {}
+
+  // Eigener Allocator für das JSON Dokument, z.B. eine Arena
+  Tank(uint8_t index, const TankConfig& config, MqttTransport& transport, ArduinoJson::Allocator* allocator)
+      : tankIndex(index), tankConfig(config), tankNames(config.name),
+        statePublisher(transport, allocator, telemetryConfig()) {}
+
+  Tank(const Tank&) = delete;
+  Tank& operator=(const Tank&) = delete;
+
+  // Kalibrierung und Zähler nach dem Start
+  void load(KeyValueStore& store) {
+    calibration = loadCalibration(store, tankNames.key(TANK_KEY_MIN_MM), tankNames.key(TANK_KEY_MAX_MM));
+    refillCount = store.getUInt(tankNames.key(TANK_KEY_REFILLS), 0);
+    consumption.setCounts(store.getUInt(tankNames.key(TANK_KEY_SHOTS), 0),
+                          store.getUInt(tankNames.key(TANK_KEY_RINSES), 0));
+  }
+
+  // Counts refills, runs the consumption analytics and marks the changed
+  // fields. Returns the drop that ended with this event, if any.
+  const DropEvent& update(const LevelEvent& event, KeyValueStore& store) {
+    if (event.refill) {
+      refillCount++;
+      publishRefillCount(store);
+    }
+    statePublisher.updateWaterLevel(event.waterLevel, event.distance);
+    latest = event;
+
+    if (consumption.update(event.timestamp, event.waterLevel, event.refill)) {
+      const ConsumptionStats& stats = consumption.statistics();
+      const DropEvent& drop = consumption.drop();
+      if (drop.type == DROP_SHOT) {
+        store.putUInt(tankNames.key(TANK_KEY_SHOTS), stats.shots);
+      } else if (drop.type == DROP_RINSE) {
+        store.putUInt(tankNames.key(TANK_KEY_RINSES), stats.rinses);
+      }
+      statePublisher.updateConsumption(stats);
+    }
+    return consumption.drop();
+  }
+
+  void resetRefills(KeyValueStore& store) {
+    refillCount = 0;
+    publishRefillCount(store);
+  }
+
+  // Returns false and republishes the current values if update is invalid
+  bool setCalibration(const Calibration& update, KeyValueStore& store) {
+    if (!update.isValid()) {
+      statePublisher.updateCalibration(calibration);
+      return false;
+    }
+    calibration = update;
+    saveCalibration(store, calibration, tankNames.key(TANK_KEY_MIN_MM), tankNames.key(TANK_KEY_MAX_MM));
+    consumption.reset();  // alte Pegel passen nicht mehr zur neuen Kalibrierung
+    statePublisher.forceWaterLevelUpdate();
+    statePublisher.updateCalibration(calibration);
+    return true;
+  }
+
+  // Aktueller Stand gesammelt im nächsten flush(), z.B. nach dem Connect
+  void publishState() {
+    statePublisher.updateRefillCount(refillCount);
+    statePublisher.updateCalibration(calibration);
+    statePublisher.updateConsumption(consumption.statistics());
+    statePublisher.requestFullFrame();
+  }
+
+  HaInstance haInstance() const {
+    return {tankNames.objectPrefix(), tankConfig.label, tankNames.topic()};
+  }
+
+  uint8_t index() const { return tankIndex; }
+  const TankConfig& config() const { return tankConfig; }
+  const TankNames& names() const { return tankNames; }
+  StatePublisher& publisher() { return statePublisher; }
+  const Calibration& currentCalibration() const { return calibration; }
+  uint32_t refills() const { return refillCount; }
+  const LevelEvent& latestLevel() const { return latest; }
+  const ConsumptionStats& consumptionStats() const { return consumption.statistics(); }
+
+ private:
+  TelemetryConfig telemetryConfig() const {
+    TelemetryConfig telemetry;
+    telemetry.topic = tankNames.topic();
+    return telemetry;
+  }
+
+  void publishRefillCount(KeyValueStore& store) {
+    statePublisher.updateRefillCount(refillCount);
+    store.putUInt(tankNames.key(TANK_KEY_REFILLS), refillCount);
+  }
+
+  const uint8_t tankIndex;
+  const TankConfig& tankConfig;
+  const TankNames tankNames;
+  StatePublisher statePublisher;
+  ConsumptionAnalytics consumption;
+  Calibration calibration = {WATER_FULL_DEFAULT, WATER_EMPTY_DEFAULT};
+  uint32_t refillCount = 0;
+  LevelEvent latest = {0, -1, 0, false};
+};
+
+// Kalibrierung für den Verarbeitungs-Task
+struct CalibrationUpdate {
+  uint8_t tank;
+  Calibration calibration;
+};
+
+// Starts continuous ranging of several sensors spread evenly over one
+// measurement period. Their results then become ready one after another,
+// so a read on the shared bus never queues behind another sensor's.
+class RangingSchedule {
+ public:
+  explicit RangingSchedule(uint8_t count) : count(count) {}
+
+  // Neue Messperiode: alle Sensoren der Reihe nach neu starten
+  void restart(uint32_t now, uint32_t period) {
+    for (uint8_t i = 0; i < count; i++) {
+      startAt[i] = now + period * i / count;
+    }
+    pending = (1u << count) - 1;
+  }
+
+  // True once for sensor i when its start is due
+  bool due(uint8_t i, uint32_t now) {
+    if (!waiting(i) || (int32_t)(now - startAt[i]) < 0) {
+      return false;
+    }
+    pending &= ~(1u << i);
+    return true;
+  }
+
+  // Noch nicht gestartet, ein fehlender Messwert ist dann kein Timeout
+  bool waiting(uint8_t i) const { return pending & (1u << i); }
+
+  // ms bis zum nächsten Start, UINT32_MAX wenn keiner aussteht
+  uint32_t nextIn(uint32_t now) const {
+    uint32_t next = UINT32_MAX;
+    for (uint8_t i = 0; i < count; i++) {
+      if (waiting(i)) {
+        const int32_t remaining = (int32_t)(startAt[i] - now);
+        const uint32_t wait = remaining > 0 ? remaining : 0;
+        next = wait < next ? wait : next;
+      }
+    }
+    return next;
+  }
+
+ private:
+  const uint8_t count;
+  uint32_t startAt[TANK_MAX_COUNT] = {};
+  uint8_t pending = 0;
+};
+
+// std::array of objects without default constructor, make(i) builds
+// element i in place (e.g. one Tank per config row)
+template <typename T, size_t N, typename Make, size_t... I>
+std::array<T, N> makeArray(Make make, std::index_sequence<I...>) {
+  return {{make(I)...}};
+}
+
+template <typename T, size_t N, typename Make>
+std::array<T, N> makeArray(Make make) {
+  return makeArray<T, N>(make, std::make_index_sequence<N>());
+}
@@ -0,0 +1,174 @@
+// Water level processing, shared by the firmware and the host build
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <Hal.h>
+#include <SampleFilter.h>
+#include <RefillDetector.h>
+#include <Latency.h>
+
+// Definition der Wasserstands-Grenzen in mm
+#define WATER_FULL_DEFAULT 50
+#define WATER_EMPTY_DEFAULT 230
+#define WATER_CALIBRATION_MAX_MM 2000
+
+// Schwellwerte
+const float WATER_LEVEL_THRESHOLD = 5.0;      // Mindeständerung für MQTT Update in %
+const float REFILL_THRESHOLD = 30.0;         // Mindestanstieg für Auffüllerkennung in %
+const int REFILL_TIME_WINDOW = 10000;        // Zeitfenster für Auffüllerkennung in ms
+const int REFILL_SETTLE_TIME = 3000;         // Kein weiterer Anstieg = Auffüllung abgeschlossen
+const uint8_t REFILL_DEBOUNCE_SAMPLES = 2;   // Anstieg muss so oft hintereinander anliegen
+#define REFILL_WINDOW_SAMPLES 64             // Max. Messwerte im Zeitfenster (10 s bei schneller Abtastung)
+
+// Filter für Rohwerte des ToF Sensors: Median gegen Spritzer und Reflexionen,
+// Ausreißer-Sperre gegen einzelne Sprünge, Kalman zur Glättung
+#define FILTER_MEDIAN_WINDOW 5
+#define FILTER_MAX_JUMP_MM 40
+#define FILTER_MAX_REJECTS 2
+#define FILTER_PROCESS_NOISE 4       // mm^2
+#define FILTER_MEASUREMENT_NOISE 16  // mm^2
+typedef FilterChain<MedianFilter<FILTER_MEDIAN_WINDOW>,
+                    OutlierRejector<FILTER_MAX_JUMP_MM, FILTER_MAX_REJECTS>,
+                    KalmanFilter<FILTER_PROCESS_NOISE, FILTER_MEASUREMENT_NOISE>> DistanceFilter;
+
+// Persistente Einstellungen
+const char* const prefFile = "rocket";
+const char* const prefValueRefills = "refills";
+const char* const prefValueMinMm = "min_mm";
+const char* const prefValueMaxMm = "max_mm";
+const char* const prefValueShots = "shots";
+const char* const prefValueRinses = "rinses";
+
+struct SensorSample {
+  uint32_t timestamp;
+  uint16_t distance;
+  uint8_t tank = 0;
+};
+
+struct LevelEvent {
+  uint32_t timestamp;
+  float waterLevel;
+  uint16_t distance;
+  bool refill;
+  uint8_t tank = 0;
+};
+
+struct Calibration {
+  uint16_t minMm;
+  uint16_t maxMm;
+
+  bool isValid() const { return minMm < maxMm; }
+};
+
+// Wasserhöhe in Prozent, 100% bei minMm (voll), 0% bei maxMm (leer)
+inline float waterLevelFromDistance(uint16_t distance, const Calibration& calibration) {
+  const uint16_t constrainedDistance = distance < calibration.minMm ? calibration.minMm
+                                     : distance > calibration.maxMm ? calibration.maxMm
+                                     : distance;
+  return 100.0f - ((constrainedDistance - calibration.minMm) * 100.0f /
+                   (calibration.maxMm - calibration.minMm));
+}
+
+// Akzeptiert nur Ziffern (Leerzeichen am Rand werden ignoriert) bis WATER_CALIBRATION_MAX_MM
+inline bool parseCalibrationValue(const char* value, size_t length, uint16_t& result) {
+  while (length > 0 && (*value == ' ' || *value == '\t' || *value == '\r' || *value == '\n')) {
+    value++;
+    length--;
+  }
+  while (length > 0 && (value[length - 1] == ' ' || value[length - 1] == '\t' ||
+                        value[length - 1] == '\r' || value[length - 1] == '\n')) {
+    length--;
+  }
+
+  if (length == 0) {
+    return false;
+  }
+
+  uint32_t parsedValue = 0;
+  for (size_t i = 0; i < length; i++) {
+    if (value[i] < '0' || value[i] > '9') {
+      return false;
+    }
+    parsedValue = parsedValue * 10 + (value[i] - '0');
+    if (parsedValue > WATER_CALIBRATION_MAX_MM) {
+      return false;
+    }
+  }
+
+  result = parsedValue;
+  return true;
+}
+
+// Weitere Tanks übergeben ihre eigenen Schlüssel
+inline Calibration loadCalibration(KeyValueStore& store, const char* minKey = prefValueMinMm,
+                                   const char* maxKey = prefValueMaxMm) {
+  Calibration calibration = {store.getUShort(minKey, WATER_FULL_DEFAULT),
+                             store.getUShort(maxKey, WATER_EMPTY_DEFAULT)};
+  if (!calibration.isValid()) {
+    calibration = {WATER_FULL_DEFAULT, WATER_EMPTY_DEFAULT};
+  }
+  return calibration;
+}
+
+inline void saveCalibration(KeyValueStore& store, const Calibration& calibration,
+                            const char* minKey = prefValueMinMm, const char* maxKey = prefValueMaxMm) {
+  store.putUShort(minKey, calibration.minMm);
+  store.putUShort(maxKey, calibration.maxMm);
+}
+
+// Rohwert -> gefilterte Distanz -> Füllstand -> Auffüllerkennung
+class LevelProcessor {
+ public:
+  explicit LevelProcessor(const Calibration& calibration = {WATER_FULL_DEFAULT, WATER_EMPTY_DEFAULT})
+      : calibration(calibration),
+        refillDetector(REFILL_THRESHOLD, REFILL_TIME_WINDOW, REFILL_SETTLE_TIME,
+                       REFILL_DEBOUNCE_SAMPLES) {}
+
+  LevelEvent process(const SensorSample& sample) {
+    uint16_t distance;
+    float waterLevel;
+    {
+      LATENCY_SCOPE(PROBE_LEVEL);
+      distance = distanceFilter.update(sample.distance);
+      waterLevel = waterLevelFromDistance(distance, calibration);
+    }
+    LATENCY_SCOPE(PROBE_REFILL);
+    return {sample.timestamp, waterLevel, distance,
+            refillDetector.update(sample.timestamp, waterLevel), sample.tank};
+  }
+
+  void setCalibration(const Calibration& update) { calibration = update; }
+
+  // Anstieg erkannt, aber noch nicht abgeschlossen
+  bool refillActive() const {
+    return refillDetector.currentState() == RefillDetector<REFILL_WINDOW_SAMPLES>::STATE_RISING;
+  }
+
+ private:
+  Calibration calibration;
+  DistanceFilter distanceFilter;
+  RefillDetector<REFILL_WINDOW_SAMPLES> refillDetector;
+};
+
+// Farbverlauf für den LED Ring
+// bei 100% = 510; red=0, green=255
+// 50% = 255; red=255, green=255
+// 0% = 0; red=255, green=0
+inline uint32_t waterLevelColor(float waterLevel) {
+  long red = (long)(waterLevel * 510 / 100);
+  if (red < 0) {
+    red = 0;
+  } else if (red > 510) {
+    red = 510;
+  }
+
+  uint8_t green = 255;
+  if (red > 255) {
+    green = 255;
+    red = 510 - red;
+  } else {
+    green = red;
+    red = 255;
+  }
+  return ledColor(red, green, 0);
+}
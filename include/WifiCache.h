@@ -0,0 +1,100 @@
+// Last good access point and lease, used to skip the scan on the next connect
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <Hal.h>
+
+const char* const prefValueWifiCache = "wifi_cache";
+#define WIFI_CACHE_STATIC_IP false  // Gespeicherte Adresse statt DHCP verwenden (Adresse im Router reservieren)
+
+// Stored as one string, so it costs one NVS key and one cache slot:
+// "bssid,channel,ip,gateway,subnet,dns", all hex. Addresses are kept in
+// the uint32_t form of IPAddress.
+struct WifiCache {
+  uint8_t bssid[6];
+  uint8_t channel;
+  uint32_t ip;
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+
+  bool isValid() const { return channel >= 1 && channel <= 14; }
+};
+
+const size_t WIFI_CACHE_TEXT_LENGTH = 12 + 1 + 2 + 4 * (1 + 8) + 1;
+
+inline bool formatWifiCache(const WifiCache& cache, char* out, size_t size) {
+  const int written = snprintf(out, size, "%02x%02x%02x%02x%02x%02x,%02x,%08lx,%08lx,%08lx,%08lx",
+                               cache.bssid[0], cache.bssid[1], cache.bssid[2],
+                               cache.bssid[3], cache.bssid[4], cache.bssid[5], cache.channel,
+                               (unsigned long)cache.ip, (unsigned long)cache.gateway,
+                               (unsigned long)cache.subnet, (unsigned long)cache.dns);
+  return written > 0 && (size_t)written < size;
+}
+
+// Exactly `digits` hex digits, unlike strtoul() no sign, space or 0x prefix
+inline bool parseHexField(const char* text, uint8_t digits, uint32_t& value) {
+  value = 0;
+  for (uint8_t i = 0; i < digits; i++) {
+    const char c = text[i];
+    uint8_t nibble;
+    if (c >= '0' && c <= '9') {
+      nibble = c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      nibble = c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      nibble = c - 'A' + 10;
+    } else {
+      return false;
+    }
+    value = (value << 4) | nibble;
+  }
+  return true;
+}
+
+// Accepts only the fixed-width layout formatWifiCache() writes
+inline bool parseWifiCache(const char* text, WifiCache& cache) {
+  if (strlen(text) != WIFI_CACHE_TEXT_LENGTH - 1) {
+    return false;
+  }
+  uint32_t value = 0;
+  for (uint8_t i = 0; i < 6; i++) {
+    if (!parseHexField(text + 2 * i, 2, value)) {
+      return false;
+    }
+    cache.bssid[i] = (uint8_t)value;
+  }
+  const char* cursor = text + 12;
+  if (*cursor != ',' || !parseHexField(cursor + 1, 2, value)) {
+    return false;
+  }
+  cache.channel = (uint8_t)value;
+  cursor += 3;
+  uint32_t* const addresses[] = {&cache.ip, &cache.gateway, &cache.subnet, &cache.dns};
+  for (uint32_t* address : addresses) {
+    if (*cursor != ',' || !parseHexField(cursor + 1, 8, *address)) {
+      return false;
+    }
+    cursor += 9;
+  }
+  return cache.isValid();
+}
+
+inline bool loadWifiCache(KeyValueStore& store, WifiCache& cache) {
+  char text[WIFI_CACHE_TEXT_LENGTH];
+  store.getString(prefValueWifiCache, text, sizeof(text));
+  return parseWifiCache(text, cache);
+}
+
+// Unchanged values are not written again by CachedStore
+inline void saveWifiCache(KeyValueStore& store, const WifiCache& cache) {
+  char text[WIFI_CACHE_TEXT_LENGTH];
+  if (formatWifiCache(cache, text, sizeof(text))) {
+    store.putString(prefValueWifiCache, text);
+  }
+}
+
+inline void clearWifiCache(KeyValueStore& store) {
+  store.putString(prefValueWifiCache, "");
+}
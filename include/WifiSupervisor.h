@@ -0,0 +1,98 @@
+// Station connection with a fallback config portal, fed by Wi-Fi events
+#pragma once
+#include <stdint.h>
+#include <Hal.h>
+
+// WLAN Einstellungen
+const uint32_t WIFI_PORTAL_DELAY = 20000;           // Ohne Verbindung so lange bis der Access Point startet
+const uint32_t WIFI_FAST_CONNECT_TIMEOUT = 3000;    // Direktverbindung aus dem Cache, danach vollständiger Scan
+#define WIFI_PORTAL_AFTER_OUTAGE false              // Access Point auch nach einem Ausfall, nicht nur beim Start
+
+// The event handler only records whether the station has an IP; update()
+// runs in the network task and tells the caller what to do. Reconnecting
+// is left to the station's auto-reconnect. The portal is started next to
+// the station (AP+STA), so the station keeps retrying and the portal is
+// taken down again once the network is back. A device that was already
+// connected since boot does not open the portal on an outage (e.g. a
+// router reboot) unless WIFI_PORTAL_AFTER_OUTAGE is set.
+//
+// fast      -> full scan  no link after WIFI_FAST_CONNECT_TIMEOUT
+// any       -> CONNECTED  link up
+// CONNECTED -> offline    link down
+// offline   -> portal     still down after WIFI_PORTAL_DELAY, only before
+//                         the first connection
+class WifiSupervisor {
+ public:
+  enum Action : uint8_t {
+    WIFI_NONE,
+    WIFI_CONNECTED,     // Station hat eine IP
+    WIFI_DISCONNECTED,  // Verbindung verloren
+    WIFI_FULL_SCAN,     // Direktverbindung gescheitert, mit Scan verbinden
+    WIFI_START_PORTAL,  // Access Point zusätzlich starten
+    WIFI_STOP_PORTAL    // Access Point beenden, Station ist verbunden
+  };
+
+  explicit WifiSupervisor(Clock& clock) : clock(clock) {}
+
+  // Start of the first connection attempt, fast when it goes straight to
+  // a known BSSID and channel
+  void begin(bool fastAttempt = false) {
+    offlineSince = clock.millis();
+    fastPhase = fastAttempt;
+  }
+
+  // Called every tick with the link state from the event handler,
+  // returns at most one action per call
+  Action update(bool linkUp) {
+    const uint32_t now = clock.millis();
+    if (linkUp) {
+      if (!up) {
+        up = true;
+        connects++;
+        connectedFast = fastPhase;
+        fastPhase = false;
+        return WIFI_CONNECTED;
+      }
+      if (portal) {
+        portal = false;
+        return WIFI_STOP_PORTAL;
+      }
+      return WIFI_NONE;
+    }
+
+    if (up) {
+      up = false;
+      offlineSince = now;
+      return WIFI_DISCONNECTED;
+    }
+    if (fastPhase) {
+      if (now - offlineSince < WIFI_FAST_CONNECT_TIMEOUT) {
+        return WIFI_NONE;
+      }
+      fastPhase = false;
+      return WIFI_FULL_SCAN;
+    }
+    if (!portal && portalAllowed() && now - offlineSince >= WIFI_PORTAL_DELAY) {
+      portal = true;
+      return WIFI_START_PORTAL;
+    }
+    return WIFI_NONE;
+  }
+
+  bool connected() const { return up; }
+  bool portalActive() const { return portal; }
+  // Nach der ersten Verbindung seit dem Start nur mit WIFI_PORTAL_AFTER_OUTAGE
+  bool portalAllowed() const { return connects == 0 || WIFI_PORTAL_AFTER_OUTAGE; }
+  uint32_t connectCount() const { return connects; }
+  // Letzte Verbindung kam über die Direktverbindung zustande
+  bool fastConnected() const { return connectedFast; }
+
+ private:
+  Clock& clock;
+  bool up = false;
+  bool portal = false;
+  bool fastPhase = false;
+  bool connectedFast = false;
+  uint32_t offlineSince = 0;
+  uint32_t connects = 0;
+};
@@ -0,0 +1,59 @@
+# Komprimiert die Seiten des Konfigurationsportals aus web/ mit gzip und
+# schreibt sie als Byte-Arrays nach include/PortalAssets.h. Läuft vor jedem
+# Build (extra_scripts in platformio.ini) und direkt mit python3.
+import gzip
+import hashlib
+import os
+
+try:
+    Import("env")  # PlatformIO (SCons), dort gibt es kein __file__
+    PROJECT_DIR = env.subst("$PROJECT_DIR")
+except NameError:
+    PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+ASSETS = [
+    # (Datei in web/, Name im Header)
+    ("index.html", "PORTAL_INDEX"),
+]
+OUTPUT = os.path.join(PROJECT_DIR, "include", "PortalAssets.h")
+
+
+def array(name, data):
+    lines = []
+    for i in range(0, len(data), 16):
+        lines.append("  " + ", ".join("0x%02x" % b for b in data[i:i + 16]) + ",")
+    return "const uint8_t %s_GZ[] = {\n%s\n};\n" % (name, "\n".join(lines))
+
+
+def render():
+    parts = [
+        "// Generiert von scripts/build_portal.py aus web/, nicht von Hand ändern\n",
+        "#pragma once\n",
+        "#include <stddef.h>\n",
+        "#include <stdint.h>\n",
+    ]
+    for source, name in ASSETS:
+        with open(os.path.join(PROJECT_DIR, "web", source), "rb") as f:
+            raw = f.read()
+        # mtime=0, damit gleiche Eingabe gleiche Bytes und gleiches ETag ergibt
+        data = gzip.compress(raw, compresslevel=9, mtime=0)
+        etag = hashlib.sha1(data).hexdigest()[:16]
+        parts.append("\n// %s: %d Bytes, komprimiert %d Bytes\n" % (source, len(raw), len(data)))
+        parts.append(array(name, data))
+        parts.append("const size_t %s_GZ_SIZE = sizeof(%s_GZ);\n" % (name, name))
+        parts.append("const char %s_ETAG[] = \"\\\"%s\\\"\";\n" % (name, etag))
+    return "".join(parts)
+
+
+def build():
+    content = render()
+    # Nur bei Änderung schreiben, sonst baut PlatformIO main.cpp jedes Mal neu
+    if os.path.exists(OUTPUT):
+        with open(OUTPUT, encoding="utf-8") as f:
+            if f.read() == content:
+                return
+    with open(OUTPUT, "w", encoding="utf-8") as f:
+        f.write(content)
+    print("PortalAssets.h aktualisiert")
+
+
+build()
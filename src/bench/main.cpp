@@ -0,0 +1,147 @@
+// Host benchmark of the per-iteration hot path (sensor read, filter, level
+// conversion, refill detection, publish incl. JSON serialization, LED) and
+// of the level history (recording, one-day query, bytes per day).
+//
+//   pio run -e bench && .pio/build/bench/program [iterations]
+//
+// Reports ns/iteration, allocations/iteration and peak heap per stage as
+// one JSON line each, so results of two builds can be diffed. Exits with 1
+// if any stage still allocates after its warm-up pass, the steady state
+// has to run without the heap.
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <new>
+#include <HalFakes.h>
+#include <Benchmark.h>
+
+// Heap accounting: every allocation carries its size in front of the block
+static uint32_t allocationCount = 0;
+static size_t heapInUse = 0;
+static size_t heapBaseline = 0;
+static size_t heapPeak = 0;
+
+static const size_t HEADER_SIZE = alignof(max_align_t);
+
+static void* trackedAllocate(size_t size) {
+  char* block = (char*)malloc(size + HEADER_SIZE);
+  if (!block) {
+    return nullptr;
+  }
+  *(size_t*)block = size;
+  allocationCount++;
+  heapInUse += size;
+  if (heapInUse > heapPeak) {
+    heapPeak = heapInUse;
+  }
+  return block + HEADER_SIZE;
+}
+
+static void trackedDeallocate(void* pointer) {
+  if (!pointer) {
+    return;
+  }
+  char* block = (char*)pointer - HEADER_SIZE;
+  heapInUse -= *(size_t*)block;
+  free(block);
+}
+
+static void* trackedReallocate(void* pointer, size_t size) {
+  void* resized = trackedAllocate(size);
+  if (resized && pointer) {
+    const size_t oldSize = *(size_t*)((char*)pointer - HEADER_SIZE);
+    memcpy(resized, pointer, oldSize < size ? oldSize : size);
+    trackedDeallocate(pointer);
+  }
+  return resized;
+}
+
+void* operator new(size_t size) {
+  void* pointer = trackedAllocate(size);
+  if (!pointer) {
+    throw std::bad_alloc();
+  }
+  return pointer;
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* pointer) noexcept { trackedDeallocate(pointer); }
+void operator delete[](void* pointer) noexcept { trackedDeallocate(pointer); }
+void operator delete(void* pointer, size_t) noexcept { trackedDeallocate(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { trackedDeallocate(pointer); }
+
+class CountingJsonAllocator : public ArduinoJson::Allocator {
+ public:
+  void* allocate(size_t size) override { return trackedAllocate(size); }
+  void deallocate(void* pointer) override { trackedDeallocate(pointer); }
+  void* reallocate(void* pointer, size_t size) override { return trackedReallocate(pointer, size); }
+};
+
+// Liefert immer einen Messwert, der Trace wiederholt sich
+class CyclicRangeSensor : public RangeSensor {
+ public:
+  bool dataReady() override { return true; }
+
+  bool readMillimeters(uint16_t& distance) override {
+    distance = benchDistance(position++);
+    return true;
+  }
+
+ private:
+  uint32_t position = 0;
+};
+
+static uint64_t hostNanos() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint32_t hostAllocations() { return allocationCount; }
+
+static void hostResetPeakHeap() {
+  heapBaseline = heapInUse;
+  heapPeak = heapInUse;
+}
+
+static uint32_t hostPeakHeap() { return heapPeak - heapBaseline; }
+
+static void printResult(const BenchResult& result) {
+  char line[160];
+  formatBenchResult(result, line, sizeof(line));
+  printf("%s\n", line);
+}
+
+int main(int argc, char** argv) {
+  const uint32_t iterations = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+  if (iterations == 0) {
+    fprintf(stderr, "Ungültige Anzahl Iterationen\n");
+    return 1;
+  }
+
+  static const BenchHooks hooks = {hostNanos, hostAllocations, hostResetPeakHeap, hostPeakHeap};
+  BenchRunner runner(hooks, printResult);
+
+  CyclicRangeSensor sensor;
+  NullMqttTransport transport;
+  CountingJsonAllocator jsonAllocator;
+  StatePublisher publisher(transport, &jsonAllocator);
+  FakeLedStrip strip(16);
+
+  runHotPathBenchmarks(runner, iterations, sensor, publisher, strip);
+
+  // Verlauf auf einer 256 KB Partition wie auf dem Gerät
+  MemoryFlash historyFlash(256 * 1024, 4096);
+  History history(historyFlash);
+  history.begin();
+  runHistoryBenchmarks(runner, iterations, history);
+  char line[160];
+  formatHistoryStorage(history, iterations, line, sizeof(line));
+  printf("%s\n", line);
+
+  if (runner.allocatingStageCount() > 0) {
+    fprintf(stderr, "%lu Stufen allokieren im eingeschwungenen Zustand\n",
+            (unsigned long)runner.allocatingStageCount());
+    return 1;
+  }
+  return 0;
+}
@@ -11,6 +11,29 @@
 #include <Preferences.h>
 #include <MQTT_ha.h>
 #include <WebServer.h>
+#include <Scheduler.h>
+#include <SpscQueue.h>
+#include <HalArduino.h>
+#include <WaterLevel.h>
+#include <Publisher.h>
+#include <Benchmark.h>
+#include <CommandDispatcher.h>
+#include <Journal.h>
+#include <CachedStore.h>
+#include <SamplingPolicy.h>
+#include <WifiSupervisor.h>
+#include <WifiCache.h>
+#include <BootTimeline.h>
+#include <LedCompositor.h>
+#include <ArenaAllocator.h>
+#include <History.h>
+#include <Consumption.h>
+#include <Tank.h>
+#include <HttpApi.h>
+#include <PortalAssets.h>
+#include <string_view>
+#include <esp_pm.h>
+#include <esp_wifi.h>
 
 // WiFi Einstellungen
 const char* hostname = "rocket";
@@ -21,29 +44,35 @@ const char* firmware = "0.9.8"; // Firmware version
 const char* mqtt_server = "192.168.179.21"; //"iobroker.fritz.box";
 const int mqtt_port = 1883;
 
-const char* mqtt_topic_watersum = "rocket/wasserstand";
-const char* mqtt_topic_water = "rocket/wasserstand/fuellstand";
-const char* mqtt_topic_distance = "rocket/wasserstand/distanz";
-const char* mqtt_topic_status = "rocket/wasserstand/status";
-const char* mqtt_topic_refills = "rocket/wasserstand/auffuellungen";
-const char* mqtt_topic_command = "rocket/wasserstand/command";  // Eingehende Befehle
-const char* mqtt_topic_firmware = "rocket/wasserstand/firmware";  // aktuelle Firmware Version
-const char* mqtt_topic_min_mm = "rocket/wasserstand/min_mm";
-const char* mqtt_topic_max_mm = "rocket/wasserstand/max_mm";
-const char* mqtt_topic_set_min_mm = "rocket/wasserstand/set/min_mm";
-const char* mqtt_topic_set_max_mm = "rocket/wasserstand/set/max_mm";
-
 // Einstellungen
 Preferences preferences;
-const char* prefFile = "rocket";
-const char* prefValueRefills = "refills";
-const char* prefValueMinMm = "min_mm";
-const char* prefValueMaxMm = "max_mm";
 
-// Schwellwerte
-const float WATER_LEVEL_THRESHOLD = 10.0;     // Mindeständerung für MQTT Update in %
-const float REFILL_THRESHOLD = 30.0;         // Mindestanstieg für Auffüllerkennung in %
-const int REFILL_TIME_WINDOW = 10000;        // Zeitfenster für Auffüllerkennung in ms
+// Task Intervalle in ms
+const uint32_t NETWORK_INTERVAL = 10;        // MQTT, OTA und Webserver
+const uint32_t NETWORK_SLOW_INTERVAL = 100;  // im Modus langsam, damit die CPU schlafen kann
+const uint32_t SENSOR_INTERVAL = 100;        // Abfrage ToF Sensor
+const uint32_t LED_INTERVAL = 100;           // LED Ring Aktualisierung
+const uint32_t OTA_ERROR_DISPLAY_TIME = 3000; // Rot nach fehlgeschlagenem Update
+const uint32_t HEAP_REPORT_INTERVAL = 60000;  // Heap Kennzahlen senden
+const size_t PUBLISHER_ARENA_SIZE = 4096;     // Fester Speicher für das JSON Dokument
+const uint32_t STORE_INTERVAL = 1000;        // Prüfen ob Einstellungen geschrieben werden müssen
+const uint32_t SENSOR_TIMEOUT = 2500;        // Keine Messung innerhalb dieser Zeit = Timeout
+const uint8_t SENSOR_RECOVERY_ERRORS = 3;    // Fehler in Folge bis zur I2C Bus-Recovery
+const uint8_t SENSOR_MISSED_EDGES = 3;       // Messwerte ohne Data Ready Interrupt in Folge bis zum Abfragen
+
+// CPU Takt: feste Frequenz, nur im Modus langsam skalieren und Light-Sleep
+const int CPU_FREQ_MAX_MHZ = 160;
+const int CPU_FREQ_SLOW_MIN_MHZ = 40;
+
+// FreeRTOS Tasks (loop() läuft als Netzwerk-Task mit Priorität 1)
+const uint32_t TASK_STACK_SIZE = 4096;
+const UBaseType_t SENSOR_TASK_PRIORITY = 3;
+const UBaseType_t PROCESSING_TASK_PRIORITY = 2;
+const UBaseType_t LED_TASK_PRIORITY = 1;
+const UBaseType_t MQTT_CONNECT_TASK_PRIORITY = 1;  // Blockierender Verbindungsaufbau
+
+// Benchmark auf dem Gerät (MQTT Befehl "run_benchmark")
+const uint32_t BENCHMARK_ITERATIONS = 200;
 
 // Konfiguration für LED Ring
 #define NUM_LEDS 16
@@ -54,226 +83,268 @@ const int REFILL_TIME_WINDOW = 10000;        // Zeitfenster für Auffüllerkennu
 // Declare our NeoPixel strip object:
 Adafruit_NeoPixel strip(NUM_LEDS, LED_PIN, NEO_GRB + NEO_KHZ800);
 
-// Definition der Wasserstands-Grenzen in mm
-#define WATER_FULL_DEFAULT 50
-#define WATER_EMPTY_DEFAULT 230
-#define WATER_CALIBRATION_MAX_MM 2000
 #define SENSOR_OFFSET 0 //-35 // Offset in mm 
+#define SENSOR_INT_PIN -1        // GPIO1 des VL53L0X (Data Ready) falls verdrahtet, z.B. 2; -1 = abfragen
+#define I2C_SDA_PIN 22
+#define I2C_SCL_PIN 23
+
+// Ein Tank pro VL53L0X. Ab zwei Sensoren braucht jeder einen XSHUT Pin und
+// eine eigene Adresse, der LED Ring, das Journal und der Verlauf zeigen den
+// ersten Tank. Topics und NVS Schlüssel hängen am Namen, nicht an der Zeile.
+constexpr TankConfig tankConfigs[] = {
+  {"wasserstand", "", -1, VL53L0X_DEFAULT_ADDRESS, SENSOR_INT_PIN, SENSOR_OFFSET},
+  // {"tropfschale", "Tropfschale", 16, 0x30, 17, 0},
+};
+constexpr uint8_t TANK_COUNT = sizeof(tankConfigs) / sizeof(tankConfigs[0]);
+static_assert(tankConfigsValid(tankConfigs), "tankConfigs: names, pins or addresses invalid");
 
-VL53L0X sensor;
 WiFiClient espClient;
 PubSubClient mqtt(espClient);
 
+// Hardware-Abstraktion für die gemeinsame Logik (siehe Hal.h)
+ArduinoClock systemClock;
+VL53L0X sensors[TANK_COUNT];
+std::array<VL53L0XSensor, TANK_COUNT> rangeSensors = makeArray<VL53L0XSensor, TANK_COUNT>([](size_t i) {
+  return VL53L0XSensor(sensors[i], tankConfigs[i].offsetMm, Wire, I2C_SDA_PIN, I2C_SCL_PIN,
+                       tankConfigs[i].xshutPin, tankConfigs[i].address);
+});
+PreferencesStore nvsStore(preferences, prefFile);
+CachedStore<STORE_DEVICE_KEYS + TANK_COUNT * TANK_KEY_COUNT> store(nvsStore, systemClock);  // Lesen aus dem RAM, Schreiben verzögert
+NeoPixelStrip ledStrip(strip);
+LedCompositor<NUM_LEDS> leds(ledStrip);  // Gehört dem LED-Task
+PubSubTransport mqttTransport(mqtt);
+ArenaAllocator<PUBLISHER_ARENA_SIZE> publisherArenas[TANK_COUNT];  // JSON Dokumente ohne Heap
+
+// Zustand der Tanks, nur im Netzwerk-Task. Werte des Geräts gehen mit dem ersten Tank raus.
+std::array<Tank, TANK_COUNT> tanks = makeArray<Tank, TANK_COUNT>([](size_t i) {
+  return Tank(i, tankConfigs[i], mqttTransport, &publisherArenas[i]);
+});
+StatePublisher& publisher = tanks[0].publisher();
+
+// Werte während Broker/WLAN Ausfall, optional mit Partition "journal" im Flash
+TimeBase timeBase;
+EspPartitionRegion journalPartition("journal");
+FlashJournal flashJournal(journalPartition);
+OfflineJournal journal(timeBase);
+const time_t SNTP_VALID_AFTER = 1700000000;  // Vorher ist die Uhrzeit noch nicht gesetzt
+
+// Füllstandsverlauf, nur mit Partition "history" im Flash
+EspPartitionRegion historyPartition("history");
+History history(historyPartition);
+HistoryQuery historyQuery;  // aus dem MQTT Callback, beantwortet im Netzwerk-Task
+bool historyQueryPending = false;
+
 // Webserver für Konfiguration
 WebServer server(80);
 
-// Globale Variablen für den letzten gemessenen Wasserstand
-float lastPublishedWaterLevel = -1;
-float lastWaterLevel = -1;
-unsigned long lastMqttReconnectAttempt = 0;
-unsigned long lastWaterLevelCheck = 0;
-const unsigned long MQTT_RECONNECT_INTERVAL = 5000; // 5 Sekunden zwischen Reconnect-Versuchen
-
-// Zähler für Auffüllvorgänge
-uint32_t refillCount = 0;
-bool isRefilling = false;
-uint16_t waterMinMm = WATER_FULL_DEFAULT;
-uint16_t waterMaxMm = WATER_EMPTY_DEFAULT;
-
-// JSON Buffer für MQTT Nachrichten
-JsonDocument jsonDoc;
-
-// HTML für die Konfigurationsseite
-const char INDEX_HTML[] PROGMEM = R"=====(
-<!DOCTYPE HTML>
-<html>
-<head>
-    <meta name="viewport" content="width=device-width, initial-scale=1">
-    <title>Rocket WLAN Konfiguration</title>
-    <style>
-        body { font-family: Arial, sans-serif; max-width: 500px; margin: 0 auto; padding: 20px; }
-        h1 { color: #333; text-align: center; }
-        .form-group { margin-bottom: 15px; }
-        label { display: block; margin-bottom: 5px; font-weight: bold; }
-        input[type="text"], input[type="password"] { width: 100%; padding: 8px; box-sizing: border-box; border: 1px solid #ddd; border-radius: 4px; }
-        button { background-color: #4CAF50; color: white; padding: 10px 15px; border: none; border-radius: 4px; cursor: pointer; width: 100%; }
-        button:hover { background-color: #45a049; }
-        .status { padding: 10px; margin: 10px 0; border-radius: 4px; }
-        .success { background-color: #dff0d8; color: #3c763d; }
-        .error { background-color: #f2dede; color: #a94442; }
-        .info { background-color: #d9edf7; color: #31708f; }
-    </style>
-</head>
-<body>
-    <h1>Rocket WLAN Konfiguration</h1>
-    <div class="status info">
-        Verbinden Sie sich mit dem WLAN "Rocket-Config" um diese Seite zu erreichen.<br>
-        Aktuelle IP: %s
-    </div>
-    <form action="/save" method="POST">
-        <div class="form-group">
-            <label for="ssid">WLAN SSID:</label>
-            <input type="text" id="ssid" name="ssid" required>
-        </div>
-        <div class="form-group">
-            <label for="password">WLAN Passwort:</label>
-            <input type="password" id="password" name="password">
-        </div>
-        <button type="submit">Speichern und neu starten</button>
-    </form>
-    <div id="message" class="status" style="display: none;"></div>
-    <script>
-        // Zeige Statusmeldung wenn vorhanden
-        const urlParams = new URLSearchParams(window.location.search);
-        const message = urlParams.get('message');
-        const status = urlParams.get('status');
-        if (message) {
-            document.getElementById('message').style.display = 'block';
-            document.getElementById('message').innerHTML = message;
-            document.getElementById('message').className = 'status ' + status;
-        }
-    </script>
-</body>
-</html>
-)=====";
-
-void updateLEDRing(float waterLevel);
-void colorProgress(uint32_t color, int progress, int total);
-void blink(uint32_t color, int wait);
-void colorWipe(uint32_t color, int wait);
-void colorFill(uint32_t color);
-void publishRefillCount();
-void publishJSONDoc();
+// Kooperativer Scheduler statt delay() in loop()
+Scheduler<8> scheduler(millis);
+
+// Datenaustausch zwischen den Tasks
+SpscQueue<SensorSample, 16> sampleQueue;      // Sensor -> Verarbeitung
+SpscQueue<LevelEvent, 16> publishQueue;       // Verarbeitung -> Netzwerk
+SpscQueue<LevelEvent, 8> ledQueue;            // Verarbeitung -> LED
+SpscQueue<CalibrationUpdate, 4> calibrationQueue;  // Netzwerk -> Verarbeitung
+SpscQueue<LedCommand, 8> ledCommandQueue;     // Netzwerk -> LED
+
+TaskHandle_t sensorTaskHandle = nullptr;
+TaskHandle_t processingTaskHandle = nullptr;
+TaskHandle_t ledTaskHandle = nullptr;
+volatile bool sensorPauseRequested = false;  // Sensor-Task gibt den I2C Bus frei
+volatile bool sensorPaused = false;
+
+// Fehlerzähler des Sensor-Tasks, werden als Diagnose veröffentlicht
+volatile uint32_t sensorTimeouts = 0;
+volatile uint32_t sensorReadErrors = 0;
+volatile uint32_t sensorRecoveries = 0;
+
+// Abtastrate: Verarbeitung entscheidet, Sensor und Netzwerk folgen
+volatile SamplingMode samplingMode = SAMPLING_NORMAL;
+SamplingMode appliedSamplingMode = SAMPLING_NORMAL;  // Netzwerk-Task
+uint16_t mqttKeepAlive = SAMPLING_NORMAL_KEEPALIVE;  // Netzwerk-Task, mit dem Connect-Auftrag übergeben
+TaskId networkTaskId = TASK_INVALID;
+TaskId publishTaskId = TASK_INVALID;
+TaskId benchmarkTaskId = TASK_INVALID;  // per MQTT angefordert, läuft im Scheduler
+
+// MQTT Verbindung: Zustand im Netzwerk-Task, Verbindungsaufbau im eigenen Task.
+// Pro Tank zwei Abos (command, set/#) und dessen Entitäten.
+enum MqttSetupStep : uint8_t { SETUP_STATUS, SETUP_SUBSCRIBE_HISTORY, SETUP_SUBSCRIBE_TANKS };
+const uint8_t HA_DEVICE_ENTITY_COUNT = sizeof(ha_device_entities) / sizeof(ha_device_entities[0]);
+const uint8_t HA_TANK_ENTITY_COUNT = sizeof(ha_tank_entities) / sizeof(ha_tank_entities[0]);
+const uint8_t SETUP_DISCOVERY = SETUP_SUBSCRIBE_TANKS + 2 * TANK_COUNT;
+const uint8_t SETUP_TANK_DISCOVERY = SETUP_DISCOVERY + HA_DEVICE_ENTITY_COUNT;
+const uint8_t MQTT_SETUP_STEPS = SETUP_TANK_DISCOVERY + TANK_COUNT * HA_TANK_ENTITY_COUNT + 1;  // + Zustand senden
+enum MqttConnectResult : int8_t { MQTT_CONNECT_PENDING, MQTT_CONNECT_OK, MQTT_CONNECT_FAILED };
+volatile MqttConnectResult mqttConnectResult = MQTT_CONNECT_PENDING;
+TaskHandle_t mqttConnectTaskHandle = nullptr;
+MqttSession mqttSession(systemClock, []() -> uint32_t { return esp_random(); }, MQTT_SETUP_STEPS);
+
+// WLAN: Events setzen den Zustand, ausgewertet im Netzwerk-Task
+WifiSupervisor wifiSupervisor(systemClock);
+volatile bool wifiLinkUp = false;
+bool webServerStarted = false;
+BootTimeline bootTimeline;
+
+void sendLedCommand(LedCommand::Type type, uint32_t color = 0, uint32_t value = 0, uint32_t total = 0);
 bool setupMDNS();
-void loadCalibration();
-void publishCalibration();
-void updateCalibration(uint16_t minMm, uint16_t maxMm);
-bool parseCalibrationValue(const String& value, uint16_t& result);
-
-// MQTT Callback für eingehende Nachrichten
-void mqttCallback(char* topic, byte* payload, unsigned int length) {
-  // Payload in String umwandeln
-  char message[length + 1];
-  memcpy(message, payload, length);
-  message[length] = '\0';
-  
-  String command = String(message);
-  
-  if (String(topic) == mqtt_topic_command) {
-    if (command == "reset_refill_counter") {
-      refillCount = 0;
-      publishRefillCount();
-      mqtt.publish(mqtt_topic_command, " ", true); // Command zurücksetzen nach der Verarbeitung
-      Serial.println("Auffüllzähler zurückgesetzt");
-    }
-  } else if (String(topic) == mqtt_topic_set_min_mm) {
-    uint16_t minMm = 0;
-    if (parseCalibrationValue(command, minMm)) {
-      updateCalibration(minMm, waterMaxMm);
-    }
-  } else if (String(topic) == mqtt_topic_set_max_mm) {
-    uint16_t maxMm = 0;
-    if (parseCalibrationValue(command, maxMm)) {
-      updateCalibration(waterMinMm, maxMm);
-    }
+void updateCalibration(uint8_t tank, uint16_t minMm, uint16_t maxMm);
+void setupWebServer();
+void requestBenchmark();
+void taskBenchmark();
+void taskNetwork();
+void taskWiFi();
+void taskMqtt();
+void taskPublish();
+void taskStore();
+void applySamplingMode();
+void taskHeap();
+void publishHistory();
+#if LATENCY_TRACKING
+void taskLatency();
+#endif
+void sensorTask(void* parameter);
+void processingTask(void* parameter);
+void ledTask(void* parameter);
+
+void handleCommand(uint8_t tank, const uint8_t* payload, size_t length) {
+  if (payloadEquals(payload, length, "reset_refill_counter")) {
+    tanks[tank].resetRefills(store);
+    mqtt.publish(tanks[tank].names().commandTopic(), " ", true); // Command zurücksetzen nach der Verarbeitung
+    Serial.printf("Auffüllzähler zurückgesetzt: %s\n", tanks[tank].config().name);
+  } else if (payloadEquals(payload, length, "run_benchmark")) {
+    mqtt.publish(tanks[tank].names().commandTopic(), " ", true);
+    requestBenchmark();
   }
 }
 
-void publishJSONDoc() {
-    // JSON Objekt für strukturierte Daten
-    char jsonBuffer[200];
-    serializeJson(jsonDoc, jsonBuffer);
-    mqtt.publish(mqtt_topic_watersum, jsonBuffer, true);
-}
-
-void publishRefillCount() {
-  char refillStr[10];
-  itoa(refillCount, refillStr, 10);
-  mqtt.publish(mqtt_topic_refills, refillStr, true);
-  jsonDoc["auffuellungen"] = refillCount;
-  publishJSONDoc();
-  preferences.begin(prefFile, false);
-  preferences.putUInt(prefValueRefills, refillCount);
-  preferences.end();
+void handleSetMinMm(uint8_t tank, const uint8_t* payload, size_t length) {
+  uint16_t minMm = 0;
+  if (parseCalibrationValue((const char*)payload, length, minMm)) {
+    updateCalibration(tank, minMm, tanks[tank].currentCalibration().maxMm);
+  }
 }
 
-void loadCalibration() {
-  preferences.begin(prefFile, true);
-  waterMinMm = preferences.getUShort(prefValueMinMm, WATER_FULL_DEFAULT);
-  waterMaxMm = preferences.getUShort(prefValueMaxMm, WATER_EMPTY_DEFAULT);
-  preferences.end();
-
-  if (waterMinMm >= waterMaxMm) {
-    waterMinMm = WATER_FULL_DEFAULT;
-    waterMaxMm = WATER_EMPTY_DEFAULT;
+void handleSetMaxMm(uint8_t tank, const uint8_t* payload, size_t length) {
+  uint16_t maxMm = 0;
+  if (parseCalibrationValue((const char*)payload, length, maxMm)) {
+    updateCalibration(tank, tanks[tank].currentCalibration().minMm, maxMm);
   }
 }
 
-void publishCalibration() {
-  if (!mqtt.connected()) {
+// Abfrage merken, der Callback läuft im Empfangspuffer von PubSubClient.
+// Der Verlauf gehört zum ersten Tank.
+void handleHistoryQuery(uint8_t tank, const uint8_t* payload, size_t length) {
+  const std::string_view body((const char*)payload, length);
+  if (tank != 0 || !history.active() || !timeBase.synced() ||
+      !parseHistoryQuery([&](std::string_view key) { return findJsonValue(body, key); },
+                         time(nullptr), historyQuery)) {
+    Serial.println("Ungültige Verlaufsabfrage ignoriert");
     return;
   }
+  historyQueryPending = true;
+}
 
-  char minMmStr[8];
-  char maxMmStr[8];
-  itoa(waterMinMm, minMmStr, 10);
-  itoa(waterMaxMm, maxMmStr, 10);
+// Eingehende Befehle unter rocket/<tank>/, sortiert nach Topic (wird beim Kompilieren geprüft)
+constexpr CommandRoute commandRoutes[] = {
+  {mqtt_suffix_command, handleCommand},
+  {mqtt_suffix_set_max_mm, handleSetMaxMm},
+  {mqtt_suffix_set_min_mm, handleSetMinMm},
+  {mqtt_suffix_history_query, handleHistoryQuery},
+};
+static_assert(commandRoutesSorted(commandRoutes), "commandRoutes must be sorted by topic");
 
-  mqtt.publish(mqtt_topic_min_mm, minMmStr, true);
-  mqtt.publish(mqtt_topic_max_mm, maxMmStr, true);
-  jsonDoc["min_mm"] = waterMinMm;
-  jsonDoc["max_mm"] = waterMaxMm;
-  publishJSONDoc();
+// MQTT Callback für eingehende Nachrichten, Payload wird direkt geparst
+void mqttCallback(char* topic, byte* payload, unsigned int length) {
+  std::string_view suffix;
+  for (Tank& tank : tanks) {
+    if (tank.names().matches(topic, suffix)) {
+      dispatchCommand(commandRoutes, suffix, tank.index(), payload, length);
+      return;
+    }
+  }
 }
 
-void updateCalibration(uint16_t minMm, uint16_t maxMm) {
-  if (minMm >= maxMm) {
-    Serial.printf("Ungültige Kalibrierung ignoriert: min=%u max=%u\n", minMm, maxMm);
-    publishCalibration();
+void updateCalibration(uint8_t tank, uint16_t minMm, uint16_t maxMm) {
+  if (!tanks[tank].setCalibration({minMm, maxMm}, store)) {
+    Serial.printf("Ungültige Kalibrierung ignoriert: %s min=%u max=%u\n", tanks[tank].config().name, minMm, maxMm);
     return;
   }
 
-  waterMinMm = minMm;
-  waterMaxMm = maxMm;
-
-  preferences.begin(prefFile, false);
-  preferences.putUShort(prefValueMinMm, waterMinMm);
-  preferences.putUShort(prefValueMaxMm, waterMaxMm);
-  preferences.end();
-
-  lastPublishedWaterLevel = -1;
-  Serial.printf("Kalibrierung gespeichert: min=%u mm, max=%u mm\n", waterMinMm, waterMaxMm);
-  publishCalibration();
+  calibrationQueue.push({tank, tanks[tank].currentCalibration()});
+  xTaskNotifyGive(processingTaskHandle);
+  Serial.printf("Kalibrierung gespeichert: %s min=%u mm, max=%u mm\n", tanks[tank].config().name, minMm, maxMm);
 }
 
-bool parseCalibrationValue(const String& value, uint16_t& result) {
-  String normalizedValue = value;
-  normalizedValue.trim();
-
-  if (normalizedValue.length() == 0) {
-    return false;
+// Tank aus ?tank=<name>, ohne Angabe der erste
+Tank* requestedTank() {
+  if (!server.hasArg("tank")) {
+    return &tanks[0];
   }
-
-  for (uint16_t i = 0; i < normalizedValue.length(); i++) {
-    if (!isDigit(normalizedValue[i])) {
-      return false;
+  const String name = server.arg("tank");
+  for (Tank& tank : tanks) {
+    if (name == tank.config().name) {
+      return &tank;
     }
   }
+  return nullptr;
+}
 
-  const long parsedValue = normalizedValue.toInt();
-  if (parsedValue < 0 || parsedValue > WATER_CALIBRATION_MAX_MM) {
-    return false;
-  }
+// IPv4 als Text ohne String
+size_t formatIp(const IPAddress& ip, char* text, size_t size) {
+  return snprintf(text, size, "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+}
 
-  result = parsedValue;
-  return true;
+void printIp(const char* label, const IPAddress& ip) {
+  char text[16];
+  formatIp(ip, text, sizeof(text));
+  Serial.printf("%s%s\n", label, text);
 }
 
 // Webserver Handler
+// Antwort ohne Content-Length in Stücken von HTTP_CHUNK_SIZE senden
+template <typename Body>
+void sendChunked(const char* contentType, Body body) {
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, contentType, "");
+  {
+    ChunkedWriter writer([](const char* data, size_t length) { server.sendContent(data, length); });
+    body(writer);
+  }
+  server.sendContent("");
+}
+
+// Portal aus PortalAssets.h: gzip direkt aus dem Flash, unverändert nur 304
 void handleRoot() {
-  char html[sizeof(INDEX_HTML) + 50];
-  sprintf(html, INDEX_HTML, WiFi.softAPIP().toString().c_str());
-  server.send(200, "text/html", html);
+  server.sendHeader("ETag", PORTAL_INDEX_ETAG);
+  server.sendHeader("Cache-Control", "no-cache");
+  const String ifNoneMatch = server.header("If-None-Match");
+  if (etagMatches(std::string_view(ifNoneMatch.c_str(), ifNoneMatch.length()), PORTAL_INDEX_ETAG)) {
+    server.send(304);
+    return;
+  }
+
+  server.sendHeader("Content-Encoding", "gzip");
+  server.setContentLength(PORTAL_INDEX_GZ_SIZE);
+  server.send(200, "text/html", "");
+  server.sendContent((const char*)PORTAL_INDEX_GZ, PORTAL_INDEX_GZ_SIZE);
+}
+
+// Werte, die früher in die Seite eingesetzt wurden. Die SSID kommt ohne
+// String aus dem AP-Eintrag der Station und wird maskiert.
+void handlePortal() {
+  char ip[16];
+  formatIp(WiFi.getMode() == WIFI_STA ? WiFi.localIP() : WiFi.softAPIP(), ip, sizeof(ip));
+  const bool connected = wifiSupervisor.connected();
+  char ssid[sizeof(wifi_ap_record_t::ssid)] = "";
+  wifi_ap_record_t ap;
+  if (connected && esp_wifi_sta_get_ap_info(&ap) == ESP_OK) {
+    snprintf(ssid, sizeof(ssid), "%s", (const char*)ap.ssid);
+  }
+  sendChunked("application/json", [&](auto& writer) {
+    writer.printf("{\"ip\":\"%s\",\"wlan\":%s,\"ssid\":", ip, connected ? "true" : "false");
+    writeJsonString(writer, ssid);
+    writer.print("}");
+  });
 }
 
 void handleSave() {
@@ -282,10 +353,11 @@ void handleSave() {
     String password = server.arg("password");
     
     // Speichere die Anmeldeinformationen in den Preferences
-    preferences.begin(prefFile, false);
-    preferences.putString("wifi_ssid", ssid);
-    preferences.putString("wifi_password", password);
-    preferences.end();
+    store.putString("wifi_ssid", ssid.c_str());
+    store.putString("wifi_password", password.c_str());
+    clearWifiCache(store);
+    store.flushNow();
+    history.flush();
     
     // Sende Erfolgmeldung
     String redirectUrl = "/?message=Einstellungen+gespeichert.+Das+Ger%C3%A4t+startet+neu...&status=success";
@@ -300,161 +372,300 @@ void handleSave() {
 }
 
 void handleNotFound() {
-  String message = "Datei nicht gefunden\n\n";
-  message += "URI: ";
-  message += server.uri();
-  message += "\nMethod: ";
-  message += (server.method() == HTTP_GET) ? "GET" : "POST";
-  message += "\nArguments: ";
-  message += server.args();
-  message += "\n";
-  for (uint8_t i = 0; i < server.args(); i++) {
-    message += " " + server.argName(i) + ": " + server.arg(i) + "\n";
+  static char message[512];
+  int length = snprintf(message, sizeof(message), "Datei nicht gefunden\n\nURI: %s\nMethod: %s\nArguments: %d\n",
+                        server.uri().c_str(), (server.method() == HTTP_GET) ? "GET" : "POST", server.args());
+  for (uint8_t i = 0; i < server.args() && length > 0 && (size_t)length < sizeof(message); i++) {
+    length += snprintf(message + length, sizeof(message) - length, " %s: %s\n",
+                       server.argName(i).c_str(), server.arg(i).c_str());
   }
   server.send(404, "text/plain", message);
 }
 
+// Aktueller Zustand für die HTTP API, Handler laufen im Netzwerk-Task
+ApiState currentApiState() {
+  ApiState state = {};
+  for (Tank& tank : tanks) {
+    state.tanks[tank.index()] = {tank.config().name, tank.latestLevel().waterLevel, tank.latestLevel().distance,
+                                 tank.refills(), tank.currentCalibration()};
+  }
+  state.tankCount = TANK_COUNT;
+  state.firmware = firmware;
+  state.uptimeMs = millis();
+  state.mqttConnected = mqttSession.online();
+  state.sensorTimeouts = sensorTimeouts;
+  state.sensorReadErrors = sensorReadErrors;
+  state.freeHeap = ESP.getFreeHeap();
+  return state;
+}
+
+void handleApiState() {
+  const ApiState state = currentApiState();
+  sendChunked("application/json", [&](auto& writer) { writeStateJson(writer, state); });
+}
+
+void handleMetrics() {
+  const ApiState state = currentApiState();
+  sendChunked("text/plain; version=0.0.4", [&](auto& writer) { writeMetrics(writer, state); });
+}
+
+void handleGetCalibration() {
+  const Tank* tank = requestedTank();
+  if (tank == nullptr) {
+    server.send(404, "text/plain", "Fehler: unbekannter Tank");
+    return;
+  }
+  char body[48];
+  snprintf(body, sizeof(body), "{\"min_mm\":%u,\"max_mm\":%u}", tank->currentCalibration().minMm,
+           tank->currentCalibration().maxMm);
+  server.send(200, "application/json", body);
+}
+
+// Formular (min_mm, max_mm) oder JSON Body, fehlende Werte bleiben erhalten
+void handlePostCalibration() {
+  Tank* tank = requestedTank();
+  if (tank == nullptr) {
+    server.send(404, "text/plain", "Fehler: unbekannter Tank");
+    return;
+  }
+  Calibration update = tank->currentCalibration();
+  bool valid = false;
+  if (server.hasArg("min_mm") || server.hasArg("max_mm")) {
+    valid = true;
+    if (server.hasArg("min_mm")) {
+      const String value = server.arg("min_mm");
+      valid = parseCalibrationValue(value.c_str(), value.length(), update.minMm);
+    }
+    if (valid && server.hasArg("max_mm")) {
+      const String value = server.arg("max_mm");
+      valid = parseCalibrationValue(value.c_str(), value.length(), update.maxMm);
+    }
+    valid = valid && update.isValid();
+  } else if (server.hasArg("plain")) {
+    const String body = server.arg("plain");
+    valid = parseCalibrationJson(std::string_view(body.c_str(), body.length()), update);
+  }
+
+  if (!valid) {
+    server.send(400, "text/plain", "Fehler: min_mm < max_mm erforderlich");
+    return;
+  }
+  updateCalibration(tank->index(), update.minMm, update.maxMm);
+  handleGetCalibration();
+}
+
+// Portal und API teilen sich den Server, er wird nur einmal gestartet
+void startWebServer() {
+  if (!webServerStarted) {
+    setupWebServer();
+    webServerStarted = true;
+  }
+}
+
+// GET /api/history?from=..&to=..&res=raw|hour|day|auto
+void handleHistory() {
+  if (!history.active() || !timeBase.synced()) {
+    server.send(503, "text/plain", "Kein Verlauf verfügbar");
+    return;
+  }
+  const String from = server.arg("from");
+  const String to = server.arg("to");
+  const String resolution = server.arg("res");
+  HistoryQuery query;
+  const bool valid = parseHistoryQuery([&](std::string_view key) {
+    const String& value = key == "from" ? from : key == "to" ? to : resolution;
+    return std::string_view(value.c_str(), value.length());
+  }, time(nullptr), query);
+  if (!valid) {
+    server.send(400, "text/plain", "Fehler: from <= to und res=raw|hour|day|auto erwartet");
+    return;
+  }
+  sendChunked("application/json", [&](auto& writer) { history.query(writer, query); });
+}
+
+// Antwort auf eine Verlaufsabfrage: Länge zählen, dann direkt in den Socket
+void publishHistory() {
+  historyQueryPending = false;
+  LengthCounter counter;
+  history.query(counter, historyQuery);
+  if (!mqttTransport.beginPublish(mqtt_topic_history, counter.length(), false)) {
+    return;
+  }
+  {
+    ChunkedWriter writer([](const char* data, size_t length) { mqttTransport.write((const uint8_t*)data, length); });
+    history.query(writer, historyQuery);
+  }
+  mqttTransport.endPublish();
+}
+
 void setupWebServer() {
-  server.on("/", handleRoot);
+  static const char* collectedHeaders[] = {"If-None-Match"};
+  server.collectHeaders(collectedHeaders, 1);
+  server.on("/", HTTP_GET, handleRoot);
+  server.on("/api/portal", HTTP_GET, handlePortal);
   server.on("/save", HTTP_POST, handleSave);
+  server.on("/api/state", HTTP_GET, handleApiState);
+  server.on("/metrics", HTTP_GET, handleMetrics);
+  server.on("/api/history", HTTP_GET, handleHistory);
+  server.on("/api/calibration", HTTP_GET, handleGetCalibration);
+  server.on("/api/calibration", HTTP_POST, handlePostCalibration);
   server.onNotFound(handleNotFound);
   server.begin();
   Serial.println("HTTP-Server gestartet");
 }
 
-bool connectMQTT() {
-  if (mqtt.connected()) {
-    return true;
+// Discovery Dokument aus der Tabelle in MQTT_ha.h direkt in den Socket schreiben,
+// der MQTT Puffer bleibt dadurch bei der Standardgröße
+bool publishHaDiscovery(const HaEntity& entity, const HaInstance& instance) {
+  char topic[HA_TOPIC_MAX_LENGTH + 1];
+  haDiscoveryTopic(entity, instance, topic, sizeof(topic));
+
+  if (!mqttTransport.beginPublish(topic, haDiscoveryLength(entity, instance), true)) {
+    return false;
+  }
+  {
+    MqttStreamWriter writer(mqttTransport);
+    writeHaDiscovery(entity, instance, [&](std::string_view part) {
+      writer.write((const uint8_t*)part.data(), part.size());
+    });
   }
+  return mqttTransport.endPublish();
+}
 
+// Blockiert bis der Broker antwortet, läuft daher im eigenen Task
+bool connectMQTT(uint16_t keepAlive) {
   Serial.print("Verbinde mit MQTT Broker...");
   
-  // Client ID generieren
-  String clientId = "ROCKET-ESP32";
+  // Client ID
+  const char clientId[] = "ROCKET-ESP32";
   
+  // Keepalive passend zur Abtastrate beim Auftrag aushandeln
+  mqtt.setKeepAlive(keepAlive);
+
   // Verbindungsversuch mit Credentials
   bool connected = false;
   if (MQTT_user[0] != '\0' && MQTT_password[0] != '\0') {
-    connected = mqtt.connect(clientId.c_str(), MQTT_user, MQTT_password, 
+    connected = mqtt.connect(clientId, MQTT_user, MQTT_password, 
                            mqtt_topic_status, 1, true, "offline");
   } else {
-    connected = mqtt.connect(clientId.c_str(), mqtt_topic_status, 1, true, "offline");
+    connected = mqtt.connect(clientId, mqtt_topic_status, 1, true, "offline");
   }
 
   if (connected) {
     Serial.println("verbunden");
-    // Online Status publizieren
-    mqtt.publish(mqtt_topic_status, "online", true);
-    mqtt.publish(mqtt_topic_firmware, firmware, true);
-    jsonDoc["firmware"] = firmware;
-    mqtt.subscribe(mqtt_topic_command);
-    mqtt.subscribe(mqtt_topic_set_min_mm);
-    mqtt.subscribe(mqtt_topic_set_max_mm);
-    
-    // Setting Homeassistant sensor config
-    Serial.println("--> HA Config");
-    mqtt.setBufferSize(1200);
-    Serial.println(mqtt.publish(mqtt_topic_ha_auffuellungen.c_str(), mqtt_ha_config_auffuellungen, true));
-    Serial.println(mqtt.publish(mqtt_topic_ha_distanz.c_str(), mqtt_ha_config_distanz, true));
-    Serial.println(mqtt.publish(mqtt_topic_ha_fuellstand.c_str(), mqtt_ha_config_fuellstand, true));
-    Serial.println(mqtt.publish(mqtt_topic_ha_command.c_str(), mqtt_ha_config_command, true));
-    Serial.println(mqtt.publish(mqtt_topic_ha_firmware.c_str(), mqtt_ha_config_firmware, true));
-    Serial.println(mqtt.publish(mqtt_topic_ha_min_mm.c_str(), mqtt_ha_config_min_mm, true));
-    Serial.println(mqtt.publish(mqtt_topic_ha_max_mm.c_str(), mqtt_ha_config_max_mm, true));
-
-    // Gespeicherte Werte lesen, bspw. nach Neustart
-    if (refillCount == 0)
-    {
-      preferences.begin(prefFile, false);
-      refillCount = preferences.getUInt(prefValueRefills, 0);
-      preferences.end();
-    }  
-
-    publishRefillCount(); // Aktuellen Zählerstand senden
-    publishCalibration();
-    return true;
   } else {
     Serial.print("fehlgeschlagen, rc=");
     Serial.println(mqtt.state());
-    return false;
   }
+  return connected;
 }
 
-void checkForRefill(float currentWaterLevel) {
-  unsigned long now = millis();
-  
-  // Erste Messung
-  if (lastWaterLevel < 0) {
-    lastWaterLevel = currentWaterLevel;
-    lastWaterLevelCheck = now;
-    return;
+// Verbindungsaufbau ohne den Netzwerk-Task zu blockieren. Solange der
+// Versuch läuft, gehört der MQTT Client diesem Task. Der Auftrag trägt
+// den Keepalive als Notification-Wert.
+void mqttConnectTask(void* parameter) {
+  for (;;) {
+    uint32_t keepAlive = 0;
+    xTaskNotifyWait(0, UINT32_MAX, &keepAlive, portMAX_DELAY);
+    mqttConnectResult = connectMQTT((uint16_t)keepAlive) ? MQTT_CONNECT_OK : MQTT_CONNECT_FAILED;
   }
-  
-  // Prüfen ob signifikanter Anstieg im Zeitfenster
-  if (now - lastWaterLevelCheck <= REFILL_TIME_WINDOW) {
-    float waterLevelChange = currentWaterLevel - lastWaterLevel;
-    
-    // Wenn Wasserstand deutlich gestiegen ist und wir noch nicht im Auffüllmodus sind
-    if (waterLevelChange >= REFILL_THRESHOLD && !isRefilling) {
-      isRefilling = true;
-      refillCount++;
-      publishRefillCount();
-      
-      // Visuelle Bestätigung auf LED Ring
-      for(int i = 0; i < 3; i++) {
-        blink(strip.Color(0,0,255), 100);
-        }
+}
+
+// Arbeit nach dem Connect, ein Schritt pro Tick statt alles auf einmal
+void runMqttSetupStep(uint8_t step) {
+  if (step == SETUP_STATUS) {
+    // Online Status publizieren
+    mqtt.publish(mqtt_topic_status, "online", true);
+  } else if (step == SETUP_SUBSCRIBE_HISTORY) {
+    mqtt.subscribe(mqtt_topic_history_query);
+  } else if (step < SETUP_DISCOVERY) {
+    const Tank& tank = tanks[(step - SETUP_SUBSCRIBE_TANKS) / 2];
+    mqtt.subscribe((step - SETUP_SUBSCRIBE_TANKS) % 2 == 0 ? tank.names().commandTopic() : tank.names().setTopic());
+  } else if (step < MQTT_SETUP_STEPS - 1) {
+    // Setting Homeassistant sensor config: erst das Gerät, dann jeder Tank
+    const bool device = step < SETUP_TANK_DISCOVERY;
+    const uint8_t index = device ? step - SETUP_DISCOVERY : step - SETUP_TANK_DISCOVERY;
+    const HaEntity& entity = device ? ha_device_entities[index] : ha_tank_entities[index % HA_TANK_ENTITY_COUNT];
+    const HaInstance instance = device ? HaInstance{} : tanks[index / HA_TANK_ENTITY_COUNT].haInstance();
+    if (!publishHaDiscovery(entity, instance)) {
+      Serial.printf("HA Config fehlgeschlagen: %.*s%.*s\n", (int)instance.objectPrefix.size(),
+                    instance.objectPrefix.data(), (int)entity.objectId.size(), entity.objectId.data());
     }
   } else {
-    // Zeitfenster abgelaufen, Reset für neue Erkennung
-    isRefilling = false;
-    lastWaterLevel = currentWaterLevel;
-    lastWaterLevelCheck = now;
+    // Aktuellen Stand gesammelt im nächsten Tick senden
+    publisher.updateFirmware(firmware);
+    publisher.updateStoreWrites(store.writeCount());
+    publisher.updateSensorErrors(sensorTimeouts, sensorReadErrors, sensorRecoveries);
+    publisher.updateConnectionStats(mqttSession.statistics());
+    for (Tank& tank : tanks) {
+      tank.publishState();
+    }
   }
 }
 
-void publishWaterLevel(float waterLevel, int distance) {
-  if (!mqtt.connected()) {
-    return;
-  }
-
-  // Nur publizieren wenn die Änderung größer als der Schwellwert ist
-  if (abs(waterLevel - lastPublishedWaterLevel) >= WATER_LEVEL_THRESHOLD || 
-      lastPublishedWaterLevel < 0) {
-    
-    // Einzelne Werte für einfache Verarbeitung
-    char waterLevelStr[10];
-    dtostrf(waterLevel, 1, 1, waterLevelStr);
-    mqtt.publish(mqtt_topic_water, waterLevelStr, true);
-    
-    char distanceStr[10];
-    itoa(distance, distanceStr, 10);
-    mqtt.publish(mqtt_topic_distance, distanceStr, true);
-    
-    lastPublishedWaterLevel = waterLevel;
-    
-    Serial.print("MQTT Update - Füllstand: ");
-    Serial.print(waterLevelStr);
-    Serial.print("%, Distanz: ");
-    Serial.print(distanceStr);
-    Serial.print("mm, Auffüllungen: ");
-    Serial.println(refillCount);
+// MQTT Verbindung prüfen und ggf. wiederherstellen
+void taskMqtt() {
+  switch (mqttSession.state()) {
+    case MqttSession::SESSION_WAITING:
+      if (mqttSession.attemptDue()) {
+        mqttConnectResult = MQTT_CONNECT_PENDING;
+        mqttKeepAlive = SamplingPolicy::samplingKeepAlive(appliedSamplingMode);
+        xTaskNotify(mqttConnectTaskHandle, mqttKeepAlive, eSetValueWithOverwrite);
+      }
+      break;
 
-    jsonDoc["fuellstand"] = waterLevel;
-    jsonDoc["distanz"] = distance;
-    publishJSONDoc();
+    case MqttSession::SESSION_CONNECTING:
+      if (mqttConnectResult != MQTT_CONNECT_PENDING) {
+        mqttSession.connectFinished(mqttConnectResult == MQTT_CONNECT_OK);
+        if (mqttSession.state() == MqttSession::SESSION_WAITING) {
+          Serial.printf("Nächster MQTT Versuch in %lu ms\n", (unsigned long)mqttSession.retryIn());
+        }
+      }
+      break;
+
+    case MqttSession::SESSION_SETUP:
+    case MqttSession::SESSION_ONLINE:
+      if (!mqtt.connected()) {
+        mqttTransport.setEnabled(false);
+        mqttSession.lost();
+        Serial.println("MQTT Verbindung verloren");
+        break;
+      }
+      mqtt.loop();
+      if (mqttSession.state() == MqttSession::SESSION_SETUP) {
+        runMqttSetupStep(mqttSession.setupStep());
+        if (mqttSession.nextStep()) {
+          mqttTransport.setEnabled(true);
+          bootTimeline.mark(BOOT_MQTT_UP, millis());
+        }
+      }
+      break;
   }
 }
 
 void setupMQTT() {
   mqtt.setServer(mqtt_server, mqtt_port);
   mqtt.setCallback(mqttCallback);
-  connectMQTT();
+  xTaskCreate(mqttConnectTask, "mqtt_connect", TASK_STACK_SIZE, nullptr,
+              MQTT_CONNECT_TASK_PRIORITY, &mqttConnectTaskHandle);
 }
 
-// LED Statusanzeige für OTA
+// Animationen laufen im LED-Task, hier nur den Auftrag abgeben
+void sendLedCommand(LedCommand::Type type, uint32_t color, uint32_t value, uint32_t total) {
+  ledCommandQueue.push({type, color, value, total});
+  if (ledTaskHandle != nullptr) {
+    xTaskNotifyGive(ledTaskHandle);
+  }
+}
+
+// LED Statusanzeige für OTA, nur bei jedem neuen Prozent
 void showOTAProgress(unsigned int progress, unsigned int total) {
-  colorProgress(strip.Color(0,0,255), progress, total);
+  static uint8_t lastPercent = 0xFF;
+  const uint8_t percent = total > 0 ? (uint8_t)((uint64_t)progress * 100 / total) : 0;
+  if (percent != lastPercent) {
+    lastPercent = percent;
+    sendLedCommand(LedCommand::LED_PROGRESS, strip.Color(0,0,255), percent, 100);
+  }
 }
 
 void setupOTA() {
@@ -462,17 +673,20 @@ void setupOTA() {
   
   ArduinoOTA
     .onStart([]() {
-      colorFill(strip.Color(158, 37, 190));
+      store.flushNow();            // Nichts verlieren, falls das Update neu startet
+      history.flush();
+      sendLedCommand(LedCommand::LED_FILL, strip.Color(158, 37, 190));
     })
     .onProgress([](unsigned int progress, unsigned int total) {
       showOTAProgress(progress, total);
     })
     .onEnd([]() {
-      colorFill(strip.Color(0,255,0));
-      delay(500);
+      sendLedCommand(LedCommand::LED_FILL, strip.Color(0,255,0));
+      delay(500);                  // LED-Task zeigt es noch vor dem Neustart
     })
     .onError([](ota_error_t error) {
-      colorFill(strip.Color(255,0,0));
+      sendLedCommand(LedCommand::LED_CLEAR);
+      sendLedCommand(LedCommand::LED_FILL, strip.Color(255,0,0), OTA_ERROR_DISPLAY_TIME);
     });
 
   ArduinoOTA.begin();
@@ -493,68 +707,144 @@ bool setupMDNS() {
   MDNS.addService("arduino", "tcp", 3232);
   MDNS.addServiceTxt("arduino", "tcp", "fw", firmware);
 
-  Serial.println("mDNS gestartet: " + String(hostname) + ".local");
+  Serial.printf("mDNS gestartet: %s.local\n", hostname);
   return true;
 }
 
+// Läuft im WiFi Event Task, daher nur den Zustand merken
+void onWiFiEvent(arduino_event_id_t event, arduino_event_info_t info) {
+  if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP) {
+    wifiLinkUp = true;
+  } else if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED || event == ARDUINO_EVENT_WIFI_STA_LOST_IP) {
+    wifiLinkUp = false;
+  }
+}
+
+// Verbindung wird im Hintergrund aufgebaut, Messung und LED laufen sofort los
 void setupWiFi() {
   // Versuche, gespeicherte Anmeldeinformationen zu laden
-  preferences.begin(prefFile, true); // Read-only Modus
-  String savedSsid = preferences.getString("wifi_ssid", "");
-  String savedPassword = preferences.getString("wifi_password", "");
-  preferences.end();
+  char savedSsid[33];
+  char savedPassword[65];
+  store.getString("wifi_ssid", savedSsid, sizeof(savedSsid));
+  store.getString("wifi_password", savedPassword, sizeof(savedPassword));
   
-  const char* ssidToUse = savedSsid.length() > 0 ? savedSsid.c_str() : WIFI_ssid;
-  const char* passwordToUse = savedPassword.length() > 0 ? savedPassword.c_str() : WIFI_password;
+  const char* ssidToUse = savedSsid[0] != '\0' ? savedSsid : WIFI_ssid;
+  const char* passwordToUse = savedPassword[0] != '\0' ? savedPassword : WIFI_password;
   
+  WiFi.onEvent(onWiFiEvent);
   WiFi.mode(WIFI_STA);
   WiFi.hostname(hostname);
-  WiFi.begin(ssidToUse, passwordToUse);
-  
-  // Versuche, eine Verbindung zum konfigurierten WLAN herzustellen
-  int attempt = 0;
-  const int maxAttempts = 10;
-  
-  while (WiFi.status() != WL_CONNECTED && attempt < maxAttempts) {
-    colorFill(strip.Color(0,0,0));
-    colorWipe(strip.Color(255, 255, 0), 20);
-    attempt++;
-    delay(500);
-  }
-  
-  if (WiFi.status() == WL_CONNECTED) {
-    // Erfolgreich mit dem WLAN verbunden
-    colorFill(strip.Color(0, 255, 0));
-    delay(500);
-    Serial.println("Verbunden mit WLAN: " + String(ssidToUse));
-    Serial.println("IP-Adresse: " + WiFi.localIP().toString());
+  WiFi.setAutoReconnect(true);
+
+  // Letzten Access Point direkt ansprechen, spart den Scan (und ggf. DHCP)
+  WifiCache cache;
+  const bool fast = loadWifiCache(store, cache);
+  if (fast) {
+    if (WIFI_CACHE_STATIC_IP) {
+      WiFi.config(IPAddress(cache.ip), IPAddress(cache.gateway), IPAddress(cache.subnet), IPAddress(cache.dns));
+    }
+    WiFi.begin(ssidToUse, passwordToUse, cache.channel, cache.bssid);
   } else {
-    // Verbindung fehlgeschlagen, starte Access Point als Fallback
-    Serial.println("Verbindung zu WLAN fehlgeschlagen, starte Access Point...");
-    WiFi.mode(WIFI_AP);
-    WiFi.softAP("Rocket-Config", "rocket123");
-    
-    // LED-Anzeige für Access Point Modus
-    colorFill(strip.Color(0, 0, 255));
-    delay(500);
-    colorFill(strip.Color(0, 0, 0));
-    delay(500);
-    colorFill(strip.Color(0, 0, 255));
-    
-    // Starte den Webserver für die Konfiguration
-    setupWebServer();
-    
-    Serial.println("Access Point gestartet");
-    Serial.println("SSID: Rocket-Config");
-    Serial.println("Passwort: rocket123");
-    Serial.println("IP-Adresse: " + WiFi.softAPIP().toString());
-    Serial.println("Öffnen Sie einen Browser und gehen Sie zu: http://" + WiFi.softAPIP().toString());
+    WiFi.begin(ssidToUse, passwordToUse);
+  }
+  wifiSupervisor.begin(fast);
+  Serial.printf("Verbinde mit WLAN: %s%s\n", ssidToUse, fast ? " (direkt)" : "");
+}
+
+// Nach gescheiterter Direktverbindung normal mit Scan und DHCP verbinden
+void connectWiFiWithScan() {
+  char savedSsid[33];
+  char savedPassword[65];
+  store.getString("wifi_ssid", savedSsid, sizeof(savedSsid));
+  store.getString("wifi_password", savedPassword, sizeof(savedPassword));
+
+  Serial.println("Direktverbindung fehlgeschlagen, suche WLAN...");
+  WiFi.disconnect();
+  if (WIFI_CACHE_STATIC_IP) {
+    WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);
+  }
+  WiFi.begin(savedSsid[0] != '\0' ? savedSsid : WIFI_ssid,
+             savedPassword[0] != '\0' ? savedPassword : WIFI_password);
+}
+
+// Access Point und Lease der aktuellen Verbindung für den nächsten Start merken
+void saveCurrentWifi() {
+  const uint8_t* bssid = WiFi.BSSID();
+  if (bssid == nullptr) {
+    return;
+  }
+  WifiCache cache;
+  memcpy(cache.bssid, bssid, sizeof(cache.bssid));
+  cache.channel = WiFi.channel();
+  cache.ip = WiFi.localIP();
+  cache.gateway = WiFi.gatewayIP();
+  cache.subnet = WiFi.subnetMask();
+  cache.dns = WiFi.dnsIP();
+  saveWifiCache(store, cache);
+}
+
+// Access Point zusätzlich zur Station, die Station versucht es weiter
+void startConfigPortal() {
+  Serial.println("Keine WLAN Verbindung, starte Access Point...");
+  WiFi.mode(WIFI_AP_STA);
+  WiFi.softAP("Rocket-Config", "rocket123");
+  sendLedCommand(LedCommand::LED_PULSE, strip.Color(0, 0, 255));
+
+  // Starte den Webserver für die Konfiguration
+  startWebServer();
+
+  Serial.println("Access Point gestartet");
+  Serial.println("SSID: Rocket-Config");
+  Serial.println("Passwort: rocket123");
+  printIp("IP-Adresse: ", WiFi.softAPIP());
+  printIp("Öffnen Sie einen Browser und gehen Sie zu: http://", WiFi.softAPIP());
+}
+
+// WLAN Zustand aus den Events auswerten
+void taskWiFi() {
+  switch (wifiSupervisor.update(wifiLinkUp)) {
+    case WifiSupervisor::WIFI_CONNECTED:
+      Serial.println("Verbunden mit WLAN");
+      printIp("IP-Adresse: ", WiFi.localIP());
+      saveCurrentWifi();
+      if (bootTimeline.mark(BOOT_WIFI_UP, millis())) {
+        bootTimeline.setFastConnect(wifiSupervisor.fastConnected());
+      }
+      // mDNS und OTA brauchen eine IP, einmalig nach der ersten Verbindung
+      if (wifiSupervisor.connectCount() == 1) {
+        setupMDNS();
+        setupOTA();
+        startWebServer();
+      }
+      break;
+    case WifiSupervisor::WIFI_DISCONNECTED:
+      Serial.println("WLAN Verbindung verloren");
+      break;
+    case WifiSupervisor::WIFI_FULL_SCAN:
+      connectWiFiWithScan();
+      break;
+    case WifiSupervisor::WIFI_START_PORTAL:
+      startConfigPortal();
+      break;
+    case WifiSupervisor::WIFI_STOP_PORTAL:
+      WiFi.softAPdisconnect(true);
+      WiFi.mode(WIFI_STA);
+      sendLedCommand(LedCommand::LED_STOP_PULSE);
+      Serial.println("WLAN wieder verbunden, Access Point beendet");
+      break;
+    case WifiSupervisor::WIFI_NONE:
+      break;
   }
 }
 
 void setup() {
   Serial.begin(115200);
-  Wire.begin();
+  Wire.begin(I2C_SDA_PIN, I2C_SCL_PIN);
+
+  // Alle Sensoren in Reset halten, damit keiner auf der Startadresse antwortet
+  for (VL53L0XSensor& rangeSensor : rangeSensors) {
+    rangeSensor.holdInReset();
+  }
   
   // LED Ring initialisieren
   strip.begin();           // INITIALIZE NeoPixel strip object (REQUIRED)
@@ -563,125 +853,494 @@ void setup() {
 
   // WiFi Setup
   setupWiFi();
-  loadCalibration();
-  
-  // ToF Sensor initialisieren
-  sensor.init();
-  sensor.setTimeout(500);
-  sensor.startContinuous(1000);
+  for (Tank& tank : tanks) {
+    tank.load(store);
+  }
+
+  // Journal mit Flash-Überlauf, falls die Partitionstabelle eine Partition "journal" hat
+  if (journalPartition.begin()) {
+    flashJournal.begin();
+    journal.setSpill(&flashJournal);
+    Serial.printf("Journal im Flash: %lu Einträge offen\n", (unsigned long)flashJournal.size());
+  }
+
+  // Verlauf, falls die Partitionstabelle eine Partition "history" hat
+  if (historyPartition.begin() && history.begin()) {
+    Serial.printf("Verlauf im Flash: %lu von %lu Minuten-Chunks belegt\n",
+                  (unsigned long)history.chunkCount(HISTORY_RAW), (unsigned long)history.capacity(HISTORY_RAW));
+  }
   
-  // OTA und MQTT nur starten, wenn wir mit einem WLAN verbunden sind
-  if (WiFi.status() == WL_CONNECTED) {
-    setupMDNS();
-    setupOTA();
-    setupMQTT();
+  // Journal, Verlauf und LED Ring gibt es nur einmal, sie gehören dem ersten Tank
+  if (TANK_COUNT > 1) {
+    Serial.printf("%u Tanks, Journal, Verlauf und LED Ring nur für %s\n", TANK_COUNT, tankConfigs[0].name);
   }
+
+  // ToF Sensoren einzeln wecken und auf ihre Adresse setzen, gemessen wird ab dem Sensor-Task
+  for (uint8_t i = 0; i < TANK_COUNT; i++) {
+    if (!rangeSensors[i].begin()) {
+      Serial.printf("Sensor %s (0x%02x) nicht gefunden\n", tankConfigs[i].name, tankConfigs[i].address);
+    }
+  }
+  
+  // MQTT und SNTP warten selbst auf das WLAN, mDNS und OTA folgen bei der ersten Verbindung
+  setupMQTT();
+  configTime(0, 0, "pool.ntp.org");
+
+  // Erfassung, Verarbeitung und LED laufen als eigene Tasks
+  xTaskCreate(processingTask, "processing", TASK_STACK_SIZE, nullptr,
+              PROCESSING_TASK_PRIORITY, &processingTaskHandle);
+  xTaskCreate(ledTask, "led", TASK_STACK_SIZE, nullptr,
+              LED_TASK_PRIORITY, &ledTaskHandle);
+  xTaskCreate(sensorTask, "sensor", TASK_STACK_SIZE, nullptr,
+              SENSOR_TASK_PRIORITY, &sensorTaskHandle);
+
+  networkTaskId = scheduler.every(NETWORK_INTERVAL, taskNetwork);
+  publishTaskId = scheduler.every(NETWORK_INTERVAL, taskPublish);
+  scheduler.every(STORE_INTERVAL, taskStore);
+  scheduler.every(HEAP_REPORT_INTERVAL, taskHeap);
+#if LATENCY_TRACKING
+  latencyMicros = []() -> uint32_t { return (uint32_t)esp_timer_get_time(); };
+  scheduler.every(LATENCY_REPORT_INTERVAL, taskLatency);
+#endif
 }
 
-void loop() {
+void taskNetwork() {
+  applySamplingMode();
+
+  taskWiFi();
+
   // OTA Update Handler (nur wenn mit WLAN verbunden)
-  if (WiFi.status() == WL_CONNECTED) {
+  if (wifiSupervisor.connected()) {
     ArduinoOTA.handle();
     
-    // MQTT Verbindung prüfen und ggf. wiederherstellen
-    if (!mqtt.connected()) {
-      unsigned long now = millis();
-      if (now - lastMqttReconnectAttempt > MQTT_RECONNECT_INTERVAL) {
-        lastMqttReconnectAttempt = now;
-        if (connectMQTT()) {
-          lastMqttReconnectAttempt = 0;
-        }
-      }
+    taskMqtt();
+    if (historyQueryPending && mqttSession.online()) {
+      publishHistory();
     }
-    mqtt.loop();
-  } else {
-    // Webserver bedienen, wenn wir im Access Point Modus sind
+  }
+
+  // Webserver bedienen, sobald Access Point oder Station ihn gestartet haben
+  if (webServerStarted) {
     server.handleClient();
   }
-  
-  // Wasserhöhe messen
-  uint16_t distance = sensor.readRangeContinuousMillimeters();
-  distance = distance + SENSOR_OFFSET;
+}
 
-  if (sensor.timeoutOccurred()) {
-    Serial.println("Sensor timeout!");
-    return;
+// Ergebnisse der Verarbeitung im Netzwerk-Task veröffentlichen
+void taskPublish() {
+  LevelEvent event;
+  while (publishQueue.pop(event)) {
+    Tank& tank = tanks[event.tank];
+    const DropEvent& drop = tank.update(event, store);
+    if (drop.type != DROP_NONE) {
+      Serial.printf("%s erkannt: %s %.0f ml in %lu s\n", drop.type == DROP_SHOT ? "Bezug" : "Spülung",
+                    tank.config().name, drop.volumeMl, (unsigned long)(drop.durationMs / 1000));
+    }
+    // Verlauf und Journal haben ein festes Format für einen Tank, weitere
+    // Tanks sind nur über MQTT und die HTTP API zu sehen
+    if (event.tank != 0) {
+      continue;
+    }
+
+    if (timeBase.synced()) {
+      history.record(timeBase.toEpoch(event.timestamp), event.waterLevel, event.distance);
+    }
+
+    // Ohne Broker für später aufheben
+    if (!mqttTransport.connected()) {
+      journal.record(event.timestamp, event);
+    }
   }
-  
-  // Wasserhöhe in Prozent umrechnen
-  float constrainedDistance = constrain(distance, waterMinMm, waterMaxMm);
-  float waterLevel = 100.0f - ((constrainedDistance - waterMinMm) * 100.0f /
-                              (waterMaxMm - waterMinMm));
-
-  // Prüfen ob gerade aufgefüllt wird
-  checkForRefill(waterLevel);
-            
-  // MQTT Update (nur wenn mit WLAN verbunden)
-  if (WiFi.status() == WL_CONNECTED) {
-    publishWaterLevel(waterLevel, distance);
+
+  // Sensorfehler nur bei Änderung mitsenden
+  static uint32_t reportedSensorErrors = 0;
+  const uint32_t sensorErrors = sensorTimeouts + sensorReadErrors + sensorRecoveries;
+  if (sensorErrors != reportedSensorErrors) {
+    reportedSensorErrors = sensorErrors;
+    publisher.updateSensorErrors(sensorTimeouts, sensorReadErrors, sensorRecoveries);
+  }
+
+  if (!timeBase.synced() && time(nullptr) > SNTP_VALID_AFTER) {
+    timeBase.sync(time(nullptr), millis());
+  }
+
+  // Weitere Tanks senden ihren eigenen Frame
+  for (uint8_t i = 1; i < TANK_COUNT; i++) {
+    if (wifiSupervisor.connected() && tanks[i].publisher().flush(millis())) {
+      Serial.printf("MQTT Update %s - Füllstand: %.1f%%, Auffüllungen: %lu\n", tankConfigs[i].name,
+                    tanks[i].publisher().lastWaterLevel(), (unsigned long)tanks[i].refills());
+    }
+  }
+
+  // Geänderte Werte als ein Frame senden (nur wenn mit WLAN verbunden)
+  if (wifiSupervisor.connected() && publisher.flush(millis())) {
+    Serial.printf("MQTT Update - Füllstand: %.1f%%, Auffüllungen: %lu\n",
+                  publisher.lastWaterLevel(), (unsigned long)tanks[0].refills());
+
+    // Erster Füllstand draußen: Start-Zeitleiste einmalig mitsenden
+    if (publisher.lastWaterLevel() >= 0 && bootTimeline.mark(BOOT_FIRST_PUBLISH, millis())) {
+      Serial.printf("Boot: WLAN %lu ms%s, MQTT %lu ms, erster Wert %lu ms\n",
+                    (unsigned long)bootTimeline.at(BOOT_WIFI_UP), bootTimeline.usedFastConnect() ? " (direkt)" : "",
+                    (unsigned long)bootTimeline.at(BOOT_MQTT_UP), (unsigned long)bootTimeline.at(BOOT_FIRST_PUBLISH));
+      publisher.updateBootTimeline(bootTimeline);
+    }
+  }
+
+  // Aufgelaufene Werte nach dem Reconnect schrittweise nachliefern
+  if (wifiSupervisor.connected() && journal.replay(mqttTransport, millis()) > 0 && journal.empty()) {
+    Serial.printf("Journal nachgeliefert: %lu Einträge, %lu verworfen\n",
+                  (unsigned long)journal.replayedCount(), (unsigned long)journal.droppedCount());
   }
-  
-  // LED Ring aktualisieren
-  updateLEDRing(waterLevel);
-  
-  delay(100);
 }
 
-void updateLEDRing(float waterLevel) {
-  //waterLevel = 90.0;
-  uint8_t green = 255;
-  long red = map(waterLevel, 0, 100, 0, 510);
-  
-  // bei 100% = 510; red=0, green=255
-  // 50% = 255; red=255, green=255
-  // 0% = 0; red=255, green=0
-  if (red > 255)
-    {
-      green = 255;
-      red = 510-red;
+#if LATENCY_TRACKING
+// Laufzeiten seit dem letzten Bericht, ohne Verbindung sammeln sie weiter
+void taskLatency() {
+  if (!mqttTransport.connected()) {
+    return;
+  }
+  char report[LATENCY_REPORT_SIZE];
+  if (formatLatencyReport(report, sizeof(report)) > 0) {
+    mqttTransport.publish(mqtt_topic_latency, report, false);
+  }
+}
+#endif
+
+// Fragmentierung sichtbar machen: größter Block sinkt, obwohl genug frei ist
+void taskHeap() {
+  publisher.updateHeap(ESP.getFreeHeap(), ESP.getMinFreeHeap(), ESP.getMaxAllocHeap());
+  for (uint8_t i = 0; i < TANK_COUNT; i++) {
+    if (publisherArenas[i].failureCount() > 0) {
+      Serial.printf("JSON Arena voll: %s %u von %u Bytes\n", tankConfigs[i].name,
+                    (unsigned)publisherArenas[i].usedBytes(), (unsigned)publisherArenas[i].capacity());
     }
-  else
-  {
-      green = red;
-      red = 255; 
   }
-  for(int i = 0; i < NUM_LEDS; i++) {
-      strip.setPixelColor(i, strip.Color(red, green, 0));
+}
+
+// Stromsparen je nach Abtastrate: im Modus langsam Modem-Sleep mit
+// DTIM und automatischer Light-Sleep, sonst schnelle Reaktion
+void applySamplingMode() {
+  const SamplingMode mode = samplingMode;
+  if (mode == appliedSamplingMode) {
+    return;
+  }
+  appliedSamplingMode = mode;
+  const bool slow = mode == SAMPLING_SLOW;
+
+  WiFi.setSleep(slow ? WIFI_PS_MAX_MODEM : WIFI_PS_MIN_MODEM);
+  scheduler.setInterval(networkTaskId, slow ? NETWORK_SLOW_INTERVAL : NETWORK_INTERVAL);
+  scheduler.setInterval(publishTaskId, slow ? NETWORK_SLOW_INTERVAL : NETWORK_INTERVAL);
+
+  // Schnell und normal ohne Frequenzskalierung (min = max)
+  esp_pm_config_t pm = {};
+  pm.max_freq_mhz = CPU_FREQ_MAX_MHZ;
+  pm.min_freq_mhz = slow ? CPU_FREQ_SLOW_MIN_MHZ : CPU_FREQ_MAX_MHZ;
+  pm.light_sleep_enable = slow;
+  const bool lightSleep = esp_pm_configure(&pm) == ESP_OK && slow;
+
+  // Der Broker trennt nach 1,5 x dem beim Connect ausgehandelten Keepalive,
+  // ein längerer Wert wird daher erst beim nächsten Connect wirksam. Während
+  // eines Verbindungsversuchs gehört der Client dem Connect-Task.
+  const MqttSession::State session = mqttSession.state();
+  if (session == MqttSession::SESSION_SETUP || session == MqttSession::SESSION_ONLINE) {
+    const uint16_t keepAlive = SamplingPolicy::samplingKeepAlive(mode);
+    mqtt.setKeepAlive(keepAlive < mqttKeepAlive ? keepAlive : mqttKeepAlive);
+  }
+
+  Serial.printf("Abtastrate: %s (%lu ms), Light-Sleep: %s\n", SamplingPolicy::modeName(mode),
+                (unsigned long)SamplingPolicy::samplingInterval(mode), lightSleep ? "an" : "aus");
+}
+
+// Geänderte Einstellungen nach einer Ruhephase gesammelt in den Flash schreiben
+void taskStore() {
+  if (store.flush()) {
+    Serial.printf("NVS geschrieben - Schreibzugriffe: %lu, Commits: %lu, übersprungen: %lu\n",
+                  (unsigned long)store.writeCount(), (unsigned long)store.flushCount(),
+                  (unsigned long)store.skippedCount());
+    publisher.updateStoreWrites(store.writeCount());
   }
-  strip.show(); 
 }
 
-// LED Helper functions
-void colorProgress(uint32_t color, int progress, int total) {
-  int progressLeds = map(progress, 0, total, 0, NUM_LEDS);
-  for(int i = 0; i < NUM_LEDS; i++) {
-    if(i < progressLeds) {
-      strip.setPixelColor(i, color);
+// Data Ready vom VL53L0X: nur den Sensor-Task wecken, gelesen wird dort
+void IRAM_ATTR sensorDataReadyISR() {
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(sensorTaskHandle, &woken);
+  portYIELD_FROM_ISR(woken);
+}
+
+// Sensor-Task: nur Messwerte erfassen und weiterreichen. Gelesen wird erst
+// nach Data Ready, ein Timeout wird gezählt statt zu warten. Mehrere
+// Sensoren messen zeitversetzt, gelesen wird, wer gerade fertig ist.
+void sensorTask(void* parameter) {
+  uint32_t lastSensorReading[TANK_COUNT];
+  uint8_t errorsInRow[TANK_COUNT] = {};
+  uint8_t missedEdges = 0;
+  SamplingMode mode = SAMPLING_NORMAL;
+  uint32_t interval = SamplingPolicy::samplingInterval(mode);
+  RangingSchedule schedule(TANK_COUNT);
+  schedule.restart(systemClock.millis(), interval);
+
+  bool interrupts = true;
+  for (const TankConfig& config : tankConfigs) {
+    if (config.intPin >= 0) {
+      pinMode(config.intPin, INPUT_PULLUP);
+      attachInterrupt(digitalPinToInterrupt(config.intPin), sensorDataReadyISR, FALLING);
     } else {
-      strip.setPixelColor(i, strip.Color(0,0,0));
+      interrupts = false;
+    }
+  }
+
+  for (;;) {
+    // Mit Interrupt bis Data Ready schlafen, sonst im halben Messabstand abfragen
+    uint32_t wait = interrupts ? interval + SENSOR_TIMEOUT
+                  : interval < SENSOR_INTERVAL ? interval : interval / 2;
+    const uint32_t nextStart = schedule.nextIn(systemClock.millis());
+    if (nextStart < wait) {
+      wait = nextStart;
+    }
+    const bool notified = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait)) > 0;
+
+    sensorPaused = sensorPauseRequested;
+    if (sensorPaused) {
+      continue;
+    }
+
+    // Messperiode der Sensoren an die Abtastrate anpassen, versetzt neu starten
+    if (mode != samplingMode) {
+      mode = samplingMode;
+      interval = SamplingPolicy::samplingInterval(mode);
+      schedule.restart(systemClock.millis(), interval);
+    }
+
+    for (uint8_t i = 0; i < TANK_COUNT; i++) {
+      uint32_t now = systemClock.millis();
+      if (schedule.due(i, now)) {
+        rangeSensors[i].setMeasurementPeriod(interval);
+        lastSensorReading[i] = now;
+        continue;
+      }
+      if (schedule.waiting(i)) {
+        continue;
+      }
+
+      // Auch mit Interrupt prüfen, eine verpasste Flanke wird so nachgeholt
+      bool failed = false;
+      if (!rangeSensors[i].dataReady()) {
+        if (now - lastSensorReading[i] > interval + SENSOR_TIMEOUT) {
+          sensorTimeouts++;
+          lastSensorReading[i] = now;
+          failed = true;
+        }
+      } else {
+        lastSensorReading[i] = now;
+
+        // Messwert da, aber nur durch den Timeout gefunden: GPIO1 ist nicht
+        // verdrahtet, statt alle interval + SENSOR_TIMEOUT einen Wert abfragen
+        if (interrupts) {
+          missedEdges = notified ? 0 : missedEdges + 1;
+          if (missedEdges >= SENSOR_MISSED_EDGES) {
+            for (const TankConfig& config : tankConfigs) {
+              detachInterrupt(digitalPinToInterrupt(config.intPin));
+            }
+            interrupts = false;
+            Serial.printf("Kein Data Ready Interrupt an GPIO %d, Sensoren werden abgefragt\n", tankConfigs[i].intPin);
+          }
+        }
+
+        // Wasserhöhe messen
+        uint16_t distance = 0;
+        bool read;
+        {
+          LATENCY_SCOPE(PROBE_SENSOR_READ);
+          read = rangeSensors[i].readMillimeters(distance);
+        }
+        if (!read) {
+          sensorReadErrors++;
+          failed = true;
+        } else {
+          errorsInRow[i] = 0;
+          sampleQueue.push({now, distance, i});
+          xTaskNotifyGive(processingTaskHandle);
+        }
+      }
+
+      // Sensor hängt: Bus freitakten und Sensor neu initialisieren
+      if (failed && ++errorsInRow[i] >= SENSOR_RECOVERY_ERRORS) {
+        errorsInRow[i] = 0;
+        sensorRecoveries++;
+        Serial.printf("Sensor %s antwortet nicht, I2C Recovery: %s\n", tankConfigs[i].name,
+                      rangeSensors[i].recover() ? "ok" : "fehlgeschlagen");
+        lastSensorReading[i] = systemClock.millis();
+      }
     }
   }
-  strip.show();
 }
 
-void blink(uint32_t color, int wait) {
-  colorFill(color);
-  delay(wait);                           //  Pause for a moment
-  colorFill(strip.Color(0,0,0));
-  delay(wait);                           //  Pause for a moment
+// Verarbeitungs-Task: Füllstand berechnen und Auffüllungen erkennen.
+// Die Abtastrate richtet sich nach dem Tank, der sich am schnellsten ändert.
+void processingTask(void* parameter) {
+  LevelProcessor processors[TANK_COUNT];
+  SamplingPolicy samplingPolicies[TANK_COUNT];
+  for (uint8_t i = 0; i < TANK_COUNT; i++) {
+    processors[i].setCalibration(tanks[i].currentCalibration());
+  }
+
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    CalibrationUpdate update;
+    while (calibrationQueue.pop(update)) {
+      processors[update.tank].setCalibration(update.calibration);
+    }
+
+    SensorSample sample;
+    while (sampleQueue.pop(sample)) {
+      // Filtern, in Prozent umrechnen und prüfen ob gerade aufgefüllt wird
+      LevelProcessor& processor = processors[sample.tank];
+      LevelEvent event = processor.process(sample);
+      publishQueue.push(event);
+      if (event.tank == 0) {
+        ledQueue.push(event);
+      }
+
+      // Änderungsrate bestimmt die nächste Abtastrate
+      if (samplingPolicies[sample.tank].update(event.timestamp, event.waterLevel, processor.refillActive())) {
+        SamplingMode fastest = SAMPLING_SLOW;
+        for (const SamplingPolicy& policy : samplingPolicies) {
+          fastest = policy.mode() < fastest ? policy.mode() : fastest;
+        }
+        samplingMode = fastest;
+      }
+    }
+    xTaskNotifyGive(ledTaskHandle);
+  }
 }
 
-void colorWipe(uint32_t color, int wait) {
-  for(int i=0; i<strip.numPixels(); i++) { // For each pixel in strip...
-    strip.setPixelColor(i, color);         //  Set pixel's color (in RAM)
-    strip.show();                          //  Update strip to match
-    delay(wait);                           //  Pause for a moment
+// LED-Task: einziger Besitzer des LED Rings, sendet nur geänderte Bilder
+void ledTask(void* parameter) {
+  for (;;) {
+    // Wird pro Messwert oder Auftrag geweckt, während Animationen zum nächsten Bild
+    const uint32_t samplingInterval = SamplingPolicy::samplingInterval(samplingMode);
+    uint32_t wait = samplingInterval > LED_INTERVAL ? samplingInterval : LED_INTERVAL;
+    const uint32_t nextFrame = leds.nextFrameIn(millis());
+    if (nextFrame > 0 && nextFrame < wait) {
+      wait = nextFrame;
+    }
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait));
+
+    const uint32_t now = millis();
+    LedCommand command;
+    while (ledCommandQueue.pop(command)) {
+      leds.apply(command, now);
+    }
+
+    LevelEvent event;
+    while (ledQueue.pop(event)) {
+      leds.setLevel(event.waterLevel);
+      if (event.refill) {
+        // Visuelle Bestätigung auf LED Ring
+        leds.flash(strip.Color(0,0,255), LED_FLASH_COUNT, LED_FLASH_INTERVAL, now);
+      }
+    }
+
+    leds.render(now);
   }
 }
 
-void colorFill(uint32_t color) {
-  for(int i=0; i<strip.numPixels(); i++) { // For each pixel in strip...
-    strip.setPixelColor(i, color);         //  Set pixel's color (in RAM)
+// Zählt die Allokationen des JSON Dokuments während des Benchmarks
+class BenchJsonAllocator : public ArduinoJson::Allocator {
+ public:
+  void* allocate(size_t size) override {
+    allocations++;
+    return malloc(size);
+  }
+
+  void deallocate(void* pointer) override {
+    free(pointer);
+  }
+
+  void* reallocate(void* pointer, size_t size) override {
+    allocations++;
+    return realloc(pointer, size);
+  }
+
+  uint32_t allocations = 0;
+};
+
+BenchJsonAllocator benchJsonAllocator;
+uint32_t benchFreeHeap = 0;
+
+uint64_t benchNanos() {
+  return (uint64_t)esp_timer_get_time() * 1000;
+}
+
+uint32_t benchAllocations() {
+  return benchJsonAllocator.allocations;
+}
+
+// Auf dem Gerät: Abnahme des freien Heaps während der Stufe
+void benchResetPeakHeap() {
+  benchFreeHeap = ESP.getFreeHeap();
+}
+
+uint32_t benchPeakHeap() {
+  uint32_t freeHeap = ESP.getFreeHeap();
+  return freeHeap < benchFreeHeap ? benchFreeHeap - freeHeap : 0;
+}
+
+void benchReport(const BenchResult& result) {
+  char line[160];
+  formatBenchResult(result, line, sizeof(line));
+  Serial.println(line);
+  mqtt.publish(mqtt_topic_benchmark, line, false);
+}
+
+// Nicht im MQTT Callback messen: der Sensor-Task soll erst den I2C Bus
+// freigeben, taskBenchmark() wartet darauf ohne den Netzwerk-Task zu blockieren
+void requestBenchmark() {
+  if (benchmarkTaskId != TASK_INVALID) {
+    return;  // läuft schon
+  }
+  benchmarkTaskId = scheduler.every(SENSOR_INTERVAL, taskBenchmark);
+  if (benchmarkTaskId == TASK_INVALID) {
+    Serial.println("Benchmark: kein freier Scheduler-Platz");
+    return;
+  }
+  Serial.println("Benchmark angefordert");
+  sensorPauseRequested = true;
+  xTaskNotifyGive(sensorTaskHandle);
+}
+
+// Gleiche Stufen wie env:bench, aber mit echtem Sensor und LED Ring.
+// Publiziert wird nur in einen Null-Transport, damit die Zustands-Topics
+// nicht mit Testwerten überschrieben werden.
+void taskBenchmark() {
+  if (!sensorPaused) {
+    return;
+  }
+  scheduler.cancel(benchmarkTaskId);
+  benchmarkTaskId = TASK_INVALID;
+  Serial.println("Benchmark gestartet");
+
+  // Der LED Ring gehört während der Messung dem Benchmark. Zwischen
+  // Suspend und Resume gibt es keinen Ausstieg.
+  vTaskSuspend(ledTaskHandle);
+  {
+    static const BenchHooks hooks = {benchNanos, benchAllocations, benchResetPeakHeap, benchPeakHeap};
+    BenchRunner runner(hooks, benchReport);
+    NullMqttTransport nullTransport;
+    StatePublisher benchPublisher(nullTransport, &benchJsonAllocator);
+    runHotPathBenchmarks(runner, BENCHMARK_ITERATIONS, rangeSensors[0], benchPublisher, ledStrip);
+  }
+  vTaskResume(ledTaskHandle);
+
+  sendLedCommand(LedCommand::LED_REDRAW);
+  sensorPauseRequested = false;
+}
+
+void loop() {
+  // Fällige Tasks ausführen und bis zur nächsten Deadline schlafen
+  uint32_t idle = scheduler.run();
+  if (idle > 0) {
+    delay(idle);
   }
-  strip.show();                          //  Update strip to match
 }
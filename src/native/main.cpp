@@ -0,0 +1,157 @@
+// Host build: runs the shared level processing and publish logic against
+// the in-memory fakes from HalFakes.h.
+//
+//   pio run -e native && .pio/build/native/program [trace.txt]
+//
+// The optional trace file contains one raw distance in mm per line, sampled
+// once per second. Without a file a synthetic trace is used. The broker is
+// unreachable for the middle third of the trace; readings from that time
+// go to the journal and are replayed after the reconnect. Mode changes of
+// the adaptive sampling policy are printed with the time spent per mode,
+// the consumption analytics with their counts and prediction.
+// At the end the latency report of the processing stages is printed.
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+#include <HalFakes.h>
+#include <Journal.h>
+#include <CachedStore.h>
+#include <SamplingPolicy.h>
+#include <WaterLevel.h>
+#include <Publisher.h>
+#include <LedCompositor.h>
+#include <Tank.h>
+
+const uint32_t SAMPLE_INTERVAL = 1000;  // startContinuous(1000) auf dem Gerät
+const TankConfig TANK_CONFIG = {"wasserstand", "", -1, 0x29, -1, 0};
+
+// Tank leert sich langsam, dazwischen Spritzer, dann eine Auffüllung
+std::vector<uint16_t> syntheticTrace() {
+  std::vector<uint16_t> trace;
+  for (int i = 0; i < 120; i++) {
+    trace.push_back(60 + i);
+    if (i % 17 == 0) {
+      trace.back() = 30;  // Reflexion
+    }
+  }
+  for (int i = 0; i < 8; i++) {
+    trace.push_back(180 - i * 16);
+  }
+  for (int i = 0; i < 30; i++) {
+    trace.push_back(55);
+  }
+  return trace;
+}
+
+bool loadTrace(const char* path, std::vector<uint16_t>& trace) {
+  FILE* file = fopen(path, "r");
+  if (!file) {
+    return false;
+  }
+  unsigned value = 0;
+  while (fscanf(file, "%u", &value) == 1) {
+    trace.push_back((uint16_t)value);
+  }
+  fclose(file);
+  return true;
+}
+
+int main(int argc, char** argv) {
+  std::vector<uint16_t> trace;
+  if (argc > 1) {
+    if (!loadTrace(argv[1], trace)) {
+      fprintf(stderr, "Trace %s nicht lesbar\n", argv[1]);
+      return 1;
+    }
+  } else {
+    trace = syntheticTrace();
+  }
+
+#if LATENCY_TRACKING
+  latencyMicros = []() -> uint32_t {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+  };
+#endif
+
+  FakeClock clock;
+  FakeRangeSensor sensor(trace.data(), trace.size());
+  MemoryStore memory;
+  CachedStore<STORE_DEVICE_KEYS + TANK_KEY_COUNT> store(memory, clock);
+  FakeLedStrip strip(16);
+  LedCompositor<16> leds(strip);
+  FakeMqttTransport transport;
+  Tank tank(0, TANK_CONFIG, transport);
+  TimeBase timeBase;
+  MemoryFlash flash(16 * 1024, 4096);
+  FlashJournal flashJournal(flash);
+  flashJournal.begin();
+  OfflineJournal journal(timeBase, &flashJournal);
+  const size_t outageStart = trace.size() / 3;
+  const size_t outageEnd = trace.size() * 2 / 3;
+  size_t sampleIndex = 0;
+  SamplingPolicy samplingPolicy;
+  uint32_t modeTime[3] = {0, 0, 0};
+
+  tank.load(store);
+  LevelProcessor processor(tank.currentCalibration());
+
+  while (sensor.dataReady()) {
+    clock.advance(SAMPLE_INTERVAL);
+    transport.isConnected = sampleIndex < outageStart || sampleIndex >= outageEnd;
+    sampleIndex++;
+    uint16_t distance = 0;
+    if (!sensor.readMillimeters(distance)) {
+      continue;
+    }
+
+    LevelEvent event = processor.process({clock.millis(), distance});
+    modeTime[samplingPolicy.mode()] += SAMPLE_INTERVAL;
+    if (samplingPolicy.update(clock.millis(), event.waterLevel, processor.refillActive())) {
+      printf("Abtastrate t=%lus: %s (%.1f %%/min)\n", (unsigned long)(clock.millis() / 1000),
+             SamplingPolicy::modeName(samplingPolicy.mode()), samplingPolicy.rate());
+    }
+    tank.update(event, store);
+    if (!transport.connected()) {
+      journal.record(event.timestamp, event);
+    }
+    tank.publisher().flush(clock.millis());
+    journal.replay(transport, clock.millis());
+    store.flush();
+
+    leds.setLevel(event.waterLevel);
+    if (event.refill) {
+      leds.flash(ledColor(0, 0, 255), LED_FLASH_COUNT, LED_FLASH_INTERVAL, clock.millis());
+    }
+    leds.render(clock.millis());
+  }
+
+  store.flushNow();
+
+  for (const FakeMqttTransport::Message& message : transport.messages) {
+    printf("%s %s\n", message.topic.c_str(), message.payload.c_str());
+  }
+  printf("Messwerte: %u, Publishes: %u, Auffüllungen: %lu, NVS Schreibzugriffe: %lu\n",
+         (unsigned)trace.size(), (unsigned)transport.messages.size(),
+         (unsigned long)tank.refills(), (unsigned long)memory.writes);
+  printf("Abtastrate: schnell %lus, normal %lus, langsam %lus\n",
+         (unsigned long)(modeTime[SAMPLING_FAST] / 1000), (unsigned long)(modeTime[SAMPLING_NORMAL] / 1000),
+         (unsigned long)(modeTime[SAMPLING_SLOW] / 1000));
+  printf("LED: %lu Bilder gesendet, %lu unverändert\n",
+         (unsigned long)leds.showCount(), (unsigned long)leds.skipCount());
+  const ConsumptionStats& stats = tank.consumptionStats();
+  printf("Verbrauch: %lu Bezüge, %lu Spülungen, 24 h %.0f ml, %.1f ml/h, leer in %.1f h\n",
+         (unsigned long)stats.shots, (unsigned long)stats.rinses, stats.usage24hMl, stats.usageRateMlH,
+         stats.hoursToEmpty);
+  printf("Journal: %lu nachgeliefert, %lu offen, %lu verworfen\n",
+         (unsigned long)journal.replayedCount(), (unsigned long)journal.size(),
+         (unsigned long)journal.droppedCount());
+#if LATENCY_TRACKING
+  char report[LATENCY_REPORT_SIZE];
+  if (formatLatencyReport(report, sizeof(report)) > 0) {
+    printf("Latenz (us): %s\n", report);
+  }
+#endif
+  return 0;
+}
@@ -0,0 +1,228 @@
+// Consumption analytics on synthetic level traces
+//
+//   pio test -e native -f test_consumption
+//
+// Levels are fed once per second like the network task does. Volumes
+// follow from TANK_CAPACITY_ML (1 % = 25 ml), rates from exact linear
+// declines, so the expected values can be worked out by hand.
+#include <stdint.h>
+#include <unity.h>
+#include <Consumption.h>
+
+const float ML_PER_PERCENT = TANK_CAPACITY_ML / 100;
+const uint32_t SECOND = 1000;
+const uint32_t HOUR = 3600000;
+
+uint32_t now = 0;
+
+// Hält den Pegel für duration ms, ein Wert pro Sekunde
+void hold(ConsumptionAnalytics& analytics, float level, uint32_t duration) {
+  for (uint32_t end = now + duration; now != end; now += SECOND) {
+    analytics.update(now, level, false);
+  }
+}
+
+// Fällt gleichmäßig von from nach to über duration ms
+void ramp(ConsumptionAnalytics& analytics, float from, float to, uint32_t duration) {
+  const uint32_t steps = duration / SECOND;
+  for (uint32_t i = 0; i < steps; i++) {
+    analytics.update(now, from + (to - from) * i / steps, false);
+    now += SECOND;
+  }
+}
+
+void setUp() { now = 0; }
+void tearDown() {}
+
+void test_shot_volume() {
+  ConsumptionAnalytics analytics;
+  hold(analytics, 80, 30 * SECOND);
+  ramp(analytics, 80, 78, 4 * SECOND);  // 2 % = 50 ml
+  hold(analytics, 78, DROP_SETTLE_TIME - SECOND);
+  TEST_ASSERT_EQUAL_UINT32(0, analytics.statistics().shots);
+
+  // Erst nach DROP_SETTLE_TIME ohne neues Minimum gemeldet
+  bool reported = false;
+  for (int i = 0; i < 3 && !reported; i++) {
+    analytics.update(now, 78, false);
+    reported = analytics.drop().type != DROP_NONE;
+    now += SECOND;
+  }
+  TEST_ASSERT_TRUE(reported);
+  TEST_ASSERT_EQUAL(DROP_SHOT, analytics.drop().type);
+  TEST_ASSERT_FLOAT_WITHIN(0.5f, 2 * ML_PER_PERCENT, analytics.drop().volumeMl);
+
+  const ConsumptionStats& stats = analytics.statistics();
+  TEST_ASSERT_EQUAL_UINT32(1, stats.shots);
+  TEST_ASSERT_EQUAL_UINT32(0, stats.rinses);
+  TEST_ASSERT_FLOAT_WITHIN(0.5f, 50, stats.lastDropMl);
+  TEST_ASSERT_FLOAT_WITHIN(0.5f, 50, stats.usage24hMl);
+}
+
+void test_rinse_above_shot_limit() {
+  ConsumptionAnalytics analytics;
+  analytics.setCounts(7, 2);
+  hold(analytics, 90, 30 * SECOND);
+  ramp(analytics, 90, 80, 20 * SECOND);  // 250 ml
+  hold(analytics, 80, DROP_SETTLE_TIME + 2 * SECOND);
+
+  const ConsumptionStats& stats = analytics.statistics();
+  TEST_ASSERT_EQUAL_UINT32(7, stats.shots);
+  TEST_ASSERT_EQUAL_UINT32(3, stats.rinses);
+  TEST_ASSERT_FLOAT_WITHIN(1, 250, stats.lastDropMl);
+
+  // Knapp unter SHOT_MAX_ML zählt noch als Bezug
+  const float shot = (SHOT_MAX_ML - 2) / ML_PER_PERCENT;
+  ramp(analytics, 80, 80 - shot, 5 * SECOND);
+  hold(analytics, 80 - shot, DROP_SETTLE_TIME + 2 * SECOND);
+  TEST_ASSERT_EQUAL_UINT32(8, stats.shots);
+  TEST_ASSERT_EQUAL_UINT32(3, stats.rinses);
+  TEST_ASSERT_FLOAT_WITHIN(0.5f, 250 + SHOT_MAX_ML - 2, stats.usage24hMl);
+}
+
+void test_noise_and_small_falls_ignored() {
+  ConsumptionAnalytics analytics;
+  for (int i = 0; i < 600; i++) {
+    analytics.update(now, 60 + (i % 2 ? 0.45f : -0.45f), false);
+    now += SECOND;
+  }
+  // Gemessen am höchsten Wert im Fenster (60,45) bleibt der Abfall unter 1 %
+  ramp(analytics, 60, 59.6f, 3 * SECOND);
+  hold(analytics, 59.6f, 2 * DROP_TIME_WINDOW);
+  // Langsames Absinken (Verdunstung) über viele Fenster
+  ramp(analytics, 59.6f, 55, 30 * 60 * SECOND);
+  hold(analytics, 55, 2 * DROP_SETTLE_TIME);
+
+  const ConsumptionStats& stats = analytics.statistics();
+  TEST_ASSERT_EQUAL_UINT32(0, stats.shots);
+  TEST_ASSERT_EQUAL_UINT32(0, stats.rinses);
+  TEST_ASSERT_EQUAL_FLOAT(0, stats.usage24hMl);
+}
+
+void test_usage_leaves_after_24h() {
+  ConsumptionAnalytics analytics;
+  hold(analytics, 80, 30 * SECOND);
+  ramp(analytics, 80, 77, 3 * SECOND);  // 75 ml
+  hold(analytics, 77, DROP_SETTLE_TIME + 2 * SECOND);
+  TEST_ASSERT_FLOAT_WITHIN(0.5f, 75, analytics.statistics().usage24hMl);
+
+  // Eine Stunde später noch einmal 50 ml
+  now += HOUR - 60 * SECOND;
+  hold(analytics, 77, 30 * SECOND);
+  ramp(analytics, 77, 75, 3 * SECOND);
+  hold(analytics, 75, DROP_SETTLE_TIME + 2 * SECOND);
+  TEST_ASSERT_FLOAT_WITHIN(0.5f, 125, analytics.statistics().usage24hMl);
+
+  // Das Fach der ersten Entnahme fällt nach 24 h heraus, dann das zweite
+  now += 22 * HOUR;
+  analytics.update(now, 75, false);
+  TEST_ASSERT_FLOAT_WITHIN(0.5f, 125, analytics.statistics().usage24hMl);
+  now += HOUR;
+  analytics.update(now, 75, false);
+  TEST_ASSERT_FLOAT_WITHIN(0.5f, 50, analytics.statistics().usage24hMl);
+  now += HOUR;
+  analytics.update(now, 75, false);
+  TEST_ASSERT_EQUAL_FLOAT(0, analytics.statistics().usage24hMl);
+  TEST_ASSERT_EQUAL_UINT32(2, analytics.statistics().shots);
+}
+
+void test_buckets_across_millis_wrap() {
+  ConsumptionAnalytics analytics;
+  now = 0xFFFFFFFF - 40 * SECOND + 1;
+  hold(analytics, 80, 30 * SECOND);
+  ramp(analytics, 80, 78, 3 * SECOND);
+  hold(analytics, 78, DROP_SETTLE_TIME + 2 * SECOND);
+  TEST_ASSERT_EQUAL_UINT32(1, analytics.statistics().shots);
+  TEST_ASSERT_FLOAT_WITHIN(0.5f, 50, analytics.statistics().usage24hMl);
+
+  now += 23 * HOUR;
+  analytics.update(now, 78, false);
+  TEST_ASSERT_FLOAT_WITHIN(0.5f, 50, analytics.statistics().usage24hMl);
+  now += HOUR;
+  analytics.update(now, 78, false);
+  TEST_ASSERT_EQUAL_FLOAT(0, analytics.statistics().usage24hMl);
+}
+
+void test_refill_is_not_a_drop() {
+  ConsumptionAnalytics analytics;
+  hold(analytics, 80, 30 * SECOND);
+  ramp(analytics, 80, 77, 3 * SECOND);
+  // Auffüllung mitten in der Entnahme: die Entnahme verfällt
+  TEST_ASSERT_TRUE(analytics.update(now, 100, true));
+  now += SECOND;
+  hold(analytics, 100, 2 * DROP_SETTLE_TIME);
+  TEST_ASSERT_EQUAL_UINT32(0, analytics.statistics().shots);
+  TEST_ASSERT_EQUAL_FLOAT(0, analytics.statistics().usage24hMl);
+
+  // Danach zählt der neue, höhere Pegel als Ausgangspunkt
+  ramp(analytics, 100, 98, 3 * SECOND);
+  hold(analytics, 98, DROP_SETTLE_TIME + 2 * SECOND);
+  TEST_ASSERT_EQUAL_UINT32(1, analytics.statistics().shots);
+  TEST_ASSERT_FLOAT_WITHIN(0.5f, 50, analytics.statistics().lastDropMl);
+}
+
+void test_rate_and_time_to_empty() {
+  ConsumptionAnalytics analytics;
+  // 2 %/h = 50 ml/h, zu langsam für die Entnahme-Erkennung
+  const float perHour = 2;
+  analytics.update(now, 80, false);
+  for (uint32_t second = 1; second <= 6 * 3600; second++) {
+    now += SECOND;
+    analytics.update(now, 80 - perHour * second / 3600, false);
+    if (second == 30 * 60) {
+      TEST_ASSERT_TRUE(analytics.statistics().usageRateMlH < 0);  // unter TREND_MIN_SPAN_H
+      TEST_ASSERT_TRUE(analytics.statistics().hoursToEmpty < 0);
+    }
+  }
+  const ConsumptionStats& stats = analytics.statistics();
+  TEST_ASSERT_EQUAL_UINT32(0, stats.shots + stats.rinses);
+  TEST_ASSERT_FLOAT_WITHIN(0.5f, perHour * ML_PER_PERCENT, stats.usageRateMlH);
+  TEST_ASSERT_FLOAT_WITHIN(0.3f, 68 / perHour, stats.hoursToEmpty);
+
+  // Auffüllung: keine Prognose bis wieder eine Stunde Daten da ist
+  analytics.update(now, 100, true);
+  TEST_ASSERT_TRUE(stats.usageRateMlH < 0);
+  TEST_ASSERT_TRUE(stats.hoursToEmpty < 0);
+
+  // Konstanter Pegel: Rate 0, keine Leer-Prognose
+  hold(analytics, 100, 2 * HOUR);
+  TEST_ASSERT_FLOAT_WITHIN(0.5f, 0, stats.usageRateMlH);
+  TEST_ASSERT_TRUE(stats.hoursToEmpty < 0);
+
+  // Kalibrierung verwirft die Punkte
+  analytics.reset();
+  TEST_ASSERT_TRUE(stats.usageRateMlH < 0);
+}
+
+void test_rising_level_has_no_rate() {
+  ConsumptionAnalytics analytics;
+  for (uint32_t second = 0; second <= 3 * 3600; second++) {
+    analytics.update(now, 20 + 3.0f * second / 3600, false);
+    now += SECOND;
+  }
+  TEST_ASSERT_EQUAL_FLOAT(0, analytics.statistics().usageRateMlH);
+  TEST_ASSERT_TRUE(analytics.statistics().hoursToEmpty < 0);
+}
+
+void test_samples_rate_limited() {
+  ConsumptionAnalytics analytics;
+  TEST_ASSERT_TRUE(analytics.update(now, 50, false));  // erster Trendpunkt
+  TEST_ASSERT_FALSE(analytics.update(now + 200, 10, false));
+  TEST_ASSERT_FALSE(analytics.update(now + 999, 10, false));
+  TEST_ASSERT_FALSE(analytics.update(now + 1000, -1, false));  // kein Messwert
+  TEST_ASSERT_EQUAL_UINT32(0, analytics.statistics().shots);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_shot_volume);
+  RUN_TEST(test_rinse_above_shot_limit);
+  RUN_TEST(test_noise_and_small_falls_ignored);
+  RUN_TEST(test_usage_leaves_after_24h);
+  RUN_TEST(test_buckets_across_millis_wrap);
+  RUN_TEST(test_refill_is_not_a_drop);
+  RUN_TEST(test_rate_and_time_to_empty);
+  RUN_TEST(test_rising_level_has_no_rate);
+  RUN_TEST(test_samples_rate_limited);
+  return UNITY_END();
+}
@@ -0,0 +1,383 @@
+// Home Assistant discovery documents from the entity tables in MQTT_ha.h
+//
+//   pio test -e native -f test_ha_discovery
+//
+// Every entity is rendered for the first tank, for a tank with the longest
+// allowed name and for the controller, streamed through the fake transport
+// the same way the firmware sends it, and then read back with a small JSON
+// reader. The checks cover what Home Assistant silently ignores: unknown
+// keys, "~" without a base, value templates pointing at missing fields and
+// a length that differs from the announced one.
+#include <stdint.h>
+#include <stdio.h>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unity.h>
+#include <HalFakes.h>
+#include <MQTT_ha.h>
+#include <Publisher.h>
+#include <Tank.h>
+
+// Schlüssel die in den Tabellen vorkommen dürfen, alle aus der HA MQTT Doku
+const std::vector<std::string> HA_KEYS = {
+    "~", "availability", "availability_mode", "command_topic", "device", "device_class",
+    "enabled_by_default", "entity_category", "icon", "max", "min", "mode", "name", "object_id",
+    "origin", "payload_press", "state_class", "state_topic", "step", "unique_id",
+    "unit_of_measurement", "value_template",
+};
+
+const std::vector<std::string> HA_SENSOR_DEVICE_CLASSES = {"data_size", "distance", "duration", "humidity", "volume"};
+const std::vector<std::string> HA_STATE_CLASSES = {"measurement", "total_increasing"};
+
+bool contains(const std::vector<std::string>& list, const std::string& value) {
+  for (const std::string& item : list) {
+    if (item == value) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Prüft die Syntax und sammelt die Member des äußeren Objekts, Strings
+// ohne Anführungszeichen, alles andere als Rohtext
+class JsonReader {
+ public:
+  explicit JsonReader(std::string_view text) : text(text) {}
+
+  bool readObject(std::map<std::string, std::string>& members) {
+    skipSpace();
+    if (!consume('{')) {
+      return false;
+    }
+    skipSpace();
+    if (consume('}')) {
+      return atEnd();
+    }
+    do {
+      skipSpace();
+      std::string key;
+      if (!readString(key)) {
+        return false;
+      }
+      skipSpace();
+      if (!consume(':')) {
+        return false;
+      }
+      skipSpace();
+      const size_t start = pos;
+      if (!skipValue()) {
+        return false;
+      }
+      std::string value(text.substr(start, pos - start));
+      if (value.size() >= 2 && value.front() == '"') {
+        value = value.substr(1, value.size() - 2);
+      }
+      if (!members.emplace(key, value).second) {
+        return false;  // doppelter Schlüssel
+      }
+      skipSpace();
+    } while (consume(','));
+    return consume('}') && atEnd();
+  }
+
+ private:
+  bool skipValue() {
+    skipSpace();
+    if (pos >= text.size()) {
+      return false;
+    }
+    const char c = text[pos];
+    if (c == '"') {
+      std::string ignored;
+      return readString(ignored);
+    }
+    if (c == '{' || c == '[') {
+      const char close = c == '{' ? '}' : ']';
+      pos++;
+      skipSpace();
+      if (consume(close)) {
+        return true;
+      }
+      do {
+        skipSpace();
+        if (c == '{') {
+          std::string key;
+          skipSpace();
+          if (!readString(key) || (skipSpace(), !consume(':'))) {
+            return false;
+          }
+        }
+        if (!skipValue()) {
+          return false;
+        }
+        skipSpace();
+      } while (consume(','));
+      return consume(close);
+    }
+    for (const char* literal : {"true", "false", "null"}) {
+      if (text.substr(pos, strlen(literal)) == literal) {
+        pos += strlen(literal);
+        return true;
+      }
+    }
+    const size_t start = pos;
+    consume('-');
+    while (pos < text.size() && ((text[pos] >= '0' && text[pos] <= '9') || text[pos] == '.')) {
+      pos++;
+    }
+    return pos > start;
+  }
+
+  bool readString(std::string& out) {
+    if (!consume('"')) {
+      return false;
+    }
+    while (pos < text.size() && text[pos] != '"') {
+      if ((uint8_t)text[pos] < 0x20) {
+        return false;
+      }
+      if (text[pos] == '\\') {
+        out += text[pos++];
+      }
+      out += text[pos++];
+    }
+    return consume('"');
+  }
+
+  void skipSpace() {
+    while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\n' || text[pos] == '\r' || text[pos] == '\t')) {
+      pos++;
+    }
+  }
+
+  bool consume(char c) {
+    if (pos < text.size() && text[pos] == c) {
+      pos++;
+      return true;
+    }
+    return false;
+  }
+
+  bool atEnd() const { return pos == text.size(); }
+
+  std::string_view text;
+  size_t pos = 0;
+};
+
+// Wie publishHaDiscovery() in main.cpp
+bool publishHaDiscovery(FakeMqttTransport& transport, const HaEntity& entity, const HaInstance& instance) {
+  char topic[HA_TOPIC_MAX_LENGTH + 1];
+  const size_t topicLength = haDiscoveryTopic(entity, instance, topic, sizeof(topic));
+  TEST_ASSERT_LESS_THAN(sizeof(topic), topicLength);
+
+  if (!transport.beginPublish(topic, haDiscoveryLength(entity, instance), true)) {
+    return false;
+  }
+  {
+    MqttStreamWriter writer(transport);
+    writeHaDiscovery(entity, instance, [&](std::string_view part) {
+      writer.write((const uint8_t*)part.data(), part.size());
+    });
+  }
+  return transport.endPublish();
+}
+
+// Alle Felder eines vollen Frames, so wie sie der erste Tank sendet
+std::string fullStateFrame() {
+  FakeMqttTransport transport;
+  StatePublisher publisher(transport);
+  publisher.updateWaterLevel(50, 140);
+  publisher.updateRefillCount(1);
+  publisher.updateCalibration({50, 230});
+  publisher.updateFirmware("1.0.0");
+  publisher.updateStoreWrites(1);
+  publisher.updateSensorErrors(0, 0, 0);
+  publisher.updateConnectionStats(MqttSessionStats{});
+  publisher.updateBootTimeline(BootTimeline());
+  publisher.updateHeap(1, 1, 1);
+  ConsumptionStats consumption = {};
+  consumption.usageRateMlH = 1;
+  consumption.hoursToEmpty = 1;
+  publisher.updateConsumption(consumption);
+  TEST_ASSERT_TRUE(publisher.flush(0));
+  return transport.messages.back().payload;
+}
+
+// "{{ value_json.a.b }}" -> "a.b"
+std::string templateField(const std::string& valueTemplate) {
+  const std::string prefix = "{{ value_json.";
+  const std::string suffix = " }}";
+  TEST_ASSERT_EQUAL_INT(0, valueTemplate.compare(0, prefix.size(), prefix));
+  TEST_ASSERT_TRUE(valueTemplate.size() > prefix.size() + suffix.size());
+  TEST_ASSERT_EQUAL_INT(0, valueTemplate.compare(valueTemplate.size() - suffix.size(), suffix.size(), suffix));
+  return valueTemplate.substr(prefix.size(), valueTemplate.size() - prefix.size() - suffix.size());
+}
+
+// "~" steht in Home Assistant nur am Anfang oder Ende eines Topics
+std::string expandTopic(const std::map<std::string, std::string>& members, const std::string& value) {
+  if (value.empty() || value[0] != '~') {
+    TEST_ASSERT_TRUE(value.find('~') == std::string::npos);
+    return value;
+  }
+  const auto base = members.find("~");
+  TEST_ASSERT_TRUE(base != members.end());
+  return base->second + value.substr(1);
+}
+
+void checkDocument(const std::string& topic, const std::string& payload, const std::string& objectPrefix,
+                   const TankNames* tankNames) {
+  char message[160];
+  std::map<std::string, std::string> members;
+  JsonReader reader(payload);
+  snprintf(message, sizeof(message), "%s: invalid JSON", topic.c_str());
+  TEST_ASSERT_TRUE_MESSAGE(reader.readObject(members), message);
+
+  for (const auto& member : members) {
+    snprintf(message, sizeof(message), "%s: unknown key %s", topic.c_str(), member.first.c_str());
+    TEST_ASSERT_TRUE_MESSAGE(contains(HA_KEYS, member.first), message);
+  }
+
+  const std::string objectId = members["object_id"];
+  snprintf(message, sizeof(message), "%s: object_id %s", topic.c_str(), objectId.c_str());
+  TEST_ASSERT_EQUAL_STRING_MESSAGE(objectId.c_str(), members["unique_id"].c_str(), message);
+  const std::string expectedId = std::string(ha_node_id) + "_" + objectPrefix;
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, objectId.compare(0, expectedId.size(), expectedId), message);
+  TEST_ASSERT_TRUE_MESSAGE(topic.find("/" + objectId.substr(sizeof(ha_node_id)) + "/config") != std::string::npos,
+                           message);
+
+  if (members.count("device_class")) {
+    snprintf(message, sizeof(message), "%s: device_class %s", topic.c_str(), members["device_class"].c_str());
+    TEST_ASSERT_TRUE_MESSAGE(contains(HA_SENSOR_DEVICE_CLASSES, members["device_class"]), message);
+  }
+  if (members.count("state_class")) {
+    snprintf(message, sizeof(message), "%s: state_class %s", topic.c_str(), members["state_class"].c_str());
+    TEST_ASSERT_TRUE_MESSAGE(contains(HA_STATE_CLASSES, members["state_class"]), message);
+  }
+
+  // Tank Topics: "~" ist der Tank, Befehle landen in dessen Routen
+  if (members.count("state_topic")) {
+    const std::string stateTopic = expandTopic(members, members["state_topic"]);
+    if (tankNames) {
+      TEST_ASSERT_EQUAL_STRING_MESSAGE(tankNames->topic(), stateTopic.c_str(), message);
+    }
+  }
+  if (members.count("command_topic")) {
+    TEST_ASSERT_NOT_NULL(tankNames);
+    std::string_view suffix;
+    const std::string commandTopic = expandTopic(members, members["command_topic"]);
+    TEST_ASSERT_TRUE_MESSAGE(tankNames->matches(commandTopic, suffix), message);
+    TEST_ASSERT_TRUE_MESSAGE(suffix == mqtt_suffix_command || suffix == mqtt_suffix_set_min_mm ||
+                                 suffix == mqtt_suffix_set_max_mm,
+                             message);
+  }
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_tank_entities_render() {
+  const std::string frame = fullStateFrame();
+  const TankNames tanks[] = {TankNames(TANK_LEGACY_NAME), TankNames("tropfschale_abc")};
+  const char* labels[] = {"", "Tropfschale"};
+  TEST_ASSERT_EQUAL_size_t(HA_PREFIX_MAX_LENGTH, tanks[1].objectPrefix().size());
+
+  for (uint8_t t = 0; t < 2; t++) {
+    const HaInstance instance = {tanks[t].objectPrefix(), labels[t], tanks[t].topic()};
+    for (const HaEntity& entity : ha_tank_entities) {
+      FakeMqttTransport transport;
+      TEST_ASSERT_TRUE(publishHaDiscovery(transport, entity, instance));
+      const FakeMqttTransport::Message& message = transport.messages.back();
+      TEST_ASSERT_TRUE(message.retained);
+      TEST_ASSERT_EQUAL_size_t(haDiscoveryLength(entity, instance), message.payload.size());
+      checkDocument(message.topic, message.payload, std::string(tanks[t].objectPrefix()), &tanks[t]);
+
+      std::map<std::string, std::string> members;
+      JsonReader(message.payload).readObject(members);
+      if (entity.component != "button") {
+        const std::string field = templateField(members["value_template"]);
+        TEST_ASSERT_TRUE_MESSAGE(frame.find("\"" + field + "\":") != std::string::npos, field.c_str());
+      }
+      if (t == 1) {
+        TEST_ASSERT_EQUAL_INT(0, members["name"].compare(0, strlen(labels[t]) + 1, std::string(labels[t]) + " "));
+      }
+    }
+  }
+}
+
+void test_device_entities_render() {
+  const std::string frame = fullStateFrame();
+  for (const HaEntity& entity : ha_device_entities) {
+    FakeMqttTransport transport;
+    TEST_ASSERT_TRUE(publishHaDiscovery(transport, entity, HaInstance{}));
+    const FakeMqttTransport::Message& message = transport.messages.back();
+    TEST_ASSERT_EQUAL_size_t(haDiscoveryLength(entity, HaInstance{}), message.payload.size());
+    checkDocument(message.topic, message.payload, "", nullptr);
+
+    std::map<std::string, std::string> members;
+    JsonReader(message.payload).readObject(members);
+    TEST_ASSERT_TRUE(members.find("~") == members.end());
+    TEST_ASSERT_EQUAL_STRING("diagnostic", members["entity_category"].c_str());
+
+    const std::string field = templateField(members["value_template"]);
+    if (members["state_topic"] == mqtt_topic_watersum) {
+      TEST_ASSERT_TRUE_MESSAGE(frame.find("\"" + field + "\":") != std::string::npos, field.c_str());
+    } else {
+#if LATENCY_TRACKING
+      TEST_ASSERT_EQUAL_STRING(mqtt_topic_latency, members["state_topic"].c_str());
+      bool found = false;
+      for (const char* probe : latencyProbeNames) {
+        found |= field == std::string(probe) + ".p99";
+      }
+      TEST_ASSERT_TRUE_MESSAGE(found, field.c_str());
+#else
+      TEST_FAIL_MESSAGE(members["state_topic"].c_str());
+#endif
+    }
+  }
+}
+
+// object_id ist im Gerät eindeutig, auch über Tanks hinweg
+void test_object_ids_unique() {
+  const TankNames second("tropfschale");
+  std::vector<std::string> ids;
+  for (const HaEntity& entity : ha_device_entities) {
+    ids.push_back(std::string(entity.objectId));
+  }
+  for (const HaEntity& entity : ha_tank_entities) {
+    ids.push_back(std::string(entity.objectId));
+    ids.push_back(std::string(second.objectPrefix()) + std::string(entity.objectId));
+  }
+  for (size_t i = 0; i < ids.size(); i++) {
+    for (size_t j = i + 1; j < ids.size(); j++) {
+      TEST_ASSERT_TRUE_MESSAGE(ids[i] != ids[j], ids[i].c_str());
+    }
+  }
+}
+
+// Das angekündigte Längenfeld muss exakt stimmen, sonst verwirft der Broker
+// das Paket, und das Topic darf im Puffer nicht abgeschnitten werden
+void test_lengths_fit() {
+  const TankNames longest("abcdefghijklmno");
+  const HaInstance instance = {longest.objectPrefix(), "Abcdefghijklmno", longest.topic()};
+  for (const HaEntity& entity : ha_tank_entities) {
+    char topic[HA_TOPIC_MAX_LENGTH + 1];
+    const size_t length = haDiscoveryTopic(entity, instance, topic, sizeof(topic));
+    TEST_ASSERT_LESS_THAN(sizeof(topic), length);
+    TEST_ASSERT_EQUAL_size_t(haTopicLength(entity) + longest.objectPrefix().size(), length);
+
+    size_t rendered = 0;
+    writeHaDiscovery(entity, instance, [&](std::string_view part) { rendered += part.size(); });
+    TEST_ASSERT_EQUAL_size_t(haDiscoveryLength(entity, instance), rendered);
+  }
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_tank_entities_render);
+  RUN_TEST(test_device_entities_render);
+  RUN_TEST(test_object_ids_unique);
+  RUN_TEST(test_lengths_fit);
+  return UNITY_END();
+}
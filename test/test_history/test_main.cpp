@@ -0,0 +1,321 @@
+// Level history: chunk encoding, the flash ring and the open chunks
+//
+//   pio test -e native -f test_history
+//
+// Deltas are chosen at the edges of the prefix code (0, ±31/±32,
+// ±2047/±2048, full 32 bit) and a chunk is filled to its last bit, so an
+// off-by-one in the bit writer or reader shows up as a wrong value.
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <unity.h>
+#include <HalFakes.h>
+#include <History.h>
+
+const uint32_t START = 1700000000 - 1700000000 % HISTORY_DAY;
+const size_t SECTOR_SIZE = 4096;
+const uint32_t SLOTS_PER_SECTOR = SECTOR_SIZE / HISTORY_CHUNK_SIZE;
+
+typedef std::vector<std::vector<uint32_t>> Rows;
+
+// Kodiert alle Zeilen, neuer Chunk wenn einer voll ist
+template <uint8_t FIELDS>
+std::vector<HistoryChunk> encode(const Rows& rows, uint32_t step) {
+  std::vector<HistoryChunk> chunks;
+  HistoryEncoder<FIELDS> encoder;
+  encoder.start(HISTORY_RAW, step);
+  for (const auto& row : rows) {
+    uint32_t values[FIELDS];
+    memcpy(values, row.data(), sizeof(values));
+    if (!encoder.add(values)) {
+      chunks.push_back(encoder.chunk());
+      encoder.start(HISTORY_RAW, step);
+      TEST_ASSERT_TRUE(encoder.add(values));
+    }
+  }
+  if (!encoder.empty()) {
+    chunks.push_back(encoder.chunk());
+  }
+  return chunks;
+}
+
+template <uint8_t FIELDS>
+Rows decode(const std::vector<HistoryChunk>& chunks, uint32_t step) {
+  Rows rows;
+  for (const HistoryChunk& chunk : chunks) {
+    HistoryDecoder<FIELDS> decoder(chunk, step);
+    uint32_t values[FIELDS];
+    uint16_t count = 0;
+    while (decoder.next(values)) {
+      rows.emplace_back(values, values + FIELDS);
+      count++;
+    }
+    TEST_ASSERT_EQUAL_UINT16(chunk.header.count, count);
+  }
+  return rows;
+}
+
+template <uint8_t FIELDS>
+void assertRoundTrip(const Rows& rows, uint32_t step) {
+  const Rows decoded = decode<FIELDS>(encode<FIELDS>(rows, step), step);
+  TEST_ASSERT_EQUAL_UINT32(rows.size(), decoded.size());
+  for (size_t i = 0; i < rows.size(); i++) {
+    TEST_ASSERT_EQUAL_UINT32_ARRAY(rows[i].data(), decoded[i].data(), FIELDS);
+  }
+}
+
+HistoryChunk numberedChunk(uint32_t start) {
+  HistoryEncoder<3> encoder;
+  encoder.start(HISTORY_RAW, HISTORY_MINUTE);
+  const uint32_t values[3] = {start, 500, 120};
+  encoder.add(values);
+  return encoder.chunk();
+}
+
+// Startzeiten der Chunks in der Reihenfolge von forEach()
+std::vector<uint32_t> chunkStarts(HistoryLog& log) {
+  std::vector<uint32_t> starts;
+  log.forEach(0, [&](const HistoryChunk& chunk) {
+    starts.push_back(chunk.header.start);
+    return true;
+  });
+  return starts;
+}
+
+struct StringSink {
+  std::string text;
+  void write(const char* data, size_t length) { text.append(data, length); }
+  void print(std::string_view data) { text.append(data.data(), data.size()); }
+  void printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+    char line[128];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    text += line;
+  }
+};
+
+uint32_t countPoints(const std::string& json) {
+  uint32_t points = 0;
+  for (size_t i = json.find("\"points\":["); i != std::string::npos && i < json.size(); i++) {
+    points += json[i] == '[' ? 1 : 0;
+  }
+  return points - 1;  // ohne die Klammer von "points"
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_zigzag_and_code_lengths() {
+  const int32_t values[] = {0, 1, -1, 31, -32, 32, -33, 2047, -2048, 2048, -2049, INT32_MAX, INT32_MIN};
+  const uint8_t bits[] = {1, 8, 8, 8, 8, 15, 15, 15, 15, 35, 35, 35, 35};
+  for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+    TEST_ASSERT_EQUAL_INT32(values[i], historyUnzigzag(historyZigzag(values[i])));
+    TEST_ASSERT_EQUAL_UINT8(bits[i], historyValueBits(values[i]));
+  }
+}
+
+void test_round_trip_boundary_deltas() {
+  const int32_t deltas[] = {0, 1, -1, 31, -31, 32, -32, 33, -33, 2047, -2047, 2048, -2048, 2049, -2049, 40000, -40000};
+  Rows rows;
+  uint32_t level = 30000;
+  uint32_t distance = 32768;
+  uint32_t time = START;
+  for (int32_t delta : deltas) {
+    level += delta;
+    distance -= delta;
+    time += HISTORY_MINUTE;
+    rows.push_back({time, level, distance});
+  }
+  assertRoundTrip<3>(rows, HISTORY_MINUTE);
+}
+
+void test_round_trip_full_range() {
+  // Erster Wert in 16 bit, danach Sprünge über den ganzen Bereich
+  Rows rows = {{START, 0, 65535}, {START + 60, 65535, 0}, {START + 120, 0, 65535}};
+  rows.push_back({START + 180, 0x80000000u, 0xFFFFFFFFu});
+  rows.push_back({START + 240, 0, 1});
+  assertRoundTrip<3>(rows, HISTORY_MINUTE);
+}
+
+void test_round_trip_irregular_time() {
+  // Delta-of-delta an denselben Grenzen, in Einheiten von step
+  const uint32_t gaps[] = {1, 1, 2, 1, 33, 1, 34, 2050, 1, 1, 100000, 1};
+  Rows rows;
+  uint32_t time = START;
+  for (uint32_t gap : gaps) {
+    time += gap * HISTORY_MINUTE;
+    rows.push_back({time, 500, 120});
+  }
+  assertRoundTrip<3>(rows, HISTORY_MINUTE);
+
+  Rows hours;
+  time = START;
+  for (uint32_t i = 0; i < 400; i++) {
+    time += (i % 7 == 0 ? 2 : 1) * HISTORY_HOUR;
+    hours.push_back({time, 400 + i % 13, 600, 500, 60});
+  }
+  assertRoundTrip<5>(hours, HISTORY_HOUR);
+}
+
+void test_round_trip_many_chunks() {
+  Rows rows;
+  uint32_t seed = 7;
+  uint32_t level = 500;
+  for (uint32_t i = 0; i < 5000; i++) {
+    seed = seed * 1103515245u + 12345u;
+    level = (uint32_t)((int32_t)level + (int32_t)((seed >> 16) % 9) - 4);
+    rows.push_back({START + i * HISTORY_MINUTE, level, 120 + (seed >> 20) % 5});
+  }
+  const std::vector<HistoryChunk> chunks = encode<3>(rows, HISTORY_MINUTE);
+  TEST_ASSERT_GREATER_THAN(10, chunks.size());
+  assertRoundTrip<3>(rows, HISTORY_MINUTE);
+}
+
+// 32 bit Startwerte + 2 x 10 bit + 292 x 3 bit = 928 bit, genau der Payload
+void test_chunk_filled_to_last_bit() {
+  static_assert(HISTORY_PAYLOAD_SIZE * 8 == 32 + 2 * 10 + 292 * 3, "Aufteilung passt nicht mehr zum Payload");
+  HistoryEncoder<3> encoder;
+  encoder.start(HISTORY_RAW, HISTORY_MINUTE);
+  Rows rows;
+  uint32_t values[3] = {START, 500, 120};
+  rows.push_back({values[0], values[1], values[2]});
+  TEST_ASSERT_TRUE(encoder.add(values));
+  for (uint32_t i = 0; i < 2 + 292; i++) {
+    values[0] += HISTORY_MINUTE;
+    values[1] += i < 2 ? 5 : 0;  // '0' + '10'+6 bit + '0'
+    rows.push_back({values[0], values[1], values[2]});
+    TEST_ASSERT_TRUE(encoder.add(values));
+  }
+  TEST_ASSERT_EQUAL_UINT32(HISTORY_CHUNK_SIZE, encoder.usedBytes());
+  values[0] += HISTORY_MINUTE;
+  TEST_ASSERT_FALSE(encoder.add(values));  // kein Bit mehr frei
+  TEST_ASSERT_EQUAL_UINT16(rows.size(), encoder.chunk().header.count);
+
+  const Rows decoded = decode<3>({encoder.chunk()}, HISTORY_MINUTE);
+  TEST_ASSERT_EQUAL_UINT32(rows.size(), decoded.size());
+  for (size_t i = 0; i < rows.size(); i++) {
+    TEST_ASSERT_EQUAL_UINT32_ARRAY(rows[i].data(), decoded[i].data(), 3);
+  }
+}
+
+void test_decoder_stops_at_payload_end() {
+  HistoryChunk chunk = numberedChunk(START);
+  chunk.header.count = 2000;  // mehr als in den Payload passt
+  memset(chunk.payload, 0xFF, sizeof(chunk.payload));
+  HistoryDecoder<3> decoder(chunk, HISTORY_MINUTE);
+  uint32_t values[3];
+  uint32_t decoded = 0;
+  while (decoder.next(values)) {
+    decoded++;
+  }
+  TEST_ASSERT_LESS_THAN(2000, decoded);
+}
+
+void test_log_append_across_full_sector() {
+  MemoryFlash flash(4 * SECTOR_SIZE, SECTOR_SIZE);
+  HistoryLog log;
+  log.begin(flash, SECTOR_SIZE, 3 * SECTOR_SIZE);  // erster Sektor gehört jemand anderem
+  TEST_ASSERT_EQUAL_UINT32(3 * SLOTS_PER_SECTOR, log.capacity());
+
+  // Ring voll, dann über die Sektorgrenze hinaus: der älteste Sektor wird gelöscht
+  const uint32_t total = 3 * SLOTS_PER_SECTOR + 5;
+  for (uint32_t i = 0; i < total; i++) {
+    HistoryChunk chunk = numberedChunk(START + i * HISTORY_MINUTE);
+    TEST_ASSERT_TRUE(log.append(chunk));
+  }
+  TEST_ASSERT_EQUAL_UINT32(2 * SLOTS_PER_SECTOR + 5, log.chunkCount());
+  TEST_ASSERT_EQUAL_UINT32(4, flash.erases);
+
+  std::vector<uint32_t> starts = chunkStarts(log);
+  TEST_ASSERT_EQUAL_UINT32(log.chunkCount(), starts.size());
+  for (size_t i = 0; i < starts.size(); i++) {
+    TEST_ASSERT_EQUAL_UINT32(START + (SLOTS_PER_SECTOR + i) * HISTORY_MINUTE, starts[i]);
+  }
+  // Fremder Sektor unberührt
+  for (size_t i = 0; i < SECTOR_SIZE; i++) {
+    TEST_ASSERT_EQUAL_HEX8(0xFF, flash.bytes[i]);
+  }
+
+  // Neustart: gleiche Schreibposition, Sequenz läuft weiter
+  HistoryLog restarted;
+  restarted.begin(flash, SECTOR_SIZE, 3 * SECTOR_SIZE);
+  TEST_ASSERT_EQUAL_UINT32(log.chunkCount(), restarted.chunkCount());
+  HistoryChunk chunk = numberedChunk(START + total * HISTORY_MINUTE);
+  TEST_ASSERT_TRUE(restarted.append(chunk));
+  TEST_ASSERT_EQUAL_UINT32(total, chunk.header.sequence);
+  starts = chunkStarts(restarted);
+  TEST_ASSERT_EQUAL_UINT32(START + total * HISTORY_MINUTE, starts.back());
+  TEST_ASSERT_EQUAL_UINT32(START + (SLOTS_PER_SECTOR + 0) * HISTORY_MINUTE, starts.front());
+}
+
+void test_log_skips_torn_slot() {
+  MemoryFlash flash(3 * SECTOR_SIZE, SECTOR_SIZE);
+  HistoryLog log;
+  log.begin(flash, 0, flash.size());
+  for (uint32_t i = 0; i < 3; i++) {
+    HistoryChunk chunk = numberedChunk(START + i * HISTORY_MINUTE);
+    log.append(chunk);
+  }
+  // Stromausfall mitten im vierten Chunk: nur ein Teil des Headers steht
+  const uint32_t sequence = 3;
+  flash.write(3 * HISTORY_CHUNK_SIZE, &sequence, sizeof(sequence));
+
+  HistoryLog restarted;
+  restarted.begin(flash, 0, flash.size());
+  HistoryChunk chunk = numberedChunk(START + 10 * HISTORY_MINUTE);
+  TEST_ASSERT_TRUE(restarted.append(chunk));
+  const std::vector<uint32_t> starts = chunkStarts(restarted);
+  TEST_ASSERT_EQUAL_UINT32(4, starts.size());  // der zerrissene Slot zählt nicht
+  TEST_ASSERT_EQUAL_UINT32(START + 10 * HISTORY_MINUTE, starts.back());
+}
+
+// Die Minuten einer Stunde stehen spätestens nach dem Stundenwechsel im Flash
+void test_open_minutes_written_each_hour() {
+  MemoryFlash flash(16 * SECTOR_SIZE, SECTOR_SIZE);
+  History history(flash);
+  TEST_ASSERT_TRUE(history.begin());
+
+  // Konstanter Füllstand: ein Chunk würde viele Stunden reichen
+  const uint32_t seconds = 3 * HISTORY_HOUR + 30 * HISTORY_MINUTE;
+  for (uint32_t t = 0; t < seconds; t += 10) {
+    history.record(START + t, 50.0f, 120);
+  }
+  TEST_ASSERT_EQUAL_UINT32(3, history.writeCount(HISTORY_RAW));
+  TEST_ASSERT_EQUAL_UINT32(0, history.writeCount(HISTORY_HOURLY));
+
+  // Stromausfall ohne flush(): nur die offene halbe Stunde fehlt. Die
+  // erste Minute nach der Stunde schließt sie ab und steht mit im Chunk.
+  History restarted(flash);
+  TEST_ASSERT_TRUE(restarted.begin());
+  StringSink sink;
+  restarted.query(sink, {START, START + seconds, HISTORY_RAW});
+  TEST_ASSERT_EQUAL_UINT32(3 * 60 + 1, countPoints(sink.text));
+
+  // Tageswechsel schreibt den Stunden-Chunk
+  for (uint32_t t = seconds; t < HISTORY_DAY + 2 * HISTORY_HOUR; t += 30) {
+    history.record(START + t, 50.0f, 120);
+  }
+  TEST_ASSERT_EQUAL_UINT32(1, history.writeCount(HISTORY_HOURLY));
+  TEST_ASSERT_EQUAL_UINT32(0, history.writeCount(HISTORY_DAILY));
+  TEST_ASSERT_EQUAL_UINT32(25, history.writeCount(HISTORY_RAW));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_zigzag_and_code_lengths);
+  RUN_TEST(test_round_trip_boundary_deltas);
+  RUN_TEST(test_round_trip_full_range);
+  RUN_TEST(test_round_trip_irregular_time);
+  RUN_TEST(test_round_trip_many_chunks);
+  RUN_TEST(test_chunk_filled_to_last_bit);
+  RUN_TEST(test_decoder_stops_at_payload_end);
+  RUN_TEST(test_log_append_across_full_sector);
+  RUN_TEST(test_log_skips_torn_slot);
+  RUN_TEST(test_open_minutes_written_each_hour);
+  return UNITY_END();
+}
@@ -0,0 +1,208 @@
+// HTTP API helpers: request parsing, ETags and streamed output
+//
+//   pio test -e native -f test_http_api
+//
+// findJsonValue() only has to understand the small bodies the portal and
+// scripts send, but it must not pick a key out of a string value or a
+// nested object. The writers are compared against LengthCounter, which
+// announces the length of a streamed response before it is written.
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <unity.h>
+#include <HttpApi.h>
+
+const char ETAG[] = "\"49206de344a0aaf4\"";
+
+// ChunkedWriter in einen String, zählt die gesendeten Stücke
+struct StringSink {
+  std::string text;
+  uint32_t chunks = 0;
+};
+
+template <typename Render>
+void renderBoth(Render render, StringSink& sink, size_t& counted) {
+  {
+    ChunkedWriter writer([&](const char* data, size_t length) {
+      TEST_ASSERT_LESS_OR_EQUAL(HTTP_CHUNK_SIZE, length);
+      sink.text.append(data, length);
+      sink.chunks++;
+    });
+    render(writer);
+  }
+  LengthCounter counter;
+  render(counter);
+  counted = counter.length();
+}
+
+std::string value(std::string_view body, std::string_view key) { return std::string(findJsonValue(body, key)); }
+
+ApiState sampleState() {
+  ApiState state = {};
+  state.tanks[0] = {TANK_LEGACY_NAME, 62.5f, 143, 7, {40, 320}};
+  state.tanks[1] = {"tropfschale_abc", -1, 0, 0, {20, 90}};
+  state.tankCount = 2;
+  state.firmware = "1.4.0";
+  state.uptimeMs = 3600500;
+  state.mqttConnected = true;
+  state.sensorTimeouts = 2;
+  state.sensorReadErrors = 1;
+  state.freeHeap = 182344;
+  return state;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_find_json_value() {
+  TEST_ASSERT_EQUAL_STRING("120", value("{\"min_mm\":120,\"max_mm\":300}", "min_mm").c_str());
+  TEST_ASSERT_EQUAL_STRING("300", value("{\"min_mm\":120,\"max_mm\":300}", "max_mm").c_str());
+  TEST_ASSERT_EQUAL_STRING("300", value(" {\r\n \"min_mm\" : 120 ,\n\t\"max_mm\"\t:\t300\n}\n", "max_mm").c_str());
+  TEST_ASSERT_EQUAL_STRING("1700000000", value("{\"from\":\"1700000000\"}", "from").c_str());
+  TEST_ASSERT_EQUAL_STRING("hour", value("{\"res\":\"hour\",\"to\":5}", "res").c_str());
+  // Ganzes Token, "5.5" ist keine gültige Kalibrierung
+  TEST_ASSERT_EQUAL_STRING("5.5", value("{\"min_mm\":5.5}", "min_mm").c_str());
+  TEST_ASSERT_EQUAL_STRING("-5", value("{\"min_mm\":-5}", "min_mm").c_str());
+}
+
+void test_find_json_value_only_at_keys() {
+  // Schlüsseltext als Wert
+  TEST_ASSERT_EQUAL_STRING("5", value("{\"note\":\"min_mm\",\"min_mm\":5}", "min_mm").c_str());
+  TEST_ASSERT_EQUAL_STRING("", value("{\"note\":\"min_mm\"}", "min_mm").c_str());
+  // Mit escapten Anführungszeichen im Wert nachgebaut
+  TEST_ASSERT_EQUAL_STRING("3", value("{\"n\":\"a\\\",\\\"min_mm\\\":9\",\"min_mm\":3}", "min_mm").c_str());
+  TEST_ASSERT_EQUAL_STRING("", value("{\"n\":\"\\\"min_mm\\\":9\"}", "min_mm").c_str());
+  // In verschachtelten Objekten und Arrays
+  TEST_ASSERT_EQUAL_STRING("2", value("{\"a\":{\"min_mm\":1},\"min_mm\":2}", "min_mm").c_str());
+  TEST_ASSERT_EQUAL_STRING("", value("{\"a\":[{\"min_mm\":1}]}", "min_mm").c_str());
+  TEST_ASSERT_EQUAL_STRING("4", value("{\"a\":[\"]\",{\"b\":\"}\"}],\"min_mm\":4}", "min_mm").c_str());
+  // Teilstrings anderer Schlüssel
+  TEST_ASSERT_EQUAL_STRING("", value("{\"xmin_mm\":1,\"min_mmx\":2}", "min_mm").c_str());
+}
+
+void test_find_json_value_malformed() {
+  TEST_ASSERT_EQUAL_STRING("", value("", "min_mm").c_str());
+  TEST_ASSERT_EQUAL_STRING("", value("min_mm=5", "min_mm").c_str());
+  TEST_ASSERT_EQUAL_STRING("", value("[{\"min_mm\":5}]", "min_mm").c_str());
+  TEST_ASSERT_EQUAL_STRING("", value("{\"min_mm\":}", "min_mm").c_str());
+  TEST_ASSERT_EQUAL_STRING("", value("{\"min_mm\" 5}", "min_mm").c_str());
+  TEST_ASSERT_EQUAL_STRING("", value("{\"a\":1 \"min_mm\":5}", "min_mm").c_str());
+  TEST_ASSERT_EQUAL_STRING("", value("{\"a\":\"offen,\"min_mm\":5", "min_mm").c_str());
+  // Abgeschnitten nach dem Wert, der Wert selbst ist vollständig
+  TEST_ASSERT_EQUAL_STRING("5", value("{\"min_mm\":5", "min_mm").c_str());
+}
+
+void test_parse_calibration_json() {
+  Calibration calibration = {40, 320};
+  TEST_ASSERT_TRUE(parseCalibrationJson("{\"max_mm\":300}", calibration));
+  TEST_ASSERT_EQUAL_UINT16(40, calibration.minMm);
+  TEST_ASSERT_EQUAL_UINT16(300, calibration.maxMm);
+  TEST_ASSERT_FALSE(parseCalibrationJson("{\"min_mm\":5.5}", calibration));
+  TEST_ASSERT_FALSE(parseCalibrationJson("{\"note\":\"min_mm\"}", calibration));
+  TEST_ASSERT_FALSE(parseCalibrationJson("{\"min_mm\":400}", calibration));  // nicht unter max_mm
+  TEST_ASSERT_EQUAL_UINT16(40, calibration.minMm);
+}
+
+void test_etag_matches() {
+  TEST_ASSERT_TRUE(etagMatches(ETAG, ETAG));
+  TEST_ASSERT_TRUE(etagMatches("*", ETAG));
+  TEST_ASSERT_TRUE(etagMatches("W/\"49206de344a0aaf4\"", ETAG));
+  TEST_ASSERT_TRUE(etagMatches("\"aaaa\", W/\"49206de344a0aaf4\"", ETAG));
+  TEST_ASSERT_TRUE(etagMatches("\"aaaa\",\t\"49206de344a0aaf4\" ", ETAG));
+  TEST_ASSERT_TRUE(etagMatches("\"aaaa\" , *", ETAG));
+
+  TEST_ASSERT_FALSE(etagMatches("", ETAG));
+  TEST_ASSERT_FALSE(etagMatches(" , ", ETAG));
+  TEST_ASSERT_FALSE(etagMatches("\"aaaa\", \"bbbb\"", ETAG));
+  TEST_ASSERT_FALSE(etagMatches("49206de344a0aaf4", ETAG));  // ohne Anführungszeichen
+  TEST_ASSERT_FALSE(etagMatches("\"49206de344a0aaf\"", ETAG));
+  TEST_ASSERT_FALSE(etagMatches("w/\"49206de344a0aaf4\"", ETAG));
+}
+
+void test_json_string_escaping() {
+  const struct {
+    std::string_view input;
+    const char* expected;
+  } cases[] = {
+      {"Heimnetz", "\"Heimnetz\""},
+      {"", "\"\""},
+      {"a\"b", "\"a\\\"b\""},
+      {"C:\\wlan\\", "\"C:\\\\wlan\\\\\""},
+      {"zeile\neins\r\t", "\"zeile\\u000aeins\\u000d\\u0009\""},
+      {std::string_view("a\0b", 3), "\"a\\u0000b\""},
+      {"\x1f\x7f", "\"\\u001f\x7f\""},       // DEL bleibt
+      {"K\xc3\xbc" "che", "\"K\xc3\xbc" "che\""},  // UTF-8 unverändert
+  };
+  for (const auto& test : cases) {
+    StringSink sink;
+    size_t counted = 0;
+    renderBoth([&](auto& out) { writeJsonString(out, test.input); }, sink, counted);
+    TEST_ASSERT_EQUAL_STRING(test.expected, sink.text.c_str());
+    TEST_ASSERT_EQUAL_UINT32(sink.text.size(), counted);
+  }
+}
+
+void test_writer_chunks() {
+  StringSink sink;
+  size_t counted = 0;
+  const std::string text(3 * HTTP_CHUNK_SIZE + 17, 'x');
+  renderBoth([&](auto& out) {
+    out.print(text.substr(0, 100));
+    out.write(text.data() + 100, text.size() - 100);
+  }, sink, counted);
+  TEST_ASSERT_TRUE(sink.text == text);
+  TEST_ASSERT_EQUAL_UINT32(4, sink.chunks);
+  TEST_ASSERT_EQUAL_UINT32(text.size(), counted);
+}
+
+// Zu lange printf() Ausgaben werden in beiden gleich gekürzt
+void test_printf_truncation_parity() {
+  const std::string longName(2 * HTTP_LINE_SIZE, 'n');
+  StringSink sink;
+  size_t counted = 0;
+  renderBoth([&](auto& out) {
+    out.printf("%s", longName.c_str());
+    out.printf("|%u|", 42u);
+    out.printf("%s", longName.substr(0, HTTP_LINE_SIZE - 1).c_str());
+    out.printf("%s", "");
+  }, sink, counted);
+  TEST_ASSERT_EQUAL_UINT32(2 * (HTTP_LINE_SIZE - 1) + 4, sink.text.size());
+  TEST_ASSERT_EQUAL_UINT32(sink.text.size(), counted);
+  TEST_ASSERT_TRUE(sink.text.substr(HTTP_LINE_SIZE - 1, 4) == "|42|");
+}
+
+void test_state_and_metrics_length_parity() {
+  const ApiState state = sampleState();
+  StringSink sink;
+  size_t counted = 0;
+  renderBoth([&](auto& out) { writeStateJson(out, state); }, sink, counted);
+  TEST_ASSERT_EQUAL_UINT32(sink.text.size(), counted);
+  TEST_ASSERT_EQUAL_STRING("62.5", value(sink.text, "fuellstand").c_str());
+  TEST_ASSERT_EQUAL_STRING("1.4.0", value(sink.text, "firmware").c_str());
+  TEST_ASSERT_EQUAL_STRING("3600", value(sink.text, "uptime_s").c_str());
+  // "min_mm" des zweiten Tanks steht nur im Array
+  TEST_ASSERT_EQUAL_STRING("40", value(sink.text, "min_mm").c_str());
+
+  StringSink metrics;
+  renderBoth([&](auto& out) { writeMetrics(out, state); }, metrics, counted);
+  TEST_ASSERT_EQUAL_UINT32(metrics.text.size(), counted);
+  TEST_ASSERT_GREATER_THAN(1, metrics.chunks);
+  TEST_ASSERT_TRUE(metrics.text.find("rocket_water_level_percent{tank=\"tropfschale_abc\"}") == std::string::npos);
+  TEST_ASSERT_TRUE(metrics.text.find("rocket_calibration_mm{tank=\"tropfschale_abc\",point=\"empty\"} 90\n") !=
+                   std::string::npos);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_find_json_value);
+  RUN_TEST(test_find_json_value_only_at_keys);
+  RUN_TEST(test_find_json_value_malformed);
+  RUN_TEST(test_parse_calibration_json);
+  RUN_TEST(test_etag_matches);
+  RUN_TEST(test_json_string_escaping);
+  RUN_TEST(test_writer_chunks);
+  RUN_TEST(test_printf_truncation_parity);
+  RUN_TEST(test_state_and_metrics_length_parity);
+  return UNITY_END();
+}
@@ -0,0 +1,292 @@
+// Offline journal: RAM ring, flash spill and batched replay
+//
+//   pio test -e native -f test_journal
+//
+// Entries are numbered through the distance field, so the replayed
+// batches can be checked for order, gaps and duplicates. MemoryFlash has
+// NOR semantics (erase to 0xFF, writes only clear bits); a reboot is
+// simulated by a new FlashJournal on the same bytes.
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <unity.h>
+#include <HalFakes.h>
+#include <Journal.h>
+
+const size_t FLASH_SECTOR_SIZE = 4096;
+const size_t FLASH_SIZE = 4 * FLASH_SECTOR_SIZE;  // 1024 Einträge
+const uint32_t SAMPLE_INTERVAL = 1000;
+
+// Eintrag n: Distanz n, Füllstand springt um mehr als das Totband
+LevelEvent numberedEvent(uint16_t n) {
+  return {n * SAMPLE_INTERVAL, n % 2 ? 20.0f : 10.0f, n, false};
+}
+
+void recordNumbered(OfflineJournal& journal, uint16_t first, uint16_t count) {
+  for (uint16_t n = first; n < first + count; n++) {
+    const LevelEvent event = numberedEvent(n);
+    TEST_ASSERT_TRUE(journal.record(event.timestamp, event));
+  }
+}
+
+// Distanzen aller Einträge in den Journal-Nachrichten, in Sendereihenfolge
+std::vector<uint16_t> replayedDistances(const FakeMqttTransport& transport) {
+  std::vector<uint16_t> distances;
+  for (const FakeMqttTransport::Message& message : transport.messages) {
+    TEST_ASSERT_EQUAL_STRING(mqtt_topic_journal, message.topic.c_str());
+    TEST_ASSERT_FALSE(message.retained);
+    TEST_ASSERT_EQUAL_INT('[', message.payload.front());
+    TEST_ASSERT_EQUAL_INT(']', message.payload.back());
+    const std::string key = "\"distanz\":";
+    for (size_t pos = message.payload.find(key); pos != std::string::npos; pos = message.payload.find(key, pos + 1)) {
+      distances.push_back((uint16_t)atoi(message.payload.c_str() + pos + key.size()));
+    }
+  }
+  return distances;
+}
+
+// Replay bis das Journal leer ist, ein Aufruf pro Replay-Intervall
+size_t replayAll(OfflineJournal& journal, FakeMqttTransport& transport, uint32_t& now) {
+  size_t batches = 0;
+  while (!journal.empty() && batches < 10000) {
+    now += JOURNAL_REPLAY_INTERVAL;
+    if (journal.replay(transport, now) > 0) {
+      batches++;
+    }
+  }
+  return batches;
+}
+
+void assertSequence(const std::vector<uint16_t>& distances, uint16_t first, uint16_t count) {
+  TEST_ASSERT_EQUAL_size_t(count, distances.size());
+  for (uint16_t i = 0; i < count; i++) {
+    char message[48];
+    snprintf(message, sizeof(message), "entry %u", i);
+    TEST_ASSERT_EQUAL_UINT16_MESSAGE(first + i, distances[i], message);
+  }
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_deadband_and_heartbeat() {
+  TimeBase timeBase;
+  OfflineJournal journal(timeBase);
+  TEST_ASSERT_TRUE(journal.record(0, {0, 50.0f, 140, false}));
+  TEST_ASSERT_FALSE(journal.record(1000, {1000, 51.0f, 138, false}));
+  TEST_ASSERT_TRUE(journal.record(2000, {2000, 48.0f, 144, false}));
+  // Auffüllungen immer, ohne Änderung spätestens nach dem Heartbeat
+  TEST_ASSERT_TRUE(journal.record(3000, {3000, 48.0f, 144, true}));
+  TEST_ASSERT_FALSE(journal.record(3000 + JOURNAL_HEARTBEAT - 1, {0, 48.0f, 144, false}));
+  TEST_ASSERT_TRUE(journal.record(3000 + JOURNAL_HEARTBEAT, {0, 48.0f, 144, false}));
+  TEST_ASSERT_EQUAL_UINT32(4, journal.size());
+}
+
+// Ohne Flash wird beim vollen Ring der älteste Eintrag überschrieben
+void test_ram_ring_drops_oldest() {
+  TimeBase timeBase;
+  OfflineJournal journal(timeBase);
+  recordNumbered(journal, 0, JOURNAL_RAM_ENTRIES + 5);
+  TEST_ASSERT_EQUAL_UINT32(JOURNAL_RAM_ENTRIES, journal.size());
+  TEST_ASSERT_EQUAL_UINT32(5, journal.droppedCount());
+
+  FakeMqttTransport transport;
+  uint32_t now = (JOURNAL_RAM_ENTRIES + 5) * SAMPLE_INTERVAL;
+  replayAll(journal, transport, now);
+  assertSequence(replayedDistances(transport), 5, JOURNAL_RAM_ENTRIES);
+  TEST_ASSERT_EQUAL_UINT32(JOURNAL_RAM_ENTRIES, journal.replayedCount());
+}
+
+// Mit Flash wandert die ältere Hälfte des Rings dorthin, das Replay
+// sendet den Flash zuerst und hält so die Reihenfolge
+void test_spill_keeps_order() {
+  TimeBase timeBase;
+  MemoryFlash flash(FLASH_SIZE, FLASH_SECTOR_SIZE);
+  FlashJournal flashJournal(flash);
+  flashJournal.begin();
+  OfflineJournal journal(timeBase, &flashJournal);
+
+  const uint16_t total = 3 * JOURNAL_RAM_ENTRIES + 10;
+  recordNumbered(journal, 0, total);
+  TEST_ASSERT_EQUAL_UINT32(total, journal.size());
+  TEST_ASSERT_EQUAL_UINT32(0, journal.droppedCount());
+  TEST_ASSERT_GREATER_THAN(0, flashJournal.size());
+
+  FakeMqttTransport transport;
+  uint32_t now = total * SAMPLE_INTERVAL;
+  const size_t batches = replayAll(journal, transport, now);
+  assertSequence(replayedDistances(transport), 0, total);
+  TEST_ASSERT_EQUAL_size_t((total + JOURNAL_BATCH_ENTRIES - 1) / JOURNAL_BATCH_ENTRIES, batches);
+  TEST_ASSERT_EQUAL_UINT32(0, flashJournal.size());
+}
+
+// Neue Einträge während des Replays landen hinter den alten
+void test_record_during_replay() {
+  TimeBase timeBase;
+  MemoryFlash flash(FLASH_SIZE, FLASH_SECTOR_SIZE);
+  FlashJournal flashJournal(flash);
+  flashJournal.begin();
+  OfflineJournal journal(timeBase, &flashJournal);
+  recordNumbered(journal, 0, JOURNAL_RAM_ENTRIES + 1);
+
+  FakeMqttTransport transport;
+  uint32_t now = 1000000;
+  for (uint16_t n = JOURNAL_RAM_ENTRIES + 1; n < 2 * JOURNAL_RAM_ENTRIES + 20; n++) {
+    const LevelEvent event = numberedEvent(n);
+    journal.record(event.timestamp, event);
+    now += JOURNAL_REPLAY_INTERVAL;
+    journal.replay(transport, now);
+  }
+  replayAll(journal, transport, now);
+  assertSequence(replayedDistances(transport), 0, 2 * JOURNAL_RAM_ENTRIES + 20);
+}
+
+void test_replay_batches_with_backpressure() {
+  TimeBase timeBase;
+  OfflineJournal journal(timeBase);
+  recordNumbered(journal, 0, 3 * JOURNAL_BATCH_ENTRIES);
+  FakeMqttTransport transport;
+
+  // Ohne Verbindung passiert nichts
+  transport.isConnected = false;
+  TEST_ASSERT_EQUAL_size_t(0, journal.replay(transport, 1000000));
+
+  // Höchstens ein Batch pro Intervall
+  transport.isConnected = true;
+  uint32_t now = 2000000;
+  TEST_ASSERT_EQUAL_size_t(JOURNAL_BATCH_ENTRIES, journal.replay(transport, now));
+  TEST_ASSERT_EQUAL_size_t(0, journal.replay(transport, now + JOURNAL_REPLAY_INTERVAL - 1));
+  TEST_ASSERT_EQUAL_size_t(JOURNAL_BATCH_ENTRIES, journal.replay(transport, now + JOURNAL_REPLAY_INTERVAL));
+  TEST_ASSERT_EQUAL_size_t(2, transport.messages.size());
+}
+
+// Ein fehlgeschlagener Publish behält den Batch, der nächste Versuch
+// sendet dieselben Einträge, nichts geht verloren oder doppelt raus
+void test_failed_publish_keeps_entries() {
+  TimeBase timeBase;
+  MemoryFlash flash(FLASH_SIZE, FLASH_SECTOR_SIZE);
+  FlashJournal flashJournal(flash);
+  flashJournal.begin();
+  OfflineJournal journal(timeBase, &flashJournal);
+  const uint16_t total = JOURNAL_RAM_ENTRIES + 3 * JOURNAL_BATCH_ENTRIES;
+  recordNumbered(journal, 0, total);
+
+  FakeMqttTransport transport;
+  uint32_t now = total * SAMPLE_INTERVAL;
+  now += JOURNAL_REPLAY_INTERVAL;
+  TEST_ASSERT_EQUAL_size_t(JOURNAL_BATCH_ENTRIES, journal.replay(transport, now));
+
+  transport.failBeginPublish = true;
+  for (int i = 0; i < 5; i++) {
+    now += JOURNAL_REPLAY_INTERVAL;
+    TEST_ASSERT_EQUAL_size_t(0, journal.replay(transport, now));
+  }
+  TEST_ASSERT_EQUAL_UINT32(total - JOURNAL_BATCH_ENTRIES, journal.size());
+  TEST_ASSERT_EQUAL_UINT32(JOURNAL_BATCH_ENTRIES, journal.replayedCount());
+
+  transport.failBeginPublish = false;
+  replayAll(journal, transport, now);
+  assertSequence(replayedDistances(transport), 0, total);
+}
+
+// Nach einem Neustart findet begin() die offenen Einträge wieder. Die
+// Zeit seit dem alten Boot ist nichts mehr wert, sie werden ohne Zeit gesendet.
+void test_flash_journal_survives_reboot() {
+  MemoryFlash flash(FLASH_SIZE, FLASH_SECTOR_SIZE);
+  {
+    FlashJournal flashJournal(flash);
+    flashJournal.begin();
+    for (uint16_t n = 0; n < 40; n++) {
+      TEST_ASSERT_TRUE(flashJournal.append({n * SAMPLE_INTERVAL, n, 500, 0}));
+    }
+    flashJournal.consume(15);
+    TEST_ASSERT_EQUAL_UINT32(25, flashJournal.size());
+  }
+
+  FlashJournal flashJournal(flash);
+  flashJournal.begin();
+  TEST_ASSERT_EQUAL_UINT32(25, flashJournal.size());
+  JournalEntry entries[5];
+  TEST_ASSERT_EQUAL_size_t(5, flashJournal.peek(entries, 5));
+  for (uint16_t i = 0; i < 5; i++) {
+    TEST_ASSERT_EQUAL_UINT16(15 + i, entries[i].distance);
+    TEST_ASSERT_TRUE(entries[i].flags & JOURNAL_UNKNOWN);
+  }
+
+  // Weiter schreiben nach dem Neustart: alte Einträge zuerst, neue danach
+  TEST_ASSERT_TRUE(flashJournal.append({0, 40, 500, 0}));
+  TimeBase timeBase;
+  OfflineJournal journal(timeBase, &flashJournal);
+  FakeMqttTransport transport;
+  uint32_t now = 0;
+  replayAll(journal, transport, now);
+  assertSequence(replayedDistances(transport), 15, 26);
+  TEST_ASSERT_TRUE(transport.messages.front().payload.find("\"alter\"") == std::string::npos);
+  TEST_ASSERT_TRUE(transport.messages.back().payload.find("{\"alter\":0,\"fuellstand\":50.0,\"distanz\":40}") !=
+                   std::string::npos);
+}
+
+// Ein halb geschriebener Eintrag (Stromausfall) wird übersprungen
+void test_flash_journal_skips_torn_record() {
+  MemoryFlash flash(FLASH_SIZE, FLASH_SECTOR_SIZE);
+  {
+    FlashJournal flashJournal(flash);
+    flashJournal.begin();
+    for (uint16_t n = 0; n < 10; n++) {
+      flashJournal.append({0, n, 500, 0});
+    }
+  }
+  // Eintrag 10: nur die Sequenznummer ist geschrieben
+  const uint32_t sequence = 10;
+  flash.write(10 * 16, &sequence, sizeof(sequence));
+
+  FlashJournal flashJournal(flash);
+  flashJournal.begin();
+  TEST_ASSERT_EQUAL_UINT32(10, flashJournal.size());
+  TEST_ASSERT_TRUE(flashJournal.append({0, 10, 500, 0}));
+  JournalEntry entries[12];
+  TEST_ASSERT_EQUAL_size_t(11, flashJournal.peek(entries, 12));
+  for (uint16_t i = 0; i < 11; i++) {
+    TEST_ASSERT_EQUAL_UINT16(i, entries[i].distance);
+  }
+}
+
+// Läuft der Flash voll, fällt der älteste Sektor weg, auch über Neustarts
+void test_flash_journal_wraps() {
+  MemoryFlash flash(FLASH_SIZE, FLASH_SECTOR_SIZE);
+  const uint32_t perSector = FLASH_SECTOR_SIZE / 16;
+  const uint32_t capacity = FLASH_SIZE / 16;
+  {
+    FlashJournal flashJournal(flash);
+    flashJournal.begin();
+    for (uint32_t n = 0; n < capacity + 10; n++) {
+      TEST_ASSERT_TRUE(flashJournal.append({0, (uint16_t)n, 500, 0}));
+    }
+    TEST_ASSERT_EQUAL_UINT32(perSector, flashJournal.droppedCount());
+    TEST_ASSERT_EQUAL_UINT32(capacity - perSector + 10, flashJournal.size());
+  }
+
+  FlashJournal flashJournal(flash);
+  flashJournal.begin();
+  TEST_ASSERT_EQUAL_UINT32(capacity - perSector + 10, flashJournal.size());
+  JournalEntry first;
+  TEST_ASSERT_EQUAL_size_t(1, flashJournal.peek(&first, 1));
+  TEST_ASSERT_EQUAL_UINT16(perSector, first.distance);
+  TEST_ASSERT_TRUE(flashJournal.append({0, (uint16_t)(capacity + 10), 500, 0}));
+  TEST_ASSERT_EQUAL_UINT32(capacity - perSector + 11, flashJournal.size());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_deadband_and_heartbeat);
+  RUN_TEST(test_ram_ring_drops_oldest);
+  RUN_TEST(test_spill_keeps_order);
+  RUN_TEST(test_record_during_replay);
+  RUN_TEST(test_replay_batches_with_backpressure);
+  RUN_TEST(test_failed_publish_keeps_entries);
+  RUN_TEST(test_flash_journal_survives_reboot);
+  RUN_TEST(test_flash_journal_skips_torn_record);
+  RUN_TEST(test_flash_journal_wraps);
+  return UNITY_END();
+}
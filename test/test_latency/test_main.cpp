@@ -0,0 +1,195 @@
+// Latency histogram buckets and windows
+//
+//   pio test -e native -f test_latency
+//
+// Bucket placement is checked against the bounds for every value up to
+// 2^16 and at each power of two above; the windows use hand-picked
+// sample sets.
+#include <stdint.h>
+#include <string.h>
+#include <unity.h>
+#include <Latency.h>
+
+#if LATENCY_TRACKING
+
+const uint8_t LAST_BUCKET = LATENCY_BUCKETS - 1;
+const uint32_t OVERFLOW_MICROS = 1UL << LATENCY_MAX_EXPONENT;
+
+uint32_t fakeMicros = 0;
+
+uint32_t readFakeMicros() { return fakeMicros; }
+
+void setUp() {
+  fakeMicros = 0;
+  latencyMicros = nullptr;
+}
+void tearDown() {}
+
+// Wert liegt im Bucket zwischen der Obergrenze des vorigen und der eigenen
+void assertPlaced(uint32_t micros) {
+  const uint8_t bucket = LatencyHistogram::bucketOf(micros);
+  TEST_ASSERT_LESS_OR_EQUAL(LAST_BUCKET, bucket);
+  if (bucket < LAST_BUCKET) {
+    TEST_ASSERT_LESS_OR_EQUAL(LatencyHistogram::upperBound(bucket), micros);
+  }
+  if (bucket > 0) {
+    TEST_ASSERT_GREATER_THAN(LatencyHistogram::upperBound(bucket - 1), micros);
+  }
+}
+
+void test_small_values_exact() {
+  for (uint32_t micros = 0; micros < 8; micros++) {
+    TEST_ASSERT_EQUAL_UINT8(micros, LatencyHistogram::bucketOf(micros));
+    TEST_ASSERT_EQUAL_UINT32(micros, LatencyHistogram::upperBound(micros));
+  }
+  // Ab 8 us zwei Werte pro Bucket
+  TEST_ASSERT_EQUAL_UINT8(8, LatencyHistogram::bucketOf(8));
+  TEST_ASSERT_EQUAL_UINT8(8, LatencyHistogram::bucketOf(9));
+  TEST_ASSERT_EQUAL_UINT8(9, LatencyHistogram::bucketOf(10));
+}
+
+void test_bucket_placement() {
+  for (uint32_t micros = 0; micros <= 65536; micros++) {
+    assertPlaced(micros);
+  }
+  for (uint8_t exponent = 17; exponent < LATENCY_MAX_EXPONENT; exponent++) {
+    assertPlaced((1UL << exponent) - 1);
+    assertPlaced(1UL << exponent);
+    assertPlaced((1UL << exponent) + 1);
+  }
+}
+
+void test_bucket_width() {
+  // Höchstens 25 % breit ab 4 us
+  for (uint8_t bucket = LATENCY_SUB_BUCKETS + 1; bucket < LATENCY_BUCKETS; bucket++) {
+    const uint32_t lower = LatencyHistogram::upperBound(bucket - 1) + 1;
+    const uint32_t width = LatencyHistogram::upperBound(bucket) - lower + 1;
+    TEST_ASSERT_LESS_OR_EQUAL(lower / 4, width);
+  }
+  TEST_ASSERT_EQUAL_UINT32(OVERFLOW_MICROS - 1, LatencyHistogram::upperBound(LAST_BUCKET));
+}
+
+void test_overflow_bucket() {
+  // Der letzte Bucket ist zugleich der oberste reguläre
+  TEST_ASSERT_EQUAL_UINT8(LAST_BUCKET - 1, LatencyHistogram::bucketOf(OVERFLOW_MICROS / 8 * 7 - 1));
+  TEST_ASSERT_EQUAL_UINT8(LAST_BUCKET, LatencyHistogram::bucketOf(OVERFLOW_MICROS / 8 * 7));
+  TEST_ASSERT_EQUAL_UINT8(LAST_BUCKET, LatencyHistogram::bucketOf(OVERFLOW_MICROS - 1));
+  TEST_ASSERT_EQUAL_UINT8(LAST_BUCKET, LatencyHistogram::bucketOf(OVERFLOW_MICROS));
+  TEST_ASSERT_EQUAL_UINT8(LAST_BUCKET, LatencyHistogram::bucketOf(UINT32_MAX));
+
+  // Perzentil zeigt die Obergrenze, max bleibt exakt
+  LatencyHistogram histogram;
+  histogram.record(10);
+  histogram.record(UINT32_MAX);
+  const LatencyWindow window = histogram.take();
+  TEST_ASSERT_EQUAL_UINT32(2, window.count);
+  TEST_ASSERT_EQUAL_UINT32(OVERFLOW_MICROS - 1, window.p99);
+  TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, window.max);
+}
+
+void test_percentiles() {
+  LatencyHistogram histogram;
+  for (int i = 0; i < 98; i++) {
+    histogram.record(10);
+  }
+  histogram.record(1000);
+  histogram.record(1000);
+  LatencyWindow window = histogram.take();
+  TEST_ASSERT_EQUAL_UINT32(100, window.count);
+  TEST_ASSERT_EQUAL_UINT32(LatencyHistogram::upperBound(LatencyHistogram::bucketOf(10)), window.p50);
+  TEST_ASSERT_EQUAL_UINT32(LatencyHistogram::upperBound(LatencyHistogram::bucketOf(1000)), window.p99);
+  TEST_ASSERT_EQUAL_UINT32(1000, window.max);
+
+  // Ein Ausreißer unter 100 liegt außerhalb von p99
+  for (int i = 0; i < 199; i++) {
+    histogram.record(10);
+  }
+  histogram.record(1000);
+  window = histogram.take();
+  TEST_ASSERT_EQUAL_UINT32(LatencyHistogram::upperBound(LatencyHistogram::bucketOf(10)), window.p99);
+  TEST_ASSERT_EQUAL_UINT32(1000, window.max);
+}
+
+void test_take_starts_new_window() {
+  LatencyHistogram histogram;
+  histogram.record(500);
+  histogram.record(7);
+  TEST_ASSERT_EQUAL_UINT32(2, histogram.take().count);
+
+  LatencyWindow window = histogram.take();
+  TEST_ASSERT_EQUAL_UINT32(0, window.count);
+  TEST_ASSERT_EQUAL_UINT32(0, window.p50);
+  TEST_ASSERT_EQUAL_UINT32(0, window.p99);
+  TEST_ASSERT_EQUAL_UINT32(0, window.max);
+
+  histogram.record(3);
+  window = histogram.take();
+  TEST_ASSERT_EQUAL_UINT32(1, window.count);
+  TEST_ASSERT_EQUAL_UINT32(3, window.p50);
+  TEST_ASSERT_EQUAL_UINT32(3, window.max);
+}
+
+void test_scope_records_with_clock() {
+  latencyHistograms[PROBE_NVS].take();
+  {
+    LATENCY_SCOPE(PROBE_NVS);  // ohne Uhr wird nichts gemessen
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, latencyHistograms[PROBE_NVS].take().count);
+
+  latencyMicros = readFakeMicros;
+  fakeMicros = UINT32_MAX - 5;
+  {
+    LATENCY_SCOPE(PROBE_NVS);
+    fakeMicros += 125;  // über den Überlauf
+  }
+  const LatencyWindow window = latencyHistograms[PROBE_NVS].take();
+  TEST_ASSERT_EQUAL_UINT32(1, window.count);
+  TEST_ASSERT_EQUAL_UINT32(125, window.max);
+}
+
+void test_report_format() {
+  for (LatencyHistogram& histogram : latencyHistograms) {
+    histogram.take();
+  }
+  latencyHistograms[PROBE_LEVEL].record(2);
+  char report[LATENCY_REPORT_SIZE];
+  const size_t length = formatLatencyReport(report, sizeof(report));
+  TEST_ASSERT_EQUAL_UINT32(strlen(report), length);
+  TEST_ASSERT_EQUAL_STRING(
+      "{\"sensor\":{\"n\":0,\"p50\":0,\"p99\":0,\"max\":0},"
+      "\"pegel\":{\"n\":1,\"p50\":2,\"p99\":2,\"max\":2},"
+      "\"auffuellung\":{\"n\":0,\"p50\":0,\"p99\":0,\"max\":0},"
+      "\"mqtt\":{\"n\":0,\"p50\":0,\"p99\":0,\"max\":0},"
+      "\"led\":{\"n\":0,\"p50\":0,\"p99\":0,\"max\":0},"
+      "\"nvs\":{\"n\":0,\"p50\":0,\"p99\":0,\"max\":0}}",
+      report);
+
+  // Zu kleiner Puffer: 0 statt abgeschnittenem JSON
+  TEST_ASSERT_EQUAL_UINT32(0, formatLatencyReport(report, length));
+  TEST_ASSERT_EQUAL_UINT32(length, formatLatencyReport(report, length + 1));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_small_values_exact);
+  RUN_TEST(test_bucket_placement);
+  RUN_TEST(test_bucket_width);
+  RUN_TEST(test_overflow_bucket);
+  RUN_TEST(test_percentiles);
+  RUN_TEST(test_take_starts_new_window);
+  RUN_TEST(test_scope_records_with_clock);
+  RUN_TEST(test_report_format);
+  return UNITY_END();
+}
+
+#else
+
+void setUp() {}
+void tearDown() {}
+
+int main() {
+  UNITY_BEGIN();
+  return UNITY_END();
+}
+
+#endif
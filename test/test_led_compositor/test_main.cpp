@@ -0,0 +1,201 @@
+// LED ring layers against a fake clock and strip
+//
+//   pio test -e native -f test_led_compositor
+//
+// Only full-intensity primaries are used as colors, the gamma table maps
+// 0 and 255 to themselves, so the strip holds exactly the layer colors.
+#include <stdint.h>
+#include <unity.h>
+#include <HalFakes.h>
+#include <LedCompositor.h>
+
+const uint16_t PIXELS = 12;
+const uint32_t RED = 0xFF0000;
+const uint32_t GREEN = 0x00FF00;  // Füllstand 100%
+const uint32_t BLUE = 0x0000FF;
+const uint32_t WHITE = 0xFFFFFF;
+
+FakeClock clock;
+
+LedCommand command(LedCommand::Type type, uint32_t color = 0, uint32_t value = 0, uint32_t total = 0) {
+  return {type, color, value, total};
+}
+
+void assertRing(const FakeLedStrip& strip, uint32_t even, uint32_t odd) {
+  for (uint16_t i = 0; i < PIXELS; i++) {
+    TEST_ASSERT_EQUAL_HEX32(i % 2 == 0 ? even : odd, strip.pixels[i]);
+  }
+}
+
+void setUp() { clock.now = 0; }
+void tearDown() {}
+
+void test_layer_priority() {
+  FakeLedStrip strip(PIXELS);
+  LedCompositor<PIXELS> ring(strip);
+  ring.setLevel(100);
+  ring.render(clock.millis());
+  assertRing(strip, GREEN, GREEN);
+
+  // Puls nur auf geraden Pixeln, Pegel bleibt dazwischen sichtbar
+  ring.apply(command(LedCommand::LED_PULSE, BLUE), clock.millis());
+  clock.advance(LED_PULSE_PERIOD / 2);  // Maximum der Dreieckskurve
+  ring.render(clock.millis());
+  assertRing(strip, BLUE, GREEN);
+
+  // Blinken deckt Puls und Pegel
+  ring.flash(WHITE, 3, 100, clock.millis());
+  ring.render(clock.millis());
+  assertRing(strip, WHITE, WHITE);
+
+  // Fortschritt über dem Blinken, 6 von 12 Pixeln
+  ring.apply(command(LedCommand::LED_PROGRESS, RED, 50, 100), clock.millis());
+  ring.render(clock.millis());
+  for (uint16_t i = 0; i < PIXELS; i++) {
+    TEST_ASSERT_EQUAL_HEX32(i < 6 ? RED : 0, strip.pixels[i]);
+  }
+
+  // Füllung ganz oben
+  ring.apply(command(LedCommand::LED_FILL, BLUE), clock.millis());
+  ring.render(clock.millis());
+  assertRing(strip, BLUE, BLUE);
+
+  // LED_CLEAR beendet Füllung und Fortschritt, das Blinken läuft weiter
+  ring.apply(command(LedCommand::LED_CLEAR), clock.millis());
+  ring.render(clock.millis());
+  assertRing(strip, WHITE, WHITE);
+
+  clock.advance(600);  // Blinken vorbei
+  ring.render(clock.millis());
+  TEST_ASSERT_EQUAL_HEX32(GREEN, strip.pixels[1]);
+  ring.apply(command(LedCommand::LED_STOP_PULSE), clock.millis());
+  ring.render(clock.millis());
+  assertRing(strip, GREEN, GREEN);
+
+  ring.setLevel(-1);
+  ring.render(clock.millis());
+  assertRing(strip, 0, 0);
+}
+
+void test_progress_replaces_fill() {
+  FakeLedStrip strip(PIXELS);
+  LedCompositor<PIXELS> ring(strip);
+  ring.apply(command(LedCommand::LED_FILL, BLUE), clock.millis());
+  ring.apply(command(LedCommand::LED_PROGRESS, RED, 1, 3), clock.millis());
+  ring.render(clock.millis());
+  TEST_ASSERT_EQUAL_HEX32(RED, strip.pixels[3]);
+  TEST_ASSERT_EQUAL_HEX32(0, strip.pixels[4]);
+
+  ring.apply(command(LedCommand::LED_PROGRESS, RED, 3, 3), clock.millis());
+  ring.render(clock.millis());
+  assertRing(strip, RED, RED);
+
+  // total = 0 zeigt nichts statt durch 0 zu teilen
+  ring.apply(command(LedCommand::LED_PROGRESS, RED, 3, 0), clock.millis());
+  ring.render(clock.millis());
+  assertRing(strip, 0, 0);
+}
+
+void test_timed_fill_expires() {
+  FakeLedStrip strip(PIXELS);
+  LedCompositor<PIXELS> ring(strip);
+  ring.setLevel(100);
+  ring.apply(command(LedCommand::LED_FILL, RED, 500), clock.millis());
+  TEST_ASSERT_TRUE(ring.animating());
+  TEST_ASSERT_EQUAL_UINT32(500, ring.nextFrameIn(clock.millis()));
+
+  clock.advance(499);
+  ring.render(clock.millis());
+  assertRing(strip, RED, RED);
+  TEST_ASSERT_EQUAL_UINT32(1, ring.nextFrameIn(clock.millis()));
+
+  clock.advance(1);
+  ring.render(clock.millis());
+  assertRing(strip, GREEN, GREEN);
+  TEST_ASSERT_FALSE(ring.animating());
+  TEST_ASSERT_EQUAL_UINT32(0, ring.nextFrameIn(clock.millis()));
+
+  // value = 0 bleibt bis LED_CLEAR
+  ring.apply(command(LedCommand::LED_FILL, RED), clock.millis());
+  clock.advance(3600000);
+  ring.render(clock.millis());
+  assertRing(strip, RED, RED);
+  TEST_ASSERT_EQUAL_UINT32(0, ring.nextFrameIn(clock.millis()));
+}
+
+void test_flash_phases_and_expiry() {
+  FakeLedStrip strip(PIXELS);
+  LedCompositor<PIXELS> ring(strip);
+  ring.setLevel(100);
+  ring.flash(WHITE, LED_FLASH_COUNT, LED_FLASH_INTERVAL, clock.millis());
+
+  // an, aus, an, aus, an, aus, dann wieder der Pegel
+  for (uint8_t phase = 0; phase < 2 * LED_FLASH_COUNT; phase++) {
+    ring.render(clock.millis());
+    const uint32_t expected = phase % 2 == 0 ? WHITE : 0;
+    assertRing(strip, expected, expected);
+    TEST_ASSERT_EQUAL_UINT32(LED_FLASH_INTERVAL, ring.nextFrameIn(clock.millis()));
+    clock.advance(LED_FLASH_INTERVAL / 2);
+    TEST_ASSERT_EQUAL_UINT32(LED_FLASH_INTERVAL / 2, ring.nextFrameIn(clock.millis()));
+    clock.advance(LED_FLASH_INTERVAL / 2);
+  }
+  ring.render(clock.millis());
+  assertRing(strip, GREEN, GREEN);
+  TEST_ASSERT_FALSE(ring.animating());
+}
+
+void test_flash_across_millis_wrap() {
+  FakeLedStrip strip(PIXELS);
+  LedCompositor<PIXELS> ring(strip);
+  ring.setLevel(100);
+  clock.now = 0xFFFFFFFF - 150;
+  ring.flash(WHITE, 1, 100, clock.millis());
+  clock.advance(150);
+  ring.render(clock.millis());
+  assertRing(strip, 0, 0);  // zweite Phase, aus
+  clock.advance(50);
+  ring.render(clock.millis());
+  assertRing(strip, GREEN, GREEN);
+}
+
+void test_unchanged_frame_not_sent() {
+  FakeLedStrip strip(PIXELS);
+  LedCompositor<PIXELS> ring(strip);
+  ring.setLevel(100);
+  TEST_ASSERT_TRUE(ring.render(clock.millis()));
+  clock.advance(1000);
+  TEST_ASSERT_FALSE(ring.render(clock.millis()));
+  ring.setLevel(100.2f);  // gleicher 0,5% Schritt
+  TEST_ASSERT_FALSE(ring.render(clock.millis()));
+  TEST_ASSERT_EQUAL_UINT32(1, strip.shows);
+  TEST_ASSERT_EQUAL_UINT32(2, ring.skipCount());
+
+  ring.apply(command(LedCommand::LED_REDRAW), clock.millis());
+  TEST_ASSERT_TRUE(ring.render(clock.millis()));
+  TEST_ASSERT_EQUAL_UINT32(2, strip.shows);
+  TEST_ASSERT_EQUAL_UINT32(2, ring.showCount());
+}
+
+void test_pulse_requests_frames() {
+  FakeLedStrip strip(PIXELS);
+  LedCompositor<PIXELS> ring(strip);
+  ring.apply(command(LedCommand::LED_PULSE, BLUE), clock.millis());
+  TEST_ASSERT_EQUAL_UINT32(LED_FRAME_INTERVAL, ring.nextFrameIn(clock.millis()));
+  ring.render(clock.millis());
+  TEST_ASSERT_EQUAL_HEX32(0, strip.pixels[0]);  // Anfang der Periode dunkel
+  ring.apply(command(LedCommand::LED_STOP_PULSE), clock.millis());
+  TEST_ASSERT_EQUAL_UINT32(0, ring.nextFrameIn(clock.millis()));
+  TEST_ASSERT_FALSE(ring.animating());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_layer_priority);
+  RUN_TEST(test_progress_replaces_fill);
+  RUN_TEST(test_timed_fill_expires);
+  RUN_TEST(test_flash_phases_and_expiry);
+  RUN_TEST(test_flash_across_millis_wrap);
+  RUN_TEST(test_unchanged_frame_not_sent);
+  RUN_TEST(test_pulse_requests_frames);
+  return UNITY_END();
+}
@@ -0,0 +1,217 @@
+// MQTT reconnect backoff and session states
+//
+//   pio test -e native -f test_mqtt_session
+//
+// The random source and the clock are injected, so the jitter bounds and
+// the attempt times are exact.
+#include <stdint.h>
+#include <unity.h>
+#include <HalFakes.h>
+#include <MqttSession.h>
+
+const uint8_t SETUP_STEPS = 3;
+
+uint32_t randomValue = 0;
+
+uint32_t fakeRandom() { return randomValue; }
+
+// Kleiner LCG für zufällige, aber wiederholbare Jitter-Werte
+uint32_t lcgState = 1;
+
+uint32_t lcgRandom() {
+  lcgState = lcgState * 1664525u + 1013904223u;
+  return lcgState;
+}
+
+void setUp() {
+  randomValue = 0;
+  lcgState = 1;
+}
+void tearDown() {}
+
+// Delay ohne Jitter pro Fehlversuch: 1 s, 2 s, ... bis 60 s
+const uint32_t BACKOFF_DELAYS[] = {1000, 2000, 4000, 8000, 16000, 32000, 60000, 60000, 60000};
+const uint8_t BACKOFF_COUNT = sizeof(BACKOFF_DELAYS) / sizeof(BACKOFF_DELAYS[0]);
+
+void test_backoff_lower_bound() {
+  ReconnectBackoff backoff(MQTT_BACKOFF_MIN, MQTT_BACKOFF_MAX, fakeRandom);
+  for (uint8_t i = 0; i < BACKOFF_COUNT; i++) {
+    TEST_ASSERT_EQUAL_UINT32(BACKOFF_DELAYS[i] / 2, backoff.next());
+  }
+}
+
+void test_backoff_upper_bound() {
+  ReconnectBackoff backoff(MQTT_BACKOFF_MIN, MQTT_BACKOFF_MAX, fakeRandom);
+  for (uint8_t i = 0; i < BACKOFF_COUNT; i++) {
+    randomValue = BACKOFF_DELAYS[i] / 2;  // höchster Rest von random() % (delay / 2 + 1)
+    TEST_ASSERT_EQUAL_UINT32(BACKOFF_DELAYS[i], backoff.next());
+  }
+}
+
+void test_backoff_jitter_within_bounds() {
+  ReconnectBackoff backoff(MQTT_BACKOFF_MIN, MQTT_BACKOFF_MAX, lcgRandom);
+  for (uint8_t i = 0; i < 40; i++) {
+    const uint32_t delay = BACKOFF_DELAYS[i < BACKOFF_COUNT ? i : BACKOFF_COUNT - 1];
+    const uint32_t value = backoff.next();
+    TEST_ASSERT_GREATER_OR_EQUAL(delay / 2, value);
+    TEST_ASSERT_LESS_OR_EQUAL(delay, value);
+  }
+  backoff.reset();
+  const uint32_t value = backoff.next();
+  TEST_ASSERT_GREATER_OR_EQUAL(MQTT_BACKOFF_MIN / 2, value);
+  TEST_ASSERT_LESS_OR_EQUAL(MQTT_BACKOFF_MIN, value);
+}
+
+void test_failed_attempts_follow_backoff() {
+  FakeClock clock;
+  MqttSession session(clock, fakeRandom, SETUP_STEPS);
+
+  // Erster Versuch sofort
+  TEST_ASSERT_TRUE(session.attemptDue());
+  TEST_ASSERT_FALSE(session.attemptDue());
+  TEST_ASSERT_EQUAL(MqttSession::SESSION_CONNECTING, session.state());
+
+  for (uint8_t i = 0; i < BACKOFF_COUNT; i++) {
+    clock.advance(250);  // Dauer des Verbindungsversuchs
+    session.connectFinished(false);
+    TEST_ASSERT_EQUAL(MqttSession::SESSION_WAITING, session.state());
+    TEST_ASSERT_EQUAL_UINT32(BACKOFF_DELAYS[i] / 2, session.retryIn());
+
+    clock.advance(BACKOFF_DELAYS[i] / 2 - 1);
+    TEST_ASSERT_FALSE(session.attemptDue());
+    TEST_ASSERT_EQUAL_UINT32(1, session.retryIn());
+    clock.advance(1);
+    TEST_ASSERT_TRUE(session.attemptDue());
+    TEST_ASSERT_EQUAL_UINT32(0, session.retryIn());
+  }
+
+  const MqttSessionStats& stats = session.statistics();
+  TEST_ASSERT_EQUAL_UINT32(BACKOFF_COUNT + 1, stats.attempts);
+  TEST_ASSERT_EQUAL_UINT32(BACKOFF_COUNT, stats.failures);
+  TEST_ASSERT_EQUAL_UINT32(0, stats.disconnects);
+  TEST_ASSERT_EQUAL_UINT32(250, stats.lastAttemptMs);
+}
+
+void test_setup_steps_one_per_tick() {
+  FakeClock clock;
+  MqttSession session(clock, fakeRandom, SETUP_STEPS);
+  TEST_ASSERT_TRUE(session.attemptDue());
+  clock.advance(400);
+  session.connectFinished(true);
+  TEST_ASSERT_EQUAL(MqttSession::SESSION_SETUP, session.state());
+  TEST_ASSERT_EQUAL_UINT8(0, session.setupStep());
+
+  for (uint8_t i = 1; i < SETUP_STEPS; i++) {
+    TEST_ASSERT_FALSE(session.nextStep());
+    TEST_ASSERT_EQUAL_UINT8(i, session.setupStep());
+    TEST_ASSERT_FALSE(session.online());
+  }
+  TEST_ASSERT_TRUE(session.nextStep());
+  TEST_ASSERT_TRUE(session.online());
+  // Weitere Ticks bleiben online, ohne erneutes Setup
+  TEST_ASSERT_TRUE(session.nextStep());
+  TEST_ASSERT_EQUAL(MqttSession::SESSION_ONLINE, session.state());
+  TEST_ASSERT_FALSE(session.attemptDue());
+  TEST_ASSERT_EQUAL_UINT32(0, session.retryIn());
+
+  const MqttSessionStats& stats = session.statistics();
+  TEST_ASSERT_EQUAL_UINT32(400, stats.lastAttemptMs);
+  TEST_ASSERT_EQUAL_UINT32(400, stats.maxAttemptMs);
+  TEST_ASSERT_EQUAL_UINT32(400, stats.lastOutageMs);  // seit dem Start offline
+}
+
+void test_lost_during_setup_restarts() {
+  FakeClock clock;
+  MqttSession session(clock, fakeRandom, SETUP_STEPS);
+  TEST_ASSERT_TRUE(session.attemptDue());
+  session.connectFinished(true);
+  session.nextStep();
+  session.lost();
+  TEST_ASSERT_EQUAL(MqttSession::SESSION_WAITING, session.state());
+  TEST_ASSERT_EQUAL_UINT32(1, session.statistics().disconnects);
+
+  clock.advance(MQTT_BACKOFF_MIN / 2);
+  TEST_ASSERT_TRUE(session.attemptDue());
+  session.connectFinished(true);
+  // Setup beginnt wieder beim ersten Schritt
+  TEST_ASSERT_EQUAL_UINT8(0, session.setupStep());
+  for (uint8_t i = 1; i < SETUP_STEPS; i++) {
+    TEST_ASSERT_FALSE(session.nextStep());
+  }
+  TEST_ASSERT_TRUE(session.nextStep());
+}
+
+void test_success_resets_backoff() {
+  FakeClock clock;
+  MqttSession session(clock, fakeRandom, SETUP_STEPS);
+
+  // Vier Fehlversuche, der nächste Abstand wäre 16 s
+  TEST_ASSERT_TRUE(session.attemptDue());
+  for (uint8_t i = 0; i < 4; i++) {
+    session.connectFinished(false);
+    clock.advance(session.retryIn());
+    TEST_ASSERT_TRUE(session.attemptDue());
+  }
+  session.connectFinished(true);
+  for (uint8_t i = 0; i < SETUP_STEPS; i++) {
+    session.nextStep();
+  }
+  TEST_ASSERT_TRUE(session.online());
+
+  clock.advance(100000);
+  session.lost();
+  TEST_ASSERT_EQUAL_UINT32(MQTT_BACKOFF_MIN / 2, session.retryIn());
+  const uint32_t lostAt = clock.now;
+
+  // Ein Fehlversuch nach dem Verlust verdoppelt wieder ab 1 s
+  clock.advance(session.retryIn());
+  TEST_ASSERT_TRUE(session.attemptDue());
+  clock.advance(300);
+  session.connectFinished(false);
+  TEST_ASSERT_EQUAL_UINT32(2000 / 2, session.retryIn());
+
+  clock.advance(session.retryIn());
+  TEST_ASSERT_TRUE(session.attemptDue());
+  session.connectFinished(true);
+  TEST_ASSERT_FALSE(session.nextStep());
+  clock.advance(50);
+  TEST_ASSERT_FALSE(session.nextStep());
+  TEST_ASSERT_TRUE(session.nextStep());
+
+  const MqttSessionStats& stats = session.statistics();
+  TEST_ASSERT_EQUAL_UINT32(1, stats.disconnects);
+  TEST_ASSERT_EQUAL_UINT32(5, stats.failures);
+  TEST_ASSERT_EQUAL_UINT32(clock.now - lostAt, stats.lastOutageMs);
+}
+
+// Die Versuchszeit läuft über den Überlauf von millis() hinweg
+void test_attempt_across_millis_wrap() {
+  FakeClock clock;
+  MqttSession session(clock, fakeRandom, SETUP_STEPS);
+  TEST_ASSERT_TRUE(session.attemptDue());
+  session.connectFinished(true);
+  for (uint8_t i = 0; i < SETUP_STEPS; i++) {
+    session.nextStep();
+  }
+  clock.now = 0xFFFFFFFF - 200;
+  session.lost();
+  TEST_ASSERT_EQUAL_UINT32(MQTT_BACKOFF_MIN / 2, session.retryIn());
+  clock.advance(MQTT_BACKOFF_MIN / 2 - 1);
+  TEST_ASSERT_FALSE(session.attemptDue());
+  TEST_ASSERT_EQUAL_UINT32(1, session.retryIn());
+  clock.advance(1);
+  TEST_ASSERT_TRUE(session.attemptDue());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_backoff_lower_bound);
+  RUN_TEST(test_backoff_upper_bound);
+  RUN_TEST(test_backoff_jitter_within_bounds);
+  RUN_TEST(test_failed_attempts_follow_backoff);
+  RUN_TEST(test_setup_steps_one_per_tick);
+  RUN_TEST(test_lost_during_setup_restarts);
+  RUN_TEST(test_success_resets_backoff);
+  RUN_TEST(test_attempt_across_millis_wrap);
+  return UNITY_END();
+}
@@ -0,0 +1,369 @@
+// Shared level pipeline against the in-memory fakes from HalFakes.h
+//
+//   pio test -e native -f test_native
+//
+// Distance traces go through the sensor fake, LevelProcessor and Tank the
+// same way the firmware tasks chain them. The tests assert on what ends up
+// in the MemoryStore and the FakeMqttTransport.
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unity.h>
+#include <HalFakes.h>
+#include <CachedStore.h>
+#include <CommandDispatcher.h>
+#include <WaterLevel.h>
+#include <Publisher.h>
+#include <Tank.h>
+
+const uint32_t SAMPLE_INTERVAL = 1000;
+const TankConfig TANK_CONFIG = {"wasserstand", "", -1, 0x29, -1, 0};
+
+// Sensor -> Verarbeitung -> Tank -> Publish -> NVS, ein Messwert pro Sekunde
+struct Pipeline {
+  FakeClock clock;
+  MemoryStore store;
+  FakeMqttTransport transport;
+  Tank tank{0, TANK_CONFIG, transport};
+  LevelProcessor processor;
+
+  Pipeline() {
+    tank.load(store);
+    processor.setCalibration(tank.currentCalibration());
+  }
+
+  void run(const std::vector<uint16_t>& trace) {
+    FakeRangeSensor sensor(trace.data(), trace.size());
+    uint16_t distance = 0;
+    while (sensor.dataReady()) {
+      clock.advance(SAMPLE_INTERVAL);
+      TEST_ASSERT_TRUE(sensor.readMillimeters(distance));
+      tank.update(processor.process({clock.millis(), distance}), store);
+      tank.publisher().flush(clock.millis());
+    }
+  }
+
+  // Letzte Nachricht auf dem Topic, leer wenn keine
+  std::string lastPayload(const char* topic) const {
+    for (auto it = transport.messages.rbegin(); it != transport.messages.rend(); ++it) {
+      if (it->topic == topic) {
+        return it->payload;
+      }
+    }
+    return std::string();
+  }
+
+  size_t countMessages(const char* topic) const {
+    size_t count = 0;
+    for (const FakeMqttTransport::Message& message : transport.messages) {
+      count += message.topic == topic;
+    }
+    return count;
+  }
+};
+
+std::vector<uint16_t> constant(uint16_t distance, size_t count) {
+  return std::vector<uint16_t>(count, distance);
+}
+
+// Langsames Leeren, dann eine Auffüllung innerhalb weniger Sekunden
+std::vector<uint16_t> drainAndRefill() {
+  std::vector<uint16_t> trace;
+  for (uint16_t i = 0; i < 100; i++) {
+    trace.push_back(80 + i);
+  }
+  for (uint16_t i = 0; i < 6; i++) {
+    trace.push_back(180 - i * 20);
+  }
+  const std::vector<uint16_t> full = constant(60, 30);
+  trace.insert(trace.end(), full.begin(), full.end());
+  return trace;
+}
+
+// Befehle wirken wie in der Firmware auf den Tank der aktuellen Pipeline
+Pipeline* commandPipeline = nullptr;
+std::string unhandledCommand;
+
+void handleCommand(uint8_t tank, const uint8_t* payload, size_t length) {
+  TEST_ASSERT_EQUAL_UINT8(0, tank);
+  if (payloadEquals(payload, length, "reset_refill_counter")) {
+    commandPipeline->tank.resetRefills(commandPipeline->store);
+  } else {
+    unhandledCommand.assign((const char*)payload, length);
+  }
+}
+
+void handleSetMinMm(uint8_t tank, const uint8_t* payload, size_t length) {
+  uint16_t minMm = 0;
+  if (parseCalibrationValue((const char*)payload, length, minMm)) {
+    commandPipeline->tank.setCalibration({minMm, commandPipeline->tank.currentCalibration().maxMm},
+                                         commandPipeline->store);
+  }
+}
+
+void handleSetMaxMm(uint8_t tank, const uint8_t* payload, size_t length) {
+  uint16_t maxMm = 0;
+  if (parseCalibrationValue((const char*)payload, length, maxMm)) {
+    commandPipeline->tank.setCalibration({commandPipeline->tank.currentCalibration().minMm, maxMm},
+                                         commandPipeline->store);
+  }
+}
+
+constexpr CommandRoute commandRoutes[] = {
+    {mqtt_suffix_command, handleCommand},
+    {mqtt_suffix_set_max_mm, handleSetMaxMm},
+    {mqtt_suffix_set_min_mm, handleSetMinMm},
+};
+static_assert(commandRoutesSorted(commandRoutes), "commandRoutes must be sorted by topic");
+
+// Wie mqttCallback(): Tank über das Topic finden, dann über die Tabelle
+// verteilen. Der Payload liegt ohne Terminator in einem eigenen Puffer,
+// damit ASan jedes Lesen über das Ende hinaus meldet.
+bool deliver(Pipeline& pipeline, const char* topic, const std::string& payload) {
+  commandPipeline = &pipeline;
+  const std::vector<uint8_t> buffer(payload.begin(), payload.end());
+  std::string_view suffix;
+  if (!pipeline.tank.names().matches(topic, suffix)) {
+    return false;
+  }
+  return dispatchCommand(commandRoutes, suffix, pipeline.tank.index(), buffer.data(), buffer.size());
+}
+
+void setUp() {
+  unhandledCommand.clear();
+}
+
+void tearDown() {}
+
+void test_level_from_filtered_distance() {
+  Pipeline pipeline;
+  pipeline.run(constant(140, 10));
+
+  const LevelEvent& level = pipeline.tank.latestLevel();
+  TEST_ASSERT_EQUAL_UINT16(140, level.distance);
+  TEST_ASSERT_FLOAT_WITHIN(0.1f, 50.0f, level.waterLevel);
+  TEST_ASSERT_EQUAL_STRING("50.0", pipeline.lastPayload("rocket/wasserstand/fuellstand").c_str());
+  TEST_ASSERT_EQUAL_STRING("140", pipeline.lastPayload("rocket/wasserstand/distanz").c_str());
+  TEST_ASSERT_EQUAL_size_t(0, pipeline.store.writes);
+}
+
+// Ein einzelner Spritzer darf weder den Füllstand springen lassen noch zählen
+void test_spike_is_filtered() {
+  Pipeline pipeline;
+  std::vector<uint16_t> trace = constant(140, 10);
+  trace[5] = 30;
+  pipeline.run(trace);
+
+  TEST_ASSERT_EQUAL_UINT32(0, pipeline.tank.refills());
+  TEST_ASSERT_EQUAL_size_t(1, pipeline.countMessages("rocket/wasserstand/fuellstand"));
+}
+
+void test_refill_counted_stored_and_published() {
+  Pipeline pipeline;
+  pipeline.run(drainAndRefill());
+
+  TEST_ASSERT_EQUAL_UINT32(1, pipeline.tank.refills());
+  TEST_ASSERT_EQUAL_STRING("1", pipeline.store.values["refills"].c_str());
+  TEST_ASSERT_EQUAL_STRING("1", pipeline.lastPayload("rocket/wasserstand/auffuellungen").c_str());
+  const std::string frame = pipeline.lastPayload("rocket/wasserstand");
+  TEST_ASSERT_TRUE(frame.find("\"auffuellungen\":1") != std::string::npos);
+  TEST_ASSERT_FLOAT_WITHIN(1.0f, 94.4f, pipeline.tank.latestLevel().waterLevel);
+}
+
+void test_counters_and_calibration_restored() {
+  Pipeline pipeline;
+  pipeline.store.values = {{"refills", "7"}, {"min_mm", "60"}, {"max_mm", "200"}};
+  pipeline.tank.load(pipeline.store);
+  pipeline.processor.setCalibration(pipeline.tank.currentCalibration());
+  pipeline.run(constant(130, 10));
+
+  TEST_ASSERT_EQUAL_UINT32(7, pipeline.tank.refills());
+  TEST_ASSERT_EQUAL_UINT16(60, pipeline.tank.currentCalibration().minMm);
+  TEST_ASSERT_EQUAL_UINT16(200, pipeline.tank.currentCalibration().maxMm);
+  TEST_ASSERT_FLOAT_WITHIN(0.1f, 50.0f, pipeline.tank.latestLevel().waterLevel);
+}
+
+// Ungültige Werte im NVS fallen auf die Vorgabe zurück
+void test_invalid_stored_calibration_ignored() {
+  MemoryStore store;
+  store.values = {{"min_mm", "300"}, {"max_mm", "100"}};
+  const Calibration calibration = loadCalibration(store);
+  TEST_ASSERT_EQUAL_UINT16(WATER_FULL_DEFAULT, calibration.minMm);
+  TEST_ASSERT_EQUAL_UINT16(WATER_EMPTY_DEFAULT, calibration.maxMm);
+}
+
+void test_calibration_saved_and_published() {
+  Pipeline pipeline;
+  pipeline.run(constant(140, 5));
+
+  uint16_t minMm = 0;
+  uint16_t maxMm = 0;
+  TEST_ASSERT_TRUE(parseCalibrationValue(" 20\r\n", 5, minMm));
+  TEST_ASSERT_TRUE(parseCalibrationValue("220", 3, maxMm));
+  TEST_ASSERT_TRUE(pipeline.tank.setCalibration({minMm, maxMm}, pipeline.store));
+  pipeline.processor.setCalibration(pipeline.tank.currentCalibration());
+  pipeline.clock.advance(SAMPLE_INTERVAL);
+  pipeline.tank.publisher().flush(pipeline.clock.millis());
+
+  TEST_ASSERT_EQUAL_STRING("20", pipeline.store.values["min_mm"].c_str());
+  TEST_ASSERT_EQUAL_STRING("220", pipeline.store.values["max_mm"].c_str());
+  TEST_ASSERT_EQUAL_STRING("20", pipeline.lastPayload("rocket/wasserstand/min_mm").c_str());
+  TEST_ASSERT_EQUAL_STRING("220", pipeline.lastPayload("rocket/wasserstand/max_mm").c_str());
+
+  // Nächster Messwert wird mit der neuen Kalibrierung sofort veröffentlicht
+  pipeline.run(constant(140, 1));
+  TEST_ASSERT_EQUAL_STRING("40.0", pipeline.lastPayload("rocket/wasserstand/fuellstand").c_str());
+}
+
+void test_invalid_calibration_rejected() {
+  Pipeline pipeline;
+  uint16_t value = 0;
+  TEST_ASSERT_FALSE(parseCalibrationValue("12a", 3, value));
+  TEST_ASSERT_FALSE(parseCalibrationValue("2001", 4, value));
+  TEST_ASSERT_FALSE(parseCalibrationValue("  ", 2, value));
+
+  TEST_ASSERT_FALSE(pipeline.tank.setCalibration({200, 100}, pipeline.store));
+  TEST_ASSERT_EQUAL_size_t(0, pipeline.store.writes);
+  pipeline.tank.publisher().flush(pipeline.clock.millis());
+  // Die gültigen Werte werden erneut gesendet, damit Home Assistant zurückspringt
+  TEST_ASSERT_EQUAL_STRING("50", pipeline.lastPayload("rocket/wasserstand/min_mm").c_str());
+  TEST_ASSERT_EQUAL_STRING("230", pipeline.lastPayload("rocket/wasserstand/max_mm").c_str());
+}
+
+// Kleine Änderungen warten auf den Heartbeat, getrennt wird nichts gesendet
+void test_publish_threshold_and_heartbeat() {
+  Pipeline pipeline;
+  pipeline.run(constant(140, 5));
+  const size_t frames = pipeline.countMessages("rocket/wasserstand");
+  TEST_ASSERT_EQUAL_size_t(1, frames);
+
+  pipeline.run(constant(143, 10));  // 1.7 %, unter WATER_LEVEL_THRESHOLD
+  TEST_ASSERT_EQUAL_size_t(frames, pipeline.countMessages("rocket/wasserstand"));
+
+  pipeline.transport.isConnected = false;
+  pipeline.run(constant(143, TELEMETRY_MAX_INTERVAL / SAMPLE_INTERVAL));
+  TEST_ASSERT_EQUAL_size_t(frames, pipeline.countMessages("rocket/wasserstand"));
+
+  pipeline.transport.isConnected = true;
+  pipeline.run(constant(143, 1));
+  TEST_ASSERT_EQUAL_size_t(frames + 1, pipeline.countMessages("rocket/wasserstand"));
+}
+
+// Schlägt nur das Sammel-Topic fehl, wird es im nächsten Tick erneut
+// versucht, die Einzelwerte aber nicht jedes Mal mitgeschickt
+void test_failed_frame_keeps_field_topics() {
+  Pipeline pipeline;
+  pipeline.run(constant(140, 5));
+  const size_t frames = pipeline.countMessages("rocket/wasserstand");
+  const size_t levels = pipeline.countMessages("rocket/wasserstand/fuellstand");
+
+  pipeline.transport.failBeginPublish = true;
+  pipeline.clock.advance(TELEMETRY_MIN_INTERVAL);
+  TEST_ASSERT_TRUE(pipeline.tank.publisher().updateWaterLevel(80, 60));
+  for (int i = 0; i < 10; i++) {
+    pipeline.clock.advance(10);
+    TEST_ASSERT_FALSE(pipeline.tank.publisher().flush(pipeline.clock.millis()));
+  }
+  TEST_ASSERT_EQUAL_size_t(frames, pipeline.countMessages("rocket/wasserstand"));
+  TEST_ASSERT_EQUAL_size_t(levels + 1, pipeline.countMessages("rocket/wasserstand/fuellstand"));
+
+  // Ein neuer Wert geht wieder einzeln raus
+  pipeline.tank.resetRefills(pipeline.store);
+  pipeline.tank.publisher().flush(pipeline.clock.millis());
+  TEST_ASSERT_EQUAL_size_t(1, pipeline.countMessages("rocket/wasserstand/auffuellungen"));
+  TEST_ASSERT_EQUAL_size_t(levels + 1, pipeline.countMessages("rocket/wasserstand/fuellstand"));
+
+  pipeline.transport.failBeginPublish = false;
+  TEST_ASSERT_TRUE(pipeline.tank.publisher().flush(pipeline.clock.millis()));
+  TEST_ASSERT_EQUAL_size_t(frames + 1, pipeline.countMessages("rocket/wasserstand"));
+  TEST_ASSERT_EQUAL_size_t(levels + 1, pipeline.countMessages("rocket/wasserstand/fuellstand"));
+  TEST_ASSERT_EQUAL_size_t(0, pipeline.tank.publisher().dirtyFields());
+}
+
+// Zähler landen erst nach der Ruhephase gesammelt im NVS
+void test_cached_store_batches_counter_writes() {
+  Pipeline pipeline;
+  CachedStore<STORE_DEVICE_KEYS + TANK_KEY_COUNT> cache(pipeline.store, pipeline.clock);
+  for (int i = 0; i < 3; i++) {
+    pipeline.tank.resetRefills(cache);
+    pipeline.tank.update({pipeline.clock.millis(), 50, 140, true}, cache);
+    pipeline.clock.advance(SAMPLE_INTERVAL);
+    TEST_ASSERT_FALSE(cache.flush());
+  }
+  TEST_ASSERT_EQUAL_size_t(0, pipeline.store.writes);
+
+  pipeline.clock.advance(STORE_FLUSH_QUIET_TIME);
+  TEST_ASSERT_TRUE(cache.flush());
+  TEST_ASSERT_EQUAL_size_t(1, pipeline.store.writes);
+  TEST_ASSERT_EQUAL_STRING("1", pipeline.store.values["refills"].c_str());
+}
+
+void test_commands_routed_to_handlers() {
+  Pipeline pipeline;
+  pipeline.run(drainAndRefill());
+  TEST_ASSERT_EQUAL_UINT32(1, pipeline.tank.refills());
+
+  TEST_ASSERT_TRUE(deliver(pipeline, "rocket/wasserstand/command", "reset_refill_counter"));
+  TEST_ASSERT_EQUAL_UINT32(0, pipeline.tank.refills());
+  TEST_ASSERT_EQUAL_STRING("0", pipeline.store.values["refills"].c_str());
+
+  TEST_ASSERT_TRUE(deliver(pipeline, "rocket/wasserstand/set/min_mm", "25"));
+  TEST_ASSERT_TRUE(deliver(pipeline, "rocket/wasserstand/set/max_mm", " 210\n"));
+  TEST_ASSERT_EQUAL_UINT16(25, pipeline.tank.currentCalibration().minMm);
+  TEST_ASSERT_EQUAL_UINT16(210, pipeline.tank.currentCalibration().maxMm);
+  TEST_ASSERT_EQUAL_STRING("25", pipeline.store.values["min_mm"].c_str());
+  TEST_ASSERT_EQUAL_STRING("210", pipeline.store.values["max_mm"].c_str());
+}
+
+void test_unknown_commands_ignored() {
+  Pipeline pipeline;
+  pipeline.run(constant(140, 5));
+  const size_t writes = pipeline.store.writes;
+
+  // Unbekannte Topics unter dem Tank, fremde Tanks und Präfixe ohne Trenner
+  TEST_ASSERT_FALSE(deliver(pipeline, "rocket/wasserstand/set/volume", "5"));
+  TEST_ASSERT_FALSE(deliver(pipeline, "rocket/wasserstand/set", "5"));
+  TEST_ASSERT_FALSE(deliver(pipeline, "rocket/wasserstand/command/x", "reset_refill_counter"));
+  TEST_ASSERT_FALSE(deliver(pipeline, "rocket/wasserstandx/set/min_mm", "5"));
+  TEST_ASSERT_FALSE(deliver(pipeline, "rocket/milch/set/min_mm", "5"));
+  TEST_ASSERT_FALSE(deliver(pipeline, "rocket/wasserstand", "5"));
+
+  // Bekanntes Topic, unbekannter Befehl: erreicht den Handler, ändert nichts
+  TEST_ASSERT_TRUE(deliver(pipeline, "rocket/wasserstand/command", "reset_refill_counter_now"));
+  TEST_ASSERT_EQUAL_STRING("reset_refill_counter_now", unhandledCommand.c_str());
+  TEST_ASSERT_TRUE(deliver(pipeline, "rocket/wasserstand/command", ""));
+
+  TEST_ASSERT_EQUAL_size_t(writes, pipeline.store.writes);
+  TEST_ASSERT_EQUAL_UINT16(50, pipeline.tank.currentCalibration().minMm);
+}
+
+// Retained Payloads können beliebig lang sein, geparst wird ohne Kopie
+void test_oversized_payload_rejected() {
+  Pipeline pipeline;
+  const std::string digits(4096, '1');
+  TEST_ASSERT_TRUE(deliver(pipeline, "rocket/wasserstand/set/min_mm", digits));
+  TEST_ASSERT_TRUE(deliver(pipeline, "rocket/wasserstand/set/max_mm", "300" + std::string(4096, '0')));
+  TEST_ASSERT_TRUE(deliver(pipeline, "rocket/wasserstand/command", std::string(4096, 'r')));
+
+  TEST_ASSERT_EQUAL_size_t(0, pipeline.store.writes);
+  TEST_ASSERT_EQUAL_UINT16(50, pipeline.tank.currentCalibration().minMm);
+  TEST_ASSERT_EQUAL_UINT16(230, pipeline.tank.currentCalibration().maxMm);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_level_from_filtered_distance);
+  RUN_TEST(test_spike_is_filtered);
+  RUN_TEST(test_refill_counted_stored_and_published);
+  RUN_TEST(test_counters_and_calibration_restored);
+  RUN_TEST(test_invalid_stored_calibration_ignored);
+  RUN_TEST(test_calibration_saved_and_published);
+  RUN_TEST(test_invalid_calibration_rejected);
+  RUN_TEST(test_publish_threshold_and_heartbeat);
+  RUN_TEST(test_failed_frame_keeps_field_topics);
+  RUN_TEST(test_cached_store_batches_counter_writes);
+  RUN_TEST(test_commands_routed_to_handlers);
+  RUN_TEST(test_unknown_commands_ignored);
+  RUN_TEST(test_oversized_payload_rejected);
+  return UNITY_END();
+}
@@ -0,0 +1,225 @@
+// Steady-state publishing without the heap
+//
+//   pio test -e native -f test_publisher_heap
+//
+// Counts global operator new and, with glibc, malloc/calloc/realloc while
+// StatePublisher::flush() runs. After the first frame has put every field
+// into the arena-backed document, no frame, heartbeat, full frame or
+// failed publish may allocate. The transport writes into fixed buffers,
+// the FakeMqttTransport from HalFakes.h would allocate itself.
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <unity.h>
+#include <ArenaAllocator.h>
+#include <Publisher.h>
+
+static bool counting = false;
+static uint32_t allocations = 0;
+
+static void countAllocation() {
+  if (counting) {
+    allocations++;
+  }
+}
+
+#if defined(__GLIBC__)
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* pointer, size_t size);
+void __libc_free(void* pointer);
+
+void* malloc(size_t size) {
+  countAllocation();
+  return __libc_malloc(size);
+}
+void* calloc(size_t count, size_t size) {
+  countAllocation();
+  return __libc_calloc(count, size);
+}
+void* realloc(void* pointer, size_t size) {
+  countAllocation();
+  return __libc_realloc(pointer, size);
+}
+void free(void* pointer) { __libc_free(pointer); }
+}
+#endif
+
+void* operator new(size_t size) {
+  countAllocation();
+  void* pointer = malloc(size);
+  if (!pointer) {
+    throw std::bad_alloc();
+  }
+  return pointer;
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* pointer) noexcept { free(pointer); }
+void operator delete[](void* pointer) noexcept { free(pointer); }
+void operator delete(void* pointer, size_t) noexcept { free(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { free(pointer); }
+
+// Hält nur die letzte Nachricht, in festen Puffern
+class FixedMqttTransport : public MqttTransport {
+ public:
+  bool connected() override { return true; }
+
+  bool publish(const char* topic, const char* payload, bool) override {
+    snprintf(lastTopic, sizeof(lastTopic), "%s", topic);
+    snprintf(lastPayload, sizeof(lastPayload), "%s", payload);
+    messages++;
+    return true;
+  }
+
+  bool beginPublish(const char* topic, size_t length, bool) override {
+    if (failBeginPublish) {
+      return false;
+    }
+    snprintf(lastTopic, sizeof(lastTopic), "%s", topic);
+    expected = length;
+    written = 0;
+    return true;
+  }
+
+  size_t write(const uint8_t* data, size_t size) override {
+    if (written + size < sizeof(lastPayload)) {
+      memcpy(lastPayload + written, data, size);
+      lastPayload[written + size] = '\0';
+    }
+    written += size;
+    return size;
+  }
+
+  bool endPublish() override {
+    if (written != expected) {
+      return false;
+    }
+    messages++;
+    frames++;
+    return true;
+  }
+
+  bool failBeginPublish = false;
+  uint32_t messages = 0;
+  uint32_t frames = 0;
+  char lastTopic[MQTT_TOPIC_SIZE];
+  char lastPayload[1024];
+
+ private:
+  size_t expected = 0;
+  size_t written = 0;
+};
+
+const size_t ARENA_SIZE = 4096;  // wie PUBLISHER_ARENA_SIZE in main.cpp
+const char FIRMWARE[] = "1.2.3";
+
+ArenaAllocator<ARENA_SIZE> arena;
+FixedMqttTransport transport;
+StatePublisher publisher(transport, &arena);
+BootTimeline timeline;
+uint32_t now = 0;
+
+// Jedes Feld mit neuen Werten derselben Art
+void updateAll(uint32_t value) {
+  publisher.updateWaterLevel(10 + value % 80, 100 + value % 200);
+  publisher.updateRefillCount(value);
+  publisher.updateCalibration({(uint16_t)(20 + value % 10), 300});
+  publisher.updateFirmware(FIRMWARE);
+  publisher.updateStoreWrites(value);
+  publisher.updateSensorErrors(value, value / 2, value / 3);
+  publisher.updateConnectionStats({value, value, value, 120, 900, value * 1000});
+  publisher.updateBootTimeline(timeline);
+  publisher.updateHeap(200000 - value, 150000, 90000);
+  publisher.updateConsumption({value, value / 4, 35.5f, 420.0f + value, 18.2f, 20.5f});
+}
+
+// Zählt die Allokationen eines flush()
+uint32_t allocationsDuring(bool& sent) {
+  allocations = 0;
+  counting = true;
+  sent = publisher.flush(now);
+  counting = false;
+  return allocations;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_first_frame_fills_arena() {
+  timeline.mark(BOOT_WIFI_UP, 900);
+  timeline.mark(BOOT_MQTT_UP, 1400);
+  updateAll(1);
+  publisher.requestFullFrame();
+  TEST_ASSERT_TRUE(publisher.flush(now));
+  TEST_ASSERT_EQUAL_UINT32(1, transport.frames);
+  TEST_ASSERT_EQUAL_UINT32(0, arena.failureCount());
+}
+
+void test_frames_do_not_allocate() {
+  const size_t arenaUsed = arena.usedBytes();
+  bool sent = false;
+  for (uint32_t i = 2; i < 200; i++) {
+    now += TELEMETRY_MIN_INTERVAL;
+    updateAll(i);
+    TEST_ASSERT_EQUAL_UINT32(0, allocationsDuring(sent));
+    TEST_ASSERT_TRUE(sent);
+  }
+  TEST_ASSERT_EQUAL_UINT32(199, transport.frames);
+  // Werte werden im Dokument ersetzt, die Arena wächst nicht mehr
+  TEST_ASSERT_EQUAL_UINT32(arenaUsed, arena.usedBytes());
+  TEST_ASSERT_EQUAL_UINT32(0, arena.failureCount());
+}
+
+void test_heartbeat_and_full_frame_do_not_allocate() {
+  bool sent = false;
+  now += TELEMETRY_MAX_INTERVAL;
+  TEST_ASSERT_EQUAL_UINT32(0, allocationsDuring(sent));
+  TEST_ASSERT_TRUE(sent);
+
+  publisher.requestFullFrame();
+  now += 1;
+  TEST_ASSERT_EQUAL_UINT32(0, allocationsDuring(sent));
+  TEST_ASSERT_TRUE(sent);
+
+  // Nichts geändert, vor dem Heartbeat
+  now += 1;
+  TEST_ASSERT_EQUAL_UINT32(0, allocationsDuring(sent));
+  TEST_ASSERT_FALSE(sent);
+}
+
+void test_failed_publish_does_not_allocate() {
+  bool sent = false;
+  transport.failBeginPublish = true;
+  updateAll(500);
+  now += TELEMETRY_MIN_INTERVAL;
+  TEST_ASSERT_EQUAL_UINT32(0, allocationsDuring(sent));
+  TEST_ASSERT_FALSE(sent);
+
+  transport.failBeginPublish = false;
+  now += TELEMETRY_MIN_INTERVAL;
+  TEST_ASSERT_EQUAL_UINT32(0, allocationsDuring(sent));
+  TEST_ASSERT_TRUE(sent);
+}
+
+// Gegenprobe: die Zählung greift
+void test_counter_sees_allocations() {
+  allocations = 0;
+  counting = true;
+  char* volatile block = new char[16];  // volatile, sonst darf der Compiler new/delete weglassen
+  counting = false;
+  delete[] block;
+  TEST_ASSERT_GREATER_OR_EQUAL(1, allocations);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_first_frame_fills_arena);
+  RUN_TEST(test_frames_do_not_allocate);
+  RUN_TEST(test_heartbeat_and_full_frame_do_not_allocate);
+  RUN_TEST(test_failed_publish_does_not_allocate);
+  RUN_TEST(test_counter_sees_allocations);
+  return UNITY_END();
+}
@@ -0,0 +1,135 @@
+// RefillDetector on synthetic level traces
+//
+//   pio test -e native -f test_refill_detector
+//
+// Each trace is a list of segments in % sampled once per second and runs
+// through a detector with the firmware's thresholds. The table holds the
+// expected number of refills and the sequence of detector states, with
+// repeated states collapsed.
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <unity.h>
+#include <WaterLevel.h>
+
+const uint32_t TRACE_INTERVAL = 1000;
+
+typedef RefillDetector<REFILL_WINDOW_SAMPLES> Detector;
+
+// Linear from start to end in count samples (count == 1: only end)
+struct Segment {
+  float start;
+  float end;
+  uint16_t count;
+};
+
+struct TraceCase {
+  const char* name;
+  std::vector<Segment> segments;
+  uint32_t expectedRefills;
+  const char* expectedStates;  // I = idle, R = rising, S = settled
+};
+
+const char STATE_NAMES[] = {'I', 'R', 'S'};
+
+std::vector<float> buildTrace(const std::vector<Segment>& segments) {
+  std::vector<float> trace;
+  for (const Segment& segment : segments) {
+    for (uint16_t i = 0; i < segment.count; i++) {
+      const float step = segment.count > 1 ? (float)i / (segment.count - 1) : 1.0f;
+      trace.push_back(segment.start + (segment.end - segment.start) * step);
+    }
+  }
+  return trace;
+}
+
+// Noise: alternating around base with the given peak-to-peak amplitude
+std::vector<Segment> noise(float base, float amplitude, uint16_t count) {
+  std::vector<Segment> segments;
+  for (uint16_t i = 0; i < count; i++) {
+    const float level = i % 2 ? base + amplitude : base;
+    segments.push_back({level, level, 1});
+  }
+  return segments;
+}
+
+const std::vector<TraceCase>& traceCases() {
+  static const std::vector<TraceCase> cases = {
+      // 2.5 %/s: 60 % in total, but never REFILL_THRESHOLD within one window
+      {"slow rise across windows", {{20, 20, 5}, {20, 80, 25}, {80, 80, 20}}, 0, "I"},
+      // 3.5 %/s: the threshold is reached about one window after the rise began
+      {"slow rise within one window", {{20, 20, 5}, {20, 90, 21}, {90, 90, 30}}, 1, "IRSI"},
+      {"single-sample spike", {{50, 50, 5}, {95, 95, 1}, {50, 50, 20}}, 0, "I"},
+      {"noise under threshold", noise(40, REFILL_THRESHOLD - 0.5f, 60), 0, "I"},
+      // Second fill starts before the first has settled: one refill
+      {"back-to-back refills", {{20, 20, 5}, {45, 70, 2}, {70, 70, 2}, {85, 95, 2}, {95, 95, 30}}, 1, "IRSI"},
+      // Once the first rise has left the window, a new one counts again
+      {"two separate refills", {{20, 20, 5}, {60, 60, 20}, {60, 20, 40}, {60, 60, 20}}, 2, "IRSIRSI"},
+      {"steady drain", {{90, 10, 160}}, 0, "I"},
+  };
+  return cases;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void runCase(const TraceCase& testCase) {
+  Detector detector(REFILL_THRESHOLD, REFILL_TIME_WINDOW, REFILL_SETTLE_TIME, REFILL_DEBOUNCE_SAMPLES);
+  std::string states(1, STATE_NAMES[detector.currentState()]);
+  uint32_t refills = 0;
+  uint32_t now = 0;
+
+  for (float level : buildTrace(testCase.segments)) {
+    now += TRACE_INTERVAL;
+    if (detector.update(now, level)) {
+      refills++;
+    }
+    const char state = STATE_NAMES[detector.currentState()];
+    if (state != states.back()) {
+      states += state;
+    }
+  }
+
+  char message[96];
+  snprintf(message, sizeof(message), "%s: states %s", testCase.name, states.c_str());
+  TEST_ASSERT_EQUAL_UINT32_MESSAGE(testCase.expectedRefills, refills, message);
+  TEST_ASSERT_EQUAL_STRING_MESSAGE(testCase.expectedStates, states.c_str(), message);
+}
+
+void test_trace_corpus() {
+  for (const TraceCase& testCase : traceCases()) {
+    runCase(testCase);
+  }
+}
+
+// Rise above the threshold on fewer than REFILL_DEBOUNCE_SAMPLES samples
+void test_debounce_resets() {
+  Detector detector(REFILL_THRESHOLD, REFILL_TIME_WINDOW, REFILL_SETTLE_TIME, REFILL_DEBOUNCE_SAMPLES);
+  const float trace[] = {20, 20, 60, 20, 60, 20, 60, 20};
+  uint32_t now = 0;
+  for (float level : trace) {
+    now += TRACE_INTERVAL;
+    TEST_ASSERT_FALSE(detector.update(now, level));
+  }
+  TEST_ASSERT_EQUAL_UINT8(Detector::STATE_IDLE, detector.currentState());
+}
+
+void test_reset_forgets_window() {
+  Detector detector(REFILL_THRESHOLD, REFILL_TIME_WINDOW, REFILL_SETTLE_TIME, REFILL_DEBOUNCE_SAMPLES);
+  detector.update(1000, 20);
+  detector.update(2000, 60);
+  detector.reset();
+  TEST_ASSERT_FALSE(detector.update(3000, 60));
+  TEST_ASSERT_FALSE(detector.update(4000, 60));
+  TEST_ASSERT_EQUAL_UINT8(Detector::STATE_IDLE, detector.currentState());
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 0, detector.windowRise());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_trace_corpus);
+  RUN_TEST(test_debounce_resets);
+  RUN_TEST(test_reset_forgets_window);
+  return UNITY_END();
+}
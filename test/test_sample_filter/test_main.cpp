@@ -0,0 +1,145 @@
+// Filter stages for ToF distance samples
+//
+//   pio test -e native -f test_sample_filter
+//
+// Each stage on its own with hand-checked values, the smoothers also at
+// the ends of the uint16_t range where the fixed-point math is tightest.
+#include <stdint.h>
+#include <unity.h>
+#include <SampleFilter.h>
+#include <WaterLevel.h>
+
+void setUp() {}
+void tearDown() {}
+
+void test_ring_buffer_drops_oldest() {
+  RingBuffer<uint16_t, 3> buffer;
+  for (uint16_t value = 1; value <= 5; value++) {
+    buffer.push(value);
+  }
+  TEST_ASSERT_TRUE(buffer.full());
+  TEST_ASSERT_EQUAL_UINT16(3, buffer[0]);
+  TEST_ASSERT_EQUAL_UINT16(4, buffer[1]);
+  TEST_ASSERT_EQUAL_UINT16(5, buffer.newest());
+  buffer.clear();
+  TEST_ASSERT_EQUAL_UINT8(0, buffer.size());
+}
+
+void test_median_removes_spike() {
+  MedianFilter<5> median;
+  const uint16_t input[] = {100, 102, 900, 101, 99, 100, 0, 101};
+  const uint16_t expected[] = {100, 102, 102, 102, 101, 101, 100, 100};
+  for (uint8_t i = 0; i < sizeof(input) / sizeof(input[0]); i++) {
+    TEST_ASSERT_EQUAL_UINT16(expected[i], median.update(input[i]));
+  }
+}
+
+void test_median_follows_step() {
+  MedianFilter<3> median;
+  median.update(100);
+  median.update(100);
+  TEST_ASSERT_EQUAL_UINT16(100, median.update(200));
+  TEST_ASSERT_EQUAL_UINT16(200, median.update(200));
+  median.reset();
+  TEST_ASSERT_EQUAL_UINT16(50, median.update(50));
+}
+
+void test_outlier_rejector_holds_then_accepts() {
+  OutlierRejector<40, 2> rejector;
+  TEST_ASSERT_EQUAL_UINT16(100, rejector.update(100));
+  TEST_ASSERT_EQUAL_UINT16(130, rejector.update(130));  // innerhalb MAX_JUMP_MM
+  TEST_ASSERT_EQUAL_UINT16(130, rejector.update(300));
+  TEST_ASSERT_EQUAL_UINT16(130, rejector.update(300));
+  // Nach MAX_REJECTS Sprüngen in Folge ist es ein echter Pegelwechsel
+  TEST_ASSERT_EQUAL_UINT16(300, rejector.update(300));
+  TEST_ASSERT_EQUAL_UINT32(2, rejector.rejectedCount());
+}
+
+void test_exponential_filter_steps() {
+  ExponentialFilter<64> filter;  // alpha = 0.25
+  TEST_ASSERT_EQUAL_UINT16(100, filter.update(100));
+  TEST_ASSERT_EQUAL_UINT16(125, filter.update(200));
+  TEST_ASSERT_EQUAL_UINT16(144, filter.update(200));
+
+  ExponentialFilter<256> passThrough;
+  passThrough.update(10);
+  TEST_ASSERT_EQUAL_UINT16(5000, passThrough.update(5000));
+}
+
+// Full-scale steps: the difference times ALPHA_Q8 does not fit in int32
+void test_exponential_filter_full_range() {
+  ExponentialFilter<255> filter;
+  filter.update(0);
+  uint16_t value = filter.update(UINT16_MAX);
+  TEST_ASSERT_EQUAL_UINT16(65279, value);
+  for (int i = 0; i < 10; i++) {
+    value = filter.update(UINT16_MAX);
+  }
+  TEST_ASSERT_EQUAL_UINT16(UINT16_MAX, value);
+
+  value = filter.update(0);
+  TEST_ASSERT_EQUAL_UINT16(256, value);
+  for (int i = 0; i < 10; i++) {
+    value = filter.update(0);
+  }
+  TEST_ASSERT_EQUAL_UINT16(0, value);
+}
+
+void test_kalman_converges() {
+  KalmanFilter<FILTER_PROCESS_NOISE, FILTER_MEASUREMENT_NOISE> filter;
+  TEST_ASSERT_EQUAL_UINT16(100, filter.update(100));
+  uint16_t value = 0;
+  for (int i = 0; i < 50; i++) {
+    value = filter.update(i % 2 ? 96 : 104);
+  }
+  TEST_ASSERT_UINT32_WITHIN(3, 100, value);
+
+  // Sprung: folgt monoton, ohne zu überschwingen
+  uint16_t previous = value;
+  for (int i = 0; i < 30; i++) {
+    value = filter.update(200);
+    TEST_ASSERT_GREATER_OR_EQUAL(previous, value);
+    TEST_ASSERT_LESS_OR_EQUAL(200, value);
+    previous = value;
+  }
+  TEST_ASSERT_UINT32_WITHIN(1, 200, value);
+}
+
+void test_kalman_full_range() {
+  KalmanFilter<FILTER_PROCESS_NOISE, FILTER_MEASUREMENT_NOISE> filter;
+  filter.update(0);
+  uint16_t value = 0;
+  for (int i = 0; i < 30; i++) {
+    value = filter.update(UINT16_MAX);
+  }
+  TEST_ASSERT_UINT32_WITHIN(1, UINT16_MAX, value);
+}
+
+void test_distance_filter_chain() {
+  DistanceFilter filter;
+  uint16_t value = 0;
+  for (int i = 0; i < 10; i++) {
+    value = filter.update(150);
+  }
+  TEST_ASSERT_EQUAL_UINT16(150, value);
+  // Einzelner Spritzer kommt nicht durch
+  TEST_ASSERT_EQUAL_UINT16(150, filter.update(20));
+  TEST_ASSERT_EQUAL_UINT16(150, filter.update(150));
+
+  filter.reset();
+  TEST_ASSERT_EQUAL_UINT16(80, filter.update(80));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_ring_buffer_drops_oldest);
+  RUN_TEST(test_median_removes_spike);
+  RUN_TEST(test_median_follows_step);
+  RUN_TEST(test_outlier_rejector_holds_then_accepts);
+  RUN_TEST(test_exponential_filter_steps);
+  RUN_TEST(test_exponential_filter_full_range);
+  RUN_TEST(test_kalman_converges);
+  RUN_TEST(test_kalman_full_range);
+  RUN_TEST(test_distance_filter_chain);
+  return UNITY_END();
+}
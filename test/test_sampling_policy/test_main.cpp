@@ -0,0 +1,156 @@
+// SamplingPolicy on replayed level traces
+//
+//   pio test -e native -f test_sampling_policy
+//
+// A trace is a piecewise linear distance profile in mm with ±1 mm sensor
+// noise. It is replayed at the interval the policy currently asks for,
+// through the same LevelProcessor as on the device, so the filter delay is
+// part of the timing. Each row lists the expected mode changes with the
+// earliest and latest time they may happen.
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+#include <unity.h>
+#include <WaterLevel.h>
+#include <SamplingPolicy.h>
+
+// Stützpunkt des Profils: Zeit in s, Distanz in mm
+struct TracePoint {
+  uint32_t second;
+  float distance;
+};
+
+struct ModeChange {
+  SamplingMode mode;
+  uint32_t earliestMs;
+  uint32_t latestMs;
+};
+
+struct TraceCase {
+  const char* name;
+  std::vector<TracePoint> profile;
+  std::vector<ModeChange> expected;
+};
+
+struct Replay {
+  std::vector<ModeChange> changes;  // earliestMs = latestMs = Zeitpunkt
+  std::vector<uint32_t> intervals;  // Abstand der Messwerte nach jedem Wechsel
+};
+
+// Median und Ausreißer-Sperre brauchen so viele Messwerte bis ein Sprung durchkommt
+const uint32_t FILTER_DELAY_SAMPLES = FILTER_MEDIAN_WINDOW / 2 + 1 + FILTER_MAX_REJECTS;
+const uint32_t REFILL_AT = 400000;   // Auffüllung nach dem Wechsel auf langsam
+const uint32_t REFILL_END = 402000;
+
+float distanceAt(const std::vector<TracePoint>& profile, uint32_t now) {
+  for (size_t i = 1; i < profile.size(); i++) {
+    const uint32_t start = profile[i - 1].second * 1000;
+    const uint32_t end = profile[i].second * 1000;
+    if (now <= end) {
+      const float step = end > start ? (float)(now - start) / (end - start) : 1.0f;
+      return profile[i - 1].distance + (profile[i].distance - profile[i - 1].distance) * step;
+    }
+  }
+  return profile.back().distance;
+}
+
+Replay replay(const std::vector<TracePoint>& profile) {
+  LevelProcessor processor;
+  SamplingPolicy policy;
+  Replay result;
+  const uint32_t duration = profile.back().second * 1000;
+  uint32_t sample = 0;
+
+  for (uint32_t now = 0; now <= duration; now += policy.intervalMs()) {
+    const int noise = sample++ % 3 == 0 ? 1 : 0;
+    const uint16_t distance = (uint16_t)(distanceAt(profile, now) + 0.5f) + noise;
+    const LevelEvent event = processor.process({now, distance});
+    if (policy.update(now, event.waterLevel, processor.refillActive())) {
+      result.changes.push_back({policy.mode(), now, now});
+      result.intervals.push_back(policy.intervalMs());
+    }
+  }
+  return result;
+}
+
+const std::vector<TraceCase>& traceCases() {
+  static const std::vector<TraceCase> cases = {
+      // Nur Rauschen: nach STABLE_HOLD langsam
+      {"stable with noise", {{0, 140}, {600, 140}},
+       {{SAMPLING_SLOW, SAMPLING_STABLE_HOLD, SAMPLING_STABLE_HOLD + SAMPLING_NORMAL_INTERVAL}}},
+      // Auffüllung im Modus langsam: schnell sobald der Sprung die Filter
+      // passiert hat, nach FAST_HOLD normal. Langsam erst STABLE_HOLD nachdem
+      // die geglättete Rate abgeklungen ist (einige STABLE_TIME_CONSTANT)
+      {"refill while slow", {{0, 180}, {REFILL_AT / 1000, 180}, {REFILL_END / 1000, 70}, {1100, 70}},
+       {{SAMPLING_SLOW, SAMPLING_STABLE_HOLD, SAMPLING_STABLE_HOLD + SAMPLING_NORMAL_INTERVAL},
+        {SAMPLING_FAST, REFILL_AT, REFILL_AT + FILTER_DELAY_SAMPLES * SAMPLING_SLOW_INTERVAL},
+        {SAMPLING_NORMAL, REFILL_END + SAMPLING_FAST_HOLD, REFILL_END + 3 * SAMPLING_FAST_HOLD},
+        {SAMPLING_SLOW, REFILL_END + SAMPLING_FAST_HOLD + SAMPLING_STABLE_HOLD,
+         REFILL_END + 3 * SAMPLING_FAST_HOLD + 4 * SAMPLING_STABLE_TIME_CONSTANT + SAMPLING_STABLE_HOLD}}},
+      // 3 %/min: weder stabil noch schnell, bleibt normal
+      {"slow drain", {{0, 100}, {1200, 208}}, {}},
+      // 15 %/min ab 60 s: schnell, 30 s nach dem Ende normal
+      {"fast drain", {{0, 60}, {60, 60}, {180, 114}, {300, 114}},
+       {{SAMPLING_FAST, 60000, 60000 + 2 * SAMPLING_FAST_TIME_CONSTANT},
+        {SAMPLING_NORMAL, 180000 + SAMPLING_FAST_HOLD, 180000 + 2 * SAMPLING_FAST_HOLD}}},
+  };
+  return cases;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_trace_transitions() {
+  for (const TraceCase& testCase : traceCases()) {
+    const Replay result = replay(testCase.profile);
+    char message[96];
+    snprintf(message, sizeof(message), "%s: mode changes", testCase.name);
+    TEST_ASSERT_EQUAL_size_t_MESSAGE(testCase.expected.size(), result.changes.size(), message);
+
+    for (size_t i = 0; i < result.changes.size(); i++) {
+      const ModeChange& expected = testCase.expected[i];
+      const ModeChange& actual = result.changes[i];
+      snprintf(message, sizeof(message), "%s: change %u to %s at %lu ms", testCase.name, (unsigned)i,
+               SamplingPolicy::modeName(actual.mode), (unsigned long)actual.earliestMs);
+      TEST_ASSERT_EQUAL_UINT8_MESSAGE(expected.mode, actual.mode, message);
+      TEST_ASSERT_TRUE_MESSAGE(actual.earliestMs >= expected.earliestMs, message);
+      TEST_ASSERT_TRUE_MESSAGE(actual.earliestMs <= expected.latestMs, message);
+      TEST_ASSERT_EQUAL_UINT32_MESSAGE(SamplingPolicy::samplingInterval(actual.mode), result.intervals[i], message);
+    }
+  }
+}
+
+// Ein laufender Auffüllvorgang erzwingt schnell, auch ohne Änderungsrate
+void test_refill_active_forces_fast() {
+  SamplingPolicy policy;
+  policy.update(0, 50, false);
+  TEST_ASSERT_TRUE(policy.update(SAMPLING_NORMAL_INTERVAL, 50, true));
+  TEST_ASSERT_EQUAL_UINT8(SAMPLING_FAST, policy.mode());
+  TEST_ASSERT_EQUAL_UINT32(SAMPLING_FAST_INTERVAL, policy.intervalMs());
+  TEST_ASSERT_EQUAL_UINT16(SAMPLING_FAST_KEEPALIVE, policy.keepAliveSeconds());
+}
+
+// Eine einzelne 1 mm Stufe im Modus langsam weckt nicht auf
+void test_single_step_keeps_slow() {
+  SamplingPolicy policy;
+  uint32_t now = 0;
+  for (; now <= SAMPLING_STABLE_HOLD + SAMPLING_NORMAL_INTERVAL; now += SAMPLING_NORMAL_INTERVAL) {
+    policy.update(now, 50, false);
+  }
+  TEST_ASSERT_EQUAL_UINT8(SAMPLING_SLOW, policy.mode());
+
+  const float step = 100.0f / (WATER_EMPTY_DEFAULT - WATER_FULL_DEFAULT);
+  for (int i = 0; i < 20; i++) {
+    now += SAMPLING_SLOW_INTERVAL;
+    TEST_ASSERT_FALSE(policy.update(now, 50 - step, false));
+  }
+  TEST_ASSERT_EQUAL_UINT8(SAMPLING_SLOW, policy.mode());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_trace_transitions);
+  RUN_TEST(test_refill_active_forces_fast);
+  RUN_TEST(test_single_step_keeps_slow);
+  return UNITY_END();
+}
@@ -0,0 +1,225 @@
+// Scheduler against a simulated millis()
+//
+//   pio test -e native -f test_scheduler
+//
+// The clock is a plain 32-bit counter like millis() on the device, so the
+// wrap at 0xFFFFFFFF can be reached by setting it close to the end.
+#include <stdint.h>
+#include <unity.h>
+#include <Scheduler.h>
+
+uint32_t fakeNow = 0;
+uint32_t runs = 0;
+uint32_t otherRuns = 0;
+uint32_t overrunMs = 0;  // so lange "rechnet" der Task, simuliert über die Uhr
+
+unsigned long fakeMillis() {
+  return fakeNow;
+}
+
+void countRun() {
+  runs++;
+  fakeNow += overrunMs;
+}
+
+void countOtherRun() {
+  otherRuns++;
+}
+
+void setUp() {
+  fakeNow = 0;
+  runs = 0;
+  otherRuns = 0;
+  overrunMs = 0;
+}
+
+void tearDown() {}
+
+void test_periodic_task() {
+  Scheduler<4> scheduler(fakeMillis);
+  const TaskId id = scheduler.every(100, countRun, 50);
+  TEST_ASSERT_NOT_EQUAL(TASK_INVALID, id);
+
+  TEST_ASSERT_EQUAL_UINT32(50, scheduler.run());
+  TEST_ASSERT_EQUAL_UINT32(0, runs);
+
+  for (fakeNow = 1; fakeNow <= 1000; fakeNow++) {
+    scheduler.run();
+  }
+  // 50, 150, ... 950
+  TEST_ASSERT_EQUAL_UINT32(10, runs);
+  TEST_ASSERT_TRUE(scheduler.isActive(id));
+}
+
+void test_idle_time_until_next_deadline() {
+  Scheduler<4> scheduler(fakeMillis);
+  scheduler.every(100, countRun);
+  scheduler.once(30, countOtherRun);
+
+  // Der periodische Task ist sofort fällig
+  TEST_ASSERT_EQUAL_UINT32(30, scheduler.run());
+  fakeNow = 30;
+  TEST_ASSERT_EQUAL_UINT32(70, scheduler.run());
+  TEST_ASSERT_EQUAL_UINT32(10, scheduler.run(10));
+}
+
+void test_once_frees_slot() {
+  Scheduler<1> scheduler(fakeMillis);
+  const TaskId id = scheduler.once(20, countRun);
+  TEST_ASSERT_EQUAL_UINT8(TASK_INVALID, scheduler.once(10, countOtherRun));
+
+  fakeNow = 19;
+  scheduler.run();
+  TEST_ASSERT_EQUAL_UINT32(0, runs);
+  fakeNow = 20;
+  scheduler.run();
+  scheduler.run();
+  TEST_ASSERT_EQUAL_UINT32(1, runs);
+  TEST_ASSERT_FALSE(scheduler.isActive(id));
+
+  // Slot ist wieder frei
+  TEST_ASSERT_EQUAL_UINT8(id, scheduler.once(10, countOtherRun));
+}
+
+void test_cancel() {
+  Scheduler<4> scheduler(fakeMillis);
+  const TaskId periodic = scheduler.every(10, countRun);
+  const TaskId oneShot = scheduler.once(10, countOtherRun);
+  scheduler.cancel(periodic);
+  scheduler.cancel(oneShot);
+  scheduler.cancel(TASK_INVALID);
+
+  for (fakeNow = 0; fakeNow < 100; fakeNow++) {
+    scheduler.run();
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, runs);
+  TEST_ASSERT_EQUAL_UINT32(0, otherRuns);
+  TEST_ASSERT_FALSE(scheduler.isActive(periodic));
+  TEST_ASSERT_FALSE(scheduler.isActive(oneShot));
+}
+
+void test_run_in_reschedules() {
+  Scheduler<4> scheduler(fakeMillis);
+  const TaskId periodic = scheduler.every(1000, countRun, 1000);
+  fakeNow = 200;
+  scheduler.runIn(periodic, 0);
+  scheduler.run();
+  TEST_ASSERT_EQUAL_UINT32(1, runs);
+
+  // Danach wieder im normalen Abstand
+  fakeNow = 1199;
+  scheduler.run();
+  TEST_ASSERT_EQUAL_UINT32(1, runs);
+  fakeNow = 1200;
+  scheduler.run();
+  TEST_ASSERT_EQUAL_UINT32(2, runs);
+
+  // Ein abgelaufener One-Shot kann mit runIn nicht wieder belebt werden
+  const TaskId oneShot = scheduler.once(10, countOtherRun);
+  fakeNow += 10;
+  scheduler.run();
+  scheduler.runIn(oneShot, 10);
+  fakeNow += 10;
+  scheduler.run();
+  TEST_ASSERT_EQUAL_UINT32(1, otherRuns);
+}
+
+void test_set_interval() {
+  Scheduler<4> scheduler(fakeMillis);
+  const TaskId id = scheduler.every(100, countRun, 100);
+  scheduler.setInterval(id, 10);
+  for (fakeNow = 0; fakeNow <= 200; fakeNow++) {
+    scheduler.run();
+  }
+  // 100 (noch mit altem Termin), dann alle 10 ms
+  TEST_ASSERT_EQUAL_UINT32(11, runs);
+}
+
+// A task that takes longer than its interval gets one late run and then
+// continues one interval later, instead of running back to back for every
+// deadline it missed
+void test_overrun_does_not_burst() {
+  Scheduler<4> scheduler(fakeMillis);
+  scheduler.every(100, countRun, 100);
+  scheduler.every(100, countOtherRun, 100);
+
+  fakeNow = 100;
+  overrunMs = 350;
+  scheduler.run();
+  TEST_ASSERT_EQUAL_UINT32(1, runs);
+  TEST_ASSERT_EQUAL_UINT32(450, fakeNow);
+  // Der zweite Task war während des Überlaufs fällig und läuft nur einmal
+  TEST_ASSERT_EQUAL_UINT32(1, otherRuns);
+
+  // Termine 200, 300 und 400 sind verpasst: ein Lauf, nicht drei
+  overrunMs = 0;
+  for (int i = 0; i < 5; i++) {
+    scheduler.run();
+  }
+  TEST_ASSERT_EQUAL_UINT32(2, runs);
+  TEST_ASSERT_EQUAL_UINT32(1, otherRuns);
+
+  fakeNow = 549;
+  scheduler.run();
+  TEST_ASSERT_EQUAL_UINT32(2, runs);
+  fakeNow = 550;
+  scheduler.run();
+  TEST_ASSERT_EQUAL_UINT32(3, runs);
+  TEST_ASSERT_EQUAL_UINT32(2, otherRuns);
+}
+
+void test_stall_runs_once() {
+  Scheduler<4> scheduler(fakeMillis);
+  scheduler.every(10, countRun, 10);
+
+  // Die Hauptschleife hängt eine Sekunde, z.B. in einem blockierenden Aufruf
+  fakeNow = 1000;
+  for (int i = 0; i < 10; i++) {
+    scheduler.run();
+  }
+  TEST_ASSERT_EQUAL_UINT32(1, runs);
+  fakeNow = 1010;
+  scheduler.run();
+  TEST_ASSERT_EQUAL_UINT32(2, runs);
+}
+
+// millis() läuft nach ~49 Tagen über
+void test_due_across_millis_wrap() {
+  fakeNow = 0xFFFFFFFF - 50;
+  Scheduler<4> scheduler(fakeMillis);
+  scheduler.every(100, countRun, 100);  // fällig bei 49 nach dem Überlauf
+
+  fakeNow = 0xFFFFFFFF;
+  TEST_ASSERT_EQUAL_UINT32(50, scheduler.run());
+  TEST_ASSERT_EQUAL_UINT32(0, runs);
+  fakeNow = 0;
+  scheduler.run();
+  fakeNow = 48;
+  scheduler.run();
+  TEST_ASSERT_EQUAL_UINT32(0, runs);
+  fakeNow = 49;
+  TEST_ASSERT_EQUAL_UINT32(100, scheduler.run());
+  TEST_ASSERT_EQUAL_UINT32(1, runs);
+
+  // Termin vor dem Überlauf, Zeit danach: überfällig, nicht erst in 49 Tagen
+  fakeNow = 0xFFFFFFF0;
+  scheduler.once(5, countOtherRun);
+  fakeNow = 3;
+  TEST_ASSERT_EQUAL_UINT32(0, scheduler.idleTime(100));
+  scheduler.run();
+  TEST_ASSERT_EQUAL_UINT32(1, otherRuns);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_periodic_task);
+  RUN_TEST(test_idle_time_until_next_deadline);
+  RUN_TEST(test_once_frees_slot);
+  RUN_TEST(test_cancel);
+  RUN_TEST(test_run_in_reschedules);
+  RUN_TEST(test_set_interval);
+  RUN_TEST(test_overrun_does_not_burst);
+  RUN_TEST(test_stall_runs_once);
+  RUN_TEST(test_due_across_millis_wrap);
+  return UNITY_END();
+}
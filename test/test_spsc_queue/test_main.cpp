@@ -0,0 +1,107 @@
+// SpscQueue stress test on std::thread
+//
+//   pio test -e native -f test_spsc_queue
+//
+// One thread pushes sequence-numbered samples, another pops them. The
+// capacity is small, so both the full and the empty path are hit often.
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <unity.h>
+#include <SpscQueue.h>
+
+const uint32_t STRESS_COUNT = 1000000;
+
+struct Sample {
+  uint32_t sequence;
+  uint32_t check;  // muss zur Sequenznummer passen, sonst wurde halb geschrieben gelesen
+};
+
+void setUp() {}
+void tearDown() {}
+
+void test_push_pop_single_thread() {
+  SpscQueue<uint32_t, 4> queue;
+  uint32_t value = 0;
+  TEST_ASSERT_TRUE(queue.empty());
+  TEST_ASSERT_FALSE(queue.pop(value));
+
+  for (uint32_t i = 0; i < 4; i++) {
+    TEST_ASSERT_TRUE(queue.push(i));
+  }
+  TEST_ASSERT_FALSE(queue.push(4));
+  TEST_ASSERT_EQUAL_UINT32(1, queue.droppedCount());
+  TEST_ASSERT_EQUAL_UINT32(4, queue.size());
+
+  for (uint32_t i = 0; i < 4; i++) {
+    TEST_ASSERT_TRUE(queue.pop(value));
+    TEST_ASSERT_EQUAL_UINT32(i, value);
+  }
+  TEST_ASSERT_FALSE(queue.pop(value));
+}
+
+// Slots are reused once the free-running indices pass the capacity
+void test_slot_reuse() {
+  SpscQueue<uint32_t, 2> queue;
+  uint32_t value = 0;
+  for (uint32_t i = 0; i < 10; i++) {
+    TEST_ASSERT_TRUE(queue.push(i));
+    TEST_ASSERT_TRUE(queue.pop(value));
+    TEST_ASSERT_EQUAL_UINT32(i, value);
+  }
+  TEST_ASSERT_TRUE(queue.empty());
+}
+
+void test_stress_two_threads() {
+  static SpscQueue<Sample, 8> queue;
+  std::atomic<uint32_t> fullCount{0};
+  std::atomic<uint32_t> emptyCount{0};
+
+  // Producer wiederholt bei voller Queue, damit nichts verloren geht
+  std::thread producer([&]() {
+    for (uint32_t i = 0; i < STRESS_COUNT; i++) {
+      const Sample sample = {i, ~i};
+      while (!queue.push(sample)) {
+        fullCount.fetch_add(1, std::memory_order_relaxed);
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  std::vector<uint32_t> errors;
+  std::thread consumer([&]() {
+    uint32_t expected = 0;
+    Sample sample;
+    while (expected < STRESS_COUNT) {
+      if (!queue.pop(sample)) {
+        emptyCount.fetch_add(1, std::memory_order_relaxed);
+        std::this_thread::yield();
+        continue;
+      }
+      // Lücke = verloren, kleiner = doppelt oder vertauscht
+      if (sample.sequence != expected || sample.check != ~expected) {
+        errors.push_back(expected);
+        expected = sample.sequence;
+      }
+      expected++;
+    }
+  });
+
+  producer.join();
+  consumer.join();
+
+  TEST_ASSERT_EQUAL_size_t(0, errors.size());
+  TEST_ASSERT_TRUE(queue.empty());
+  TEST_ASSERT_GREATER_THAN(0, fullCount.load());
+  TEST_ASSERT_GREATER_THAN(0, emptyCount.load());
+  TEST_ASSERT_EQUAL_UINT32(fullCount.load(), queue.droppedCount());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_push_pop_single_thread);
+  RUN_TEST(test_slot_reuse);
+  RUN_TEST(test_stress_two_threads);
+  return UNITY_END();
+}
@@ -0,0 +1,160 @@
+// Tank table checks, NVS key prefixes and staggered sensor starts
+//
+//   pio test -e native -f test_tank
+//
+// tankConfigsValid() is constexpr, the tables are checked at compile time
+// and again at runtime so a failing case shows up as a test. The key
+// prefixes are stored in NVS, a changed hash would lose every counter.
+#include <stdint.h>
+#include <string.h>
+#include <string_view>
+#include <unity.h>
+#include <Tank.h>
+
+void setUp() {}
+void tearDown() {}
+
+constexpr TankConfig VALID[] = {
+    {"wasserstand", "", 4, 0x30, 5, 0},
+    {"tropfschale", "Tropfschale", 6, 0x31, -1, 0},
+};
+constexpr TankConfig SINGLE[] = {{"wasserstand", "", -1, 0x29, -1, 0}};
+constexpr TankConfig DUPLICATE_NAME[] = {
+    {"wasserstand", "", 4, 0x30, -1, 0},
+    {"wasserstand", "", 6, 0x31, -1, 0},
+};
+constexpr TankConfig DUPLICATE_ADDRESS[] = {
+    {"wasserstand", "", 4, 0x30, -1, 0},
+    {"tropfschale", "", 6, 0x30, -1, 0},
+};
+constexpr TankConfig DUPLICATE_XSHUT[] = {
+    {"wasserstand", "", 4, 0x30, -1, 0},
+    {"tropfschale", "", 4, 0x31, -1, 0},
+};
+constexpr TankConfig DUPLICATE_INT[] = {
+    {"wasserstand", "", 4, 0x30, 7, 0},
+    {"tropfschale", "", 6, 0x31, 7, 0},
+};
+constexpr TankConfig XSHUT_IS_OTHER_INT[] = {
+    {"wasserstand", "", 4, 0x30, 6, 0},
+    {"tropfschale", "", 6, 0x31, -1, 0},
+};
+constexpr TankConfig INT_IS_OTHER_XSHUT[] = {
+    {"wasserstand", "", 4, 0x30, -1, 0},
+    {"tropfschale", "", 6, 0x31, 4, 0},
+};
+constexpr TankConfig XSHUT_IS_OWN_INT[] = {{"wasserstand", "", 4, 0x29, 4, 0}};
+constexpr TankConfig MISSING_XSHUT[] = {
+    {"wasserstand", "", 4, 0x30, -1, 0},
+    {"tropfschale", "", -1, 0x31, -1, 0},
+};
+constexpr TankConfig BAD_NAME[] = {{"wasser/stand", "", -1, 0x29, -1, 0}};
+constexpr TankConfig EMPTY_NAME[] = {{"", "", -1, 0x29, -1, 0}};
+constexpr TankConfig LONG_NAME[] = {{"wasserstand_kueche", "", -1, 0x29, -1, 0}};
+constexpr TankConfig BAD_ADDRESS[] = {{"wasserstand", "", -1, 0x78, -1, 0}};
+constexpr TankConfig TOO_MANY[] = {
+    {"a", "", 1, 0x30, -1, 0}, {"b", "", 2, 0x31, -1, 0}, {"c", "", 3, 0x32, -1, 0},
+    {"d", "", 4, 0x33, -1, 0}, {"e", "", 5, 0x34, -1, 0},
+};
+
+static_assert(tankConfigsValid(VALID));
+static_assert(!tankConfigsValid(DUPLICATE_XSHUT));
+
+void test_configs_valid() {
+  TEST_ASSERT_TRUE(tankConfigsValid(VALID));
+  TEST_ASSERT_TRUE(tankConfigsValid(SINGLE));  // ein Sensor ohne XSHUT bleibt auf 0x29
+}
+
+void test_configs_duplicate_name_and_address() {
+  TEST_ASSERT_FALSE(tankConfigsValid(DUPLICATE_NAME));
+  TEST_ASSERT_FALSE(tankConfigsValid(DUPLICATE_ADDRESS));
+}
+
+void test_configs_duplicate_pins() {
+  TEST_ASSERT_FALSE(tankConfigsValid(DUPLICATE_XSHUT));
+  TEST_ASSERT_FALSE(tankConfigsValid(DUPLICATE_INT));
+  TEST_ASSERT_FALSE(tankConfigsValid(XSHUT_IS_OTHER_INT));
+  TEST_ASSERT_FALSE(tankConfigsValid(INT_IS_OTHER_XSHUT));
+  TEST_ASSERT_FALSE(tankConfigsValid(XSHUT_IS_OWN_INT));
+}
+
+void test_configs_rows_invalid() {
+  TEST_ASSERT_FALSE(tankConfigsValid(MISSING_XSHUT));
+  TEST_ASSERT_FALSE(tankConfigsValid(BAD_NAME));
+  TEST_ASSERT_FALSE(tankConfigsValid(EMPTY_NAME));
+  TEST_ASSERT_FALSE(tankConfigsValid(LONG_NAME));
+  TEST_ASSERT_FALSE(tankConfigsValid(BAD_ADDRESS));
+  TEST_ASSERT_FALSE(tankConfigsValid(TOO_MANY));
+}
+
+// Festgeschrieben: diese Werte stehen in NVS von Geräten im Einsatz
+void test_key_hash_stable() {
+  static_assert(tankKeyHash("tropfschale") == 0x5dafd9);
+  TEST_ASSERT_EQUAL_HEX32(0x5dafd9, tankKeyHash("tropfschale"));
+  TEST_ASSERT_EQUAL_HEX32(0xcde7c4, tankKeyHash("wasserstand"));
+  TEST_ASSERT_EQUAL_HEX32(0x0c29c8, tankKeyHash("a"));
+  TEST_ASSERT_EQUAL_HEX32(0x1c9d44, tankKeyHash(""));
+}
+
+void test_names_keys_and_prefix() {
+  const TankNames legacy(TANK_LEGACY_NAME);
+  TEST_ASSERT_EQUAL_STRING("refills", legacy.key(TANK_KEY_REFILLS));
+  TEST_ASSERT_TRUE(legacy.objectPrefix().empty());
+  TEST_ASSERT_EQUAL_STRING("rocket/wasserstand", legacy.topic());
+
+  const TankNames tray("tropfschale");
+  TEST_ASSERT_EQUAL_STRING("5dafd9_refills", tray.key(TANK_KEY_REFILLS));
+  TEST_ASSERT_TRUE(tray.objectPrefix() == "tropfschale_");
+  for (uint8_t i = 0; i < TANK_KEY_COUNT; i++) {
+    TEST_ASSERT_LESS_OR_EQUAL(TANK_KEY_SIZE - 1, strlen(tray.key((TankKey)i)));
+  }
+
+  std::string_view suffix;
+  TEST_ASSERT_TRUE(tray.matches("rocket/tropfschale/command", suffix));
+  TEST_ASSERT_TRUE(suffix == "command");
+  TEST_ASSERT_FALSE(tray.matches("rocket/tropfschale2/command", suffix));
+  TEST_ASSERT_FALSE(tray.matches("rocket/tropfschale", suffix));
+}
+
+void test_schedule_staggered() {
+  RangingSchedule schedule(4);
+  schedule.restart(1000, 200);
+  // Start i bei now + period * i / count
+  TEST_ASSERT_TRUE(schedule.due(0, 1000));
+  TEST_ASSERT_FALSE(schedule.due(0, 1000));  // nur einmal pro Periode
+  TEST_ASSERT_FALSE(schedule.due(1, 1049));
+  TEST_ASSERT_EQUAL_UINT32(1, schedule.nextIn(1049));
+  TEST_ASSERT_TRUE(schedule.due(1, 1050));
+  TEST_ASSERT_EQUAL_UINT32(50, schedule.nextIn(1050));
+  TEST_ASSERT_TRUE(schedule.waiting(2));
+  TEST_ASSERT_TRUE(schedule.due(2, 1100));
+  TEST_ASSERT_TRUE(schedule.due(3, 1160));  // verspätet ist trotzdem fällig
+  TEST_ASSERT_FALSE(schedule.waiting(3));
+  TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, schedule.nextIn(1160));
+
+  schedule.restart(2000, 200);
+  TEST_ASSERT_TRUE(schedule.waiting(0));
+  TEST_ASSERT_EQUAL_UINT32(0, schedule.nextIn(2010));  // überfällig
+}
+
+void test_schedule_across_wrap() {
+  RangingSchedule schedule(2);
+  schedule.restart(0xFFFFFF00u, 0x200);
+  TEST_ASSERT_TRUE(schedule.due(0, 0xFFFFFF00u));
+  TEST_ASSERT_EQUAL_UINT32(0x100, schedule.nextIn(0xFFFFFF00u));
+  TEST_ASSERT_FALSE(schedule.due(1, 0xFFFFFFFFu));
+  TEST_ASSERT_TRUE(schedule.due(1, 0x00000000u));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_configs_valid);
+  RUN_TEST(test_configs_duplicate_name_and_address);
+  RUN_TEST(test_configs_duplicate_pins);
+  RUN_TEST(test_configs_rows_invalid);
+  RUN_TEST(test_key_hash_stable);
+  RUN_TEST(test_names_keys_and_prefix);
+  RUN_TEST(test_schedule_staggered);
+  RUN_TEST(test_schedule_across_wrap);
+  return UNITY_END();
+}
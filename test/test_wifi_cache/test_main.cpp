@@ -0,0 +1,134 @@
+// Wi-Fi cache text format
+//
+//   pio test -e native -f test_wifi_cache
+//
+// The cache is read back from NVS on every boot, so anything that is not
+// exactly what formatWifiCache() wrote must be rejected and lead to a
+// normal scan.
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <unity.h>
+#include <HalFakes.h>
+#include <WifiCache.h>
+
+const WifiCache SAMPLE = {{0x00, 0x1a, 0x2b, 0xc3, 0xd4, 0xff}, 11, 0x6401a8c0, 0x0101a8c0, 0x00ffffff, 0x0101a8c0};
+
+std::string formatted(const WifiCache& cache) {
+  char text[WIFI_CACHE_TEXT_LENGTH];
+  TEST_ASSERT_TRUE(formatWifiCache(cache, text, sizeof(text)));
+  return text;
+}
+
+// Überschreibt das formatierte Beispiel ab `position`
+bool parsesPatched(size_t position, const char* replacement) {
+  std::string text = formatted(SAMPLE);
+  text.replace(position, strlen(replacement), replacement);
+  WifiCache cache;
+  return parseWifiCache(text.c_str(), cache);
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_round_trip() {
+  const std::string text = formatted(SAMPLE);
+  TEST_ASSERT_EQUAL_STRING("001a2bc3d4ff,0b,6401a8c0,0101a8c0,00ffffff,0101a8c0", text.c_str());
+  TEST_ASSERT_EQUAL_UINT32(WIFI_CACHE_TEXT_LENGTH - 1, text.size());
+
+  WifiCache cache = {};
+  TEST_ASSERT_TRUE(parseWifiCache(text.c_str(), cache));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(SAMPLE.bssid, cache.bssid, 6);
+  TEST_ASSERT_EQUAL_UINT8(SAMPLE.channel, cache.channel);
+  TEST_ASSERT_EQUAL_UINT32(SAMPLE.ip, cache.ip);
+  TEST_ASSERT_EQUAL_UINT32(SAMPLE.gateway, cache.gateway);
+  TEST_ASSERT_EQUAL_UINT32(SAMPLE.subnet, cache.subnet);
+  TEST_ASSERT_EQUAL_UINT32(SAMPLE.dns, cache.dns);
+}
+
+void test_extremes_round_trip() {
+  const WifiCache extremes[] = {
+      {{0, 0, 0, 0, 0, 0}, 1, 0, 0, 0, 0},
+      {{0xff, 0xff, 0xff, 0xff, 0xff, 0xff}, 14, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff},
+  };
+  for (const WifiCache& sample : extremes) {
+    WifiCache cache = {};
+    TEST_ASSERT_TRUE(parseWifiCache(formatted(sample).c_str(), cache));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(sample.bssid, cache.bssid, 6);
+    TEST_ASSERT_EQUAL_UINT8(sample.channel, cache.channel);
+    TEST_ASSERT_EQUAL_UINT32(sample.ip, cache.ip);
+    TEST_ASSERT_EQUAL_UINT32(sample.dns, cache.dns);
+  }
+  // Großbuchstaben, z.B. von Hand eingetragen
+  WifiCache cache = {};
+  TEST_ASSERT_TRUE(parseWifiCache("001A2BC3D4FF,0B,6401A8C0,0101A8C0,00FFFFFF,0101A8C0", cache));
+  TEST_ASSERT_EQUAL_UINT8(0xff, cache.bssid[5]);
+}
+
+void test_formatting_needs_full_buffer() {
+  char text[WIFI_CACHE_TEXT_LENGTH - 1];
+  TEST_ASSERT_FALSE(formatWifiCache(SAMPLE, text, sizeof(text)));
+}
+
+void test_truncated_rejected() {
+  const std::string text = formatted(SAMPLE);
+  WifiCache cache;
+  TEST_ASSERT_FALSE(parseWifiCache("", cache));
+  for (size_t length = 1; length < text.size(); length++) {
+    TEST_ASSERT_FALSE(parseWifiCache(text.substr(0, length).c_str(), cache));
+  }
+  // Letzter Wert gekürzt, Länge mit einem Leerzeichen aufgefüllt
+  TEST_ASSERT_FALSE(parsesPatched(text.size() - 1, " "));
+  TEST_ASSERT_FALSE(parseWifiCache((text + "0").c_str(), cache));
+}
+
+void test_bad_mac_rejected() {
+  TEST_ASSERT_TRUE(parsesPatched(0, "00"));
+  TEST_ASSERT_FALSE(parsesPatched(0, "zz"));
+  TEST_ASSERT_FALSE(parsesPatched(4, "-1"));   // strtoul() läse ULONG_MAX
+  TEST_ASSERT_FALSE(parsesPatched(6, " c"));
+  TEST_ASSERT_FALSE(parsesPatched(10, "d:"));
+  TEST_ASSERT_FALSE(parsesPatched(0, "0x"));
+}
+
+void test_bad_channel_rejected() {
+  TEST_ASSERT_TRUE(parsesPatched(13, "01"));
+  TEST_ASSERT_TRUE(parsesPatched(13, "0e"));
+  TEST_ASSERT_FALSE(parsesPatched(13, "00"));
+  TEST_ASSERT_FALSE(parsesPatched(13, "0f"));
+  TEST_ASSERT_FALSE(parsesPatched(13, "ff"));
+}
+
+void test_bad_addresses_rejected() {
+  TEST_ASSERT_FALSE(parsesPatched(16, "+401a8c0"));
+  TEST_ASSERT_FALSE(parsesPatched(25, "0101a8cg"));
+  // Verschobene Trennzeichen bei gleicher Gesamtlänge
+  TEST_ASSERT_FALSE(parsesPatched(15, "0,"));
+  TEST_ASSERT_FALSE(parsesPatched(33, "0,0"));
+}
+
+void test_store_round_trip() {
+  MemoryStore store;
+  WifiCache cache;
+  TEST_ASSERT_FALSE(loadWifiCache(store, cache));
+
+  saveWifiCache(store, SAMPLE);
+  TEST_ASSERT_TRUE(loadWifiCache(store, cache));
+  TEST_ASSERT_EQUAL_UINT32(SAMPLE.ip, cache.ip);
+
+  clearWifiCache(store);
+  TEST_ASSERT_FALSE(loadWifiCache(store, cache));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_extremes_round_trip);
+  RUN_TEST(test_formatting_needs_full_buffer);
+  RUN_TEST(test_truncated_rejected);
+  RUN_TEST(test_bad_mac_rejected);
+  RUN_TEST(test_bad_channel_rejected);
+  RUN_TEST(test_bad_addresses_rejected);
+  RUN_TEST(test_store_round_trip);
+  return UNITY_END();
+}
@@ -0,0 +1,134 @@
+// Wi-Fi station supervisor against a fake clock and link state
+//
+//   pio test -e native -f test_wifi_supervisor
+//
+// update() is called once per 100 ms tick like in the network task; the
+// link state stands in for the IP events.
+#include <stdint.h>
+#include <unity.h>
+#include <HalFakes.h>
+#include <WifiSupervisor.h>
+
+const uint32_t TICK_MS = 100;
+
+// Tickt bis eine Aktion kommt oder die Zeit abgelaufen ist
+WifiSupervisor::Action runUntilAction(FakeClock& clock, WifiSupervisor& wifi, bool linkUp, uint32_t limitMs) {
+  for (uint32_t elapsed = 0; elapsed <= limitMs; elapsed += TICK_MS) {
+    const WifiSupervisor::Action action = wifi.update(linkUp);
+    if (action != WifiSupervisor::WIFI_NONE) {
+      return action;
+    }
+    clock.advance(TICK_MS);
+  }
+  return WifiSupervisor::WIFI_NONE;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_fast_connect_succeeds() {
+  FakeClock clock;
+  WifiSupervisor wifi(clock);
+  wifi.begin(true);
+  clock.advance(800);
+  TEST_ASSERT_EQUAL(WifiSupervisor::WIFI_NONE, wifi.update(false));
+  TEST_ASSERT_EQUAL(WifiSupervisor::WIFI_CONNECTED, wifi.update(true));
+  TEST_ASSERT_TRUE(wifi.connected());
+  TEST_ASSERT_TRUE(wifi.fastConnected());
+  TEST_ASSERT_EQUAL(WifiSupervisor::WIFI_NONE, wifi.update(true));
+  TEST_ASSERT_EQUAL_UINT32(1, wifi.connectCount());
+}
+
+void test_fast_connect_timeout_falls_back_to_scan() {
+  FakeClock clock;
+  WifiSupervisor wifi(clock);
+  wifi.begin(true);
+  clock.advance(WIFI_FAST_CONNECT_TIMEOUT - 1);
+  TEST_ASSERT_EQUAL(WifiSupervisor::WIFI_NONE, wifi.update(false));
+  clock.advance(1);
+  TEST_ASSERT_EQUAL(WifiSupervisor::WIFI_FULL_SCAN, wifi.update(false));
+  // Nur einmal
+  clock.advance(TICK_MS);
+  TEST_ASSERT_EQUAL(WifiSupervisor::WIFI_NONE, wifi.update(false));
+
+  TEST_ASSERT_EQUAL(WifiSupervisor::WIFI_CONNECTED, wifi.update(true));
+  TEST_ASSERT_FALSE(wifi.fastConnected());
+}
+
+void test_without_cache_no_scan_fallback() {
+  FakeClock clock;
+  WifiSupervisor wifi(clock);
+  wifi.begin();
+  TEST_ASSERT_EQUAL(WifiSupervisor::WIFI_START_PORTAL,
+                    runUntilAction(clock, wifi, false, WIFI_PORTAL_DELAY));
+}
+
+void test_portal_opens_after_delay() {
+  FakeClock clock;
+  WifiSupervisor wifi(clock);
+  wifi.begin(true);
+  TEST_ASSERT_EQUAL(WifiSupervisor::WIFI_FULL_SCAN, runUntilAction(clock, wifi, false, WIFI_PORTAL_DELAY));
+  TEST_ASSERT_EQUAL_UINT32(WIFI_FAST_CONNECT_TIMEOUT, clock.now);
+
+  // Die Wartezeit zählt ab begin(), der Direktversuch gehört dazu
+  TEST_ASSERT_EQUAL(WifiSupervisor::WIFI_START_PORTAL, runUntilAction(clock, wifi, false, WIFI_PORTAL_DELAY));
+  TEST_ASSERT_EQUAL_UINT32(WIFI_PORTAL_DELAY, clock.now);
+  TEST_ASSERT_TRUE(wifi.portalActive());
+  TEST_ASSERT_EQUAL(WifiSupervisor::WIFI_NONE, runUntilAction(clock, wifi, false, WIFI_PORTAL_DELAY));
+
+  // Netz kommt zurück: erst verbunden, dann Portal aus
+  TEST_ASSERT_EQUAL(WifiSupervisor::WIFI_CONNECTED, wifi.update(true));
+  TEST_ASSERT_EQUAL(WifiSupervisor::WIFI_STOP_PORTAL, wifi.update(true));
+  TEST_ASSERT_FALSE(wifi.portalActive());
+  TEST_ASSERT_EQUAL(WifiSupervisor::WIFI_NONE, wifi.update(true));
+}
+
+void test_disconnect_and_reconnect() {
+  FakeClock clock;
+  WifiSupervisor wifi(clock);
+  wifi.begin();
+  TEST_ASSERT_EQUAL(WifiSupervisor::WIFI_CONNECTED, wifi.update(true));
+
+  clock.advance(60000);
+  TEST_ASSERT_EQUAL(WifiSupervisor::WIFI_DISCONNECTED, wifi.update(false));
+  TEST_ASSERT_FALSE(wifi.connected());
+  TEST_ASSERT_EQUAL(WifiSupervisor::WIFI_NONE, wifi.update(false));
+
+  clock.advance(5000);
+  TEST_ASSERT_EQUAL(WifiSupervisor::WIFI_CONNECTED, wifi.update(true));
+  TEST_ASSERT_EQUAL_UINT32(2, wifi.connectCount());
+
+  // Kurzes Flattern zählt jede Verbindung
+  TEST_ASSERT_EQUAL(WifiSupervisor::WIFI_DISCONNECTED, wifi.update(false));
+  TEST_ASSERT_EQUAL(WifiSupervisor::WIFI_CONNECTED, wifi.update(true));
+  TEST_ASSERT_EQUAL_UINT32(3, wifi.connectCount());
+}
+
+void test_no_portal_after_first_connection() {
+  FakeClock clock;
+  WifiSupervisor wifi(clock);
+  wifi.begin();
+  TEST_ASSERT_EQUAL(WifiSupervisor::WIFI_CONNECTED, wifi.update(true));
+  TEST_ASSERT_EQUAL(WifiSupervisor::WIFI_DISCONNECTED, wifi.update(false));
+
+#if WIFI_PORTAL_AFTER_OUTAGE
+  TEST_ASSERT_TRUE(wifi.portalAllowed());
+  TEST_ASSERT_EQUAL(WifiSupervisor::WIFI_START_PORTAL, runUntilAction(clock, wifi, false, 2 * WIFI_PORTAL_DELAY));
+#else
+  // Router-Neustart: der Access Point bleibt aus, die Station verbindet sich selbst wieder
+  TEST_ASSERT_FALSE(wifi.portalAllowed());
+  TEST_ASSERT_EQUAL(WifiSupervisor::WIFI_NONE, runUntilAction(clock, wifi, false, 10 * WIFI_PORTAL_DELAY));
+  TEST_ASSERT_FALSE(wifi.portalActive());
+#endif
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_fast_connect_succeeds);
+  RUN_TEST(test_fast_connect_timeout_falls_back_to_scan);
+  RUN_TEST(test_without_cache_no_scan_fallback);
+  RUN_TEST(test_portal_opens_after_delay);
+  RUN_TEST(test_disconnect_and_reconnect);
+  RUN_TEST(test_no_portal_after_first_connection);
+  return UNITY_END();
+}